@@ -0,0 +1,250 @@
+#include "Bisector.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "Disassembler.h"
+
+Bisector::Bisector(Setup setupA, Setup setupB, unsigned int seed) : m_setupA(setupA), m_setupB(setupB), m_seed(seed) {
+}
+
+bool Bisector::loadInput(const char* path) {
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	m_input.clear();
+
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream stream(line);
+		unsigned long long cycle;
+		unsigned int key, pressed;
+		if (!(stream >> std::dec >> cycle >> std::hex >> key >> std::dec >> pressed))
+			return false;
+
+		KeyEvent event = { cycle, (unsigned char)(key & 0xF), (unsigned char)(pressed != 0) };
+		m_input.push_back(event);
+	}
+
+	std::stable_sort(m_input.begin(), m_input.end(), [](const KeyEvent& a, const KeyEvent& b) { return a.cycle < b.cycle; });
+	return true;
+}
+
+void Bisector::advance(Chip8& chip, unsigned long long cycle) const {
+	auto event = std::lower_bound(m_input.begin(), m_input.end(), chip.GetCycle(),
+		[](const KeyEvent& event, unsigned long long cycle) { return event.cycle < cycle; });
+
+	while (chip.GetCycle() < cycle && !chip.IsHalted()) {
+		while (event != m_input.end() && event->cycle == chip.GetCycle()) {
+			chip.m_key[event->key] = event->pressed;
+			++event;
+		}
+
+		//Batches up to the next input event, so the configurations run the way they run in the emulator
+		unsigned long long until = event != m_input.end() && event->cycle < cycle ? event->cycle : cycle;
+		chip.runCycles((unsigned int)(until - chip.GetCycle()));
+	}
+}
+
+bool Bisector::run(unsigned long long maxCycles, unsigned long long interval) {
+	Chip8 a, b;
+	a.initialize();
+	m_setupA(a);
+	a.SetSeed(m_seed);
+	b.initialize();
+	m_setupB(b);
+	b.SetSeed(m_seed);
+
+	//Different from the start (e.g. different programs)
+	if (a.GetStateHash() != b.GetStateHash()) {
+		m_beforeA = m_afterA = a;
+		m_beforeB = m_afterB = b;
+		return true;
+	}
+
+	//Last cycle both machines agreed on and their states at that point
+	unsigned long long lo = 0;
+	Chip8 equalA = a;
+	Chip8 equalB = b;
+	unsigned long long hi = 0;
+
+	while (lo < maxCycles) {
+		unsigned long long target = std::min(lo + interval, maxCycles);
+		advance(a, target);
+		advance(b, target);
+
+		if (a.GetStateHash() != b.GetStateHash()) {
+			hi = target;
+			break;
+		}
+
+		//Both halted in the same state, nothing will change anymore
+		if (a.GetCycle() < target)
+			return false;
+
+		lo = target;
+		equalA = a;
+		equalB = b;
+	}
+
+	if (hi == 0)
+		return false;
+
+	//Binary search between the last equal and the first differing comparison
+	while (hi - lo > 1) {
+		unsigned long long mid = lo + (hi - lo) / 2;
+		a = equalA;
+		b = equalB;
+		advance(a, mid);
+		advance(b, mid);
+
+		if (a.GetStateHash() == b.GetStateHash()) {
+			lo = mid;
+			equalA = a;
+			equalB = b;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	m_beforeA = equalA;
+	m_beforeB = equalB;
+	m_afterA = equalA;
+	m_afterB = equalB;
+	advance(m_afterA, hi);
+	advance(m_afterB, hi);
+	return true;
+}
+
+void Bisector::printDiff(std::ostream& out) const {
+	char line[128];
+
+	unsigned short pc = m_beforeA.GetPC();
+	unsigned short opcode = m_beforeA.GetNextOpcode();
+	std::snprintf(line, sizeof(line), "Diverged at cycle %llu, last equal state at cycle %llu executing %03X  %04X  ",
+		m_afterA.GetCycle() > m_afterB.GetCycle() ? m_afterA.GetCycle() : m_afterB.GetCycle(), m_beforeA.GetCycle(), pc, opcode);
+	out << line << disassemble(opcode) << "\n\n";
+
+	std::snprintf(line, sizeof(line), "%-8s %8s %8s\n", "", "A", "B");
+	out << line;
+
+	auto row = [&out, &line](const char* name, unsigned int a, unsigned int b, const char* format) {
+		char values[2][16];
+		std::snprintf(values[0], sizeof(values[0]), format, a);
+		std::snprintf(values[1], sizeof(values[1]), format, b);
+		std::snprintf(line, sizeof(line), "%-8s %8s %8s%s\n", name, values[0], values[1], a != b ? "   <" : "");
+		out << line;
+	};
+
+	row("PC", m_afterA.GetPC(), m_afterB.GetPC(), "%03X");
+	row("I", m_afterA.GetI(), m_afterB.GetI(), "%03X");
+	row("SP", m_afterA.GetSP(), m_afterB.GetSP(), "%X");
+	row("DT", m_afterA.GetDelayTimer(), m_afterB.GetDelayTimer(), "%02X");
+	row("ST", m_afterA.GetSoundTimer(), m_afterB.GetSoundTimer(), "%02X");
+	row("pitch", m_afterA.GetPitch(), m_afterB.GetPitch(), "%02X");
+	row("halted", m_afterA.IsHalted(), m_afterB.IsHalted(), "%u");
+	row("random", m_afterA.GetRandomState(), m_afterB.GetRandomState(), "%08X");
+
+	for (int i = 0; i < 16; ++i) {
+		char name[8];
+		std::snprintf(name, sizeof(name), "V%X", i);
+		row(name, m_afterA.GetV(i), m_afterB.GetV(i), "%02X");
+	}
+
+	for (int i = 0; i < 16; ++i) {
+		if (m_afterA.GetStack(i) != m_afterB.GetStack(i)) {
+			char name[16];
+			std::snprintf(name, sizeof(name), "stack[%X]", i);
+			row(name, m_afterA.GetStack(i), m_afterB.GetStack(i), "%03X");
+		}
+	}
+
+	for (int i = 0; i < 16; ++i) {
+		if (m_afterA.GetFlag(i) != m_afterB.GetFlag(i)) {
+			char name[16];
+			std::snprintf(name, sizeof(name), "flag[%X]", i);
+			row(name, m_afterA.GetFlag(i), m_afterB.GetFlag(i), "%02X");
+		}
+	}
+
+	for (int i = 0; i < 16; ++i) {
+		if (m_afterA.GetAudioPattern(i) != m_afterB.GetAudioPattern(i)) {
+			char name[16];
+			std::snprintf(name, sizeof(name), "audio[%X]", i);
+			row(name, m_afterA.GetAudioPattern(i), m_afterB.GetAudioPattern(i), "%02X");
+		}
+	}
+
+	//Memory, only the bytes that differ (in the part both have when the profiles give them different sizes)
+	const size_t memoryA = m_afterA.GetMemorySize();
+	const size_t memoryB = m_afterB.GetMemorySize();
+	if (memoryA != memoryB)
+		row("memory", (unsigned int)(memoryA >> 10), (unsigned int)(memoryB >> 10), "%uK");
+
+	int differences = 0;
+	for (unsigned int address = 0; address < std::min(memoryA, memoryB); ++address) {
+		if (m_afterA.GetMemory(address) == m_afterB.GetMemory(address))
+			continue;
+
+		if (++differences <= 64) {
+			char name[16];
+			std::snprintf(name, sizeof(name), "[%03X]", address);
+			row(name, m_afterA.GetMemory(address), m_afterB.GetMemory(address), "%02X");
+		}
+	}
+	if (differences > 64) {
+		std::snprintf(line, sizeof(line), "... %d differing bytes in total\n", differences);
+		out << line;
+	}
+
+	const Display& displayA = m_afterA.GetDisplay();
+	const Display& displayB = m_afterB.GetDisplay();
+	if (displayA.IsHires() != displayB.IsHires())
+		row("hires", displayA.IsHires(), displayB.IsHires(), "%u");
+	if (displayA.GetPlanes() != displayB.GetPlanes())
+		row("planes", displayA.GetPlanes(), displayB.GetPlanes(), "%X");
+
+	//Rows are compared whole, the differing bits of every plane are counted
+	int pixels = 0;
+	for (int plane = 0; plane < Display::PLANES; ++plane) {
+		for (int y = 0; y < Display::HEIGHT; ++y) {
+			for (int word = 0; word < 2; ++word) {
+				pixels += (int)std::bitset<64>(displayA.GetRow(plane, y).words[word] ^ displayB.GetRow(plane, y).words[word]).count();
+			}
+		}
+	}
+	if (pixels > 0) {
+		std::snprintf(line, sizeof(line), "%d pixels differ\n", pixels);
+		out << line;
+	}
+
+	const MegaDisplay& megaA = m_afterA.GetMegaDisplay();
+	const MegaDisplay& megaB = m_afterB.GetMegaDisplay();
+	if (megaA.IsEnabled() != megaB.IsEnabled())
+		row("mega", megaA.IsEnabled(), megaB.IsEnabled(), "%u");
+	if (megaA.GetBlendMode() != megaB.GetBlendMode())
+		row("blend", megaA.GetBlendMode(), megaB.GetBlendMode(), "%u");
+	if (megaA.GetCollisionIndex() != megaB.GetCollisionIndex())
+		row("collide", megaA.GetCollisionIndex(), megaB.GetCollisionIndex(), "%02X");
+	if (!megaA.IsEnabled() || !megaB.IsEnabled())
+		return;
+
+	int megaPixels = 0;
+	for (int i = 0; i < MegaDisplay::WIDTH * MegaDisplay::HEIGHT; ++i) {
+		if (megaA.GetIndices()[i] != megaB.GetIndices()[i] || megaA.GetColors()[i] != megaB.GetColors()[i])
+			++megaPixels;
+	}
+	if (megaPixels > 0) {
+		std::snprintf(line, sizeof(line), "%d MEGA-CHIP pixels differ\n", megaPixels);
+		out << line;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "chip8.h"
+
+/*
+Finds the first instruction where two configurations of the core stop agreeing.
+Both machines get the same seed and keypad input and run in lockstep, their state hashes are compared every
+m_interval cycles. Once a comparison fails, the last matching pair of states is used as checkpoint for a binary
+search over the cycles in between, so pinning down the instruction costs about one more interval of emulation.
+*/
+class Bisector {
+public:
+
+	//Brings a fresh machine into its configuration and loads the program (initialize() is already done)
+	using Setup = std::function<void(Chip8& chip)>;
+
+	struct KeyEvent {
+		unsigned long long cycle;	//applied before the instruction of this cycle executes
+		unsigned char key;
+		unsigned char pressed;
+	};
+
+	Bisector(Setup setupA, Setup setupB, unsigned int seed = 1);
+
+	//Input played into both machines, sorted by cycle
+	void setInput(const std::vector<KeyEvent>& input) { m_input = input; }
+	//Text file with one "cycle key 0|1" per line (key in hex)
+	bool loadInput(const char* path);
+
+	//Runs both machines for up to maxCycles. Returns true if they diverged
+	bool run(unsigned long long maxCycles, unsigned long long interval = 65536);
+
+	//Cycle of the first differing state (valid after run() returned true)
+	unsigned long long GetDivergenceCycle() const { return m_afterA.GetCycle(); }
+	//Last equal state and the state after the next instruction
+	const Chip8& GetLastEqual() const { return m_beforeA; }
+	const Chip8& GetAfterA() const { return m_afterA; }
+	const Chip8& GetAfterB() const { return m_afterB; }
+
+	//Side by side view of the instruction and every register/memory/display difference
+	void printDiff(std::ostream& out) const;
+
+private:
+	//Runs the machine until the cycle, feeding it the input. Stops early if the core halts
+	void advance(Chip8& chip, unsigned long long cycle) const;
+
+	Setup m_setupA;
+	Setup m_setupB;
+	unsigned int m_seed;
+	std::vector<KeyEvent> m_input;
+
+	Chip8 m_beforeA;
+	Chip8 m_beforeB;
+	Chip8 m_afterA;
+	Chip8 m_afterB;
+};
@@ -0,0 +1,493 @@
+#include "CaptureExport.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+
+	const int screenWidth = Display::WIDTH;
+	const int screenHeight = Display::HEIGHT;
+	//Longest delay a GIF or APNG frame can hold, longer screens are written again
+	const unsigned int maxDelay = 65535;
+	//Where the acTL chunk starts: signature and IHDR come first
+	const long pngAnimationOffset = 8 + 12 + 13;
+
+	//Palette indices of the 128x64 screen, low resolution pixels doubled
+	void composeScreen(const CaptureFrame& frame, unsigned char* screen) {
+		const int shift = frame.hires ? 0 : 1;
+		for (int y = 0; y < screenHeight; ++y) {
+			for (int x = 0; x < screenWidth; ++x) {
+				const int column = x >> shift;
+				unsigned char index = 0;
+				for (int plane = 0; plane < Display::PLANES; ++plane) {
+					const unsigned long long word = frame.rows[plane][y >> shift].words[column >> 6];
+					index |= (unsigned char)((word >> (63 - (column & 63)) & 1) << plane);
+				}
+				screen[y * screenWidth + x] = index;
+			}
+		}
+	}
+
+	void putBig32(unsigned char* out, unsigned int value) {
+		out[0] = (unsigned char)(value >> 24);
+		out[1] = (unsigned char)(value >> 16);
+		out[2] = (unsigned char)(value >> 8);
+		out[3] = (unsigned char)value;
+	}
+
+	void putLittle16(std::vector<unsigned char>& out, unsigned int value) {
+		out.push_back((unsigned char)value);
+		out.push_back((unsigned char)(value >> 8));
+	}
+
+	unsigned int crc32(unsigned int crc, const unsigned char* data, size_t size) {
+		static unsigned int table[256];
+		static bool ready = false;
+		if (!ready) {
+			for (unsigned int i = 0; i < 256; ++i) {
+				unsigned int value = i;
+				for (int bit = 0; bit < 8; ++bit) {
+					value = value & 1 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+				}
+				table[i] = value;
+			}
+			ready = true;
+		}
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i) {
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	//zlib stream of stored deflate blocks
+	void storeZlib(const std::vector<unsigned char>& data, std::vector<unsigned char>& out) {
+		out.push_back(0x78);
+		out.push_back(0x01);
+
+		size_t position = 0;
+		do {
+			const size_t size = std::min(data.size() - position, (size_t)65535);
+			out.push_back(position + size == data.size() ? 1 : 0);
+			putLittle16(out, (unsigned int)size);
+			putLittle16(out, (unsigned int)~size & 0xFFFF);
+			out.insert(out.end(), data.begin() + position, data.begin() + position + size);
+			position += size;
+		} while (position < data.size());
+
+		unsigned int a = 1;
+		unsigned int b = 0;
+		for (unsigned char byte : data) {
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		unsigned char adler[4];
+		putBig32(adler, b << 16 | a);
+		out.insert(out.end(), adler, adler + 4);
+	}
+
+	//GIF LZW of 4 bit pixels: variable code size from 5 up to 12 bits, the table starts over when it's full
+	void encodeLzw(const std::vector<unsigned char>& pixels, std::vector<unsigned char>& out) {
+		const int depth = 4;
+		const unsigned int clearCode = 1 << depth;
+		const unsigned int stopCode = clearCode + 1;
+
+		//Code of prefix + pixel, 0 if there is none yet
+		std::vector<unsigned short> children(4096 << depth, 0);
+		int codeSize = depth + 1;
+		unsigned int nextCode = stopCode + 1;
+
+		unsigned int buffer = 0;
+		int bits = 0;
+		auto put = [&](unsigned int code) {
+			buffer |= code << bits;
+			bits += codeSize;
+			while (bits >= 8) {
+				out.push_back((unsigned char)buffer);
+				buffer >>= 8;
+				bits -= 8;
+			}
+		};
+
+		put(clearCode);
+		unsigned int prefix = pixels[0];
+		for (size_t i = 1; i < pixels.size(); ++i) {
+			const unsigned int pixel = pixels[i];
+			const unsigned short child = children[prefix << depth | pixel];
+			if (child != 0) {
+				prefix = child;
+				continue;
+			}
+
+			put(prefix);
+			if (nextCode < 4096) {
+				if (nextCode == 1u << codeSize)
+					++codeSize;
+				children[prefix << depth | pixel] = (unsigned short)nextCode++;
+			}
+			else {
+				put(clearCode);
+				std::fill(children.begin(), children.end(), 0);
+				codeSize = depth + 1;
+				nextCode = stopCode + 1;
+			}
+			prefix = pixel;
+		}
+		put(prefix);
+		put(stopCode);
+		if (bits > 0)
+			out.push_back((unsigned char)buffer);
+	}
+}
+
+CaptureExport::CaptureExport() {
+	//The window's default colors
+	const unsigned int palette[16] = {
+		0x000000, 0xFFFFFF, 0xFF6600, 0x662100, 0x0066FF, 0x99CCFF, 0x9933CC, 0x4D1A66,
+		0x00CC33, 0x99FF99, 0xCCCC00, 0x666600, 0xFF0033, 0xFF99B3, 0x808080, 0x404040
+	};
+	setPalette(palette);
+	m_scale = 1;
+
+	m_format = FORMAT_PNG;
+	m_file = nullptr;
+	m_failed = false;
+	m_empty = true;
+	m_frames = 0;
+	m_images = 0;
+	m_written = 0;
+	m_sequence = 0;
+}
+
+void CaptureExport::setPalette(const unsigned int* rgb) {
+	std::memcpy(m_palette, rgb, sizeof(m_palette));
+}
+
+void CaptureExport::setScale(int scale) {
+	m_scale = std::min(std::max(scale, 1), (int)MAX_SCALE);
+}
+
+bool CaptureExport::formatOf(const char* path, Format& format) {
+	const char* extension = std::strrchr(path, '.');
+	if (!extension)
+		return false;
+
+	std::string name(extension + 1);
+	std::transform(name.begin(), name.end(), name.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+	if (name == "png" || name == "apng")
+		format = FORMAT_PNG;
+	else if (name == "gif")
+		format = FORMAT_GIF;
+	else if (name == "y4m")
+		format = FORMAT_Y4M;
+	else
+		return false;
+	return true;
+}
+
+bool CaptureExport::write(const char* capture, const char* path, Format format) {
+	CaptureReader reader;
+	if (!reader.open(capture)) {
+		std::cerr << "Couldn't read the capture " << capture << "\n";
+		return false;
+	}
+
+	m_file = std::fopen(path, "wb");
+	if (!m_file) {
+		std::cerr << "Couldn't write " << path << "\n";
+		return false;
+	}
+
+	m_format = format;
+	m_failed = false;
+	m_empty = true;
+	m_frames = 0;
+	m_images = 0;
+	m_written = 0;
+	m_sequence = 0;
+	m_canvas.assign(screenWidth * screenHeight, 0);
+	begin();
+
+	//A screen is emitted once the next different one shows how long it lasted
+	std::vector<unsigned char> screen(screenWidth * screenHeight);
+	std::vector<unsigned char> next(screenWidth * screenHeight);
+	CaptureFrame frame;
+	unsigned long long start = 0;
+	bool started = false;
+	while (reader.next(frame)) {
+		composeScreen(frame, next.data());
+		if (started && next == screen)
+			continue;
+		if (started)
+			emit(screen.data(), frame.frame - start, false);
+		screen.swap(next);
+		start = frame.frame;
+		started = true;
+	}
+	if (started)
+		emit(screen.data(), 1, true);
+
+	end();
+	if (std::fclose(m_file) != 0)
+		m_failed = true;
+	m_file = nullptr;
+
+	if (!started) {
+		std::cerr << "The capture " << capture << " holds no frames\n";
+		return false;
+	}
+	if (m_failed) {
+		std::cerr << "Couldn't write " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+void CaptureExport::begin() {
+	const unsigned int width = screenWidth * m_scale;
+	const unsigned int height = screenHeight * m_scale;
+
+	if (m_format == FORMAT_Y4M) {
+		m_failed |= std::fprintf(m_file, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C444\n", width, height) < 0;
+	}
+	else if (m_format == FORMAT_GIF) {
+		std::vector<unsigned char> header = { 'G', 'I', 'F', '8', '9', 'a' };
+		putLittle16(header, width);
+		putLittle16(header, height);
+		//Global color table of 16 entries, 8 bit color resolution
+		header.push_back(0xF3);
+		header.push_back(0);
+		header.push_back(0);
+		for (int i = 0; i < 16; ++i) {
+			header.push_back((unsigned char)(m_palette[i] >> 16));
+			header.push_back((unsigned char)(m_palette[i] >> 8));
+			header.push_back((unsigned char)m_palette[i]);
+		}
+		//Loops forever
+		const unsigned char loop[] = { 0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00 };
+		header.insert(header.end(), loop, loop + sizeof(loop));
+		m_failed |= std::fwrite(header.data(), 1, header.size(), m_file) != header.size();
+	}
+	else {
+		const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		m_failed |= std::fwrite(signature, 1, sizeof(signature), m_file) != sizeof(signature);
+
+		//4 bit palette pixels, no interlacing
+		unsigned char header[13] = {};
+		putBig32(header, width);
+		putBig32(header + 4, height);
+		header[8] = 4;
+		header[9] = 3;
+		writePngChunk("IHDR", header, sizeof(header));
+
+		//The frame count is filled in by end()
+		const unsigned char animation[8] = {};
+		writePngChunk("acTL", animation, sizeof(animation));
+
+		unsigned char colors[16 * 3];
+		for (int i = 0; i < 16; ++i) {
+			colors[i * 3] = (unsigned char)(m_palette[i] >> 16);
+			colors[i * 3 + 1] = (unsigned char)(m_palette[i] >> 8);
+			colors[i * 3 + 2] = (unsigned char)m_palette[i];
+		}
+		writePngChunk("PLTE", colors, sizeof(colors));
+	}
+}
+
+void CaptureExport::emit(const unsigned char* screen, unsigned long long duration, bool last) {
+	m_frames += duration;
+
+	if (m_format == FORMAT_Y4M) {
+		//BT.601 studio range of every palette color, then the three full planes once for all the copies
+		unsigned char yuv[16][3];
+		for (int i = 0; i < 16; ++i) {
+			const double r = m_palette[i] >> 16 & 0xFF;
+			const double g = m_palette[i] >> 8 & 0xFF;
+			const double b = m_palette[i] & 0xFF;
+			yuv[i][0] = (unsigned char)(16.5 + (65.481 * r + 128.553 * g + 24.966 * b) / 255.0);
+			yuv[i][1] = (unsigned char)(128.5 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0);
+			yuv[i][2] = (unsigned char)(128.5 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0);
+		}
+
+		const size_t width = (size_t)screenWidth * m_scale;
+		const size_t plane = width * screenHeight * m_scale;
+		m_pixels.resize(plane * 3);
+		for (size_t y = 0; y < (size_t)screenHeight * m_scale; ++y) {
+			const unsigned char* row = screen + y / m_scale * screenWidth;
+			for (size_t x = 0; x < width; ++x) {
+				const unsigned char* color = yuv[row[x / m_scale]];
+				m_pixels[y * width + x] = color[0];
+				m_pixels[plane + y * width + x] = color[1];
+				m_pixels[plane * 2 + y * width + x] = color[2];
+			}
+		}
+
+		for (unsigned long long i = 0; i < duration && !m_failed; ++i) {
+			m_failed |= std::fputs("FRAME\n", m_file) < 0;
+			m_failed |= std::fwrite(m_pixels.data(), 1, m_pixels.size(), m_file) != m_pixels.size();
+		}
+		m_images += duration;
+		return;
+	}
+
+	unsigned long long delay = duration;
+	if (m_format == FORMAT_GIF) {
+		//Rounded to hundredths from the start of the capture, so the timing doesn't drift
+		delay = (m_frames * 10 + 3) / 6 - m_written;
+		if (delay < 2) {
+			if (!last)
+				return;
+			delay = 2;
+		}
+		m_written += delay;
+	}
+
+	Rect rect = changedRect(screen);
+	while (delay > 0) {
+		const unsigned int part = (unsigned int)std::min(delay, (unsigned long long)maxDelay);
+		if (m_format == FORMAT_GIF)
+			writeGifImage(screen, rect, part);
+		else
+			writePngImage(screen, rect, part);
+		delay -= part;
+		//The rest of a long screen is a one pixel frame that changes nothing
+		rect = { 0, 0, 1, 1 };
+	}
+
+	std::memcpy(m_canvas.data(), screen, m_canvas.size());
+	m_empty = false;
+}
+
+void CaptureExport::end() {
+	if (m_format == FORMAT_GIF) {
+		m_failed |= std::fputc(0x3B, m_file) == EOF;
+	}
+	else if (m_format == FORMAT_PNG) {
+		writePngChunk("IEND", nullptr, 0);
+
+		unsigned char animation[8] = {};
+		putBig32(animation, (unsigned int)m_images);
+		m_failed |= std::fseek(m_file, pngAnimationOffset, SEEK_SET) != 0;
+		writePngChunk("acTL", animation, sizeof(animation));
+	}
+}
+
+CaptureExport::Rect CaptureExport::changedRect(const unsigned char* screen) const {
+	if (m_empty)
+		return { 0, 0, screenWidth, screenHeight };
+
+	int left = screenWidth;
+	int right = -1;
+	int top = screenHeight;
+	int bottom = -1;
+	for (int y = 0; y < screenHeight; ++y) {
+		for (int x = 0; x < screenWidth; ++x) {
+			if (screen[y * screenWidth + x] != m_canvas[y * screenWidth + x]) {
+				left = std::min(left, x);
+				right = std::max(right, x);
+				top = std::min(top, y);
+				bottom = std::max(bottom, y);
+			}
+		}
+	}
+
+	//Back to what was written last after a dropped screen: a frame has to be written for the time anyway
+	if (right < 0)
+		return { 0, 0, 1, 1 };
+	return { left, top, right - left + 1, bottom - top + 1 };
+}
+
+void CaptureExport::writeGifImage(const unsigned char* screen, const Rect& rect, unsigned int delay) {
+	const int width = rect.width * m_scale;
+	const int height = rect.height * m_scale;
+
+	m_pixels.resize((size_t)width * height);
+	for (int y = 0; y < height; ++y) {
+		const unsigned char* row = screen + (rect.y + y / m_scale) * screenWidth + rect.x;
+		for (int x = 0; x < width; ++x) {
+			m_pixels[(size_t)y * width + x] = row[x / m_scale];
+		}
+	}
+
+	//Graphic control extension: the image stays for the next one to draw over
+	std::vector<unsigned char> image = { 0x21, 0xF9, 0x04, 0x04 };
+	putLittle16(image, delay);
+	image.push_back(0);
+	image.push_back(0);
+
+	image.push_back(0x2C);
+	putLittle16(image, rect.x * m_scale);
+	putLittle16(image, rect.y * m_scale);
+	putLittle16(image, width);
+	putLittle16(image, height);
+	image.push_back(0);
+
+	m_encoded.clear();
+	encodeLzw(m_pixels, m_encoded);
+	image.push_back(4);
+	for (size_t position = 0; position < m_encoded.size(); position += 255) {
+		const size_t size = std::min(m_encoded.size() - position, (size_t)255);
+		image.push_back((unsigned char)size);
+		image.insert(image.end(), m_encoded.begin() + position, m_encoded.begin() + position + size);
+	}
+	image.push_back(0);
+
+	m_failed |= std::fwrite(image.data(), 1, image.size(), m_file) != image.size();
+	++m_images;
+}
+
+void CaptureExport::writePngImage(const unsigned char* screen, const Rect& rect, unsigned int delay) {
+	const unsigned int width = rect.width * m_scale;
+	const unsigned int height = rect.height * m_scale;
+
+	//Frame control: rectangle, delay in 1/60 s, drawn over the last frame which stays
+	unsigned char control[26] = {};
+	putBig32(control, m_sequence++);
+	putBig32(control + 4, width);
+	putBig32(control + 8, height);
+	putBig32(control + 12, rect.x * m_scale);
+	putBig32(control + 16, rect.y * m_scale);
+	control[20] = (unsigned char)(delay >> 8);
+	control[21] = (unsigned char)delay;
+	control[23] = 60;
+	writePngChunk("fcTL", control, sizeof(control));
+
+	//Filter type 0 in front of every row, two pixels per byte
+	const size_t stride = (width + 1) / 2;
+	m_pixels.assign((stride + 1) * height, 0);
+	for (unsigned int y = 0; y < height; ++y) {
+		const unsigned char* row = screen + (rect.y + y / m_scale) * screenWidth + rect.x;
+		unsigned char* out = &m_pixels[y * (stride + 1) + 1];
+		for (unsigned int x = 0; x < width; ++x) {
+			out[x / 2] |= (unsigned char)(row[x / m_scale] << (x % 2 == 0 ? 4 : 0));
+		}
+	}
+
+	//The first frame is the default image, the others carry a sequence number in front
+	m_encoded.clear();
+	if (m_images > 0) {
+		m_encoded.resize(4);
+		putBig32(m_encoded.data(), m_sequence++);
+	}
+	storeZlib(m_pixels, m_encoded);
+	writePngChunk(m_images > 0 ? "fdAT" : "IDAT", m_encoded.data(), m_encoded.size());
+	++m_images;
+}
+
+void CaptureExport::writePngChunk(const char* type, const unsigned char* data, size_t size) {
+	unsigned char header[8];
+	putBig32(header, (unsigned int)size);
+	std::memcpy(header + 4, type, 4);
+
+	unsigned char crc[4];
+	putBig32(crc, crc32(crc32(0, header + 4, 4), data, size));
+
+	m_failed |= std::fwrite(header, 1, sizeof(header), m_file) != sizeof(header);
+	if (size > 0)
+		m_failed |= std::fwrite(data, 1, size, m_file) != size;
+	m_failed |= std::fwrite(crc, 1, sizeof(crc), m_file) != sizeof(crc);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+#include "FrameCapture.h"
+
+/*
+Converts captures (CaptureWriter files) into formats other programs play. Every format gets the 128x64 screen, low
+resolution pixels doubled, scaled up by a whole factor. Screens are held as long as the capture says, so frames the
+capture skipped cost nothing.
+
+	PNG: animated PNG, lossless and exactly timed (delays in 1/60 s). Every frame only holds the rectangle that
+	     changed, as 4 bit palette pixels. There is no compression library in the tree, the pixels are stored in
+	     uncompressed deflate blocks
+	GIF: LZW compressed rectangles that changed. GIF delays are whole 1/100 s and players don't show frames shorter
+	     than 2/100 s, a screen that doesn't last that long is dropped and its time goes to the next one
+	Y4M: uncompressed YUV4MPEG2 video at 60 fps, every frame written (BT.601 4:4:4). Lossless, ffmpeg and most
+	     players read it
+*/
+class CaptureExport {
+public:
+
+	enum Format {
+		FORMAT_PNG,
+		FORMAT_GIF,
+		FORMAT_Y4M
+	};
+
+	static const int MAX_SCALE = 16;
+
+	CaptureExport();
+
+	//0xRRGGBB of the 16 bitplane palette indices
+	void setPalette(const unsigned int* rgb);
+	void setScale(int scale);
+
+	//Format by the file extension (.png/.apng, .gif, .y4m)
+	static bool formatOf(const char* path, Format& format);
+
+	//Converts the whole capture, false if either file couldn't be opened or written
+	bool write(const char* capture, const char* path, Format format);
+
+	//60 Hz frames and images the last write() covered
+	unsigned long long GetFrames() const { return m_frames; }
+	unsigned long long GetImages() const { return m_images; }
+
+private:
+	struct Rect {
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	void begin();
+	//The screen is shown for the duration (60 Hz frames), last is true for the final screen
+	void emit(const unsigned char* screen, unsigned long long duration, bool last);
+	void end();
+
+	//The part of the screen that differs from the last image written, the whole screen for the first one
+	Rect changedRect(const unsigned char* screen) const;
+	void writeGifImage(const unsigned char* screen, const Rect& rect, unsigned int delay);
+	void writePngImage(const unsigned char* screen, const Rect& rect, unsigned int delay);
+	void writePngChunk(const char* type, const unsigned char* data, size_t size);
+
+	unsigned int m_palette[16];
+	int m_scale;
+
+	Format m_format;
+	FILE* m_file;
+	bool m_failed;
+	std::vector<unsigned char> m_canvas;
+	bool m_empty;
+	unsigned long long m_frames;
+	unsigned long long m_images;
+	//GIF: hundredths of a second the images written so far cover
+	unsigned long long m_written;
+	//PNG: chunk sequence number
+	unsigned int m_sequence;
+
+	std::vector<unsigned char> m_pixels;
+	std::vector<unsigned char> m_encoded;
+};
@@ -0,0 +1,439 @@
+#include "Debugger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "chip8.h"
+#include "Disassembler.h"
+#include "Opcode.h"
+
+std::atomic<unsigned int> Debugger::armed(0);
+
+namespace {
+
+	//Accepts 0x2A4, 2A4 and 2a4
+	unsigned long parseNumber(const std::string& text, int base = 16) {
+		return std::strtoul(text.c_str(), nullptr, base);
+	}
+}
+
+Debugger::Debugger() : m_chip(nullptr), m_readWatch(0x10000), m_writeWatch(0x10000), m_hit(STOP_NONE), m_hitAddress(0),
+	m_paused(false) {
+}
+
+Debugger::~Debugger() {
+	detach();
+}
+
+void Debugger::attach(Chip8& chip) {
+	detach();
+
+	m_chip = &chip;
+	fitWatches();
+	m_history.reset(chip);
+	m_chip->SetDebugger(this);
+	armed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Debugger::detach() {
+	if (!m_chip)
+		return;
+
+	m_chip->SetDebugger(nullptr);
+	m_chip = nullptr;
+	m_paused = false;
+	armed.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Debugger::setBreakpoint(unsigned short address, bool enabled) {
+	m_breakpoints[address] = enabled;
+}
+
+unsigned int Debugger::fitWatches() {
+	//Without a machine the tables keep the smallest memory there is
+	const size_t size = m_chip ? m_chip->GetMemorySize() : 0x10000;
+	if (m_readWatch.size() != size) {
+		m_readWatch.resize(size);
+		m_writeWatch.resize(size);
+	}
+	return (unsigned int)size - 1;
+}
+
+void Debugger::setReadWatch(unsigned int address, unsigned short length, bool enabled) {
+	const unsigned int mask = fitWatches();
+	for (unsigned int i = 0; i < length; ++i) {
+		m_readWatch[(address + i) & mask] = enabled;
+	}
+}
+
+void Debugger::setWriteWatch(unsigned int address, unsigned short length, bool enabled) {
+	const unsigned int mask = fitWatches();
+	for (unsigned int i = 0; i < length; ++i) {
+		m_writeWatch[(address + i) & mask] = enabled;
+	}
+}
+
+void Debugger::clearAll() {
+	m_breakpoints.reset();
+	m_readWatch.assign(m_readWatch.size(), false);
+	m_writeWatch.assign(m_writeWatch.size(), false);
+}
+
+void Debugger::hit(StopReason reason, unsigned int address) {
+	//Report the first access of an instruction
+	if (m_hit != STOP_NONE)
+		return;
+
+	m_hit = reason;
+	m_hitAddress = address;
+}
+
+Debugger::StopReason Debugger::stepOne() {
+	m_hit = STOP_NONE;
+	m_history.beforeStep(*m_chip);
+	m_chip->emulateCycle();
+
+	if (m_hit != STOP_NONE)
+		return m_hit;
+	if (m_chip->IsHalted())
+		return STOP_HALTED;
+	return STOP_NONE;
+}
+
+Debugger::StopReason Debugger::run(unsigned long long maxCycles) {
+	if (!m_chip)
+		return STOP_NONE;
+
+	for (unsigned long long i = 0; i < maxCycles; ++i) {
+		if (i > 0 && m_breakpoints[m_chip->GetPC()])
+			return STOP_BREAKPOINT;
+
+		StopReason reason = stepOne();
+		if (reason != STOP_NONE)
+			return reason;
+	}
+
+	return STOP_NONE;
+}
+
+Debugger::StopReason Debugger::step(unsigned long long count) {
+	StopReason reason = run(count);
+	return reason == STOP_NONE ? STOP_STEP : reason;
+}
+
+Debugger::StopReason Debugger::stepOver() {
+	if (!m_chip)
+		return STOP_NONE;
+
+	if ((m_chip->GetNextOpcode() & 0xF000) != 0x2000)
+		return step();
+
+	//Run until the call returned to the instruction after it on the same stack level
+	const unsigned short returnAddress = m_chip->GetPC() + 2;
+	const unsigned short level = m_chip->GetSP();
+
+	StopReason reason = stepOne();
+	for (unsigned long long cycles = 1; reason == STOP_NONE; ++cycles) {
+		if (m_chip->GetPC() == returnAddress && m_chip->GetSP() == level)
+			return STOP_STEP;
+		if (m_breakpoints[m_chip->GetPC()])
+			return STOP_BREAKPOINT;
+		if (cycles >= STEP_OVER_LIMIT)
+			return STOP_LIMIT;
+
+		reason = stepOne();
+	}
+
+	return reason;
+}
+
+Debugger::StopReason Debugger::reverseStep(unsigned long long count) {
+	if (!m_chip)
+		return STOP_NONE;
+
+	unsigned long long cycle = m_chip->GetCycle();
+	unsigned long long first = m_history.GetFirstCycle();
+	unsigned long long target = cycle - first >= count ? cycle - count : first;
+
+	m_history.seek(*m_chip, target);
+	return target == cycle - count ? STOP_STEP : STOP_HISTORY_START;
+}
+
+Debugger::StopReason Debugger::reverseHit() {
+	if (m_breakpoints[m_chip->GetPC()])
+		return STOP_BREAKPOINT;
+
+	bool write;
+	unsigned short length = opcodeMemoryAccess(m_chip->GetNextOpcode(), write);
+	const std::vector<bool>& watch = write ? m_writeWatch : m_readWatch;
+	const unsigned int mask = (unsigned int)m_chip->GetMemorySize() - 1;
+	for (unsigned short i = 0; i < length; ++i) {
+		unsigned int address = (m_chip->GetI() + i) & mask;
+		if (address < watch.size() && watch[address]) {
+			m_hitAddress = address;
+			return write ? STOP_WATCH_WRITE : STOP_WATCH_READ;
+		}
+	}
+
+	return STOP_NONE;
+}
+
+Debugger::StopReason Debugger::reverseContinue() {
+	if (!m_chip)
+		return STOP_NONE;
+
+	bool found = m_history.findLast(*m_chip, [this](const Chip8& chip) {
+		if (m_breakpoints[chip.GetPC()])
+			return true;
+
+		bool write;
+		unsigned short length = opcodeMemoryAccess(chip.GetNextOpcode(), write);
+		const std::vector<bool>& watch = write ? m_writeWatch : m_readWatch;
+		const unsigned int mask = (unsigned int)chip.GetMemorySize() - 1;
+		for (unsigned short i = 0; i < length; ++i) {
+			const unsigned int address = (chip.GetI() + i) & mask;
+			if (address < watch.size() && watch[address])
+				return true;
+		}
+		return false;
+	});
+
+	return found ? reverseHit() : STOP_HISTORY_START;
+}
+
+Debugger::StopReason Debugger::reverseToWrite(unsigned int address) {
+	if (!m_chip)
+		return STOP_NONE;
+
+	const unsigned int mask = (unsigned int)m_chip->GetMemorySize() - 1;
+	address &= mask;
+	bool found = m_history.findLast(*m_chip, [address, mask](const Chip8& chip) {
+		bool write;
+		unsigned short length = opcodeMemoryAccess(chip.GetNextOpcode(), write);
+		return write && ((address - chip.GetI()) & mask) < length;
+	});
+
+	m_hitAddress = address;
+	return found ? STOP_WATCH_WRITE : STOP_HISTORY_START;
+}
+
+Debugger::StopReason Debugger::reverseToRegisterWrite(int reg) {
+	if (!m_chip)
+		return STOP_NONE;
+
+	reg &= 0xF;
+	bool found = m_history.findLast(*m_chip, [reg](const Chip8& chip) {
+		return opcodeWritesRegister(chip.GetNextOpcode(), reg);
+	});
+
+	m_hitAddress = (unsigned int)reg;
+	return found ? STOP_REGISTER_WRITE : STOP_HISTORY_START;
+}
+
+void Debugger::setKey(int key, bool pressed) {
+	if (!m_chip)
+		return;
+
+	if (m_chip->GetCycle() < m_history.GetFrontier())
+		m_history.truncate(*m_chip);
+	m_chip->m_key[key & 0xF] = pressed ? 1 : 0;
+}
+
+void Debugger::runCycles(unsigned int cycles) {
+	if (m_paused)
+		return;
+
+	if (run(cycles) != STOP_NONE)
+		m_paused = true;
+}
+
+void Debugger::printRegisters(std::ostream& out) const {
+	if (!m_chip)
+		return;
+
+	char line[128];
+	std::snprintf(line, sizeof(line), "PC=%03X  I=%03X  SP=%X  DT=%02X  ST=%02X  cycle=%llu\n",
+		m_chip->GetPC(), m_chip->GetI(), m_chip->GetSP(), m_chip->GetDelayTimer(), m_chip->GetSoundTimer(), m_chip->GetCycle());
+	out << line;
+
+	for (int i = 0; i < 16; ++i) {
+		std::snprintf(line, sizeof(line), "V%X=%02X%s", i, m_chip->GetV(i), (i % 8 == 7) ? "\n" : "  ");
+		out << line;
+	}
+
+	if (m_chip->GetSP() > 0) {
+		out << "Stack:";
+		for (int i = 0; i < m_chip->GetSP() && i < 16; ++i) {
+			std::snprintf(line, sizeof(line), " %03X", m_chip->GetStack(i));
+			out << line;
+		}
+		out << "\n";
+	}
+}
+
+void Debugger::printMemory(std::ostream& out, unsigned int address, unsigned short length) const {
+	if (!m_chip)
+		return;
+
+	const unsigned int mask = (unsigned int)m_chip->GetMemorySize() - 1;
+	char text[16];
+	for (unsigned int offset = 0; offset < length; offset += 16) {
+		std::snprintf(text, sizeof(text), "%03X:", (address + offset) & mask);
+		out << text;
+		for (unsigned int i = offset; i < offset + 16 && i < length; ++i) {
+			std::snprintf(text, sizeof(text), " %02X", m_chip->GetMemory((address + i) & mask));
+			out << text;
+		}
+		out << "\n";
+	}
+}
+
+void Debugger::printDisassembly(std::ostream& out, unsigned int address, unsigned short count) const {
+	if (!m_chip)
+		return;
+
+	const unsigned int mask = (unsigned int)m_chip->GetMemorySize() - 1;
+	char text[32];
+	for (unsigned short i = 0; i < count; ++i) {
+		const unsigned int pc = (address + i * 2) & mask;
+		unsigned short opcode = m_chip->GetMemory(pc) << 8 | m_chip->GetMemory((pc + 1) & mask);
+
+		//Breakpoints only exist where the program counter can go
+		const bool breakpoint = pc < m_breakpoints.size() && m_breakpoints[pc];
+		std::snprintf(text, sizeof(text), "%c%c%03X  %04X  ", pc == m_chip->GetPC() ? '>' : ' ', breakpoint ? '*' : ' ', pc, opcode);
+		out << text << disassemble(opcode) << "\n";
+	}
+}
+
+void Debugger::printStop(std::ostream& out, StopReason reason) const {
+	char text[64];
+	switch (reason) {
+	case STOP_BREAKPOINT: std::snprintf(text, sizeof(text), "Breakpoint at %03X\n", m_chip->GetPC()); break;
+	case STOP_WATCH_READ: std::snprintf(text, sizeof(text), "Read of %03X\n", m_hitAddress); break;
+	case STOP_WATCH_WRITE: std::snprintf(text, sizeof(text), "Write to %03X\n", m_hitAddress); break;
+	case STOP_HALTED:
+		std::snprintf(text, sizeof(text), m_chip->HasExited() ? "Exited (00FD) at %03X\n" : "Halted on illegal opcode at %03X\n",
+			m_chip->GetPC());
+		break;
+	case STOP_REGISTER_WRITE: std::snprintf(text, sizeof(text), "Write to V%X\n", m_hitAddress); break;
+	case STOP_HISTORY_START: std::snprintf(text, sizeof(text), "Start of history (cycle %llu)\n", m_chip->GetCycle()); break;
+	case STOP_LIMIT: std::snprintf(text, sizeof(text), "Subroutine didn't return within %llu cycles\n", STEP_OVER_LIMIT); break;
+	default: text[0] = '\0'; break;
+	}
+	out << text;
+
+	printDisassembly(out, m_chip->GetPC(), 1);
+}
+
+void Debugger::printHistory(std::ostream& out) const {
+	char text[160];
+	std::snprintf(text, sizeof(text), "Cycles %llu-%llu, %zu checkpoints every %llu cycles, %.1f MB, reverse step <= %.1f ms\n",
+		m_history.GetFirstCycle(), m_history.GetFrontier(), m_history.GetCheckpointCount(), m_history.GetInterval(),
+		m_history.GetMemoryUsage() / (1024.0 * 1024.0), m_history.GetReverseStepLatency() * 1000.0);
+	out << text;
+}
+
+void Debugger::commandLoop(std::istream& in, std::ostream& out) {
+	if (!m_chip)
+		return;
+
+	std::string line;
+	out << "(chip8) " << std::flush;
+
+	while (std::getline(in, line)) {
+		std::istringstream stream(line);
+		std::string command, first, second, third;
+		stream >> command >> first >> second >> third;
+
+		if (command == "q") {
+			break;
+		}
+		else if (command == "h" || command == "help") {
+			out << "b ADDR / bd ADDR      set / delete breakpoint\n"
+				<< "wr ADDR [LEN]         watch reads\n"
+				<< "ww ADDR [LEN]         watch writes\n"
+				<< "wd ADDR [LEN]         delete read and write watches\n"
+				<< "s [COUNT]             step\n"
+				<< "n                     step over (2NNN runs until it returns)\n"
+				<< "c [CYCLES]            continue\n"
+				<< "rs [COUNT]            reverse step\n"
+				<< "rc                    reverse continue (last breakpoint or watched access)\n"
+				<< "rw ADDR               back to the last write of a memory cell\n"
+				<< "rv X                  back to the last write of VX\n"
+				<< "hist                  recorded history\n"
+				<< "r                     registers\n"
+				<< "m ADDR [LEN]          memory dump\n"
+				<< "d [ADDR] [COUNT]      disassemble\n"
+				<< "k KEY 0|1             release / press a key\n"
+				<< "q                     quit\n"
+				<< "Addresses and lengths are hex, counts decimal\n";
+		}
+		else if (command == "b" && !first.empty()) {
+			setBreakpoint((unsigned short)parseNumber(first));
+		}
+		else if (command == "bd" && !first.empty()) {
+			setBreakpoint((unsigned short)parseNumber(first), false);
+		}
+		else if ((command == "wr" || command == "ww" || command == "wd") && !first.empty()) {
+			unsigned int address = (unsigned int)parseNumber(first);
+			unsigned short length = second.empty() ? 1 : (unsigned short)parseNumber(second);
+
+			if (command == "wr") setReadWatch(address, length);
+			else if (command == "ww") setWriteWatch(address, length);
+			else {
+				setReadWatch(address, length, false);
+				setWriteWatch(address, length, false);
+			}
+		}
+		else if (command == "s") {
+			printStop(out, step(first.empty() ? 1 : std::strtoull(first.c_str(), nullptr, 10)));
+		}
+		else if (command == "n") {
+			printStop(out, stepOver());
+		}
+		else if (command == "c") {
+			unsigned long long cycles = first.empty() ? 100000000ULL : std::strtoull(first.c_str(), nullptr, 10);
+			StopReason reason = run(cycles);
+			if (reason == STOP_NONE)
+				out << "Ran " << cycles << " cycles\n";
+			printStop(out, reason);
+		}
+		else if (command == "rs") {
+			printStop(out, reverseStep(first.empty() ? 1 : std::strtoull(first.c_str(), nullptr, 10)));
+		}
+		else if (command == "rc") {
+			printStop(out, reverseContinue());
+		}
+		else if (command == "rw" && !first.empty()) {
+			printStop(out, reverseToWrite((unsigned int)parseNumber(first)));
+		}
+		else if (command == "rv" && !first.empty()) {
+			printStop(out, reverseToRegisterWrite((int)parseNumber(first)));
+		}
+		else if (command == "hist") {
+			printHistory(out);
+		}
+		else if (command == "r") {
+			printRegisters(out);
+		}
+		else if (command == "m" && !first.empty()) {
+			printMemory(out, (unsigned int)parseNumber(first), second.empty() ? 64 : (unsigned short)parseNumber(second));
+		}
+		else if (command == "d") {
+			unsigned int address = first.empty() ? m_chip->GetPC() : (unsigned int)parseNumber(first);
+			printDisassembly(out, address, second.empty() ? 10 : (unsigned short)std::strtoul(second.c_str(), nullptr, 10));
+		}
+		else if (command == "k" && !first.empty() && !second.empty()) {
+			setKey((int)parseNumber(first), second != "0");
+		}
+		else if (!command.empty()) {
+			out << "Unknown command, h lists all commands\n";
+		}
+
+		out << "(chip8) " << std::flush;
+	}
+
+	m_paused = false;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <bitset>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "History.h"
+
+class Chip8;
+
+/*
+Interactive debugger for the emulated program.
+Breakpoints are a bitmap over the 64 KB the program counter can reach, watchpoints one over the machine's memory (64 KB,
+16 MB under MEGA-CHIP), addresses wrap around with it like they do for I. The core
+only looks at them while Debugger::armed is set (i.e. while any debugger is attached), a normal run pays a single
+untaken branch per memory access and none per instruction.
+*/
+class Debugger {
+public:
+
+	enum StopReason {
+		STOP_NONE = 0,		//ran the requested number of cycles
+		STOP_BREAKPOINT,
+		STOP_WATCH_READ,
+		STOP_WATCH_WRITE,
+		STOP_STEP,
+		STOP_HALTED,		//the core halted (00FD or an illegal opcode, Chip8::HasExited tells which)
+		STOP_REGISTER_WRITE,
+		STOP_HISTORY_START,	//a reverse command reached the oldest recorded state
+		STOP_LIMIT			//step over ran STEP_OVER_LIMIT cycles without the subroutine returning
+	};
+
+	//Cycles a step over runs at most (a few seconds of a fast configuration), FX0A without a key or a subroutine
+	//that never returns would hang the prompt otherwise
+	static const unsigned long long STEP_OVER_LIMIT = 100000000ULL;
+
+	//Number of attached debuggers, machines of any thread only check for their own debugger while it isn't 0
+	static std::atomic<unsigned int> armed;
+
+	Debugger();
+	~Debugger();
+
+	void attach(Chip8& chip);
+	void detach();
+
+	void setBreakpoint(unsigned short address, bool enabled = true);
+	//Watch length bytes starting at address
+	void setReadWatch(unsigned int address, unsigned short length = 1, bool enabled = true);
+	void setWriteWatch(unsigned int address, unsigned short length = 1, bool enabled = true);
+	void clearAll();
+
+	//Executes instructions until a breakpoint/watchpoint is hit, the core halts or maxCycles ran.
+	//A breakpoint at the current address is ignored so continuing from a breakpoint works
+	StopReason run(unsigned long long maxCycles);
+	StopReason step(unsigned long long count = 1);
+	//Like step, but runs a 2NNN subroutine until it returned, a breakpoint is hit or STEP_OVER_LIMIT cycles ran
+	StopReason stepOver();
+
+	//Reverse execution, restores the nearest checkpoint and replays forward
+	StopReason reverseStep(unsigned long long count = 1);
+	//Back to the last instruction that hit a breakpoint or accessed a watched address
+	StopReason reverseContinue();
+	//Back to the last instruction that wrote the memory cell / register
+	StopReason reverseToWrite(unsigned int address);
+	StopReason reverseToRegisterWrite(int reg);
+
+	//Changing the keypad inside recorded history discards the recorded future
+	void setKey(int key, bool pressed);
+
+	const History& GetHistory() const { return m_history; }
+
+	//Used by Chip8::runCycles while armed. Stops early (and stays paused) when something is hit
+	void runCycles(unsigned int cycles);
+	bool isPaused() const { return m_paused; }
+	void resume() { m_paused = false; }
+
+	//Hooks called by the core with addresses within its memory. The size check only matters if the quirk profile (and
+	//with it the memory size) changed since the watches were set
+	void onRead(unsigned int address) {
+		if (address < m_readWatch.size() && m_readWatch[address])
+			hit(STOP_WATCH_READ, address);
+	}
+	void onWrite(unsigned int address) {
+		if (address < m_writeWatch.size() && m_writeWatch[address])
+			hit(STOP_WATCH_WRITE, address);
+	}
+
+	//Reads commands until the stream ends or "q" is entered. "h" lists the commands
+	void commandLoop(std::istream& in, std::ostream& out);
+
+	void printRegisters(std::ostream& out) const;
+	//Addresses wrap around with the machine's memory (64 KB, 16 MB under MEGA-CHIP)
+	void printMemory(std::ostream& out, unsigned int address, unsigned short length) const;
+	void printDisassembly(std::ostream& out, unsigned int address, unsigned short count) const;
+	void printStop(std::ostream& out, StopReason reason) const;
+	void printHistory(std::ostream& out) const;
+
+private:
+	void hit(StopReason reason, unsigned int address);
+	//Sizes the watch tables to the attached machine's memory and returns the address mask
+	unsigned int fitWatches();
+	//Executes one instruction and reports watch hits/halts
+	StopReason stepOne();
+	//Reason a reverse search stopped at the current state
+	StopReason reverseHit();
+
+	Chip8* m_chip;
+
+	std::bitset<0x10000> m_breakpoints;
+	std::vector<bool> m_readWatch;
+	std::vector<bool> m_writeWatch;
+
+	//Watch hit during the current instruction
+	StopReason m_hit;
+	unsigned int m_hitAddress;
+
+	bool m_paused;
+
+	History m_history;
+};
@@ -0,0 +1,91 @@
+#include "Disassembler.h"
+
+#include <cstdio>
+
+std::string disassemble(unsigned short opcode) {
+	char text[32];
+	const unsigned int x = (opcode & 0x0F00) >> 8;
+	const unsigned int y = (opcode & 0x00F0) >> 4;
+	const unsigned int n = opcode & 0x000F;
+	const unsigned int nn = opcode & 0x00FF;
+	const unsigned int nnn = opcode & 0x0FFF;
+
+	std::snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+
+	switch (opcode & 0xF000) {
+	case 0x0000:
+		if (opcode == 0x00E0) std::snprintf(text, sizeof(text), "CLS");
+		else if (opcode == 0x00EE) std::snprintf(text, sizeof(text), "RET");
+		else if ((opcode & 0xFFF0) == 0x00C0) std::snprintf(text, sizeof(text), "SCD %u", n);
+		else if ((opcode & 0xFFF0) == 0x00D0) std::snprintf(text, sizeof(text), "SCU %u", n);
+		else if (opcode == 0x00FB) std::snprintf(text, sizeof(text), "SCR");
+		else if (opcode == 0x00FC) std::snprintf(text, sizeof(text), "SCL");
+		else if (opcode == 0x00FD) std::snprintf(text, sizeof(text), "EXIT");
+		else if (opcode == 0x00FE) std::snprintf(text, sizeof(text), "LOW");
+		else if (opcode == 0x00FF) std::snprintf(text, sizeof(text), "HIGH");
+		//MEGA-CHIP, 01NN takes the low 16 bits of the address from the next word
+		else if (opcode == 0x0010) std::snprintf(text, sizeof(text), "MEGAOFF");
+		else if (opcode == 0x0011) std::snprintf(text, sizeof(text), "MEGAON");
+		else if ((opcode & 0xFFF0) == 0x00B0) std::snprintf(text, sizeof(text), "SCRU %u", n);
+		else if ((opcode & 0xFF00) == 0x0100) std::snprintf(text, sizeof(text), "LDHI I, 0x%02X", nn);
+		else if ((opcode & 0xFF00) == 0x0200) std::snprintf(text, sizeof(text), "LDPAL %u", nn);
+		else if ((opcode & 0xFF00) == 0x0300) std::snprintf(text, sizeof(text), "SPRW %u", nn);
+		else if ((opcode & 0xFF00) == 0x0400) std::snprintf(text, sizeof(text), "SPRH %u", nn);
+		else if ((opcode & 0xFF00) == 0x0500) std::snprintf(text, sizeof(text), "ALPHA 0x%02X", nn);
+		else if ((opcode & 0xFFF0) == 0x0600) std::snprintf(text, sizeof(text), "DIGISND %u", n);
+		else if (opcode == 0x0700) std::snprintf(text, sizeof(text), "STOPSND");
+		else if ((opcode & 0xFFF0) == 0x0800) std::snprintf(text, sizeof(text), "BMODE %u", n);
+		else if ((opcode & 0xFF00) == 0x0900) std::snprintf(text, sizeof(text), "CCOL 0x%02X", nn);
+		break;
+	case 0x1000: std::snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+	case 0x2000: std::snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+	case 0x3000: std::snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, nn); break;
+	case 0x4000: std::snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, nn); break;
+	case 0x5000:
+		if (n == 0) std::snprintf(text, sizeof(text), "SE V%X, V%X", x, y);
+		else if (n == 2) std::snprintf(text, sizeof(text), "LD [I], V%X-V%X", x, y);
+		else if (n == 3) std::snprintf(text, sizeof(text), "LD V%X-V%X, [I]", x, y);
+		break;
+	case 0x6000: std::snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, nn); break;
+	case 0x7000: std::snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, nn); break;
+	case 0x8000: {
+		static const char* alu[16] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr };
+		if (alu[n]) std::snprintf(text, sizeof(text), "%s V%X, V%X", alu[n], x, y);
+		break;
+	}
+	case 0x9000:
+		if (n == 0) std::snprintf(text, sizeof(text), "SNE V%X, V%X", x, y);
+		break;
+	case 0xA000: std::snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+	case 0xB000: std::snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+	case 0xC000: std::snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, nn); break;
+	case 0xD000: std::snprintf(text, sizeof(text), "DRW V%X, V%X, %u", x, y, n); break;
+	case 0xE000:
+		if (nn == 0x9E) std::snprintf(text, sizeof(text), "SKP V%X", x);
+		else if (nn == 0xA1) std::snprintf(text, sizeof(text), "SKNP V%X", x);
+		break;
+	case 0xF000:
+		switch (nn) {
+		//The address follows as the next word
+		case 0x00: if (x == 0) std::snprintf(text, sizeof(text), "LD I, LONG"); break;
+		case 0x01: std::snprintf(text, sizeof(text), "PLANE %u", x); break;
+		case 0x02: if (x == 0) std::snprintf(text, sizeof(text), "AUDIO"); break;
+		case 0x07: std::snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+		case 0x0A: std::snprintf(text, sizeof(text), "LD V%X, K", x); break;
+		case 0x15: std::snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+		case 0x18: std::snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+		case 0x1E: std::snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+		case 0x29: std::snprintf(text, sizeof(text), "LD F, V%X", x); break;
+		case 0x30: std::snprintf(text, sizeof(text), "LD HF, V%X", x); break;
+		case 0x3A: std::snprintf(text, sizeof(text), "PITCH V%X", x); break;
+		case 0x33: std::snprintf(text, sizeof(text), "LD B, V%X", x); break;
+		case 0x55: std::snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+		case 0x65: std::snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+		case 0x75: std::snprintf(text, sizeof(text), "LD R, V%X", x); break;
+		case 0x85: std::snprintf(text, sizeof(text), "LD V%X, R", x); break;
+		}
+		break;
+	}
+
+	return text;
+}
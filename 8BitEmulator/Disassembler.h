@@ -0,0 +1,5 @@
+#pragma once
+#include <string>
+
+//Mnemonic of a single opcode in the usual Chip-8 assembler syntax (e.g. "LD V3, 0x2A"), unknown opcodes become "DW 0xXXXX"
+std::string disassemble(unsigned short opcode);
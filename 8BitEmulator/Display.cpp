@@ -0,0 +1,253 @@
+#include "Display.h"
+
+#include <cstring>
+
+#include "DisplaySimd.h"
+
+/*
+Row kernels. A row is one 128 bit value with pixel 0 in the most significant bit of the first word, moving the pixels
+to the right means shifting both words right and carrying the low bits of the first word into the second one.
+*/
+#ifdef DISPLAY_SSE2
+typedef __m128i RowVector;
+
+static inline RowVector load(const Display::Row& row) {
+	//Unaligned, 32 bit heaps don't keep the machine on a 16 byte boundary
+	return _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.words));
+}
+
+static inline void store(Display::Row& row, RowVector value) {
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(row.words), value);
+}
+
+//Row with the pixels in the first word only, built in a register (two stores read back as one vector would stall)
+static inline RowVector firstWord(unsigned long long pixels) { return _mm_set_epi64x(0, (long long)pixels); }
+
+static inline RowVector rowAnd(RowVector a, RowVector b) { return _mm_and_si128(a, b); }
+static inline RowVector rowOr(RowVector a, RowVector b) { return _mm_or_si128(a, b); }
+static inline RowVector rowXor(RowVector a, RowVector b) { return _mm_xor_si128(a, b); }
+
+static inline bool isZero(RowVector value) {
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(value, _mm_setzero_si128())) == 0xFFFF;
+}
+
+//Moves the pixels n columns to the right (n < 128), pixels pushed past column 127 are dropped
+static inline RowVector shiftRight(RowVector value, unsigned int n) {
+	if (n >= 64) {
+		value = _mm_slli_si128(value, 8);
+		n -= 64;
+	}
+	//Shift counts of 64 give 0, so n == 0 carries nothing
+	const RowVector carry = _mm_slli_si128(_mm_sll_epi64(value, _mm_cvtsi32_si128(64 - n)), 8);
+	return _mm_or_si128(_mm_srl_epi64(value, _mm_cvtsi32_si128(n)), carry);
+}
+
+//Moves the pixels n columns to the left (n < 128), pixels pushed past column 0 are dropped
+static inline RowVector shiftLeft(RowVector value, unsigned int n) {
+	if (n >= 64) {
+		value = _mm_srli_si128(value, 8);
+		n -= 64;
+	}
+	const RowVector carry = _mm_srli_si128(_mm_srl_epi64(value, _mm_cvtsi32_si128(64 - n)), 8);
+	return _mm_or_si128(_mm_sll_epi64(value, _mm_cvtsi32_si128(n)), carry);
+}
+
+//Palette indices of 16 pixels, one byte each
+typedef __m128i IndexVector;
+
+static inline IndexVector indexOr(IndexVector a, IndexVector b) { return _mm_or_si128(a, b); }
+
+//Expands 16 pixels (two sprite-order bytes) of a plane to one byte each, set pixels become the plane's palette bit
+static inline IndexVector expandPlane(unsigned int pixels, int plane) {
+	//Both bytes copied into 8 lanes each, then every lane tests its own bit
+	IndexVector value = _mm_cvtsi32_si128((int)pixels);
+	value = _mm_unpacklo_epi8(value, value);
+	value = _mm_unpacklo_epi16(value, value);
+	value = _mm_unpacklo_epi32(value, value);
+	const IndexVector bits = _mm_set_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+	const IndexVector set = _mm_cmpeq_epi8(_mm_and_si128(value, bits), bits);
+	return _mm_and_si128(set, _mm_set1_epi8((char)(1 << plane)));
+}
+
+static inline void storeIndices(unsigned char* indices, IndexVector value) {
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(indices), value);
+}
+
+static const int COMPOSE_PIXELS = 16;
+#else
+typedef Display::Row RowVector;
+
+static inline RowVector load(const Display::Row& row) { return row; }
+static inline void store(Display::Row& row, RowVector value) { row = value; }
+
+static inline RowVector firstWord(unsigned long long pixels) { return { { pixels, 0 } }; }
+
+static inline RowVector rowAnd(RowVector a, RowVector b) { return { { a.words[0] & b.words[0], a.words[1] & b.words[1] } }; }
+static inline RowVector rowOr(RowVector a, RowVector b) { return { { a.words[0] | b.words[0], a.words[1] | b.words[1] } }; }
+static inline RowVector rowXor(RowVector a, RowVector b) { return { { a.words[0] ^ b.words[0], a.words[1] ^ b.words[1] } }; }
+
+static inline bool isZero(RowVector value) {
+	return (value.words[0] | value.words[1]) == 0;
+}
+
+static inline RowVector shiftRight(RowVector value, unsigned int n) {
+	if (n >= 64)
+		return { { 0, value.words[0] >> (n - 64) } };
+	if (n == 0)
+		return value;
+	return { { value.words[0] >> n, value.words[1] >> n | value.words[0] << (64 - n) } };
+}
+
+static inline RowVector shiftLeft(RowVector value, unsigned int n) {
+	if (n >= 64)
+		return { { value.words[1] << (n - 64), 0 } };
+	if (n == 0)
+		return value;
+	return { { value.words[0] << n | value.words[1] >> (64 - n), value.words[1] << n } };
+}
+
+//Palette indices of 8 pixels, one byte lane per pixel
+typedef unsigned long long IndexVector;
+
+static inline IndexVector indexOr(IndexVector a, IndexVector b) { return a | b; }
+
+//Lanes of every sprite byte
+struct PixelLanes {
+	unsigned long long lanes[256];
+
+	PixelLanes() {
+		for (unsigned int pixels = 0; pixels < 256; ++pixels) {
+			lanes[pixels] = 0;
+			for (int i = 0; i < 8; ++i) {
+				//Little endian: the leftmost pixel goes to the lowest byte
+				lanes[pixels] |= (unsigned long long)(pixels >> (7 - i) & 1) << (i * 8);
+			}
+		}
+	}
+};
+static const PixelLanes s_lanes;
+
+static inline IndexVector expandPlane(unsigned int pixels, int plane) {
+	return s_lanes.lanes[pixels] << plane;
+}
+
+static inline void storeIndices(unsigned char* indices, IndexVector value) {
+	std::memcpy(indices, &value, sizeof(value));
+}
+
+static const int COMPOSE_PIXELS = 8;
+#endif
+
+Display::Display() {
+	m_planes = 1;
+	setHires(false);
+}
+
+void Display::clear() {
+	for (int plane = 0; plane < PLANES; ++plane) {
+		if (m_planes & (1u << plane))
+			std::memset(m_rows[plane], 0, sizeof(m_rows[plane]));
+	}
+}
+
+void Display::setHires(bool hires) {
+	m_hires = hires;
+	m_mask.words[0] = ~0ULL;
+	m_mask.words[1] = hires ? ~0ULL : 0;
+	std::memset(m_rows, 0, sizeof(m_rows));
+}
+
+unsigned char Display::GetPixel(int x, int y) const {
+	unsigned char index = 0;
+	for (int plane = 0; plane < PLANES; ++plane) {
+		index |= (m_rows[plane][y].words[x >> 6] >> (63 - (x & 63)) & 1) << plane;
+	}
+	return index;
+}
+
+bool Display::drawRow(int plane, int x, int y, unsigned int bits, int width, bool wrap) {
+	const RowVector start = firstWord((unsigned long long)bits << (64 - width));
+
+	RowVector pixels = rowAnd(shiftRight(start, x), load(m_mask));
+	//The part that went past the right edge comes back at column 0
+	if (wrap && x > GetWidth() - width)
+		pixels = rowOr(pixels, shiftLeft(start, GetWidth() - x));
+
+	Row& row = m_rows[plane][y];
+	const RowVector target = load(row);
+	store(row, rowXor(target, pixels));
+	return !isZero(rowAnd(target, pixels));
+}
+
+void Display::scrollDown(int rows) {
+	const int height = GetHeight();
+	if (rows > height)
+		rows = height;
+
+	for (int plane = 0; plane < PLANES; ++plane) {
+		if ((m_planes & (1u << plane)) == 0)
+			continue;
+
+		std::memmove(m_rows[plane] + rows, m_rows[plane], (height - rows) * sizeof(Row));
+		std::memset(m_rows[plane], 0, rows * sizeof(Row));
+	}
+}
+
+void Display::scrollUp(int rows) {
+	const int height = GetHeight();
+	if (rows > height)
+		rows = height;
+
+	for (int plane = 0; plane < PLANES; ++plane) {
+		if ((m_planes & (1u << plane)) == 0)
+			continue;
+
+		std::memmove(m_rows[plane], m_rows[plane] + rows, (height - rows) * sizeof(Row));
+		std::memset(m_rows[plane] + height - rows, 0, rows * sizeof(Row));
+	}
+}
+
+void Display::scrollRight(int pixels) {
+	const RowVector mask = load(m_mask);
+	for (int plane = 0; plane < PLANES; ++plane) {
+		if ((m_planes & (1u << plane)) == 0)
+			continue;
+
+		for (int y = 0; y < GetHeight(); ++y) {
+			store(m_rows[plane][y], rowAnd(shiftRight(load(m_rows[plane][y]), pixels), mask));
+		}
+	}
+}
+
+void Display::scrollLeft(int pixels) {
+	for (int plane = 0; plane < PLANES; ++plane) {
+		if ((m_planes & (1u << plane)) == 0)
+			continue;
+
+		for (int y = 0; y < GetHeight(); ++y) {
+			store(m_rows[plane][y], shiftLeft(load(m_rows[plane][y]), pixels));
+		}
+	}
+}
+
+void Display::compose(unsigned char* indices) const {
+	const int width = GetWidth();
+	const int bytes = COMPOSE_PIXELS / 8;
+
+	for (int y = 0; y < GetHeight(); ++y) {
+		for (int x = 0; x < width; x += COMPOSE_PIXELS) {
+			//Sprite-order bytes of the group from every plane, ORed together lane by lane
+			IndexVector value = expandPlane(0, 0);
+			for (int plane = 0; plane < PLANES; ++plane) {
+				const unsigned long long word = m_rows[plane][y].words[x >> 6];
+				unsigned int pixels = 0;
+				for (int byte = 0; byte < bytes; ++byte) {
+					pixels |= (unsigned int)(word >> (56 - (x & 63) - byte * 8) & 0xFF) << (byte * 8);
+				}
+				value = indexOr(value, expandPlane(pixels, plane));
+			}
+			storeIndices(indices + y * width + x, value);
+		}
+	}
+}
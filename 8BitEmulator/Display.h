@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+Chip-8 display as packed rows of 128 pixels, one bit per pixel: 64x32 in the original low resolution, 128x64 in the
+SUPER-CHIP high resolution (00FF/00FE). Row words hold the pixels left to right starting at the most significant bit
+(the order sprite bytes are stored in), pixel 0-63 in words[0] and 64-127 in words[1]. Low resolution only uses the
+first 32 rows and words[0].
+Sprite blits and scrolls shift whole rows at once (SSE2 when the target has it), so drawing a 16 pixel wide sprite
+row or scrolling the full hi-res screen costs about as much as a single byte-per-pixel store did before.
+
+XO-CHIP draws on bitplanes (FN01 selects them), each kept as its own set of rows. Clears, scrolls and sprites only
+touch the selected planes, a pixel's color is the palette index made of its bits in every plane (plane 0 is bit 0).
+XO-CHIP defines two planes, the other two are the 16 color extension some interpreters offer. Everything but XO-CHIP
+leaves plane 0 selected and the others clear.
+*/
+class Display {
+public:
+
+	static const int WIDTH = 128;
+	static const int HEIGHT = 64;
+	static const int PLANES = 4;
+
+	struct alignas(16) Row {
+		unsigned long long words[2];
+	};
+
+	Display();
+
+	//Clears every pixel of the selected planes, the resolution stays
+	void clear();
+	//Switches resolution (00FF/00FE) and clears all planes like modern SUPER-CHIP interpreters do
+	void setHires(bool hires);
+	bool IsHires() const { return m_hires; }
+	int GetWidth() const { return m_hires ? WIDTH : WIDTH / 2; }
+	int GetHeight() const { return m_hires ? HEIGHT : HEIGHT / 2; }
+
+	//Planes the drawing instructions work on, bit per plane (FN01)
+	void setPlanes(unsigned int planes) { m_planes = planes & ((1u << PLANES) - 1); }
+	unsigned int GetPlanes() const { return m_planes; }
+
+	//Palette index of the pixel
+	unsigned char GetPixel(int x, int y) const;
+	const Row& GetRow(int plane, int y) const { return m_rows[plane][y]; }
+	//All HEIGHT rows of the plane (the ones low resolution doesn't use stay clear), used for hashing and comparing
+	const Row* GetRows(int plane) const { return m_rows[plane]; }
+
+	//XORs a sprite row of up to 16 pixels (bits read from the most significant one down) onto row y of the plane
+	//starting at column x, both on screen. Pixels leaving the right edge wrap around or are clipped. Returns true if
+	//a set pixel was cleared
+	bool drawRow(int plane, int x, int y, unsigned int bits, int width, bool wrap);
+
+	//00CN, 00DN, 00FB and 00FC on the selected planes: pixels scrolled off the screen are lost, the gap is cleared
+	void scrollDown(int rows);
+	void scrollUp(int rows);
+	void scrollRight(int pixels);
+	void scrollLeft(int pixels);
+
+	//Writes the palette index of every pixel of the current resolution, row by row (GetWidth() * GetHeight() bytes).
+	//Meant to be called once per presented frame
+	void compose(unsigned char* indices) const;
+
+private:
+	bool m_hires;
+	unsigned int m_planes;
+	//Pixels of the current resolution, ANDed after every shift so nothing is left outside the screen
+	Row m_mask;
+	Row m_rows[PLANES][HEIGHT];
+};
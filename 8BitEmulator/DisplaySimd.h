@@ -0,0 +1,8 @@
+#pragma once
+
+//Defines DISPLAY_SSE2 where the display and renderer kernels can use SSE2: always on x86-64, on 32 bit x86 only if the
+//compiler targets it (/arch:SSE2, -msse2). Everything else builds the scalar kernels
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DISPLAY_SSE2
+#include <emmintrin.h>
+#endif
@@ -0,0 +1,204 @@
+#include "EventLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.h"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Entry {
+		EventLog::Event event;
+		unsigned short pc;
+		unsigned short opcode;
+		unsigned long long cycle;
+		//How often the event happened
+		unsigned long long count;
+		//Set for the repeat count of an event that was already written
+		bool repeat;
+		//Events the rate limit swallowed before this one
+		unsigned long long dropped;
+	};
+
+	//Per thread state, only the owning thread touches anything but the ring
+	struct Producer {
+		Producer() : ring(1024), pending(false), tokens(0.0), dropped(0), lastRefill(Clock::now()), lastFlush(Clock::now()) {}
+
+		SpscRing<Entry> ring;
+
+		//Last event, held back while identical events keep coming
+		Entry last;
+		bool pending;
+
+		double tokens;
+		unsigned long long dropped;
+		Clock::time_point lastRefill;
+		Clock::time_point lastFlush;
+	};
+
+	std::mutex registryMutex;
+	std::vector<std::shared_ptr<Producer>> producers;
+
+	std::atomic<unsigned int> rateLimit(100);
+	std::atomic<bool> running(false);
+	std::thread sinkThread;
+	FILE* sinkFile = nullptr;
+
+	thread_local std::shared_ptr<Producer> localProducer;
+
+	Producer& producer() {
+		if (!localProducer) {
+			localProducer = std::make_shared<Producer>();
+			localProducer->tokens = rateLimit;
+
+			std::lock_guard<std::mutex> lock(registryMutex);
+			producers.push_back(localProducer);
+		}
+		return *localProducer;
+	}
+
+	void push(Producer& producer, const Entry& entry) {
+		//A full ring means the sink can't keep up, losing the event is better than stalling the core
+		if (!producer.ring.tryPush(entry))
+			producer.dropped += entry.count;
+	}
+
+	//Sends the held back event with its repeat count
+	void flushPending(Producer& producer) {
+		if (!producer.pending || producer.last.count == 0)
+			return;
+
+		Entry repeat = producer.last;
+		repeat.repeat = true;
+		push(producer, repeat);
+		producer.last.count = 0;
+		producer.lastFlush = Clock::now();
+	}
+
+	const char* eventName(EventLog::Event event) {
+		static const char* names[EventLog::EVENT_COUNT] = { "beep", "illegal opcode", "halted" };
+		return names[event];
+	}
+
+	void write(const Entry& entry) {
+		if (entry.dropped > 0)
+			std::fprintf(sinkFile, "[chip8] %llu events dropped by the rate limit\n", entry.dropped);
+
+		std::fprintf(sinkFile, "[chip8] cycle %llu: %s (opcode %04X at %03X)", entry.cycle, eventName(entry.event), entry.opcode, entry.pc);
+		if (entry.repeat)
+			std::fprintf(sinkFile, " repeated %llu more times", entry.count);
+		std::fprintf(sinkFile, "\n");
+	}
+
+	//Drains all rings, returns false if there was nothing to write
+	bool drain() {
+		std::vector<std::shared_ptr<Producer>> snapshot;
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			snapshot = producers;
+		}
+
+		bool written = false;
+		Entry entry;
+		for (const auto& producer : snapshot) {
+			while (producer->ring.tryPop(entry)) {
+				write(entry);
+				written = true;
+			}
+		}
+		snapshot.clear();
+
+		if (written)
+			std::fflush(sinkFile);
+
+		//Forget threads that are gone (only the registry holds them) and have nothing left to write
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (size_t i = 0; i < producers.size();) {
+			if (producers[i].use_count() == 1 && producers[i]->ring.size() == 0) {
+				producers.erase(producers.begin() + i);
+				continue;
+			}
+			++i;
+		}
+
+		return written;
+	}
+
+	void sinkLoop() {
+		while (running.load(std::memory_order_acquire)) {
+			if (!drain())
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		drain();
+	}
+}
+
+namespace EventLog {
+
+	void post(Event event, unsigned short pc, unsigned short opcode, unsigned long long cycle) {
+		Producer& state = producer();
+
+		//Same event as last time: only count it, but let the count through about once a second
+		if (state.pending && state.last.event == event && state.last.pc == pc && state.last.opcode == opcode) {
+			++state.last.count;
+			state.last.cycle = cycle;
+			if ((state.last.count & 0x3FF) == 0 && Clock::now() - state.lastFlush >= std::chrono::seconds(1))
+				flushPending(state);
+			return;
+		}
+
+		flushPending(state);
+
+		//Token bucket
+		Clock::time_point now = Clock::now();
+		state.tokens = std::min<double>(rateLimit, state.tokens + std::chrono::duration<double>(now - state.lastRefill).count() * rateLimit);
+		state.lastRefill = now;
+
+		if (state.tokens < 1.0) {
+			++state.dropped;
+			state.pending = false;
+			return;
+		}
+		state.tokens -= 1.0;
+
+		Entry entry = { event, pc, opcode, cycle, 1, false, state.dropped };
+		state.dropped = 0;
+		push(state, entry);
+
+		state.last = entry;
+		state.last.count = 0;
+		state.last.dropped = 0;
+		state.pending = true;
+		state.lastFlush = now;
+	}
+
+	void start(FILE* sink) {
+		stop();
+
+		sinkFile = sink;
+		running = true;
+		sinkThread = std::thread(sinkLoop);
+	}
+
+	void stop() {
+		//Repeats the calling thread is still holding back
+		if (localProducer)
+			flushPending(*localProducer);
+
+		if (!running.exchange(false))
+			return;
+
+		sinkThread.join();
+	}
+
+	void setRateLimit(unsigned int eventsPerSecond) {
+		rateLimit = eventsPerSecond;
+	}
+}
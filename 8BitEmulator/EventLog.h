@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdio>
+
+/*
+Non-blocking log for events raised by the core (beeps, illegal opcodes, ...).
+post() never does I/O: every emulation thread owns a lock-free ring the event is copied into, a background
+sink thread formats and writes them. Identical consecutive events are merged into one line with a repeat count
+and each thread may only post a limited number of events per second, the rest is counted as dropped.
+Without a running sink events are queued until the ring is full and dropped afterwards.
+*/
+namespace EventLog {
+
+	enum Event {
+		EVENT_BEEP = 0,
+		EVENT_ILLEGAL_OPCODE,
+		EVENT_HALTED,
+		EVENT_COUNT
+	};
+
+	void post(Event event, unsigned short pc, unsigned short opcode, unsigned long long cycle);
+
+	//Starts the background sink writing to the file (stderr by default)
+	void start(FILE* sink = stderr);
+	//Writes everything still queued and stops the sink
+	void stop();
+
+	//Events per second and thread that get through before the rate limit kicks in
+	void setRateLimit(unsigned int eventsPerSecond);
+}
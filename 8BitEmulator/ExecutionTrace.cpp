@@ -0,0 +1,339 @@
+#include "ExecutionTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+	const unsigned int traceVersion = 1;
+	const unsigned int recordsPerBlock = 4096;
+	//Block header: byte size, record count, first cycle
+	const size_t blockHeaderSize = 4 + 4 + 8;
+	//Cycle delta (up to 10 bytes as varint), pc delta (3), opcode (2), register and value (2)
+	const size_t maxRecordSize = 10 + 3 + 2 + 2;
+
+	//64 bit file offsets, long is 32 bits on Windows and traces grow past 2 GB
+	long long tellFile(FILE* file) {
+#ifdef _WIN32
+		return _ftelli64(file);
+#else
+		return (long long)ftello(file);
+#endif
+	}
+
+	bool seekFile(FILE* file, long long offset, int origin) {
+#ifdef _WIN32
+		return _fseeki64(file, offset, origin) == 0;
+#else
+		return fseeko(file, (off_t)offset, origin) == 0;
+#endif
+	}
+
+	void putU32(std::vector<unsigned char>& out, unsigned int value) {
+		for (int i = 0; i < 4; ++i) {
+			out.push_back((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	void putU64(std::vector<unsigned char>& out, unsigned long long value) {
+		for (int i = 0; i < 8; ++i) {
+			out.push_back((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	//Writes at out and returns the position after the value
+	unsigned char* putVarint(unsigned char* out, unsigned long long value) {
+		while (value >= 0x80) {
+			*out++ = (unsigned char)(value | 0x80);
+			value >>= 7;
+		}
+		*out++ = (unsigned char)value;
+		return out;
+	}
+
+	unsigned long long getU(const unsigned char* data, int bytes) {
+		unsigned long long value = 0;
+		for (int i = 0; i < bytes; ++i) {
+			value |= (unsigned long long)data[i] << (8 * i);
+		}
+		return value;
+	}
+
+	bool getVarint(const std::vector<unsigned char>& data, size_t& position, unsigned long long& value) {
+		value = 0;
+		for (int shift = 0; shift < 64 && position < data.size(); shift += 7) {
+			unsigned char byte = data[position++];
+			value |= (unsigned long long)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	//Program counter deltas are signed, zigzag keeps small negative jumps small
+	unsigned int zigzag(int value) {
+		return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+	}
+
+	int unzigzag(unsigned int value) {
+		return (int)(value >> 1) ^ -(int)(value & 1);
+	}
+
+	//Most instructions are followed by the one at pc + 2, that is what the delta is taken against
+	const unsigned short blockStartPc = 0x200 - 2;
+}
+
+TraceWriter::TraceWriter() : m_ring(RING_SIZE), m_stop(false), m_dropped(0), m_file(nullptr), m_blockSize(0), m_blockRecords(0), m_blockCycle(0), m_lastCycle(0), m_lastPc(blockStartPc) {
+}
+
+TraceWriter::~TraceWriter() {
+	close();
+}
+
+bool TraceWriter::open(const char* path) {
+	close();
+
+	m_file = std::fopen(path, "wb");
+	if (!m_file)
+		return false;
+
+	std::vector<unsigned char> header = { 'C', '8', 'T', 'R' };
+	putU32(header, traceVersion);
+	std::fwrite(header.data(), 1, header.size(), m_file);
+
+	m_index.clear();
+	m_block.resize(recordsPerBlock * maxRecordSize);
+	m_blockSize = 0;
+	m_blockRecords = 0;
+	m_dropped = 0;
+	m_stop = false;
+	m_thread = std::thread(&TraceWriter::writerLoop, this);
+	return true;
+}
+
+bool TraceWriter::isOpen() const {
+	return m_file != nullptr;
+}
+
+void TraceWriter::close() {
+	if (!m_file)
+		return;
+
+	m_stop = true;
+	m_thread.join();
+
+	flushBlock();
+
+	std::vector<unsigned char> footer;
+	long long indexOffset = tellFile(m_file);
+	for (unsigned long long value : m_index) {
+		putU64(footer, value);
+	}
+	putU64(footer, (unsigned long long)indexOffset);
+	putU32(footer, (unsigned int)(m_index.size() / 2));
+	footer.insert(footer.end(), { 'C', '8', 'T', 'I' });
+	std::fwrite(footer.data(), 1, footer.size(), m_file);
+
+	std::fclose(m_file);
+	m_file = nullptr;
+}
+
+void TraceWriter::writerLoop() {
+	std::vector<TraceRecord> records(1024);
+
+	for (;;) {
+		bool drained = true;
+		while (size_t count = m_ring.tryPop(records.data(), records.size())) {
+			for (size_t i = 0; i < count; ++i) {
+				encode(records[i]);
+			}
+			drained = false;
+		}
+
+		if (drained) {
+			//Only stop once the emulation thread can't add anything anymore
+			if (m_stop.load(std::memory_order_acquire) && m_ring.size() == 0)
+				break;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	}
+}
+
+void TraceWriter::encode(const TraceRecord& record) {
+	if (m_blockRecords == 0) {
+		m_blockCycle = record.cycle;
+		m_lastCycle = record.cycle;
+		m_lastPc = blockStartPc;
+	}
+
+	unsigned char* out = m_block.data() + m_blockSize;
+	out = putVarint(out, record.cycle - m_lastCycle);
+	out = putVarint(out, zigzag((short)(record.pc - (unsigned short)(m_lastPc + 2))));
+	*out++ = record.opcode >> 8;
+	*out++ = record.opcode & 0xFF;
+	*out++ = record.reg;
+	if (record.reg != TraceRecord::NO_REGISTER)
+		*out++ = record.value;
+	m_blockSize = out - m_block.data();
+
+	m_lastCycle = record.cycle;
+	m_lastPc = record.pc;
+
+	if (++m_blockRecords == recordsPerBlock)
+		flushBlock();
+}
+
+void TraceWriter::flushBlock() {
+	if (m_blockRecords == 0)
+		return;
+
+	m_index.push_back(m_blockCycle);
+	m_index.push_back((unsigned long long)tellFile(m_file));
+
+	std::vector<unsigned char> header;
+	putU32(header, (unsigned int)m_blockSize);
+	putU32(header, m_blockRecords);
+	putU64(header, m_blockCycle);
+	std::fwrite(header.data(), 1, header.size(), m_file);
+	std::fwrite(m_block.data(), 1, m_blockSize, m_file);
+
+	m_blockSize = 0;
+	m_blockRecords = 0;
+}
+
+TraceReader::TraceReader() : m_file(nullptr), m_block(0), m_position(0), m_remaining(0), m_lastCycle(0), m_lastPc(blockStartPc) {
+}
+
+TraceReader::~TraceReader() {
+	close();
+}
+
+void TraceReader::close() {
+	if (m_file)
+		std::fclose(m_file);
+	m_file = nullptr;
+	m_blockCycles.clear();
+	m_blockOffsets.clear();
+	m_remaining = 0;
+}
+
+bool TraceReader::open(const char* path) {
+	close();
+
+	m_file = std::fopen(path, "rb");
+	if (!m_file)
+		return false;
+
+	unsigned char header[8];
+	unsigned char footer[16];
+	if (std::fread(header, 1, sizeof(header), m_file) != sizeof(header) || std::memcmp(header, "C8TR", 4) != 0
+		|| getU(header + 4, 4) != traceVersion
+		|| !seekFile(m_file, -(long long)sizeof(footer), SEEK_END)
+		|| std::fread(footer, 1, sizeof(footer), m_file) != sizeof(footer) || std::memcmp(footer + 12, "C8TI", 4) != 0) {
+		close();
+		return false;
+	}
+
+	unsigned long long indexOffset = getU(footer, 8);
+	unsigned int blocks = (unsigned int)getU(footer + 8, 4);
+
+	std::vector<unsigned char> index(blocks * 16);
+	if (!seekFile(m_file, (long long)indexOffset, SEEK_SET) || std::fread(index.data(), 1, index.size(), m_file) != index.size()) {
+		close();
+		return false;
+	}
+
+	for (unsigned int i = 0; i < blocks; ++i) {
+		m_blockCycles.push_back(getU(&index[i * 16], 8));
+		m_blockOffsets.push_back(getU(&index[i * 16 + 8], 8));
+	}
+
+	return loadBlock(0) || blocks == 0;
+}
+
+bool TraceReader::loadBlock(size_t block) {
+	m_remaining = 0;
+	if (block >= m_blockOffsets.size())
+		return false;
+
+	unsigned char header[blockHeaderSize];
+	if (!seekFile(m_file, (long long)m_blockOffsets[block], SEEK_SET) || std::fread(header, 1, sizeof(header), m_file) != sizeof(header))
+		return false;
+
+	m_data.resize((size_t)getU(header, 4));
+	if (std::fread(m_data.data(), 1, m_data.size(), m_file) != m_data.size())
+		return false;
+
+	m_block = block;
+	m_position = 0;
+	m_remaining = (unsigned int)getU(header + 4, 4);
+	m_lastCycle = getU(header + 8, 8);
+	m_lastPc = blockStartPc;
+	return true;
+}
+
+bool TraceReader::seek(unsigned long long cycle) {
+	if (m_blockCycles.empty())
+		return false;
+
+	//Last block that starts at or before the cycle
+	auto it = std::upper_bound(m_blockCycles.begin(), m_blockCycles.end(), cycle);
+	size_t block = it == m_blockCycles.begin() ? 0 : (size_t)(it - m_blockCycles.begin()) - 1;
+
+	if (!loadBlock(block))
+		return false;
+
+	//Decode up to the record, then step back by restoring the decoder state
+	for (;;) {
+		size_t position = m_position;
+		unsigned int remaining = m_remaining;
+		size_t current = m_block;
+		unsigned long long lastCycle = m_lastCycle;
+		unsigned short lastPc = m_lastPc;
+
+		TraceRecord record;
+		if (!next(record))
+			return false;
+
+		if (record.cycle >= cycle) {
+			if (m_block != current && !loadBlock(current))
+				return false;
+			m_position = position;
+			m_remaining = remaining;
+			m_lastCycle = lastCycle;
+			m_lastPc = lastPc;
+			return true;
+		}
+	}
+}
+
+bool TraceReader::next(TraceRecord& record) {
+	while (m_remaining == 0) {
+		if (!loadBlock(m_block + 1))
+			return false;
+	}
+
+	unsigned long long cycleDelta;
+	unsigned long long pcDelta;
+	if (!getVarint(m_data, m_position, cycleDelta) || !getVarint(m_data, m_position, pcDelta) || m_position + 3 > m_data.size())
+		return false;
+
+	record.cycle = m_lastCycle + cycleDelta;
+	record.pc = (unsigned short)(m_lastPc + 2 + unzigzag((unsigned int)pcDelta));
+	record.opcode = (unsigned short)(m_data[m_position] << 8 | m_data[m_position + 1]);
+	record.reg = m_data[m_position + 2];
+	m_position += 3;
+
+	record.value = 0;
+	if (record.reg != TraceRecord::NO_REGISTER) {
+		if (m_position >= m_data.size())
+			return false;
+		record.value = m_data[m_position++];
+	}
+
+	m_lastCycle = record.cycle;
+	m_lastPc = record.pc;
+	--m_remaining;
+	return true;
+}
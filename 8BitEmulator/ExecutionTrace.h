@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.h"
+
+//One executed instruction. reg is the first V register the instruction changed (NO_REGISTER if none)
+struct TraceRecord {
+	static const unsigned char NO_REGISTER = 0xFF;
+
+	unsigned long long cycle;
+	unsigned short pc;
+	unsigned short opcode;
+	unsigned char reg;
+	unsigned char value;
+};
+
+/*
+Streams trace records to a file.
+The emulation thread only copies the record into a ring buffer, a background thread delta-encodes the records
+into blocks and writes them. If the writer falls a full ring behind (the disk can't keep up) records are dropped
+rather than making the emulation wait, the trace then has gaps (GetDropped).
+Every block starts at a known cycle, the block index is appended when the trace is closed so TraceReader can seek
+without decoding the whole file.
+
+File layout:
+	header:  "C8TR" + version (u32)
+	blocks:  byte size (u32), record count (u32), cycle of the first record (u64), encoded records
+	index:   per block: first cycle (u64), file offset (u64)
+	footer:  index offset (u64), block count (u32), "C8TI"
+All values are little endian.
+*/
+class TraceWriter {
+public:
+
+	//Records the ring holds
+	static const size_t RING_SIZE = 1 << 16;
+
+	TraceWriter();
+	~TraceWriter();
+
+	TraceWriter(const TraceWriter&) = delete;
+	TraceWriter& operator=(const TraceWriter&) = delete;
+
+	bool open(const char* path);
+	//Writes everything that is still queued and the index
+	void close();
+	bool isOpen() const;
+
+	//Called by the emulation thread, never waits
+	void record(const TraceRecord& record) {
+		if (!m_ring.tryPush(record))
+			++m_dropped;
+	}
+
+	//Records lost because the writer thread was a full ring behind
+	unsigned long long GetDropped() const { return m_dropped; }
+	//Emulation thread: records that fit before the next one would be dropped (at least, the writer may have freed more).
+	//Callers that would rather wait than lose records (offline recording) run batches that fit
+	size_t GetFree() const { return m_ring.capacity() - m_ring.size(); }
+
+private:
+	void writerLoop();
+	void encode(const TraceRecord& record);
+	void flushBlock();
+
+	SpscRing<TraceRecord> m_ring;
+	std::thread m_thread;
+	std::atomic<bool> m_stop;
+	unsigned long long m_dropped;
+
+	//Only used by the writer thread
+	FILE* m_file;
+	std::vector<unsigned char> m_block;
+	size_t m_blockSize;
+	unsigned int m_blockRecords;
+	unsigned long long m_blockCycle;
+	unsigned long long m_lastCycle;
+	unsigned short m_lastPc;
+	//First cycle and file offset of every block written so far
+	std::vector<unsigned long long> m_index;
+};
+
+//Reads files written by TraceWriter
+class TraceReader {
+public:
+
+	TraceReader();
+	~TraceReader();
+
+	TraceReader(const TraceReader&) = delete;
+	TraceReader& operator=(const TraceReader&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	//Positions the reader on the first record at or after the cycle
+	bool seek(unsigned long long cycle);
+	//Returns false at the end of the trace
+	bool next(TraceRecord& record);
+
+	size_t GetBlockCount() const { return m_blockCycles.size(); }
+
+private:
+	bool loadBlock(size_t block);
+
+	FILE* m_file;
+	std::vector<unsigned long long> m_blockCycles;
+	std::vector<unsigned long long> m_blockOffsets;
+
+	//Currently decoded block
+	size_t m_block;
+	std::vector<unsigned char> m_data;
+	size_t m_position;
+	unsigned int m_remaining;
+	unsigned long long m_lastCycle;
+	unsigned short m_lastPc;
+};
@@ -0,0 +1,254 @@
+#include "FrameCapture.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+	const unsigned int captureVersion = 1;
+	const unsigned char kindDelta = 0;
+	const unsigned char kindKeyframe = 1;
+	//Zero runs shorter than this stay inside the literals, a token pair costs at least two bytes
+	const size_t minZeroRun = 3;
+	//Every token pair costs up to 6 bytes of varints, there are at most BYTES / minZeroRun + 1 of them
+	const size_t maxPayloadSize = CaptureFrame::BYTES + (CaptureFrame::BYTES / minZeroRun + 1) * 6;
+
+	unsigned char* putVarint(unsigned char* out, unsigned long long value) {
+		while (value >= 0x80) {
+			*out++ = (unsigned char)(value | 0x80);
+			value >>= 7;
+		}
+		*out++ = (unsigned char)value;
+		return out;
+	}
+
+	bool readVarint(FILE* file, unsigned long long& value) {
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			const int byte = std::fgetc(file);
+			if (byte == EOF)
+				return false;
+			value |= (unsigned long long)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	bool getVarint(const std::vector<unsigned char>& data, size_t& position, unsigned long long& value) {
+		value = 0;
+		for (int shift = 0; shift < 64 && position < data.size(); shift += 7) {
+			unsigned char byte = data[position++];
+			value |= (unsigned long long)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+CaptureWriter::CaptureWriter() : m_ring(256), m_stop(false), m_dropped(0), m_file(nullptr), m_size(0), m_records(0), m_lastFrame(0),
+	m_lastHires(false) {
+}
+
+CaptureWriter::~CaptureWriter() {
+	close();
+}
+
+bool CaptureWriter::open(const char* path) {
+	close();
+
+	m_file = std::fopen(path, "wb");
+	if (!m_file)
+		return false;
+
+	const unsigned char header[8] = { 'C', '8', 'C', 'V', captureVersion & 0xFF, captureVersion >> 8 & 0xFF,
+		captureVersion >> 16 & 0xFF, captureVersion >> 24 };
+	std::fwrite(header, 1, sizeof(header), m_file);
+
+	m_size = sizeof(header);
+	m_records = 0;
+	m_lastFrame = 0;
+	m_lastHires = false;
+	m_previous.assign(CaptureFrame::BYTES, 0);
+	m_payload.resize(maxPayloadSize);
+	m_dropped = 0;
+	m_stop = false;
+	m_thread = std::thread(&CaptureWriter::writerLoop, this);
+	return true;
+}
+
+void CaptureWriter::close() {
+	if (!m_file)
+		return;
+
+	m_stop = true;
+	m_thread.join();
+
+	std::fclose(m_file);
+	m_file = nullptr;
+}
+
+void CaptureWriter::writerLoop() {
+	//Frames are big, they are encoded one at a time straight from a local copy
+	CaptureFrame frame;
+
+	for (;;) {
+		bool drained = true;
+		while (m_ring.tryPop(frame)) {
+			encode(frame);
+			drained = false;
+		}
+
+		if (drained) {
+			//Only stop once the emulation thread can't add anything anymore
+			if (m_stop.load(std::memory_order_acquire) && m_ring.size() == 0)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	}
+}
+
+void CaptureWriter::encode(const CaptureFrame& frame) {
+	const bool keyframe = m_records % KEYFRAME_INTERVAL == 0;
+	if (keyframe)
+		std::fill(m_previous.begin(), m_previous.end(), 0);
+
+	//XOR against the last frame in place, m_previous becomes this frame. Whole words, the rows are 16 byte aligned
+	unsigned long long* words = reinterpret_cast<unsigned long long*>(m_previous.data());
+	const unsigned long long* rowWords = reinterpret_cast<const unsigned long long*>(frame.rows);
+	unsigned long long changed = 0;
+	for (size_t i = 0; i < CaptureFrame::BYTES / 8; ++i) {
+		words[i] ^= rowWords[i];
+		changed |= words[i];
+	}
+
+	//A frame drawn without changing anything needs no record, the next one's frame delta covers it. A resolution
+	//switch on an unchanged (usually blank) screen still gets one
+	const unsigned char* rows = reinterpret_cast<const unsigned char*>(frame.rows);
+	if (!keyframe && changed == 0 && frame.hires == m_lastHires) {
+		std::memcpy(m_previous.data(), rows, CaptureFrame::BYTES);
+		return;
+	}
+
+	unsigned char* screen = m_previous.data();
+	unsigned char* out = m_payload.data();
+	size_t position = 0;
+	while (position < CaptureFrame::BYTES) {
+		//Zero runs are mostly long, they are skipped a word at a time
+		const size_t zeroStart = position;
+		while (position < CaptureFrame::BYTES && screen[position] == 0) {
+			++position;
+			while (position % 8 == 0 && position < CaptureFrame::BYTES && words[position / 8] == 0) {
+				position += 8;
+			}
+		}
+
+		//Literals run until the next zero run worth a token of its own
+		const size_t literalStart = position;
+		size_t zeros = 0;
+		while (position < CaptureFrame::BYTES && zeros < minZeroRun) {
+			zeros = screen[position] == 0 ? zeros + 1 : 0;
+			++position;
+		}
+		if (zeros == minZeroRun)
+			position -= zeros;
+
+		out = putVarint(out, literalStart - zeroStart);
+		out = putVarint(out, position - literalStart);
+		std::memcpy(out, screen + literalStart, position - literalStart);
+		out += position - literalStart;
+	}
+	const size_t payloadSize = out - m_payload.data();
+
+	unsigned char header[2 + 10 + 10];
+	unsigned char* end = header;
+	*end++ = keyframe ? kindKeyframe : kindDelta;
+	*end++ = frame.hires ? 1 : 0;
+	end = putVarint(end, m_records == 0 ? frame.frame : frame.frame - m_lastFrame);
+	end = putVarint(end, payloadSize);
+	std::fwrite(header, 1, end - header, m_file);
+	std::fwrite(m_payload.data(), 1, payloadSize, m_file);
+
+	std::memcpy(screen, rows, CaptureFrame::BYTES);
+	m_lastFrame = frame.frame;
+	m_lastHires = frame.hires;
+	++m_records;
+	m_size += (end - header) + payloadSize;
+}
+
+CaptureReader::CaptureReader() : m_file(nullptr), m_records(0), m_lastFrame(0) {
+}
+
+CaptureReader::~CaptureReader() {
+	close();
+}
+
+bool CaptureReader::open(const char* path) {
+	close();
+
+	m_file = std::fopen(path, "rb");
+	if (!m_file)
+		return false;
+
+	unsigned char header[8];
+	if (std::fread(header, 1, sizeof(header), m_file) != sizeof(header) || std::memcmp(header, "C8CV", 4) != 0 ||
+		(header[4] | header[5] << 8 | header[6] << 16 | (unsigned int)header[7] << 24) != captureVersion) {
+		close();
+		return false;
+	}
+
+	m_records = 0;
+	m_lastFrame = 0;
+	m_screen.assign(CaptureFrame::BYTES, 0);
+	return true;
+}
+
+void CaptureReader::close() {
+	if (m_file)
+		std::fclose(m_file);
+	m_file = nullptr;
+}
+
+bool CaptureReader::next(CaptureFrame& frame) {
+	if (!m_file)
+		return false;
+
+	const int kind = std::fgetc(m_file);
+	const int hires = std::fgetc(m_file);
+	unsigned long long delta = 0;
+	unsigned long long payloadSize = 0;
+	if (kind == EOF || hires == EOF || !readVarint(m_file, delta) || !readVarint(m_file, payloadSize) || payloadSize > maxPayloadSize)
+		return false;
+
+	m_payload.resize((size_t)payloadSize);
+	if (std::fread(m_payload.data(), 1, m_payload.size(), m_file) != m_payload.size())
+		return false;
+
+	if (kind == kindKeyframe)
+		std::fill(m_screen.begin(), m_screen.end(), 0);
+
+	size_t position = 0;
+	size_t offset = 0;
+	while (position < m_payload.size()) {
+		unsigned long long zeros = 0;
+		unsigned long long literals = 0;
+		if (!getVarint(m_payload, position, zeros) || !getVarint(m_payload, position, literals))
+			return false;
+		if (offset + zeros + literals > CaptureFrame::BYTES || position + literals > m_payload.size())
+			return false;
+
+		offset += (size_t)zeros;
+		for (size_t i = 0; i < literals; ++i) {
+			m_screen[offset++] ^= m_payload[position++];
+		}
+	}
+
+	frame.frame = m_records == 0 ? delta : m_lastFrame + delta;
+	frame.hires = hires != 0;
+	std::memcpy(frame.rows, m_screen.data(), CaptureFrame::BYTES);
+
+	m_lastFrame = frame.frame;
+	++m_records;
+	return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "Display.h"
+#include "SpscRing.h"
+
+//One captured screen: the packed rows of every bitplane as Display keeps them
+struct CaptureFrame {
+	static const size_t BYTES = sizeof(Display::Row) * Display::PLANES * Display::HEIGHT;
+
+	//Frame number, counted by whoever captures (60 per second)
+	unsigned long long frame;
+	bool hires;
+	Display::Row rows[Display::PLANES][Display::HEIGHT];
+};
+
+/*
+Records the screen losslessly into a compact file.
+The emulation thread only copies the packed rows (4 KB) into a ring buffer, a background thread XORs every frame
+with the one before and run-length encodes the result: unchanged bytes cost nothing but the length of their run, an
+unchanged screen costs nothing. If the writer falls a full ring behind, frames are dropped rather than making the
+emulation wait (GetDropped). The next frame is still encoded against the last one written, so only the dropped
+screens are missing. Every KEYFRAME_INTERVAL records the frame is encoded against a blank screen, so
+a damaged file decodes again from there on. An hour of gameplay usually stays within a few MB.
+Only the Chip-8 Display (up to 128x64, four bitplanes) is recorded. The MEGA-CHIP 256x192 color screen isn't, a
+MEGA-CHIP session's capture shows its Chip-8 display, which keeps what it showed before MEGA-CHIP mode was
+entered.
+
+File layout:
+	header:  "C8CV" + version (u32)
+	records: kind (u8, 0 delta, 1 keyframe), hires (u8), frames since the last record (varint, the first record's
+	         frame number), payload size (varint), payload
+	payload: pairs of zero run length and literal count (varints) followed by the literal bytes, covering the
+	         CaptureFrame::BYTES of the XORed rows
+All values are little endian. Frames that aren't captured (nothing drawn) or didn't change the
+screen or the resolution are covered by the frame delta.
+*/
+class CaptureWriter {
+public:
+
+	static const unsigned int KEYFRAME_INTERVAL = 600;
+
+	CaptureWriter();
+	~CaptureWriter();
+
+	CaptureWriter(const CaptureWriter&) = delete;
+	CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+	bool open(const char* path);
+	//Writes everything that is still queued
+	void close();
+	bool IsOpen() const { return m_file != nullptr; }
+
+	//Called by the emulation thread with increasing frame numbers, never waits. Does nothing if the writer isn't open
+	void capture(const Display& display, unsigned long long frame) {
+		if (!m_file)
+			return;
+
+		CaptureFrame* slot = m_ring.tryClaim();
+		if (!slot) {
+			++m_dropped;
+			return;
+		}
+
+		slot->frame = frame;
+		slot->hires = display.IsHires();
+		for (int plane = 0; plane < Display::PLANES; ++plane) {
+			std::copy(display.GetRows(plane), display.GetRows(plane) + Display::HEIGHT, slot->rows[plane]);
+		}
+		m_ring.publish();
+	}
+
+	//Frames lost because the writer thread was a full ring behind
+	unsigned long long GetDropped() const { return m_dropped; }
+	//Emulation thread: frames that fit before the next one would be dropped (at least, the writer may have freed more)
+	size_t GetFree() const { return m_ring.capacity() - m_ring.size(); }
+	//Bytes written so far, only exact after close()
+	unsigned long long GetSize() const { return m_size; }
+
+private:
+	void writerLoop();
+	void encode(const CaptureFrame& frame);
+
+	SpscRing<CaptureFrame> m_ring;
+	std::thread m_thread;
+	std::atomic<bool> m_stop;
+	unsigned long long m_dropped;
+
+	//Only used by the writer thread (capture() checks it, it doesn't change while the thread runs)
+	FILE* m_file;
+	std::atomic<unsigned long long> m_size;
+	unsigned long long m_records;
+	unsigned long long m_lastFrame;
+	bool m_lastHires;
+	std::vector<unsigned char> m_previous;
+	std::vector<unsigned char> m_payload;
+};
+
+//Reads files written by CaptureWriter, frame by frame
+class CaptureReader {
+public:
+
+	CaptureReader();
+	~CaptureReader();
+
+	CaptureReader(const CaptureReader&) = delete;
+	CaptureReader& operator=(const CaptureReader&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	//Returns false at the end of the capture or at a record that doesn't decode
+	bool next(CaptureFrame& frame);
+
+private:
+	FILE* m_file;
+	unsigned long long m_records;
+	unsigned long long m_lastFrame;
+	std::vector<unsigned char> m_screen;
+	std::vector<unsigned char> m_payload;
+};
@@ -0,0 +1,198 @@
+#include "FrameRenderer.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+//Big enough for either screen: the MEGA-CHIP frame (4 bytes per pixel) or every row of every bitplane
+static const size_t SLOT_SIZE = MegaDisplay::WIDTH * MegaDisplay::HEIGHT * sizeof(unsigned int);
+static_assert(SLOT_SIZE >= sizeof(Display::Row) * Display::HEIGHT * Display::PLANES, "bitplanes don't fit a slot");
+
+static unsigned int compileShader(const GLFunctions& gl, unsigned int type, const char* path) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "Couldn't load shader " << path << "\n";
+		return 0;
+	}
+	std::stringstream stream;
+	stream << file.rdbuf();
+	const std::string source = stream.str();
+	const char* text = source.c_str();
+
+	unsigned int shader = gl.CreateShader(type);
+	gl.ShaderSource(shader, 1, &text, nullptr);
+	gl.CompileShader(shader);
+
+	int compiled = 0;
+	gl.GetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled) {
+		char log[1024];
+		gl.GetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		std::cerr << "Couldn't compile " << path << ":\n" << log << "\n";
+		gl.DeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+FrameRenderer::FrameRenderer() {
+	m_ready = false;
+	m_program = 0;
+	m_vertexArray = 0;
+	m_planes = 0;
+	m_colors = 0;
+	m_modeLocation = -1;
+	m_sizeLocation = -1;
+	m_paletteLocation = -1;
+}
+
+FrameRenderer::~FrameRenderer() {
+	//The context may be gone by now, release() is up to the owner
+}
+
+bool FrameRenderer::loadFunctions(GLFunctions& gl, GLFunctions::LoadProc loadProc) {
+	if (!gl.load(loadProc)) {
+		std::cerr << "OpenGL 4.4 is needed (persistently mapped buffers)\n";
+		return false;
+	}
+	return true;
+}
+
+unsigned int FrameRenderer::loadProgram(const GLFunctions& gl, const char* vertexPath, const char* fragmentPath) {
+	const unsigned int vertex = compileShader(gl, GL_VERTEX_SHADER, vertexPath);
+	const unsigned int fragment = compileShader(gl, GL_FRAGMENT_SHADER, fragmentPath);
+	if (!vertex || !fragment) {
+		if (vertex)
+			gl.DeleteShader(vertex);
+		if (fragment)
+			gl.DeleteShader(fragment);
+		return 0;
+	}
+
+	unsigned int program = gl.CreateProgram();
+	gl.AttachShader(program, vertex);
+	gl.AttachShader(program, fragment);
+	gl.LinkProgram(program);
+	gl.DeleteShader(vertex);
+	gl.DeleteShader(fragment);
+
+	int linked = 0;
+	gl.GetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		char log[1024];
+		gl.GetProgramInfoLog(program, sizeof(log), nullptr, log);
+		std::cerr << "Couldn't link the shaders:\n" << log << "\n";
+		gl.DeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+bool FrameRenderer::init(GLFunctions::LoadProc loadProc, const char* vertexPath, const char* fragmentPath) {
+	if (!loadFunctions(m_gl, loadProc))
+		return false;
+
+	m_program = loadProgram(m_gl, vertexPath, fragmentPath);
+	if (!m_program)
+		return false;
+
+	m_gl.UseProgram(m_program);
+	m_modeLocation = m_gl.GetUniformLocation(m_program, "mode");
+	m_sizeLocation = m_gl.GetUniformLocation(m_program, "size");
+	m_paletteLocation = m_gl.GetUniformLocation(m_program, "palette");
+	m_gl.Uniform1i(m_gl.GetUniformLocation(m_program, "planes"), 0);
+	m_gl.Uniform1i(m_gl.GetUniformLocation(m_program, "colors"), 1);
+
+	//The vertex shader makes up its own triangle, the core profile still wants a vertex array bound
+	m_gl.GenVertexArrays(1, &m_vertexArray);
+
+	//Integer textures can't be filtered, the shader fetches texels anyway
+	m_gl.GenTextures(1, &m_planes);
+	m_gl.ActiveTexture(GL_TEXTURE0);
+	m_gl.BindTexture(GL_TEXTURE_2D, m_planes);
+	m_gl.TexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32UI, Display::HEIGHT, Display::PLANES);
+	m_gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	m_gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	m_gl.GenTextures(1, &m_colors);
+	m_gl.ActiveTexture(GL_TEXTURE1);
+	m_gl.BindTexture(GL_TEXTURE_2D, m_colors);
+	m_gl.TexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, MegaDisplay::WIDTH, MegaDisplay::HEIGHT);
+	m_gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	m_gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	if (!m_upload.init(m_gl, SLOT_SIZE)) {
+		release();
+		return false;
+	}
+
+	const float white[16][4] = { { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } };
+	setPalette(white);
+
+	m_ready = true;
+	return true;
+}
+
+void FrameRenderer::release() {
+	m_upload.release();
+	if (m_planes)
+		m_gl.DeleteTextures(1, &m_planes);
+	if (m_colors)
+		m_gl.DeleteTextures(1, &m_colors);
+	if (m_vertexArray)
+		m_gl.DeleteVertexArrays(1, &m_vertexArray);
+	if (m_program)
+		m_gl.DeleteProgram(m_program);
+
+	m_planes = m_colors = m_vertexArray = m_program = 0;
+	m_ready = false;
+}
+
+void FrameRenderer::setPalette(const float (*colors)[4]) {
+	m_gl.UseProgram(m_program);
+	m_gl.Uniform4fv(m_paletteLocation, 16, &colors[0][0]);
+}
+
+void FrameRenderer::endUpload(unsigned int texture, int mode, int texelWidth, int texelHeight, unsigned int format,
+	unsigned int type, int screenWidth, int screenHeight, int width, int height) {
+	const void* slot = m_upload.bind();
+	m_gl.ActiveTexture(mode == 0 ? GL_TEXTURE0 : GL_TEXTURE1);
+	m_gl.BindTexture(GL_TEXTURE_2D, texture);
+	m_gl.TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texelWidth, texelHeight, format, type, slot);
+	m_upload.end();
+
+	m_gl.Viewport(0, 0, width, height);
+	m_gl.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	m_gl.Clear(GL_COLOR_BUFFER_BIT);
+	m_gl.UseProgram(m_program);
+	m_gl.Uniform1i(m_modeLocation, mode);
+	m_gl.Uniform2i(m_sizeLocation, screenWidth, screenHeight);
+	m_gl.BindVertexArray(m_vertexArray);
+	m_gl.DrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void FrameRenderer::draw(const Display& display, int width, int height) {
+	if (!m_ready)
+		return;
+
+	//The rows as they are, 4 KB however many planes are in use
+	unsigned char* slot = m_upload.begin();
+	const size_t plane = sizeof(Display::Row) * Display::HEIGHT;
+	for (int i = 0; i < Display::PLANES; ++i) {
+		std::memcpy(slot + i * plane, display.GetRows(i), plane);
+	}
+	endUpload(m_planes, 0, Display::HEIGHT, Display::PLANES, GL_RGBA_INTEGER, GL_UNSIGNED_INT,
+		display.GetWidth(), display.GetHeight(), width, height);
+}
+
+void FrameRenderer::draw(const MegaDisplay& display, int width, int height) {
+	if (!m_ready || !display.IsEnabled())
+		return;
+
+	//expand writes the finished frame straight into the mapped slot
+	display.expand(reinterpret_cast<unsigned int*>(m_upload.begin()));
+	endUpload(m_colors, 1, MegaDisplay::WIDTH, MegaDisplay::HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE,
+		MegaDisplay::WIDTH, MegaDisplay::HEIGHT, width, height);
+}
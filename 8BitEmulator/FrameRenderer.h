@@ -0,0 +1,62 @@
+#pragma once
+#include "Display.h"
+#include "GLFunctions.h"
+#include "MegaDisplay.h"
+#include "UploadRing.h"
+
+/*
+Draws the emulator screen with OpenGL 4.4: the frame is uploaded as one small texture and the fragment shader
+(shader/fragment.txt) turns it into colors, so the host never touches single pixels.
+Chip-8 screens go up as they are stored, the packed rows of every bitplane (4 KB, a 64x4 RGBA32UI texture), the shader
+picks the bits and looks the palette index up. MEGA-CHIP screens go up as the RGBA frame MegaDisplay::expand writes.
+
+The frame is written straight into a slot of a persistently mapped pixel buffer (UploadRing), nothing is allocated or
+mapped per frame.
+
+Works with any context that has the entry points (a GLFW window, a headless EGL context), the context has to be
+current on the thread that calls init/draw/release. Draws into the framebuffer that is bound.
+*/
+class FrameRenderer {
+public:
+
+	FrameRenderer();
+	~FrameRenderer();
+
+	//Loads the entry points and the shaders, creates the textures and the pixel buffer. Prints the reason to std::cerr
+	//and returns false if the context can't do it (older than 4.4, shader errors)
+	bool init(GLFunctions::LoadProc loadProc, const char* vertexPath, const char* fragmentPath);
+	//Deletes everything init created, the context must still be current
+	void release();
+
+	//Colors of the 16 bitplane palette indices (RGBA, 0-1)
+	void setPalette(const float (*colors)[4]);
+
+	//Draws the screen stretched over a viewport of the given size
+	void draw(const Display& display, int width, int height);
+	void draw(const MegaDisplay& display, int width, int height);
+
+	const GLFunctions& GetFunctions() const { return m_gl; }
+
+	//Loads the entry points, false (with the reason on std::cerr) if the context is older than 4.4
+	static bool loadFunctions(GLFunctions& gl, GLFunctions::LoadProc loadProc);
+	//Compiles and links the two shader files, 0 (with the reason on std::cerr) if that fails
+	static unsigned int loadProgram(const GLFunctions& gl, const char* vertexPath, const char* fragmentPath);
+
+private:
+	//Copies the slot the frame was written to into the texture and draws it
+	void endUpload(unsigned int texture, int mode, int texelWidth, int texelHeight, unsigned int format, unsigned int type,
+		int screenWidth, int screenHeight, int width, int height);
+
+	GLFunctions m_gl;
+	bool m_ready;
+
+	unsigned int m_program;
+	unsigned int m_vertexArray;
+	unsigned int m_planes;
+	unsigned int m_colors;
+	UploadRing m_upload;
+
+	int m_modeLocation;
+	int m_sizeLocation;
+	int m_paletteLocation;
+};
@@ -0,0 +1,687 @@
+#include "FrameStream.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+	typedef WSAPOLLFD PollDescriptor;
+	const SocketHandle invalidSocket = INVALID_SOCKET;
+	const int sendFlags = 0;
+
+	int pollSockets(PollDescriptor* descriptors, size_t count, int timeout) {
+		return WSAPoll(descriptors, (ULONG)count, timeout);
+	}
+
+	bool wouldBlock() {
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+	}
+
+	void setNonBlocking(SocketHandle socket) {
+		u_long enabled = 1;
+		ioctlsocket(socket, FIONBIO, &enabled);
+	}
+
+	void closeHandle(SocketHandle socket) {
+		closesocket(socket);
+	}
+
+	//WSAPoll only takes sockets, a loopback UDP socket connected to itself stands in for a pipe
+	bool openWakeup(SocketHandle& readEnd, SocketHandle& writeEnd) {
+		const SocketHandle wakeup = socket(AF_INET, SOCK_DGRAM, 0);
+		if (wakeup == invalidSocket)
+			return false;
+
+		sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		int length = sizeof(address);
+		if (bind(wakeup, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+			getsockname(wakeup, reinterpret_cast<sockaddr*>(&address), &length) != 0 ||
+			connect(wakeup, reinterpret_cast<const sockaddr*>(&address), length) != 0) {
+			closesocket(wakeup);
+			return false;
+		}
+
+		setNonBlocking(wakeup);
+		readEnd = wakeup;
+		writeEnd = wakeup;
+		return true;
+	}
+
+	void closeWakeup(SocketHandle readEnd, SocketHandle) {
+		closesocket(readEnd);
+	}
+
+	void signalWakeup(SocketHandle writeEnd) {
+		const char signal = 1;
+		send(writeEnd, &signal, 1, 0);
+	}
+
+	void drainWakeup(SocketHandle readEnd) {
+		char buffer[64];
+		while (recv(readEnd, buffer, sizeof(buffer), 0) > 0) {
+		}
+	}
+
+	//Winsock has to be started by every user, the counts are kept by Windows
+	void startSockets() {
+		WSADATA data;
+		WSAStartup(MAKEWORD(2, 2), &data);
+	}
+
+	void stopSockets() {
+		WSACleanup();
+	}
+#else
+	typedef pollfd PollDescriptor;
+	const SocketHandle invalidSocket = -1;
+	//A viewer that went away must not kill the emulator with SIGPIPE
+#ifdef MSG_NOSIGNAL
+	const int sendFlags = MSG_NOSIGNAL;
+#else
+	const int sendFlags = 0;
+#endif
+
+	int pollSockets(PollDescriptor* descriptors, size_t count, int timeout) {
+		return poll(descriptors, (nfds_t)count, timeout);
+	}
+
+	bool wouldBlock() {
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+
+	void setNonBlocking(SocketHandle socket) {
+		fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+	}
+
+	void closeHandle(SocketHandle socket) {
+		::close(socket);
+	}
+
+	bool openWakeup(SocketHandle& readEnd, SocketHandle& writeEnd) {
+		int ends[2];
+		if (pipe(ends) != 0)
+			return false;
+
+		setNonBlocking(ends[0]);
+		setNonBlocking(ends[1]);
+		readEnd = ends[0];
+		writeEnd = ends[1];
+		return true;
+	}
+
+	void closeWakeup(SocketHandle readEnd, SocketHandle writeEnd) {
+		::close(readEnd);
+		::close(writeEnd);
+	}
+
+	void signalWakeup(SocketHandle writeEnd) {
+		const char signal = 1;
+		//Only fails if the pipe is full, which wakes the reader just the same
+		const ssize_t written = write(writeEnd, &signal, 1);
+		(void)written;
+	}
+
+	void drainWakeup(SocketHandle readEnd) {
+		char buffer[64];
+		while (read(readEnd, buffer, sizeof(buffer)) > 0) {
+		}
+	}
+
+	void startSockets() {
+	}
+
+	void stopSockets() {
+	}
+#endif
+
+	const unsigned char messageFrame = 1;
+	const int tileCount = Display::PLANES * (Display::HEIGHT / 8) * 2;
+	//Size field, type, frame number, hires, tile count, and every tile with all its rows
+	const size_t maxMessageSize = 4 + 1 + 8 + 1 + 1 + tileCount * (2 + 8 * 8);
+
+	void putLittle(std::vector<unsigned char>& out, unsigned long long value, int bytes) {
+		for (int i = 0; i < bytes; ++i) {
+			out.push_back((unsigned char)(value >> (i * 8)));
+		}
+	}
+
+	unsigned long long getLittle(const unsigned char* data, int bytes) {
+		unsigned long long value = 0;
+		for (int i = 0; i < bytes; ++i) {
+			value |= (unsigned long long)data[i] << (i * 8);
+		}
+		return value;
+	}
+
+	//Row and word of a tile's first row
+	void tilePosition(int tile, int& plane, int& row, int& column) {
+		plane = tile >> 4;
+		row = (tile >> 1 & 7) * 8;
+		column = tile & 1;
+	}
+}
+
+StreamServer::StreamServer() : m_wakeRead(invalidSocket), m_wakeWrite(invalidSocket), m_wakePending(false), m_stop(false),
+	m_clientCount(0), m_dropped(0), m_bytesSent(0) {
+	startSockets();
+	//Without it the network thread goes back to polling every millisecond
+	if (!openWakeup(m_wakeRead, m_wakeWrite)) {
+		std::cerr << "Couldn't create the stream wakeup, polling instead\n";
+		m_wakeRead = invalidSocket;
+		m_wakeWrite = invalidSocket;
+	}
+}
+
+StreamServer::~StreamServer() {
+	stop();
+	if (m_wakeRead != invalidSocket)
+		closeWakeup(m_wakeRead, m_wakeWrite);
+	stopSockets();
+}
+
+int StreamServer::addSession() {
+	m_sessions.push_back(std::unique_ptr<Session>(new Session()));
+	return (int)m_sessions.size() - 1;
+}
+
+bool StreamServer::listenTcp(unsigned short port, bool any) {
+	const SocketHandle listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener == invalidSocket) {
+		std::cerr << "Couldn't create a socket\n";
+		return false;
+	}
+
+	//A restarted server can take the port over right away
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(any ? INADDR_ANY : INADDR_LOOPBACK);
+	if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+		std::cerr << "Couldn't listen on port " << port << "\n";
+		closeHandle(listener);
+		return false;
+	}
+
+	setNonBlocking(listener);
+	m_listeners.push_back(listener);
+	return true;
+}
+
+bool StreamServer::listenUnix(const char* path) {
+#ifdef _WIN32
+	std::cerr << "Unix domain sockets aren't supported on this platform, " << path << " isn't served\n";
+	return false;
+#else
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (std::strlen(path) >= sizeof(address.sun_path)) {
+		std::cerr << "Socket path too long: " << path << "\n";
+		return false;
+	}
+	std::strcpy(address.sun_path, path);
+
+	const SocketHandle listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener == invalidSocket) {
+		std::cerr << "Couldn't create a socket\n";
+		return false;
+	}
+
+	//The socket file of a server that didn't shut down cleanly is in the way
+	unlink(path);
+	if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+		std::cerr << "Couldn't listen on " << path << "\n";
+		closeHandle(listener);
+		return false;
+	}
+
+	setNonBlocking(listener);
+	m_listeners.push_back(listener);
+	m_unixPath = path;
+	return true;
+#endif
+}
+
+bool StreamServer::start() {
+	if (m_listeners.empty() || m_thread.joinable())
+		return false;
+
+	m_stop = false;
+	m_thread = std::thread(&StreamServer::networkLoop, this);
+	return true;
+}
+
+void StreamServer::stop() {
+	if (m_thread.joinable()) {
+		m_stop = true;
+		wake();
+		m_thread.join();
+	}
+
+	for (auto& client : m_clients) {
+		closeHandle(client->socket);
+	}
+	m_clients.clear();
+	m_clientCount = 0;
+
+	for (SocketHandle listener : m_listeners) {
+		closeHandle(listener);
+	}
+	m_listeners.clear();
+#ifndef _WIN32
+	if (!m_unixPath.empty())
+		unlink(m_unixPath.c_str());
+#endif
+	m_unixPath.clear();
+}
+
+void StreamServer::wake() {
+	if (m_wakeWrite != invalidSocket && !m_wakePending.exchange(true, std::memory_order_acq_rel))
+		signalWakeup(m_wakeWrite);
+}
+
+void StreamServer::networkLoop() {
+	std::vector<PollDescriptor> descriptors;
+
+	while (!m_stop.load(std::memory_order_acquire)) {
+		//Drained before the flag is cleared, a wake() after the clear always leaves a byte for the next poll. Frames
+		//published before it are popped below
+		if (m_wakeRead != invalidSocket) {
+			drainWakeup(m_wakeRead);
+			m_wakePending.exchange(false, std::memory_order_acq_rel);
+		}
+
+		//Only the newest screen of every session matters
+		for (auto& session : m_sessions) {
+			while (session->ring.tryPop(session->latest)) {
+				session->fresh = true;
+			}
+		}
+
+		//A viewer that is behind skips the frame and catches up with the screen it finds once it drained
+		for (auto& client : m_clients) {
+			if (client->session < 0)
+				continue;
+			Session& session = *m_sessions[client->session];
+			if (!session.fresh && !client->stale)
+				continue;
+
+			if (client->output.size() - client->outputSent < MAX_PENDING) {
+				appendDelta(*client, session.latest);
+				client->stale = false;
+			}
+			else if (session.fresh) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				client->stale = true;
+			}
+		}
+		for (auto& session : m_sessions) {
+			session->fresh = false;
+		}
+
+		descriptors.clear();
+		for (SocketHandle listener : m_listeners) {
+			PollDescriptor descriptor = {};
+			descriptor.fd = listener;
+			descriptor.events = POLLIN;
+			descriptors.push_back(descriptor);
+		}
+		for (auto& client : m_clients) {
+			PollDescriptor descriptor = {};
+			descriptor.fd = client->socket;
+			descriptor.events = POLLIN;
+			if (client->outputSent < client->output.size())
+				descriptor.events |= POLLOUT;
+			descriptors.push_back(descriptor);
+		}
+		const size_t polled = m_clients.size();
+		if (m_wakeRead != invalidSocket) {
+			PollDescriptor descriptor = {};
+			descriptor.fd = m_wakeRead;
+			descriptor.events = POLLIN;
+			descriptors.push_back(descriptor);
+		}
+
+		//Blocks until there is something to do, a millisecond at a time if there is no wakeup
+		if (pollSockets(descriptors.data(), descriptors.size(), m_wakeRead != invalidSocket ? -1 : 1) <= 0)
+			continue;
+
+		for (size_t i = 0; i < m_listeners.size(); ++i) {
+			if (descriptors[i].revents & POLLIN)
+				acceptClients(m_listeners[i]);
+		}
+
+		//Clients accepted just now come after the ones polled
+		size_t kept = 0;
+		for (size_t i = 0; i < m_clients.size(); ++i) {
+			bool keep = true;
+			if (i < polled) {
+				const short events = descriptors[m_listeners.size() + i].revents;
+				if (events & (POLLERR | POLLNVAL))
+					keep = false;
+				if (keep && (events & (POLLIN | POLLHUP)))
+					keep = readClient(*m_clients[i]);
+				if (keep && (events & POLLOUT))
+					keep = writeClient(*m_clients[i]);
+			}
+
+			if (keep)
+				m_clients[kept++] = std::move(m_clients[i]);
+			else
+				closeHandle(m_clients[i]->socket);
+		}
+		m_clients.resize(kept);
+		m_clientCount.store((unsigned int)kept, std::memory_order_relaxed);
+	}
+}
+
+void StreamServer::acceptClients(SocketHandle listener) {
+	for (;;) {
+		const SocketHandle socket = accept(listener, nullptr, nullptr);
+		if (socket == invalidSocket)
+			return;
+
+		setNonBlocking(socket);
+		//Frames are small and latency matters more than packet count, fails harmlessly on Unix sockets
+		int noDelay = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+		//The kernel would otherwise queue seconds of frames for a slow viewer, frames are dropped here instead
+		int bufferSize = (int)MAX_PENDING;
+		setsockopt(socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+
+		std::unique_ptr<Client> client(new Client());
+		client->socket = socket;
+		client->session = -1;
+		client->helloSize = 0;
+		std::memset(&client->sent, 0, sizeof(client->sent));
+		client->outputSent = 0;
+		client->stale = true;
+		m_clients.push_back(std::move(client));
+	}
+}
+
+bool StreamServer::readClient(Client& client) {
+	unsigned char buffer[64];
+	for (;;) {
+		unsigned char* target = client.session < 0 ? client.hello + client.helloSize : buffer;
+		const size_t size = client.session < 0 ? sizeof(client.hello) - client.helloSize : sizeof(buffer);
+		const int received = (int)recv(client.socket, reinterpret_cast<char*>(target), (int)size, 0);
+		if (received == 0)
+			return false;
+		if (received < 0)
+			return wouldBlock();
+
+		//Viewers don't send anything after the hello, it is ignored
+		if (client.session >= 0)
+			continue;
+		client.helloSize += received;
+		if (client.helloSize < sizeof(client.hello))
+			continue;
+
+		const unsigned int version = (unsigned int)getLittle(client.hello + 4, 2);
+		const unsigned int session = (unsigned int)getLittle(client.hello + 6, 2);
+		if (std::memcmp(client.hello, "C8SV", 4) != 0 || version != VERSION || session >= m_sessions.size())
+			return false;
+		client.session = (int)session;
+	}
+}
+
+bool StreamServer::writeClient(Client& client) {
+	while (client.outputSent < client.output.size()) {
+		const int sent = (int)send(client.socket, reinterpret_cast<const char*>(client.output.data() + client.outputSent),
+			(int)(client.output.size() - client.outputSent), sendFlags);
+		if (sent < 0)
+			return wouldBlock();
+		client.outputSent += sent;
+		m_bytesSent.fetch_add(sent, std::memory_order_relaxed);
+	}
+
+	client.output.clear();
+	client.outputSent = 0;
+	return true;
+}
+
+void StreamServer::appendDelta(Client& client, const CaptureFrame& frame) {
+	std::vector<unsigned char>& out = client.output;
+	const size_t start = out.size();
+	putLittle(out, 0, 4);
+	out.push_back(messageFrame);
+	putLittle(out, frame.frame, 8);
+	out.push_back(frame.hires ? 1 : 0);
+	const size_t countPosition = out.size();
+	out.push_back(0);
+
+	int tiles = 0;
+	for (int tile = 0; tile < tileCount; ++tile) {
+		int plane, row, column;
+		tilePosition(tile, plane, row, column);
+
+		unsigned long long words[8];
+		unsigned char mask = 0;
+		for (int i = 0; i < 8; ++i) {
+			words[i] = frame.rows[plane][row + i].words[column] ^ client.sent.rows[plane][row + i].words[column];
+			if (words[i] != 0)
+				mask |= (unsigned char)(1 << i);
+		}
+		if (mask == 0)
+			continue;
+
+		out.push_back((unsigned char)tile);
+		out.push_back(mask);
+		for (int i = 0; i < 8; ++i) {
+			if (mask & (1 << i))
+				putLittle(out, words[i], 8);
+		}
+		++tiles;
+	}
+
+	if (tiles == 0 && frame.hires == client.sent.hires) {
+		out.resize(start);
+		return;
+	}
+
+	out[countPosition] = (unsigned char)tiles;
+	const size_t size = out.size() - start - 4;
+	for (int i = 0; i < 4; ++i) {
+		out[start + i] = (unsigned char)(size >> (i * 8));
+	}
+	client.sent = frame;
+}
+
+StreamClient::StreamClient() : m_socket(invalidSocket), m_bytesReceived(0) {
+	startSockets();
+	std::memset(&m_screen, 0, sizeof(m_screen));
+}
+
+StreamClient::~StreamClient() {
+	close();
+	stopSockets();
+}
+
+bool StreamClient::connectTcp(const char* host, unsigned short port, int session) {
+	close();
+
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &addresses) != 0) {
+		std::cerr << "Unknown host " << host << "\n";
+		return false;
+	}
+
+	for (addrinfo* address = addresses; address && m_socket == invalidSocket; address = address->ai_next) {
+		m_socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (m_socket != invalidSocket && connect(m_socket, address->ai_addr, (int)address->ai_addrlen) != 0) {
+			closeHandle(m_socket);
+			m_socket = invalidSocket;
+		}
+	}
+	freeaddrinfo(addresses);
+
+	if (m_socket == invalidSocket) {
+		std::cerr << "Couldn't connect to " << host << ":" << port << "\n";
+		return false;
+	}
+
+	int noDelay = 1;
+	setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+	return subscribe(session);
+}
+
+bool StreamClient::connectUnix(const char* path, int session) {
+	close();
+
+#ifdef _WIN32
+	std::cerr << "Unix domain sockets aren't supported on this platform, can't connect to " << path << "\n";
+	(void)session;
+	return false;
+#else
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (std::strlen(path) >= sizeof(address.sun_path)) {
+		std::cerr << "Socket path too long: " << path << "\n";
+		return false;
+	}
+	std::strcpy(address.sun_path, path);
+
+	m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_socket == invalidSocket || connect(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+		std::cerr << "Couldn't connect to " << path << "\n";
+		close();
+		return false;
+	}
+	return subscribe(session);
+#endif
+}
+
+void StreamClient::close() {
+	if (m_socket != invalidSocket)
+		closeHandle(m_socket);
+	m_socket = invalidSocket;
+}
+
+bool StreamClient::subscribe(int session) {
+	std::memset(&m_screen, 0, sizeof(m_screen));
+	m_bytesReceived = 0;
+
+	std::vector<unsigned char> hello = { 'C', '8', 'S', 'V' };
+	putLittle(hello, StreamServer::VERSION, 2);
+	putLittle(hello, (unsigned int)session, 2);
+
+	size_t sent = 0;
+	while (sent < hello.size()) {
+		const int result = (int)send(m_socket, reinterpret_cast<const char*>(hello.data() + sent), (int)(hello.size() - sent), sendFlags);
+		if (result <= 0) {
+			close();
+			return false;
+		}
+		sent += result;
+	}
+	return true;
+}
+
+bool StreamClient::receive(unsigned char* data, size_t size, int timeoutMilliseconds) {
+	size_t received = 0;
+	while (received < size) {
+		//Only the start of a message may time out, a message that stops halfway means the server is gone
+		PollDescriptor descriptor = {};
+		descriptor.fd = m_socket;
+		descriptor.events = POLLIN;
+		if (pollSockets(&descriptor, 1, received == 0 ? timeoutMilliseconds : 1000) <= 0) {
+			if (received > 0)
+				close();
+			return false;
+		}
+
+		const int result = (int)recv(m_socket, reinterpret_cast<char*>(data + received), (int)(size - received), 0);
+		if (result <= 0) {
+			close();
+			return false;
+		}
+		received += result;
+		m_bytesReceived += result;
+	}
+	return true;
+}
+
+bool StreamClient::next(CaptureFrame& frame, int timeoutMilliseconds) {
+	if (m_socket == invalidSocket)
+		return false;
+
+	unsigned char header[4];
+	if (!receive(header, sizeof(header), timeoutMilliseconds))
+		return false;
+
+	const size_t size = (size_t)getLittle(header, 4);
+	if (size < 11 || size > maxMessageSize - 4) {
+		close();
+		return false;
+	}
+	m_message.resize(size);
+	if (!receive(m_message.data(), size, 1000)) {
+		close();
+		return false;
+	}
+
+	const unsigned char* data = m_message.data();
+	const unsigned char* end = data + size;
+	if (data[0] != messageFrame) {
+		close();
+		return false;
+	}
+	m_screen.frame = getLittle(data + 1, 8);
+	m_screen.hires = data[9] != 0;
+	const int tiles = data[10];
+	data += 11;
+
+	for (int i = 0; i < tiles; ++i) {
+		if (end - data < 2 || data[0] >= tileCount) {
+			close();
+			return false;
+		}
+		int plane, row, column;
+		tilePosition(data[0], plane, row, column);
+		const unsigned char mask = data[1];
+		data += 2;
+
+		for (int r = 0; r < 8; ++r) {
+			if (!(mask & (1 << r)))
+				continue;
+			if (end - data < 8) {
+				close();
+				return false;
+			}
+			m_screen.rows[plane][row + r].words[column] ^= getLittle(data, 8);
+			data += 8;
+		}
+	}
+
+	frame = m_screen;
+	return true;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Display.h"
+#include "FrameCapture.h"
+#include "SpscRing.h"
+
+#ifdef _WIN32
+typedef std::uintptr_t SocketHandle;
+#else
+typedef int SocketHandle;
+#endif
+
+/*
+Streams the screens of one or more sessions to viewers over TCP or Unix domain sockets.
+
+The emulation thread of a session only hands its screen to the server (a 4 KB copy into a ring slot, the frame is
+dropped if the network thread is that far behind), everything else happens on the network thread: every viewer
+gets its own delta against the screen it received last, as tiles of the packed rows that changed. A viewer whose
+socket doesn't take the data fast enough simply misses frames, the next delta it gets brings it up to date, so a
+slow or stuck viewer never costs the emulator or the other viewers anything.
+
+Protocol (little endian):
+	viewer -> server, once after connecting: "C8SV", version (u16), session (u16)
+	server -> viewer, per frame: size of the rest (u32), type (u8, 1 frame), frame number (u64), hires (u8), tile
+	        count (u8), tiles
+	tile:   index (u8: plane * 16 + tile row * 2 + tile column, tiles are 64 pixels by 8 rows of a bitplane), row
+	        mask (u8, bit n set if row n changed), the changed rows' 64 bit words XORed with the last screen sent
+A viewer starts from a blank low resolution screen, frames that change nothing aren't sent.
+*/
+class StreamServer {
+public:
+
+	static const unsigned short VERSION = 1;
+	//Unsent bytes at which a viewer skips frames, about four full screens
+	static const size_t MAX_PENDING = 16 * 1024;
+
+	StreamServer();
+	~StreamServer();
+	StreamServer(const StreamServer&) = delete;
+	StreamServer& operator=(const StreamServer&) = delete;
+
+	//Before start(): sessions are numbered from 0 in the order they are added
+	int addSession();
+	//Before start(). TCP listens on the loopback interface unless any is set
+	bool listenTcp(unsigned short port, bool any = false);
+	bool listenUnix(const char* path);
+	bool start();
+	void stop();
+
+	//Emulation thread of the session, never waits
+	void publish(int session, const Display& display, unsigned long long frame) {
+		Session& target = *m_sessions[session];
+		CaptureFrame* slot = target.ring.tryClaim();
+		if (!slot) {
+			target.skipped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		slot->frame = frame;
+		slot->hires = display.IsHires();
+		for (int plane = 0; plane < Display::PLANES; ++plane) {
+			std::copy(display.GetRows(plane), display.GetRows(plane) + Display::HEIGHT, slot->rows[plane]);
+		}
+		target.ring.publish();
+		wake();
+	}
+
+	unsigned int GetClients() const { return m_clientCount.load(std::memory_order_relaxed); }
+	//Frames viewers missed because they didn't read fast enough
+	unsigned long long GetDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+	unsigned long long GetBytesSent() const { return m_bytesSent.load(std::memory_order_relaxed); }
+	//Frames of the session publish() dropped because the network thread was behind
+	unsigned long long GetSkipped(int session) const { return m_sessions[session]->skipped.load(std::memory_order_relaxed); }
+
+private:
+	struct Session {
+		Session() : ring(4), skipped(0), latest(), fresh(false) {}
+
+		SpscRing<CaptureFrame> ring;
+		std::atomic<unsigned long long> skipped;
+		//Only used by the network thread
+		CaptureFrame latest;
+		bool fresh;
+	};
+
+	struct Client {
+		SocketHandle socket;
+		//-1 until the viewer said which session it wants
+		int session;
+		unsigned char hello[8];
+		size_t helloSize;
+		CaptureFrame sent;
+		std::vector<unsigned char> output;
+		size_t outputSent;
+		//Skipped a frame, gets the session's screen as soon as its output drained
+		bool stale;
+	};
+
+	void networkLoop();
+	//Makes the network thread's poll return, without a system call if it wasn't picked up since the last one
+	void wake();
+	void acceptClients(SocketHandle listener);
+	//Returns false if the client has to be dropped
+	bool readClient(Client& client);
+	bool writeClient(Client& client);
+	//Appends the message that brings the client from what it has to the frame, nothing if that's the same
+	void appendDelta(Client& client, const CaptureFrame& frame);
+
+	std::vector<std::unique_ptr<Session>> m_sessions;
+	std::vector<SocketHandle> m_listeners;
+	std::string m_unixPath;
+	std::vector<std::unique_ptr<Client>> m_clients;
+
+	//The network thread sleeps in poll until a socket is ready or a byte arrives here (wake)
+	SocketHandle m_wakeRead;
+	SocketHandle m_wakeWrite;
+	std::atomic<bool> m_wakePending;
+
+	std::thread m_thread;
+	std::atomic<bool> m_stop;
+	std::atomic<unsigned int> m_clientCount;
+	std::atomic<unsigned long long> m_dropped;
+	std::atomic<unsigned long long> m_bytesSent;
+};
+
+//Viewer side of StreamServer: keeps the screen up to date from the deltas
+class StreamClient {
+public:
+
+	StreamClient();
+	~StreamClient();
+	StreamClient(const StreamClient&) = delete;
+	StreamClient& operator=(const StreamClient&) = delete;
+
+	bool connectTcp(const char* host, unsigned short port, int session);
+	bool connectUnix(const char* path, int session);
+	void close();
+
+	//Waits up to the timeout for the next frame, false on timeout, a closed connection or a malformed message
+	bool next(CaptureFrame& frame, int timeoutMilliseconds);
+	unsigned long long GetBytesReceived() const { return m_bytesReceived; }
+
+private:
+	bool subscribe(int session);
+	bool receive(unsigned char* data, size_t size, int timeoutMilliseconds);
+
+	SocketHandle m_socket;
+	CaptureFrame m_screen;
+	std::vector<unsigned char> m_message;
+	unsigned long long m_bytesReceived;
+};
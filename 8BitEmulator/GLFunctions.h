@@ -0,0 +1,87 @@
+#pragma once
+#include <glad/glad.h>
+
+/*
+The OpenGL entry points the renderer uses, loaded through whatever the context came from (glfwGetProcAddress for a
+window, eglGetProcAddress headless). glad.h only supplies the types and constants, a table of our own keeps the
+renderer free of a generated loader and lets every context have its own pointers.
+Entry points are called without the gl prefix: gl.BindTexture(...).
+*/
+#define GL_FUNCTIONS(X) \
+	X(PFNGLGETERRORPROC, GetError, glGetError) \
+	X(PFNGLGETSTRINGPROC, GetString, glGetString) \
+	X(PFNGLGETINTEGERVPROC, GetIntegerv, glGetIntegerv) \
+	X(PFNGLVIEWPORTPROC, Viewport, glViewport) \
+	X(PFNGLCLEARCOLORPROC, ClearColor, glClearColor) \
+	X(PFNGLCLEARPROC, Clear, glClear) \
+	X(PFNGLFINISHPROC, Finish, glFinish) \
+	X(PFNGLPIXELSTOREIPROC, PixelStorei, glPixelStorei) \
+	X(PFNGLREADPIXELSPROC, ReadPixels, glReadPixels) \
+	X(PFNGLGENTEXTURESPROC, GenTextures, glGenTextures) \
+	X(PFNGLDELETETEXTURESPROC, DeleteTextures, glDeleteTextures) \
+	X(PFNGLBINDTEXTUREPROC, BindTexture, glBindTexture) \
+	X(PFNGLACTIVETEXTUREPROC, ActiveTexture, glActiveTexture) \
+	X(PFNGLTEXPARAMETERIPROC, TexParameteri, glTexParameteri) \
+	X(PFNGLTEXSTORAGE2DPROC, TexStorage2D, glTexStorage2D) \
+	X(PFNGLTEXSUBIMAGE2DPROC, TexSubImage2D, glTexSubImage2D) \
+	X(PFNGLTEXSTORAGE3DPROC, TexStorage3D, glTexStorage3D) \
+	X(PFNGLTEXSUBIMAGE3DPROC, TexSubImage3D, glTexSubImage3D) \
+	X(PFNGLGENBUFFERSPROC, GenBuffers, glGenBuffers) \
+	X(PFNGLDELETEBUFFERSPROC, DeleteBuffers, glDeleteBuffers) \
+	X(PFNGLBINDBUFFERPROC, BindBuffer, glBindBuffer) \
+	X(PFNGLBUFFERSTORAGEPROC, BufferStorage, glBufferStorage) \
+	X(PFNGLMAPBUFFERRANGEPROC, MapBufferRange, glMapBufferRange) \
+	X(PFNGLUNMAPBUFFERPROC, UnmapBuffer, glUnmapBuffer) \
+	X(PFNGLFENCESYNCPROC, FenceSync, glFenceSync) \
+	X(PFNGLCLIENTWAITSYNCPROC, ClientWaitSync, glClientWaitSync) \
+	X(PFNGLDELETESYNCPROC, DeleteSync, glDeleteSync) \
+	X(PFNGLGENVERTEXARRAYSPROC, GenVertexArrays, glGenVertexArrays) \
+	X(PFNGLDELETEVERTEXARRAYSPROC, DeleteVertexArrays, glDeleteVertexArrays) \
+	X(PFNGLBINDVERTEXARRAYPROC, BindVertexArray, glBindVertexArray) \
+	X(PFNGLDRAWARRAYSPROC, DrawArrays, glDrawArrays) \
+	X(PFNGLDRAWARRAYSINSTANCEDPROC, DrawArraysInstanced, glDrawArraysInstanced) \
+	X(PFNGLCREATESHADERPROC, CreateShader, glCreateShader) \
+	X(PFNGLSHADERSOURCEPROC, ShaderSource, glShaderSource) \
+	X(PFNGLCOMPILESHADERPROC, CompileShader, glCompileShader) \
+	X(PFNGLGETSHADERIVPROC, GetShaderiv, glGetShaderiv) \
+	X(PFNGLGETSHADERINFOLOGPROC, GetShaderInfoLog, glGetShaderInfoLog) \
+	X(PFNGLDELETESHADERPROC, DeleteShader, glDeleteShader) \
+	X(PFNGLCREATEPROGRAMPROC, CreateProgram, glCreateProgram) \
+	X(PFNGLATTACHSHADERPROC, AttachShader, glAttachShader) \
+	X(PFNGLLINKPROGRAMPROC, LinkProgram, glLinkProgram) \
+	X(PFNGLGETPROGRAMIVPROC, GetProgramiv, glGetProgramiv) \
+	X(PFNGLGETPROGRAMINFOLOGPROC, GetProgramInfoLog, glGetProgramInfoLog) \
+	X(PFNGLDELETEPROGRAMPROC, DeleteProgram, glDeleteProgram) \
+	X(PFNGLUSEPROGRAMPROC, UseProgram, glUseProgram) \
+	X(PFNGLGETUNIFORMLOCATIONPROC, GetUniformLocation, glGetUniformLocation) \
+	X(PFNGLUNIFORM1IPROC, Uniform1i, glUniform1i) \
+	X(PFNGLUNIFORM2IPROC, Uniform2i, glUniform2i) \
+	X(PFNGLUNIFORM2FPROC, Uniform2f, glUniform2f) \
+	X(PFNGLUNIFORM4FVPROC, Uniform4fv, glUniform4fv) \
+	X(PFNGLGENFRAMEBUFFERSPROC, GenFramebuffers, glGenFramebuffers) \
+	X(PFNGLDELETEFRAMEBUFFERSPROC, DeleteFramebuffers, glDeleteFramebuffers) \
+	X(PFNGLBINDFRAMEBUFFERPROC, BindFramebuffer, glBindFramebuffer) \
+	X(PFNGLGENRENDERBUFFERSPROC, GenRenderbuffers, glGenRenderbuffers) \
+	X(PFNGLDELETERENDERBUFFERSPROC, DeleteRenderbuffers, glDeleteRenderbuffers) \
+	X(PFNGLBINDRENDERBUFFERPROC, BindRenderbuffer, glBindRenderbuffer) \
+	X(PFNGLRENDERBUFFERSTORAGEPROC, RenderbufferStorage, glRenderbufferStorage) \
+	X(PFNGLFRAMEBUFFERRENDERBUFFERPROC, FramebufferRenderbuffer, glFramebufferRenderbuffer) \
+	X(PFNGLCHECKFRAMEBUFFERSTATUSPROC, CheckFramebufferStatus, glCheckFramebufferStatus)
+
+struct GLFunctions {
+	//Address of an entry point by name, nullptr if the context doesn't have it
+	using LoadProc = void* (*)(const char* name);
+
+#define GL_FUNCTION_POINTER(type, name, symbol) type name = nullptr;
+	GL_FUNCTIONS(GL_FUNCTION_POINTER)
+#undef GL_FUNCTION_POINTER
+
+	//Needs the context current. Returns false if any entry point is missing (the context is older than 4.4)
+	bool load(LoadProc loadProc) {
+		bool complete = true;
+#define GL_FUNCTION_LOAD(type, name, symbol) name = reinterpret_cast<type>(loadProc(#symbol)); complete = complete && name;
+		GL_FUNCTIONS(GL_FUNCTION_LOAD)
+#undef GL_FUNCTION_LOAD
+		return complete;
+	}
+};
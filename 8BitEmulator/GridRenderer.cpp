@@ -0,0 +1,146 @@
+#include "GridRenderer.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "FrameRenderer.h"
+
+//Texel rows of a layer: one per bitplane, then the one with the resolution
+static const int LAYER_ROWS = Display::PLANES + 1;
+static const size_t LAYER_SIZE = sizeof(Display::Row) * Display::HEIGHT * LAYER_ROWS;
+
+GridRenderer::GridRenderer() {
+	m_ready = false;
+	m_capacity = 0;
+	m_program = 0;
+	m_vertexArray = 0;
+	m_planes = 0;
+	m_columnsLocation = -1;
+	m_cellLocation = -1;
+	m_originLocation = -1;
+	m_viewportLocation = -1;
+	m_paletteLocation = -1;
+}
+
+GridRenderer::~GridRenderer() {
+	//release() needs the context current, that is up to the owner
+}
+
+bool GridRenderer::init(GLFunctions::LoadProc loadProc, int capacity, const char* vertexPath, const char* fragmentPath) {
+	if (!FrameRenderer::loadFunctions(m_gl, loadProc))
+		return false;
+
+	int layers = 0;
+	m_gl.GetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layers);
+	if (capacity < 1 || capacity > layers) {
+		std::cerr << "Can't draw " << capacity << " screens at once, the texture array holds 1 to " << layers << "\n";
+		return false;
+	}
+	m_capacity = capacity;
+
+	m_program = FrameRenderer::loadProgram(m_gl, vertexPath, fragmentPath);
+	if (!m_program)
+		return false;
+
+	m_gl.UseProgram(m_program);
+	m_columnsLocation = m_gl.GetUniformLocation(m_program, "columns");
+	m_cellLocation = m_gl.GetUniformLocation(m_program, "cell");
+	m_originLocation = m_gl.GetUniformLocation(m_program, "origin");
+	m_viewportLocation = m_gl.GetUniformLocation(m_program, "viewport");
+	m_paletteLocation = m_gl.GetUniformLocation(m_program, "palette");
+	m_gl.Uniform1i(m_gl.GetUniformLocation(m_program, "planes"), 0);
+
+	//The vertex shader makes up the quads, the core profile still wants a vertex array bound
+	m_gl.GenVertexArrays(1, &m_vertexArray);
+
+	m_gl.GenTextures(1, &m_planes);
+	m_gl.ActiveTexture(GL_TEXTURE0);
+	m_gl.BindTexture(GL_TEXTURE_2D_ARRAY, m_planes);
+	m_gl.TexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32UI, Display::HEIGHT, LAYER_ROWS, m_capacity);
+	m_gl.TexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	m_gl.TexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	//A slot holds every layer, they all go up at once
+	if (!m_upload.init(m_gl, LAYER_SIZE * m_capacity)) {
+		release();
+		return false;
+	}
+
+	const float white[16][4] = { { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } };
+	setPalette(white);
+
+	m_ready = true;
+	return true;
+}
+
+void GridRenderer::release() {
+	m_upload.release();
+	if (m_planes)
+		m_gl.DeleteTextures(1, &m_planes);
+	if (m_vertexArray)
+		m_gl.DeleteVertexArrays(1, &m_vertexArray);
+	if (m_program)
+		m_gl.DeleteProgram(m_program);
+
+	m_planes = m_vertexArray = m_program = 0;
+	m_capacity = 0;
+	m_ready = false;
+}
+
+void GridRenderer::setPalette(const float (*colors)[4]) {
+	m_gl.UseProgram(m_program);
+	m_gl.Uniform4fv(m_paletteLocation, 16, &colors[0][0]);
+}
+
+void GridRenderer::draw(const Display* const* displays, int count, int width, int height) {
+	if (!m_ready || count <= 0 || width <= 0 || height <= 0)
+		return;
+	if (count > m_capacity)
+		count = m_capacity;
+
+	//Screens are 2:1, the column count that gives the widest cell wins. Whole pixels keep the screen pixels even
+	int columns = 1;
+	int cellWidth = 0;
+	for (int candidate = 1; candidate <= count; ++candidate) {
+		const int rows = (count + candidate - 1) / candidate;
+		int size = width / candidate;
+		if (size > height / rows * 2)
+			size = height / rows * 2;
+		if (size > cellWidth) {
+			cellWidth = size;
+			columns = candidate;
+		}
+	}
+	cellWidth = cellWidth < 2 ? 2 : cellWidth & ~1;
+	const int cellHeight = cellWidth / 2;
+	const int rows = (count + columns - 1) / columns;
+
+	//Every screen's rows as they are, followed by its resolution
+	unsigned char* slot = m_upload.begin();
+	const size_t plane = sizeof(Display::Row) * Display::HEIGHT;
+	for (int i = 0; i < count; ++i) {
+		unsigned char* layer = slot + LAYER_SIZE * i;
+		for (int p = 0; p < Display::PLANES; ++p) {
+			std::memcpy(layer + p * plane, displays[i]->GetRows(p), plane);
+		}
+		const unsigned int resolution[4] = { displays[i]->IsHires() ? 1u : 0u, 0, 0, 0 };
+		std::memcpy(layer + Display::PLANES * plane, resolution, sizeof(resolution));
+	}
+
+	const void* offset = m_upload.bind();
+	m_gl.ActiveTexture(GL_TEXTURE0);
+	m_gl.BindTexture(GL_TEXTURE_2D_ARRAY, m_planes);
+	m_gl.TexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, Display::HEIGHT, LAYER_ROWS, count, GL_RGBA_INTEGER, GL_UNSIGNED_INT, offset);
+	m_upload.end();
+
+	m_gl.Viewport(0, 0, width, height);
+	m_gl.ClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	m_gl.Clear(GL_COLOR_BUFFER_BIT);
+	m_gl.UseProgram(m_program);
+	m_gl.Uniform1i(m_columnsLocation, columns);
+	m_gl.Uniform2f(m_cellLocation, (float)cellWidth, (float)cellHeight);
+	m_gl.Uniform2f(m_originLocation, (float)((width - columns * cellWidth) / 2), (float)((height - rows * cellHeight) / 2));
+	m_gl.Uniform2f(m_viewportLocation, (float)width, (float)height);
+	m_gl.BindVertexArray(m_vertexArray);
+	m_gl.DrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+}
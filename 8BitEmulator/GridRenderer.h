@@ -0,0 +1,50 @@
+#pragma once
+#include "Display.h"
+#include "GLFunctions.h"
+#include "UploadRing.h"
+
+/*
+Draws many Chip-8 screens side by side in one viewport, for watching a lot of sessions at once. Every screen is a
+layer of one RGBA32UI texture array holding its packed bitplane rows like FrameRenderer's texture, plus a texel row
+that says which resolution it has. All screens go up with one texture update from a slot of an UploadRing and are drawn with one instanced draw call (one quad per screen, shader/grid_vertex.txt places it, the fragment shader
+picks the bits like FrameRenderer's), so the cost per frame hardly depends on the number of screens.
+The number of screens is only limited by the layers a texture array can have (GL_MAX_ARRAY_TEXTURE_LAYERS, at least
+2048 under OpenGL 4.4). MEGA-CHIP screens are shown as their Chip-8 display.
+*/
+class GridRenderer {
+public:
+
+	GridRenderer();
+	~GridRenderer();
+
+	//Loads the entry points and the shaders and makes room for up to capacity screens per draw. Prints the reason to
+	//std::cerr and returns false if the context can't do it (older than 4.4, shader errors, not enough layers)
+	bool init(GLFunctions::LoadProc loadProc, int capacity, const char* vertexPath, const char* fragmentPath);
+	//Deletes everything init created, the context must still be current
+	void release();
+
+	//Colors of the 16 bitplane palette indices (RGBA, 0-1)
+	void setPalette(const float (*colors)[4]);
+
+	//Draws the screens as a grid filling a viewport of the given size, with as many columns as make the screens
+	//largest. Screens beyond the capacity aren't drawn
+	void draw(const Display* const* displays, int count, int width, int height);
+
+	int GetCapacity() const { return m_capacity; }
+
+private:
+	GLFunctions m_gl;
+	bool m_ready;
+	int m_capacity;
+
+	unsigned int m_program;
+	unsigned int m_vertexArray;
+	unsigned int m_planes;
+	UploadRing m_upload;
+
+	int m_columnsLocation;
+	int m_cellLocation;
+	int m_originLocation;
+	int m_viewportLocation;
+	int m_paletteLocation;
+};
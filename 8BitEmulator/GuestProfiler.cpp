@@ -0,0 +1,183 @@
+#include "GuestProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+GuestProfiler::GuestProfiler() {
+	reset();
+}
+
+void GuestProfiler::reset() {
+	m_pcCounts.assign(ADDRESSES, 0);
+	std::memset(m_opcodeCounts, 0, sizeof(m_opcodeCounts));
+	m_reads.assign(ADDRESSES, 0);
+	m_writes.assign(ADDRESSES, 0);
+
+	m_instructions = 0;
+	m_pending = 0;
+	std::memset(m_pairCounts, 0, sizeof(m_pairCounts));
+	std::memset(m_superCounts, 0, sizeof(m_superCounts));
+	m_lastPc[0] = m_lastPc[1] = 0xFFFF;
+	m_lastOpcode[0] = m_lastOpcode[1] = 0;
+	m_lastFused = false;
+	m_stack.clear();
+	m_folded.clear();
+}
+
+void GuestProfiler::flush() {
+	if (m_pending == 0)
+		return;
+
+	m_folded[m_stack] += m_pending;
+	m_pending = 0;
+}
+
+void GuestProfiler::onCall(unsigned short target) {
+	//The call instruction itself still belongs to the caller
+	flush();
+	m_stack.push_back(target & 0xFFF);
+}
+
+void GuestProfiler::onReturn() {
+	flush();
+	//A ROM that returns more often than it calls would otherwise empty the root frame
+	if (!m_stack.empty())
+		m_stack.pop_back();
+}
+
+bool GuestProfiler::writeFoldedStacks(const char* path) {
+	flush();
+
+	FILE* file = std::fopen(path, "w");
+	if (!file)
+		return false;
+
+	for (const auto& entry : m_folded) {
+		std::fprintf(file, "main");
+		for (unsigned short frame : entry.first) {
+			std::fprintf(file, ";sub_%03X", frame);
+		}
+		std::fprintf(file, " %llu\n", entry.second);
+	}
+
+	std::fclose(file);
+	return true;
+}
+
+void GuestProfiler::countSequence(unsigned short pc, unsigned short opcode) {
+	if (pc == (unsigned short)(m_lastPc[1] + 2)) {
+		++m_pairCounts[opcodeShape(m_lastOpcode[1])][opcodeShape(opcode)];
+
+		Superinstruction pair = matchSuperinstruction(m_lastPc[1], m_lastOpcode[1], opcode, 0);
+		if (pair != SUPER_NONE && !m_lastFused) {
+			m_superCounts[pair] += 2;
+			m_lastFused = true;
+		}
+		else {
+			m_lastFused = false;
+		}
+
+		if (m_lastPc[1] == (unsigned short)(m_lastPc[0] + 2)
+			&& matchSuperinstruction(m_lastPc[0], m_lastOpcode[0], m_lastOpcode[1], opcode) == SUPER_TIMER_WAIT)
+			m_superCounts[SUPER_TIMER_WAIT] += 3;
+	}
+	else {
+		m_lastFused = false;
+	}
+
+	m_lastPc[0] = m_lastPc[1];
+	m_lastOpcode[0] = m_lastOpcode[1];
+	m_lastPc[1] = pc;
+	m_lastOpcode[1] = opcode;
+}
+
+bool GuestProfiler::writeReport(const char* path, int top) const {
+	FILE* file = std::fopen(path, "w");
+	if (!file)
+		return false;
+
+	std::fprintf(file, "Instructions: %llu\n\nHottest addresses:\n", m_instructions);
+
+	std::vector<unsigned short> addresses;
+	for (unsigned int pc = 0; pc < ADDRESSES; ++pc) {
+		if (m_pcCounts[pc] != 0)
+			addresses.push_back((unsigned short)pc);
+	}
+	std::sort(addresses.begin(), addresses.end(), [this](unsigned short a, unsigned short b) {
+		return m_pcCounts[a] > m_pcCounts[b];
+	});
+
+	for (int i = 0; i < top && i < (int)addresses.size(); ++i) {
+		unsigned short pc = addresses[i];
+		std::fprintf(file, "  0x%03X %12llu %6.2f%%\n", pc, m_pcCounts[pc], 100.0 * m_pcCounts[pc] / std::max(1ULL, m_instructions));
+	}
+
+	std::fprintf(file, "\nHottest opcodes:\n");
+
+	std::vector<unsigned int> opcodes;
+	for (unsigned int opcode = 0; opcode < 65536; ++opcode) {
+		if (m_opcodeCounts[opcode] != 0)
+			opcodes.push_back(opcode);
+	}
+	std::sort(opcodes.begin(), opcodes.end(), [this](unsigned int a, unsigned int b) {
+		return m_opcodeCounts[a] > m_opcodeCounts[b];
+	});
+
+	for (int i = 0; i < top && i < (int)opcodes.size(); ++i) {
+		unsigned int opcode = opcodes[i];
+		std::fprintf(file, "  %04X %12llu %6.2f%%\n", opcode, m_opcodeCounts[opcode], 100.0 * m_opcodeCounts[opcode] / std::max(1ULL, m_instructions));
+	}
+
+	std::fclose(file);
+	return true;
+}
+
+bool GuestProfiler::writeHeatmap(const char* path) const {
+	FILE* file = std::fopen(path, "w");
+	if (!file)
+		return false;
+
+	std::fprintf(file, "address,executions,reads,writes\n");
+	for (unsigned int address = 0; address < ADDRESSES; ++address) {
+		if (m_pcCounts[address] == 0 && m_reads[address] == 0 && m_writes[address] == 0)
+			continue;
+
+		std::fprintf(file, "0x%03X,%llu,%llu,%llu\n", address, m_pcCounts[address], m_reads[address], m_writes[address]);
+	}
+
+	std::fclose(file);
+	return true;
+}
+
+bool GuestProfiler::writeFusionReport(const char* path, int top) const {
+	FILE* file = std::fopen(path, "w");
+	if (!file)
+		return false;
+
+	std::fprintf(file, "Instructions: %llu\n\nSuperinstruction coverage:\n", m_instructions);
+	for (int super = SUPER_NONE + 1; super < SUPER_COUNT; ++super) {
+		std::fprintf(file, "  %-30s %12llu %6.2f%%\n", superinstructionName((Superinstruction)super), m_superCounts[super],
+			100.0 * m_superCounts[super] / std::max(1ULL, m_instructions));
+	}
+
+	std::fprintf(file, "\nMost frequent pairs:\n");
+
+	std::vector<int> pairs;
+	for (int pair = 0; pair < OPCODE_SHAPE_COUNT * OPCODE_SHAPE_COUNT; ++pair) {
+		if (m_pairCounts[pair / OPCODE_SHAPE_COUNT][pair % OPCODE_SHAPE_COUNT] != 0)
+			pairs.push_back(pair);
+	}
+	std::sort(pairs.begin(), pairs.end(), [this](int a, int b) {
+		return m_pairCounts[a / OPCODE_SHAPE_COUNT][a % OPCODE_SHAPE_COUNT] > m_pairCounts[b / OPCODE_SHAPE_COUNT][b % OPCODE_SHAPE_COUNT];
+	});
+
+	for (int i = 0; i < top && i < (int)pairs.size(); ++i) {
+		int first = pairs[i] / OPCODE_SHAPE_COUNT;
+		int second = pairs[i] % OPCODE_SHAPE_COUNT;
+		std::fprintf(file, "  %s %s %12llu %6.2f%%\n", opcodeShapeName(first), opcodeShapeName(second), m_pairCounts[first][second],
+			100.0 * m_pairCounts[first][second] / std::max(1ULL, m_instructions));
+	}
+
+	return std::fclose(file) == 0;
+}
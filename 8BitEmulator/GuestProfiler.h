@@ -0,0 +1,81 @@
+#pragma once
+#include <map>
+#include <vector>
+
+#include "Fusion.h"
+#include "Opcode.h"
+
+/*
+Profiler for the emulated program (not the emulator itself).
+Counts executions per address and per opcode, memory reads/writes per address and instructions per call stack.
+The address counts cover the 64 KB the program counter can reach (all of XO-CHIP memory). MEGA-CHIP reads and writes
+above it aren't counted, no address is ever folded onto another.
+The core only calls into it when compiled with CHIP8_PROFILER, otherwise the hooks don't exist at all.
+*/
+class GuestProfiler {
+public:
+
+	//Addresses the per address counts cover
+	static const unsigned int ADDRESSES = 0x10000;
+
+	GuestProfiler();
+
+	void reset();
+
+	//Hooks called by the core
+	void onInstruction(unsigned short pc, unsigned short opcode) {
+		++m_pcCounts[pc];
+		++m_opcodeCounts[opcode];
+		++m_pending;
+		++m_instructions;
+		countSequence(pc, opcode);
+	}
+	void onRead(unsigned int address) { if (address < ADDRESSES) ++m_reads[address]; }
+	void onWrite(unsigned int address) { if (address < ADDRESSES) ++m_writes[address]; }
+	void onCall(unsigned short target);
+	void onReturn();
+
+	unsigned long long GetInstructions() const { return m_instructions; }
+	unsigned long long GetPCCount(unsigned short pc) const { return m_pcCounts[pc]; }
+	unsigned long long GetOpcodeCount(unsigned short opcode) const { return m_opcodeCounts[opcode]; }
+	//How often an instruction of shape second directly followed one of shape first (see opcodeShape)
+	unsigned long long GetPairCount(int first, int second) const { return m_pairCounts[first][second]; }
+	//Instructions that would have run as part of the superinstruction
+	unsigned long long GetSuperinstructionCount(Superinstruction super) const { return m_superCounts[super]; }
+
+	//Flamegraph input: one line per call stack, frames separated by ';' followed by the instruction count
+	bool writeFoldedStacks(const char* path);
+	//Top addresses and opcodes
+	bool writeReport(const char* path, int top = 32) const;
+	//address,executions,reads,writes for every address that was executed or accessed
+	bool writeHeatmap(const char* path) const;
+	//Superinstruction coverage and the most frequent instruction pairs (candidates for new superinstructions)
+	bool writeFusionReport(const char* path, int top = 16) const;
+
+private:
+	//Adds the instructions executed since the last stack change to the current stack
+	void flush();
+	//Counts instruction pairs and the superinstructions the executed sequence contains
+	void countSequence(unsigned short pc, unsigned short opcode);
+
+	//ADDRESSES entries each, on the heap so the profiler still fits on a stack
+	std::vector<unsigned long long> m_pcCounts;
+	unsigned long long m_opcodeCounts[65536];
+	std::vector<unsigned long long> m_reads;
+	std::vector<unsigned long long> m_writes;
+
+	unsigned long long m_instructions;
+	unsigned long long m_pending;
+
+	unsigned long long m_pairCounts[OPCODE_SHAPE_COUNT][OPCODE_SHAPE_COUNT];
+	unsigned long long m_superCounts[SUPER_COUNT];
+	//Last two executed instructions
+	unsigned short m_lastPc[2];
+	unsigned short m_lastOpcode[2];
+	//The last instruction already belongs to a counted pair (the interpreter doesn't fuse overlapping pairs)
+	bool m_lastFused;
+
+	//Entry points of the active subroutines (the shadow of the 2NNN/00EE stack)
+	std::vector<unsigned short> m_stack;
+	std::map<std::vector<unsigned short>, unsigned long long> m_folded;
+};
@@ -0,0 +1,130 @@
+#include "HeadlessContext.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext() {
+	m_display = nullptr;
+	m_context = nullptr;
+	m_framebuffer = 0;
+	m_renderbuffer = 0;
+	m_width = 0;
+	m_height = 0;
+}
+
+HeadlessContext::~HeadlessContext() {
+	destroy();
+}
+
+#ifdef __linux__
+
+void* HeadlessContext::getProcAddress(const char* name) {
+	return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+
+bool HeadlessContext::create(int width, int height) {
+	//Surfaceless: no window system at all, the framebuffer object is all there is to draw into
+	auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	EGLDisplay display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) : EGL_NO_DISPLAY;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+		std::cerr << "No surfaceless EGL display (error 0x" << std::hex << eglGetError() << std::dec << ")\n";
+		return false;
+	}
+	m_display = display;
+
+	const EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 4,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = EGL_NO_CONTEXT;
+	if (eglBindAPI(EGL_OPENGL_API))
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		std::cerr << "Couldn't create an OpenGL 4.4 core context (error 0x" << std::hex << eglGetError() << std::dec << ")\n";
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		destroy();
+		return false;
+	}
+	m_context = context;
+
+	if (!m_gl.load(getProcAddress)) {
+		std::cerr << "The context is missing OpenGL 4.4 entry points\n";
+		destroy();
+		return false;
+	}
+
+	m_gl.GenRenderbuffers(1, &m_renderbuffer);
+	m_gl.BindRenderbuffer(GL_RENDERBUFFER, m_renderbuffer);
+	m_gl.RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	m_gl.GenFramebuffers(1, &m_framebuffer);
+	m_gl.BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	m_gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffer);
+	if (m_gl.CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Couldn't create a " << width << "x" << height << " framebuffer\n";
+		destroy();
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	return true;
+}
+
+void HeadlessContext::destroy() {
+	if (m_context) {
+		if (m_framebuffer)
+			m_gl.DeleteFramebuffers(1, &m_framebuffer);
+		if (m_renderbuffer)
+			m_gl.DeleteRenderbuffers(1, &m_renderbuffer);
+		eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(m_display, m_context);
+	}
+	if (m_display)
+		eglTerminate(m_display);
+
+	m_display = nullptr;
+	m_context = nullptr;
+	m_framebuffer = 0;
+	m_renderbuffer = 0;
+	m_width = 0;
+	m_height = 0;
+}
+
+#else
+
+void* HeadlessContext::getProcAddress(const char* name) {
+	return nullptr;
+}
+
+bool HeadlessContext::create(int width, int height) {
+	std::cerr << "Headless OpenGL contexts need EGL, which this platform build doesn't have\n";
+	return false;
+}
+
+void HeadlessContext::destroy() {
+}
+
+#endif
+
+void HeadlessContext::readPixels(std::vector<unsigned char>& rgba) {
+	rgba.resize((size_t)m_width * m_height * 4);
+	if (!m_context)
+		return;
+
+	//OpenGL's rows go bottom up
+	std::vector<unsigned char> flipped(rgba.size());
+	m_gl.PixelStorei(GL_PACK_ALIGNMENT, 1);
+	m_gl.ReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, flipped.data());
+	const size_t row = (size_t)m_width * 4;
+	for (int y = 0; y < m_height; ++y) {
+		std::copy(flipped.begin() + (m_height - 1 - y) * row, flipped.begin() + (m_height - y) * row, rgba.begin() + y * row);
+	}
+}
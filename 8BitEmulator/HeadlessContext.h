@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+
+#include "GLFunctions.h"
+
+/*
+OpenGL 4.4 core context without a window, drawing into an off screen RGBA framebuffer of a fixed size. Used by the
+tools to run the renderer where there is no display (CI, servers), Mesa's llvmpipe is enough.
+Needs EGL with EGL_MESA_platform_surfaceless and EGL_KHR_no_config_context, which is what Linux drivers have;
+elsewhere create() reports that headless contexts aren't supported.
+*/
+class HeadlessContext {
+public:
+	HeadlessContext();
+	~HeadlessContext();
+
+	//Creates the context, makes it current on the calling thread and binds the framebuffer. Prints the reason to
+	//std::cerr and returns false if it can't
+	bool create(int width, int height);
+	void destroy();
+
+	//Loader for FrameRenderer::init and GLFunctions::load
+	static void* getProcAddress(const char* name);
+
+	//Waits for the drawing and copies the framebuffer out, top row first, 4 bytes (RGBA) per pixel
+	void readPixels(std::vector<unsigned char>& rgba);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+
+private:
+	void* m_display;
+	void* m_context;
+	GLFunctions m_gl;
+	unsigned int m_framebuffer;
+	unsigned int m_renderbuffer;
+	int m_width;
+	int m_height;
+};
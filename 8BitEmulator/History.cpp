@@ -0,0 +1,196 @@
+#include "History.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	//Spacing of a fresh history, small enough that the first reverse steps are instant
+	const unsigned long long INITIAL_INTERVAL = 1024;
+	//Cycles run to estimate the replay speed before the first real replay
+	const unsigned int CALIBRATION_CYCLES = 100000;
+	const unsigned long long NO_MATCH = ULLONG_MAX;
+}
+
+History::History(size_t memoryBudget, double latencyTarget) : m_memoryBudget(memoryBudget), m_latencyTarget(latencyTarget),
+	m_cyclesPerSecond(10000000.0), m_interval(INITIAL_INTERVAL), m_frontier(0) {
+	std::memset(m_keys, 0, sizeof(m_keys));
+}
+
+void History::reset(const Chip8& chip) {
+	m_checkpoints.clear();
+	m_keyLog.clear();
+	m_interval = INITIAL_INTERVAL;
+	m_frontier = chip.GetCycle();
+	std::memcpy(m_keys, chip.m_key, sizeof(m_keys));
+
+	//The first checkpoint doesn't have to be aligned to the interval, it is never thinned out
+	m_checkpoints.emplace(m_frontier, chip);
+
+	//Estimate the replay speed on a copy (emulateCycle, runCycles would hand over to an attached debugger)
+	Chip8 calibration = chip;
+	auto start = Clock::now();
+	for (unsigned int i = 0; i < CALIBRATION_CYCLES && !calibration.IsHalted(); ++i) {
+		calibration.emulateCycle();
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	unsigned long long cycles = calibration.GetCycle() - chip.GetCycle();
+	if (cycles >= CALIBRATION_CYCLES / 10 && seconds > 0.0)
+		m_cyclesPerSecond = cycles / seconds;
+}
+
+void History::record(Chip8& chip) {
+	const unsigned long long cycle = chip.GetCycle();
+
+	if (std::memcmp(chip.m_key, m_keys, sizeof(m_keys)) != 0) {
+		KeyEvent event;
+		event.cycle = cycle;
+		std::memcpy(event.keys, chip.m_key, sizeof(event.keys));
+		m_keyLog.push_back(event);
+		std::memcpy(m_keys, chip.m_key, sizeof(m_keys));
+	}
+
+	//Taken after the keys were logged so the checkpoint already contains them
+	if (cycle % m_interval == 0 && m_checkpoints.find(cycle) == m_checkpoints.end()) {
+		m_checkpoints.emplace(cycle, chip);
+		if (GetMemoryUsage() > m_memoryBudget)
+			thin();
+	}
+
+	//The instruction about to execute extends the history by one cycle
+	m_frontier = cycle + 1;
+}
+
+void History::replayKeys(Chip8& chip) {
+	const unsigned long long cycle = chip.GetCycle();
+
+	auto event = std::lower_bound(m_keyLog.begin(), m_keyLog.end(), cycle,
+		[](const KeyEvent& event, unsigned long long cycle) { return event.cycle < cycle; });
+	if (event != m_keyLog.end() && event->cycle == cycle)
+		std::memcpy(chip.m_key, event->keys, sizeof(chip.m_key));
+}
+
+void History::truncate(const Chip8& chip) {
+	const unsigned long long cycle = chip.GetCycle();
+
+	m_checkpoints.erase(m_checkpoints.upper_bound(cycle), m_checkpoints.end());
+	m_keyLog.erase(std::lower_bound(m_keyLog.begin(), m_keyLog.end(), cycle,
+		[](const KeyEvent& event, unsigned long long cycle) { return event.cycle < cycle; }), m_keyLog.end());
+
+	m_frontier = cycle;
+	std::memcpy(m_keys, chip.m_key, sizeof(m_keys));
+}
+
+void History::replay(Chip8& chip, unsigned long long cycle, const Predicate* predicate, unsigned long long* lastMatch) {
+	const unsigned long long from = chip.GetCycle();
+	auto start = Clock::now();
+
+	auto event = std::lower_bound(m_keyLog.begin(), m_keyLog.end(), from,
+		[](const KeyEvent& event, unsigned long long cycle) { return event.cycle < cycle; });
+
+	while (chip.GetCycle() < cycle && !chip.IsHalted()) {
+		const unsigned long long current = chip.GetCycle();
+
+		if (event != m_keyLog.end() && event->cycle == current) {
+			std::memcpy(chip.m_key, event->keys, sizeof(chip.m_key));
+			++event;
+		}
+
+		if (predicate && (*predicate)(chip))
+			*lastMatch = current;
+
+		chip.emulateCycle();
+	}
+
+	//Keep the speed estimate current, short replays are dominated by the clock
+	unsigned long long replayed = chip.GetCycle() - from;
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	if (replayed >= 10000 && seconds > 0.0)
+		m_cyclesPerSecond = 0.75 * m_cyclesPerSecond + 0.25 * (replayed / seconds);
+}
+
+bool History::seek(Chip8& chip, unsigned long long cycle) {
+	if (m_checkpoints.empty() || cycle > m_frontier)
+		return false;
+
+	auto checkpoint = m_checkpoints.upper_bound(cycle);
+	if (checkpoint == m_checkpoints.begin())
+		return false;
+	--checkpoint;
+
+	//Going forward from the current state is cheaper than restoring if no checkpoint lies in between
+	if (chip.GetCycle() > cycle || chip.GetCycle() < checkpoint->first || chip.IsHalted())
+		chip = checkpoint->second;
+
+	replay(chip, cycle, nullptr, nullptr);
+	return chip.GetCycle() == cycle;
+}
+
+bool History::findLast(Chip8& chip, const Predicate& predicate) {
+	if (m_checkpoints.empty())
+		return false;
+
+	unsigned long long end = chip.GetCycle();
+
+	//Search the segments between checkpoints backwards, the latest match of the first segment that has one wins
+	while (true) {
+		auto checkpoint = m_checkpoints.lower_bound(end);
+		if (checkpoint == m_checkpoints.begin()) {
+			chip = checkpoint->second;
+			return false;
+		}
+		--checkpoint;
+
+		unsigned long long match = NO_MATCH;
+		chip = checkpoint->second;
+		replay(chip, end, &predicate, &match);
+
+		if (match != NO_MATCH)
+			return seek(chip, match);
+
+		end = checkpoint->first;
+	}
+}
+
+unsigned long long History::GetFirstCycle() const {
+	return m_checkpoints.empty() ? 0 : m_checkpoints.begin()->first;
+}
+
+size_t History::GetMemoryUsage() const {
+	//Rough size of a map node on top of the state, the memory and the MEGA-CHIP screen (an index and two colors per
+	//pixel) live on the heap
+	const size_t state = m_checkpoints.empty() ? 0 : m_checkpoints.begin()->second.GetMemorySize()
+		+ (m_checkpoints.begin()->second.GetMegaDisplay().IsEnabled() ? MegaDisplay::WIDTH * MegaDisplay::HEIGHT * 9 : 0);
+	const size_t node = sizeof(Chip8) + state + 4 * sizeof(void*);
+	return m_checkpoints.size() * node + m_keyLog.capacity() * sizeof(KeyEvent);
+}
+
+void History::thin() {
+	//A wider spacing keeps the whole session as long as reverse steps stay within the latency target
+	while (GetMemoryUsage() > m_memoryBudget && (m_interval * 2) / m_cyclesPerSecond <= m_latencyTarget) {
+		m_interval *= 2;
+
+		auto checkpoint = m_checkpoints.begin();
+		++checkpoint;
+		while (checkpoint != m_checkpoints.end()) {
+			if (checkpoint->first % m_interval != 0)
+				checkpoint = m_checkpoints.erase(checkpoint);
+			else
+				++checkpoint;
+		}
+	}
+
+	//Beyond that the history starts later, the newest checkpoint always stays
+	if (GetMemoryUsage() <= m_memoryBudget)
+		return;
+	while (GetMemoryUsage() > m_memoryBudget && m_checkpoints.size() > 1) {
+		m_checkpoints.erase(m_checkpoints.begin());
+	}
+	const unsigned long long first = m_checkpoints.begin()->first;
+	m_keyLog.erase(m_keyLog.begin(), std::lower_bound(m_keyLog.begin(), m_keyLog.end(), first,
+		[](const KeyEvent& event, unsigned long long cycle) { return event.cycle < cycle; }));
+}
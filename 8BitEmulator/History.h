@@ -0,0 +1,86 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "chip8.h"
+
+/*
+Execution history for reverse debugging.
+Keeps copies of the whole machine every m_interval cycles plus a log of keypad changes. Any earlier cycle is
+reached by restoring the nearest checkpoint before it and executing forward again, which needs a deterministic
+core (seeded CXNN, input replayed from the log).
+
+The spacing adapts to the session: while the checkpoints fit into the memory budget the interval stays small,
+once they don't every other checkpoint is dropped and the interval doubles. The interval never grows beyond what
+the core replays within the latency target, past that the oldest checkpoints are dropped instead, so the memory
+budget always holds (unless a single checkpoint is larger) and long sessions only keep their recent history.
+A checkpoint holds all of memory, 64 KB, 16 MB under MEGA-CHIP, which keeps MEGA-CHIP histories short.
+*/
+class History {
+public:
+
+	//Evaluated on the machine state before an instruction executes
+	using Predicate = std::function<bool(const Chip8& chip)>;
+
+	explicit History(size_t memoryBudget = 64 * 1024 * 1024, double latencyTarget = 0.05);
+
+	//Forgets everything and starts recording at the current state of the chip
+	void reset(const Chip8& chip);
+	bool isRecording() const { return !m_checkpoints.empty(); }
+
+	//Called before every instruction executed forward. Records keypad changes and takes checkpoints,
+	//inside already recorded history it replays the logged keypad state instead
+	void beforeStep(Chip8& chip) {
+		const unsigned long long cycle = chip.GetCycle();
+		if (cycle < m_frontier)
+			replayKeys(chip);
+		else
+			record(chip);
+	}
+
+	//Drops everything recorded after the current cycle (the keypad changed, a new timeline starts)
+	void truncate(const Chip8& chip);
+
+	//Moves the chip to the cycle, which must lie between the first checkpoint and the recorded frontier
+	bool seek(Chip8& chip, unsigned long long cycle);
+
+	//Moves the chip to the last cycle before the current one where the predicate held.
+	//Returns false (and leaves the chip at the first recorded cycle) if there is none
+	bool findLast(Chip8& chip, const Predicate& predicate);
+
+	unsigned long long GetFirstCycle() const;
+	unsigned long long GetFrontier() const { return m_frontier; }
+	unsigned long long GetInterval() const { return m_interval; }
+	size_t GetCheckpointCount() const { return m_checkpoints.size(); }
+	size_t GetMemoryUsage() const;
+	//Estimated worst case time of a reverse step in seconds
+	double GetReverseStepLatency() const { return m_interval / m_cyclesPerSecond; }
+
+private:
+	struct KeyEvent {
+		unsigned long long cycle;
+		unsigned char keys[16];
+	};
+
+	void record(Chip8& chip);
+	void replayKeys(Chip8& chip);
+	//Executes forward until the cycle, stops early if the core halts
+	void replay(Chip8& chip, unsigned long long cycle, const Predicate* predicate, unsigned long long* lastMatch);
+	//Brings the checkpoints back within the memory budget
+	void thin();
+
+	size_t m_memoryBudget;
+	double m_latencyTarget;
+	//Replay speed, measured on every replay
+	double m_cyclesPerSecond;
+
+	unsigned long long m_interval;
+	//Cycle up to which the history is known
+	unsigned long long m_frontier;
+
+	std::map<unsigned long long, Chip8> m_checkpoints;
+	std::vector<KeyEvent> m_keyLog;
+	//Keypad at the frontier
+	unsigned char m_keys[16];
+};
@@ -3,122 +3,150 @@
 #include <chrono>
 #include <thread>
 
-#include "RenderAPI.h"
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
 #include "chip8.h"
+#include "EventLog.h"
+#include "FrameRenderer.h"
+#include "Scheduler.h"
 
 void HandleInput(GLFWwindow* window, Chip8& chip);
 
+static void* LoadGLFunction(const char* name) {
+	return reinterpret_cast<void*>(glfwGetProcAddress(name));
+}
+
 int main() {
+	//Core events (beeps, illegal opcodes) are written by a background thread
+	EventLog::start();
+
 	//Graphic init
-	Renderer::Init(800, 400, "Chip-8");
-	Renderer::Shader shader("shader/vertex.txt", "shader/fragment.txt");
-	Renderer::Grid grid = Renderer::CreateGrid(64, 32);
-	Renderer::BufferManager bufferManager(grid);
-	bufferManager.SetGridStandard();
+	if (!glfwInit()) {
+		std::cerr << "Couldn't initialize GLFW\n";
+		return 1;
+	}
+	//The renderer keeps its pixel buffer mapped, which needs OpenGL 4.4
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+	GLFWwindow* window = glfwCreateWindow(800, 400, "Chip-8", nullptr, nullptr);
+	if (!window) {
+		std::cerr << "Couldn't create an OpenGL 4.4 window\n";
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent(window);
+	//The scheduler paces the frames, waiting for vsync on top of it would only add latency
+	glfwSwapInterval(0);
+
+	FrameRenderer renderer;
+	if (!renderer.init(LoadGLFunction, "shader/vertex.txt", "shader/fragment.txt")) {
+		glfwTerminate();
+		return 1;
+	}
 
-	Chip8 chip{ grid };
+	Chip8 chip;
 	chip.initialize();
 	chip.loadGame("test_opcode.ch8");
 
-	//Cycles per second
-	const double cyclesPerSecond = 500.0;
-	const double timePerCycle = 1.0 / cyclesPerSecond;
-
-	//Timing
-	auto lastCycleTime = std::chrono::high_resolution_clock::now();
-	double deltaTime = 0.0;
-
-	while (!Renderer::windowShouldClose()) {
-		//Current time
-		auto currentCycleTime = std::chrono::high_resolution_clock::now();
-		//Elapsed time
-		std::chrono::duration<double> elapsed = currentCycleTime - lastCycleTime;
-
-		deltaTime += elapsed.count();
-
-		lastCycleTime = currentCycleTime;
-
-		if (deltaTime >= timePerCycle) {
-			chip.emulateCycle();
-			deltaTime -= timePerCycle;
-
-			HandleInput((GLFWwindow*)Renderer::GetRenderWindow(), chip);
-
-			if (chip.drawFlag) {
-				grid.Clear();
-				for (int x = 0; x < 64; ++x) {
-					for (int y = 0; y < 32; ++y) {
-						if (chip.GetGFX()[x][y] == (int)1) {
-							grid.SetPixel(x, 31 - y);
-						}
-					}
-				}
-				chip.drawFlag = false;
-				Renderer::RenderGrid(grid, shader);
-				Renderer::BufferSwap(Renderer::GetRenderWindow());
-				Renderer::PollEvents();
-				
-			}
+#ifdef CHIP8_PROFILER
+	GuestProfiler profiler;
+	chip.SetProfiler(&profiler);
+#endif
+
+	//The timers run on the scheduler's 60 Hz tick instead of after every instruction
+	chip.SetTiming(TIMING_SCHEDULED);
+
+	//Emulated time runs on a 3000 Hz clock, so both the 500 Hz CPU and the 60 Hz devices get whole ticks
+	const unsigned long long ticksPerSecond = 3000;
+	const unsigned long long ticksPerCycle = ticksPerSecond / 500;
+	const unsigned long long ticksPerFrame = ticksPerSecond / 60;
+
+	Scheduler scheduler;
+
+	//The CPU runs everything up to the next event as one batch
+	unsigned long long cpuTime = 0;
+	auto cpu = [&chip, &cpuTime, ticksPerCycle](unsigned long long until) {
+		unsigned long long cycles = (until - cpuTime) / ticksPerCycle;
+		chip.runCycles((unsigned int)cycles);
+		cpuTime += cycles * ticksPerCycle;
+	};
+
+	//Delay and sound timer
+	scheduler.schedule(ticksPerFrame, [&chip]() { chip.tickTimers(); }, ticksPerFrame);
+
+	//Colors of the XO-CHIP bitplanes (index 1 is the only one other programs draw with)
+	const float palette[16][4] = {
+		{ 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 0.4f, 0.0f, 1.0f }, { 0.4f, 0.13f, 0.0f, 1.0f },
+		{ 0.0f, 0.4f, 1.0f, 1.0f }, { 0.6f, 0.8f, 1.0f, 1.0f }, { 0.6f, 0.2f, 0.8f, 1.0f }, { 0.3f, 0.1f, 0.4f, 1.0f },
+		{ 0.0f, 0.8f, 0.2f, 1.0f }, { 0.6f, 1.0f, 0.6f, 1.0f }, { 0.8f, 0.8f, 0.0f, 1.0f }, { 0.4f, 0.4f, 0.0f, 1.0f },
+		{ 1.0f, 0.0f, 0.2f, 1.0f }, { 1.0f, 0.6f, 0.7f, 1.0f }, { 0.5f, 0.5f, 0.5f, 1.0f }, { 0.25f, 0.25f, 0.25f, 1.0f }
+	};
+	renderer.setPalette(palette);
+	int width = 0;
+	int height = 0;
+
+	//Vblank: present the frame, read the keypad and wait for the wall clock to catch up with the emulated time
+	auto start = std::chrono::steady_clock::now();
+	scheduler.schedule(ticksPerFrame, [&]() {
+		//A resized window has to be drawn again even if the program didn't draw anything
+		int framebufferWidth = 0;
+		int framebufferHeight = 0;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		if (framebufferWidth != width || framebufferHeight != height) {
+			width = framebufferWidth;
+			height = framebufferHeight;
+			chip.drawFlag = true;
 		}
-		else {
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		//The frame goes up as it is, the shader turns it into colors
+		if (chip.drawFlag && width > 0 && height > 0) {
+			if (chip.GetMegaDisplay().IsEnabled())
+				renderer.draw(chip.GetMegaDisplay(), width, height);
+			else
+				renderer.draw(chip.GetDisplay(), width, height);
+			chip.drawFlag = false;
+			glfwSwapBuffers(window);
 		}
-		
-	}
-}
 
-void KeyDown(GLFWwindow* window, Chip8& chip, Renderer::InputHandler::KeyCode key, int reg) {
-	if (Renderer::InputHandler::GetKey(window, key) == Renderer::InputHandler::KEY_PRESSED) {
-		chip.m_key[reg] = 1;
-		//std::cout << "Pressed Key: " << key << "\n";
-	}
-}
+		glfwPollEvents();
+		HandleInput(window, chip);
 
-void KeyUP(GLFWwindow* window, Chip8& chip, Renderer::InputHandler::KeyCode key, int reg) {
-	if (Renderer::InputHandler::GetKey(window, key) == Renderer::InputHandler::KEY_RELEASED) {
-		chip.m_key[reg] = 0;
-	}
+		if (glfwWindowShouldClose(window)) {
+			scheduler.stop();
+			return;
+		}
+
+		std::this_thread::sleep_until(start + std::chrono::microseconds(scheduler.GetTime() * 1000000 / ticksPerSecond));
+	}, ticksPerFrame);
+
+	scheduler.runUntil(~0ULL, cpu);
+
+#ifdef CHIP8_PROFILER
+	profiler.writeFoldedStacks("profile.folded");
+	profiler.writeReport("profile.report.txt");
+	profiler.writeHeatmap("profile.heatmap.csv");
+#endif
+
+	renderer.release();
+	glfwDestroyWindow(window);
+	glfwTerminate();
+
+	EventLog::stop();
 }
 
 void HandleInput(GLFWwindow* window, Chip8& chip) {
-	KeyDown(window, chip, Renderer::InputHandler::KEY_1, 0x1);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_2, 0x2);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_3, 0x3);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_4, 0xC);
-
-	KeyDown(window, chip, Renderer::InputHandler::KEY_Q, 0x4);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_W, 0x5);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_E, 0x6);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_R, 0xD);
-
-	KeyDown(window, chip, Renderer::InputHandler::KEY_A, 0x7);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_S, 0x8);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_D, 0x9);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_F, 0xE);
-
-	KeyDown(window, chip, Renderer::InputHandler::KEY_Y, 0xA);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_X, 0x0);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_C, 0xB);
-	KeyDown(window, chip, Renderer::InputHandler::KEY_V, 0xF);
-
-	//
-	KeyUP(window, chip, Renderer::InputHandler::KEY_1, 0x1);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_2, 0x2);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_3, 0x3);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_4, 0xC);
-
-	KeyUP(window, chip, Renderer::InputHandler::KEY_Q, 0x4);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_W, 0x5);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_E, 0x6);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_R, 0xD);
-
-	KeyUP(window, chip, Renderer::InputHandler::KEY_A, 0x7);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_S, 0x8);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_D, 0x9);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_F, 0xE);
-
-	KeyUP(window, chip, Renderer::InputHandler::KEY_Y, 0xA);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_X, 0x0);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_C, 0xB);
-	KeyUP(window, chip, Renderer::InputHandler::KEY_V, 0xF);
-}
\ No newline at end of file
+	//The 4x4 keypad on 1-4, Q-R, A-F and Y-V
+	static const int keys[16] = {
+		GLFW_KEY_X, GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3,
+		GLFW_KEY_Q, GLFW_KEY_W, GLFW_KEY_E, GLFW_KEY_A,
+		GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_Y, GLFW_KEY_C,
+		GLFW_KEY_4, GLFW_KEY_R, GLFW_KEY_F, GLFW_KEY_V
+	};
+
+	for (int reg = 0; reg < 16; ++reg) {
+		chip.m_key[reg] = glfwGetKey(window, keys[reg]) == GLFW_PRESS ? 1 : 0;
+	}
+}
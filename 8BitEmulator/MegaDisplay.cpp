@@ -0,0 +1,275 @@
+#include "MegaDisplay.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "DisplaySimd.h"
+
+/*
+Blend kernels, one per mode so the mode is picked once per row instead of per pixel. The percentage modes mix every
+channel as (sprite * a + screen * (256 - a)) / 256, multiply divides by 255 with the (t + (t >> 8)) >> 8 trick, add
+saturates. Alpha is a channel like the others.
+*/
+template<int Mode> struct Blend;
+
+template<int Share> struct BlendShare {
+	static unsigned int pixel(unsigned int sprite, unsigned int screen) {
+		unsigned int result = 0;
+		for (int shift = 0; shift < 32; shift += 8) {
+			const unsigned int s = sprite >> shift & 0xFF;
+			const unsigned int d = screen >> shift & 0xFF;
+			result |= (s * Share + d * (256 - Share)) >> 8 << shift;
+		}
+		return result;
+	}
+#ifdef DISPLAY_SSE2
+	static __m128i pixels(__m128i sprite, __m128i screen) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i share = _mm_set1_epi16(Share);
+		const __m128i rest = _mm_set1_epi16(256 - Share);
+		//At most 255 * 256 per lane, the sums fit unsigned 16 bit
+		const __m128i low = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(sprite, zero), share),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(screen, zero), rest)), 8);
+		const __m128i high = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(sprite, zero), share),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(screen, zero), rest)), 8);
+		return _mm_packus_epi16(low, high);
+	}
+#endif
+};
+
+template<> struct Blend<MegaDisplay::BLEND_NORMAL> {
+	static unsigned int pixel(unsigned int sprite, unsigned int) { return sprite; }
+#ifdef DISPLAY_SSE2
+	static __m128i pixels(__m128i sprite, __m128i) { return sprite; }
+#endif
+};
+
+template<> struct Blend<MegaDisplay::BLEND_25> : BlendShare<64> {};
+template<> struct Blend<MegaDisplay::BLEND_50> : BlendShare<128> {};
+template<> struct Blend<MegaDisplay::BLEND_75> : BlendShare<192> {};
+
+template<> struct Blend<MegaDisplay::BLEND_ADD> {
+	static unsigned int pixel(unsigned int sprite, unsigned int screen) {
+		unsigned int result = 0;
+		for (int shift = 0; shift < 32; shift += 8) {
+			const unsigned int sum = (sprite >> shift & 0xFF) + (screen >> shift & 0xFF);
+			result |= std::min(sum, 255u) << shift;
+		}
+		return result;
+	}
+#ifdef DISPLAY_SSE2
+	static __m128i pixels(__m128i sprite, __m128i screen) { return _mm_adds_epu8(sprite, screen); }
+#endif
+};
+
+template<> struct Blend<MegaDisplay::BLEND_MULTIPLY> {
+	static unsigned int pixel(unsigned int sprite, unsigned int screen) {
+		unsigned int result = 0;
+		for (int shift = 0; shift < 32; shift += 8) {
+			const unsigned int t = (sprite >> shift & 0xFF) * (screen >> shift & 0xFF) + 128;
+			result |= (t + (t >> 8)) >> 8 << shift;
+		}
+		return result;
+	}
+#ifdef DISPLAY_SSE2
+	static __m128i pixels(__m128i sprite, __m128i screen) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi16(128);
+		__m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(sprite, zero), _mm_unpacklo_epi8(screen, zero)), round);
+		__m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(sprite, zero), _mm_unpackhi_epi8(screen, zero)), round);
+		low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+		high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+		return _mm_packus_epi16(low, high);
+	}
+#endif
+};
+
+/*
+Blends a row: transparent sprite pixels (index 0) leave the screen alone, opaque ones replace the index and blend
+their palette color onto the screen color. Returns true if an opaque pixel covered the collision index.
+SSE2 takes 16 indices at a time (compare, select, collision test) and blends their colors 4 at a time, groups that are
+completely transparent are skipped. The rest of the row goes pixel by pixel.
+*/
+template<int Mode>
+static bool blendRow(unsigned char* indices, unsigned int* colors, const unsigned char* pixels, int width,
+	const unsigned int* palette, unsigned char collisionIndex) {
+	bool collision = false;
+	int i = 0;
+
+#ifdef DISPLAY_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i collisionColor = _mm_set1_epi8((char)collisionIndex);
+	__m128i hits = zero;
+
+	for (; i + 16 <= width; i += 16) {
+		const __m128i sprite = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+		const __m128i transparent = _mm_cmpeq_epi8(sprite, zero);
+		if (_mm_movemask_epi8(transparent) == 0xFFFF)
+			continue;
+
+		const __m128i screen = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+		hits = _mm_or_si128(hits, _mm_andnot_si128(transparent, _mm_cmpeq_epi8(screen, collisionColor)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i),
+			_mm_or_si128(_mm_and_si128(transparent, screen), _mm_andnot_si128(transparent, sprite)));
+
+		//Byte masks widened to one 32 bit lane per pixel
+		const __m128i words[2] = { _mm_unpacklo_epi8(transparent, transparent), _mm_unpackhi_epi8(transparent, transparent) };
+		for (int group = 0; group < 4; ++group) {
+			const __m128i keep = group & 1 ? _mm_unpackhi_epi16(words[group >> 1], words[group >> 1])
+				: _mm_unpacklo_epi16(words[group >> 1], words[group >> 1]);
+			const unsigned char* p = pixels + i + group * 4;
+			//No gather before AVX2, the palette lookups are plain loads
+			const __m128i spriteColors = _mm_set_epi32((int)palette[p[3]], (int)palette[p[2]], (int)palette[p[1]], (int)palette[p[0]]);
+			__m128i* target = reinterpret_cast<__m128i*>(colors + i + group * 4);
+			const __m128i screenColors = _mm_loadu_si128(target);
+			const __m128i blended = Blend<Mode>::pixels(spriteColors, screenColors);
+			_mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(keep, screenColors), _mm_andnot_si128(keep, blended)));
+		}
+	}
+	collision = _mm_movemask_epi8(hits) != 0;
+#endif
+
+	for (; i < width; ++i) {
+		const unsigned char index = pixels[i];
+		if (index == 0)
+			continue;
+
+		collision = collision || indices[i] == collisionIndex;
+		indices[i] = index;
+		colors[i] = Blend<Mode>::pixel(palette[index], colors[i]);
+	}
+	return collision;
+}
+
+MegaDisplay::MegaDisplay() {
+	//Index 0 is transparent black, the others start out white until the program loads its palette
+	m_palette[0] = 0;
+	for (int i = 1; i < 256; ++i) {
+		m_palette[i] = 0xFFFFFFFF;
+	}
+	m_spriteWidth = 256;
+	m_spriteHeight = 256;
+	m_blend = BLEND_NORMAL;
+	m_collision = 0;
+	m_screenAlpha = 0xFF;
+}
+
+void MegaDisplay::enable() {
+	m_indices.assign(WIDTH * HEIGHT, 0);
+	m_colors.assign(WIDTH * HEIGHT, 0);
+	m_frame.assign(WIDTH * HEIGHT, 0);
+}
+
+void MegaDisplay::disable() {
+	std::vector<unsigned char>().swap(m_indices);
+	std::vector<unsigned int>().swap(m_colors);
+	std::vector<unsigned int>().swap(m_frame);
+}
+
+void MegaDisplay::loadPalette(const unsigned char* argb, int count) {
+	for (int i = 0; i < count && i < 255; ++i) {
+		const unsigned char* color = argb + i * 4;
+		m_palette[i + 1] = (unsigned int)color[1] | (unsigned int)color[2] << 8 | (unsigned int)color[3] << 16 | (unsigned int)color[0] << 24;
+	}
+}
+
+void MegaDisplay::setSpriteSize(int width, int height) {
+	m_spriteWidth = width == 0 ? 256 : width;
+	m_spriteHeight = height == 0 ? 256 : height;
+}
+
+bool MegaDisplay::drawRow(int x, int y, const unsigned char* pixels, int width) {
+	width = std::min(width, WIDTH - x);
+	unsigned char* indices = &m_indices[y * WIDTH + x];
+	unsigned int* colors = &m_colors[y * WIDTH + x];
+
+	switch (m_blend) {
+	case BLEND_25:
+		return blendRow<BLEND_25>(indices, colors, pixels, width, m_palette, m_collision);
+	case BLEND_50:
+		return blendRow<BLEND_50>(indices, colors, pixels, width, m_palette, m_collision);
+	case BLEND_75:
+		return blendRow<BLEND_75>(indices, colors, pixels, width, m_palette, m_collision);
+	case BLEND_ADD:
+		return blendRow<BLEND_ADD>(indices, colors, pixels, width, m_palette, m_collision);
+	case BLEND_MULTIPLY:
+		return blendRow<BLEND_MULTIPLY>(indices, colors, pixels, width, m_palette, m_collision);
+	default:
+		return blendRow<BLEND_NORMAL>(indices, colors, pixels, width, m_palette, m_collision);
+	}
+}
+
+void MegaDisplay::flip() {
+	m_frame.swap(m_colors);
+	std::fill(m_indices.begin(), m_indices.end(), 0);
+	std::fill(m_colors.begin(), m_colors.end(), 0);
+}
+
+void MegaDisplay::scrollUp(int rows) {
+	if (rows > HEIGHT)
+		rows = HEIGHT;
+	std::memmove(&m_indices[0], &m_indices[rows * WIDTH], (HEIGHT - rows) * WIDTH);
+	std::memset(&m_indices[(HEIGHT - rows) * WIDTH], 0, rows * WIDTH);
+	std::memmove(&m_colors[0], &m_colors[rows * WIDTH], (HEIGHT - rows) * WIDTH * sizeof(unsigned int));
+	std::memset(&m_colors[(HEIGHT - rows) * WIDTH], 0, rows * WIDTH * sizeof(unsigned int));
+}
+
+void MegaDisplay::scrollDown(int rows) {
+	if (rows > HEIGHT)
+		rows = HEIGHT;
+	std::memmove(&m_indices[rows * WIDTH], &m_indices[0], (HEIGHT - rows) * WIDTH);
+	std::memset(&m_indices[0], 0, rows * WIDTH);
+	std::memmove(&m_colors[rows * WIDTH], &m_colors[0], (HEIGHT - rows) * WIDTH * sizeof(unsigned int));
+	std::memset(&m_colors[0], 0, rows * WIDTH * sizeof(unsigned int));
+}
+
+void MegaDisplay::scrollRight(int pixels) {
+	if (pixels > WIDTH)
+		pixels = WIDTH;
+	for (int y = 0; y < HEIGHT; ++y) {
+		unsigned char* indices = &m_indices[y * WIDTH];
+		unsigned int* colors = &m_colors[y * WIDTH];
+		std::memmove(indices + pixels, indices, WIDTH - pixels);
+		std::memset(indices, 0, pixels);
+		std::memmove(colors + pixels, colors, (WIDTH - pixels) * sizeof(unsigned int));
+		std::memset(colors, 0, pixels * sizeof(unsigned int));
+	}
+}
+
+void MegaDisplay::scrollLeft(int pixels) {
+	if (pixels > WIDTH)
+		pixels = WIDTH;
+	for (int y = 0; y < HEIGHT; ++y) {
+		unsigned char* indices = &m_indices[y * WIDTH];
+		unsigned int* colors = &m_colors[y * WIDTH];
+		std::memmove(indices, indices + pixels, WIDTH - pixels);
+		std::memset(indices + WIDTH - pixels, 0, pixels);
+		std::memmove(colors, colors + pixels, (WIDTH - pixels) * sizeof(unsigned int));
+		std::memset(colors + WIDTH - pixels, 0, pixels * sizeof(unsigned int));
+	}
+}
+
+void MegaDisplay::expand(unsigned int* rgba) const {
+	if (m_screenAlpha == 0xFF) {
+		std::memcpy(rgba, m_frame.data(), WIDTH * HEIGHT * sizeof(unsigned int));
+		return;
+	}
+
+	//Only the alpha byte is scaled, 255 becomes 256 so an opaque screen keeps its pixels exact
+	const unsigned int scale = m_screenAlpha + (m_screenAlpha >> 7);
+	int i = 0;
+#ifdef DISPLAY_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i factors = _mm_set_epi16((short)scale, 256, 256, 256, (short)scale, 256, 256, 256);
+	for (; i + 4 <= WIDTH * HEIGHT; i += 4) {
+		const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_frame[i]));
+		const __m128i low = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(value, zero), factors), 8);
+		const __m128i high = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(value, zero), factors), 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i), _mm_packus_epi16(low, high));
+	}
+#endif
+	for (; i < WIDTH * HEIGHT; ++i) {
+		const unsigned int color = m_frame[i];
+		rgba[i] = (color & 0x00FFFFFF) | ((color >> 24) * scale >> 8) << 24;
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+
+/*
+MEGA-CHIP display: 256x192 pixels of 8 bit palette indices (index 0 is transparent) and the RGBA colors they were
+blended to. Sprites are rows of palette indices, every row is blended onto the screen in one go (SSE2 when the target
+has it, 16 pixels per step): the indices decide the collision (a sprite pixel over the collision color sets VF) and
+which pixels are opaque, the colors are mixed by the blend mode (080N).
+Drawing happens off screen, 00E0 hands the finished frame over to the host (GetFrame/expand) and starts the next one
+on a cleared screen, so the host never sees half drawn frames.
+
+Colors are kept as the host wants them: 32 bit values with the bytes R, G, B, A in memory order (little-endian hosts),
+palette entries are converted once when they are loaded (02NN). The buffers are only allocated while MEGA-CHIP mode
+is on (0011), machines running anything else don't carry them around.
+*/
+class MegaDisplay {
+public:
+
+	static const int WIDTH = 256;
+	static const int HEIGHT = 192;
+
+	//Sprite blend modes (080N), the percentages are the sprite's share of the result
+	enum BlendMode {
+		BLEND_NORMAL = 0,
+		BLEND_25,
+		BLEND_50,
+		BLEND_75,
+		BLEND_ADD,
+		BLEND_MULTIPLY,
+		BLEND_COUNT
+	};
+
+	MegaDisplay();
+
+	//0011/0010: allocates a cleared screen or releases it, the palette and the sprite settings stay
+	void enable();
+	void disable();
+	bool IsEnabled() const { return !m_indices.empty(); }
+
+	//02NN: palette entries from ARGB bytes, starting at index 1 (index 0 stays transparent)
+	void loadPalette(const unsigned char* argb, int count);
+	unsigned int GetColor(int index) const { return m_palette[index & 0xFF]; }
+
+	//03NN/04NN (0 means 256)
+	void setSpriteSize(int width, int height);
+	int GetSpriteWidth() const { return m_spriteWidth; }
+	int GetSpriteHeight() const { return m_spriteHeight; }
+	//080N, unknown modes draw like BLEND_NORMAL
+	void setBlendMode(int mode) { m_blend = mode < BLEND_COUNT ? (BlendMode)mode : BLEND_NORMAL; }
+	BlendMode GetBlendMode() const { return m_blend; }
+	//09NN
+	void setCollisionIndex(unsigned char index) { m_collision = index; }
+	unsigned char GetCollisionIndex() const { return m_collision; }
+	//05NN: alpha of the whole screen, applied when the frame is expanded
+	void setScreenAlpha(unsigned char alpha) { m_screenAlpha = alpha; }
+	unsigned char GetScreenAlpha() const { return m_screenAlpha; }
+
+	//Blends a sprite row of up to 256 palette indices onto row y starting at column x, both on screen. Pixels past the
+	//right edge are clipped. Returns true if an opaque pixel landed on the collision color
+	bool drawRow(int x, int y, const unsigned char* pixels, int width);
+
+	//00E0: the drawn frame becomes the one the host sees, drawing starts over on a cleared screen
+	void flip();
+
+	//00BN, 00CN, 00FB and 00FC on the screen being drawn
+	void scrollUp(int rows);
+	void scrollDown(int rows);
+	void scrollRight(int pixels);
+	void scrollLeft(int pixels);
+
+	//Palette index of a pixel of the frame being drawn
+	unsigned char GetIndex(int x, int y) const { return m_indices[y * WIDTH + x]; }
+	//All WIDTH * HEIGHT indices/colors of the frame being drawn, used for hashing and comparing
+	const unsigned char* GetIndices() const { return m_indices.data(); }
+	const unsigned int* GetColors() const { return m_colors.data(); }
+	//Colors of the last finished frame, without the screen alpha
+	const unsigned int* GetFrame() const { return m_frame.data(); }
+
+	//Writes the last finished frame with the screen alpha applied (WIDTH * HEIGHT RGBA values), once per presented
+	//frame
+	void expand(unsigned int* rgba) const;
+
+private:
+	std::vector<unsigned char> m_indices;
+	std::vector<unsigned int> m_colors;
+	std::vector<unsigned int> m_frame;
+
+	unsigned int m_palette[256];
+	int m_spriteWidth;
+	int m_spriteHeight;
+	BlendMode m_blend;
+	unsigned char m_collision;
+	unsigned char m_screenAlpha;
+};
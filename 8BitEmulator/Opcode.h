@@ -0,0 +1,208 @@
+#pragma once
+
+//Groups of opcodes that cost roughly the same on the host, used by the instrumentation to attribute samples
+enum OpcodeClass {
+	OPCLASS_FLOW = 0,	//00EE, 00FD, 1NNN, 2NNN, BNNN
+	OPCLASS_SKIP,		//3XNN, 4XNN, 5XY0, 9XY0, EX9E, EXA1
+	OPCLASS_LOAD,		//6XNN, 7XNN, ANNN, 01NN NNNN, 060N, 0700, F000 NNNN, FX07, FX15, FX18, FX1E, FX29, FX30, FX3A
+	OPCLASS_ALU,		//8XYN
+	OPCLASS_DRAW,		//00E0, 0010, 0011, 00BN, 00CN, 00DN, 00FB, 00FC, 00FE, 00FF, 03NN-05NN, 080N, 09NN, DXYN, FN01
+	OPCLASS_MEMORY,		//02NN, 5XY2, 5XY3, F002, FX33, FX55, FX65, FX75, FX85
+	OPCLASS_RANDOM,		//CXNN
+	OPCLASS_KEY,		//FX0A
+	OPCLASS_UNKNOWN,
+	OPCLASS_COUNT
+};
+
+inline OpcodeClass classifyOpcode(unsigned short opcode) {
+	switch (opcode & 0xF000) {
+	case 0x0000:
+		if (opcode == 0x00E0 || (opcode & 0xFFF0) == 0x00C0 || (opcode & 0xFFF0) == 0x00D0) return OPCLASS_DRAW;
+		if (opcode == 0x00FB || opcode == 0x00FC || opcode == 0x00FE || opcode == 0x00FF) return OPCLASS_DRAW;
+		if (opcode == 0x00EE || opcode == 0x00FD) return OPCLASS_FLOW;
+		//MEGA-CHIP
+		if (opcode == 0x0010 || opcode == 0x0011 || (opcode & 0xFFF0) == 0x00B0) return OPCLASS_DRAW;
+		switch (opcode & 0x0F00) {
+		case 0x0100: case 0x0600: case 0x0700: return OPCLASS_LOAD;
+		case 0x0200: return OPCLASS_MEMORY;
+		case 0x0300: case 0x0400: case 0x0500: case 0x0800: case 0x0900: return OPCLASS_DRAW;
+		}
+		return OPCLASS_UNKNOWN;
+	case 0x1000:
+	case 0x2000:
+	case 0xB000:
+		return OPCLASS_FLOW;
+	case 0x5000:
+		if ((opcode & 0x000F) == 0x2 || (opcode & 0x000F) == 0x3) return OPCLASS_MEMORY;
+		return OPCLASS_SKIP;
+	case 0x3000:
+	case 0x4000:
+	case 0x9000:
+		return OPCLASS_SKIP;
+	case 0x6000:
+	case 0x7000:
+	case 0xA000:
+		return OPCLASS_LOAD;
+	case 0x8000:
+		return OPCLASS_ALU;
+	case 0xC000:
+		return OPCLASS_RANDOM;
+	case 0xD000:
+		return OPCLASS_DRAW;
+	case 0xE000:
+		if ((opcode & 0x00FF) == 0x009E || (opcode & 0x00FF) == 0x00A1) return OPCLASS_SKIP;
+		return OPCLASS_UNKNOWN;
+	default:
+		switch (opcode & 0x00FF) {
+		case 0x0000: case 0x0007: case 0x0015: case 0x0018: case 0x001E: case 0x0029: case 0x0030: case 0x003A:
+			return OPCLASS_LOAD;
+		case 0x0002: case 0x0033: case 0x0055: case 0x0065: case 0x0075: case 0x0085:
+			return OPCLASS_MEMORY;
+		case 0x0001:
+			return OPCLASS_DRAW;
+		case 0x000A:
+			return OPCLASS_KEY;
+		}
+		return OPCLASS_UNKNOWN;
+	}
+}
+
+inline const char* opcodeClassName(OpcodeClass opcodeClass) {
+	static const char* names[OPCLASS_COUNT] = { "flow", "skip", "load", "alu", "draw", "memory", "random", "key", "unknown" };
+	return names[opcodeClass];
+}
+
+//True if the opcode may assign the register under any quirk profile (VF as carry/collision flag and the logic
+//operations' VF reset included). Used to search for the last write of a register
+inline bool opcodeWritesRegister(unsigned short opcode, int reg) {
+	const int x = (opcode & 0x0F00) >> 8;
+
+	switch (opcode & 0xF000) {
+	case 0x5000: {
+		//5XY3 loads VX to VY in either direction
+		const int y = (opcode & 0x00F0) >> 4;
+		return (opcode & 0x000F) == 0x3 && reg >= (x < y ? x : y) && reg <= (x < y ? y : x);
+	}
+	case 0x6000:
+	case 0x7000:
+	case 0xC000:
+		return reg == x;
+	case 0x8000:
+		switch (opcode & 0x000F) {
+		case 0x0:
+			return reg == x;
+		case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x6: case 0x7: case 0xE:
+			return reg == x || reg == 0xF;
+		}
+		return false;
+	case 0xD000:
+		return reg == 0xF;
+	case 0xF000:
+		switch (opcode & 0x00FF) {
+		case 0x0007: case 0x000A:
+			return reg == x;
+		case 0x0065: case 0x0085:
+			return reg <= x;
+		}
+		return false;
+	default:
+		return false;
+	}
+}
+
+//Bytes the opcode accesses starting at I (DXYN, FX65 read, FX33, FX55 write). Returns 0 if it doesn't touch memory at I.
+//XO-CHIP sprites on several planes read one sprite per plane, only the first is counted. MEGA-CHIP sprites depend on the
+//sprite size registers and are counted like the other sprites
+inline unsigned short opcodeMemoryAccess(unsigned short opcode, bool& write) {
+	const unsigned short x = (opcode & 0x0F00) >> 8;
+
+	write = false;
+	//MEGA-CHIP palette (4 bytes per color) and sound header
+	if ((opcode & 0xFF00) == 0x0200)
+		return (opcode & 0x00FF) * 4;
+	if ((opcode & 0xFFF0) == 0x0600)
+		return 6;
+	if ((opcode & 0xF00E) == 0x5002) {
+		const unsigned short y = (opcode & 0x00F0) >> 4;
+		write = (opcode & 0x000F) == 0x2;
+		return (x < y ? y - x : x - y) + 1;
+	}
+	//DXY0 is a 16x16 SUPER-CHIP sprite
+	if ((opcode & 0xF000) == 0xD000)
+		return (opcode & 0x000F) != 0 ? opcode & 0x000F : 32;
+	if ((opcode & 0xF000) != 0xF000)
+		return 0;
+
+	switch (opcode & 0x00FF) {
+	case 0x0033:
+		write = true;
+		return 3;
+	case 0x0055:
+		write = true;
+		return x + 1;
+	case 0x0065:
+		return x + 1;
+	case 0x0002:
+		return x == 0 ? 16 : 0;
+	default:
+		return 0;
+	}
+}
+
+//Bytes the instruction takes, MEGA-CHIP 01NN NNNN and XO-CHIP F000 NNNN are followed by a 16 bit operand word.
+//Only the ROM is looked at, not the quirk profile, so this assumes the extended instruction sets
+inline unsigned short opcodeLength(unsigned short opcode) {
+	return (opcode & 0xFF00) == 0x0100 || opcode == 0xF000 ? 4 : 2;
+}
+
+//Opcode patterns with the operands masked out (6XNN, 8XY4, FX07, ...), used to count which instructions follow each other
+const int OPCODE_SHAPE_COUNT = 44;
+
+inline int opcodeShape(unsigned short opcode) {
+	switch (opcode & 0xF000) {
+	case 0x0000:
+		if (opcode == 0x00E0) return 0;
+		if (opcode == 0x00EE) return 1;
+		return 2;
+	case 0x1000: return 3;
+	case 0x2000: return 4;
+	case 0x3000: return 5;
+	case 0x4000: return 6;
+	case 0x5000: return 7;
+	case 0x6000: return 8;
+	case 0x7000: return 9;
+	case 0x8000: return 10 + (opcode & 0x000F);
+	case 0x9000: return 26;
+	case 0xA000: return 27;
+	case 0xB000: return 28;
+	case 0xC000: return 29;
+	case 0xD000: return 30;
+	case 0xE000:
+		if ((opcode & 0x00FF) == 0x009E) return 31;
+		if ((opcode & 0x00FF) == 0x00A1) return 32;
+		return 33;
+	default:
+		switch (opcode & 0x00FF) {
+		case 0x0007: return 34;
+		case 0x000A: return 35;
+		case 0x0015: return 36;
+		case 0x0018: return 37;
+		case 0x001E: return 38;
+		case 0x0029: return 39;
+		case 0x0033: return 40;
+		case 0x0055: return 41;
+		case 0x0065: return 42;
+		}
+		return 43;
+	}
+}
+
+inline const char* opcodeShapeName(int shape) {
+	static const char* names[OPCODE_SHAPE_COUNT] = {
+		"00E0", "00EE", "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+		"8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XY8", "8XY9", "8XYA", "8XYB", "8XYC", "8XYD", "8XYE", "8XYF",
+		"9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "EXNN",
+		"FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65", "FXNN"
+	};
+	return names[shape];
+}
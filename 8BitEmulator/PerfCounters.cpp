@@ -0,0 +1,315 @@
+#include "PerfCounters.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfCounters::PerfCounters() : m_groupFd(-1), m_opened(0) {
+	for (int i = 0; i < EVENT_COUNT; ++i) {
+		m_fds[i] = -1;
+		m_slot[i] = -1;
+	}
+}
+
+PerfCounters::~PerfCounters() {
+	close();
+}
+
+bool PerfCounters::open() {
+	close();
+
+#ifdef __linux__
+	struct EventConfig {
+		unsigned int type;
+		unsigned long long config;
+	};
+
+	const EventConfig configs[EVENT_COUNT] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	};
+
+	for (int i = 0; i < EVENT_COUNT; ++i) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = configs[i].type;
+		attr.config = configs[i].config;
+		attr.read_format = PERF_FORMAT_GROUP;
+		//Only the emulator itself is of interest, the read() syscalls used for sampling stay invisible this way
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.disabled = m_groupFd == -1 ? 1 : 0;
+
+		int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, m_groupFd, 0);
+		if (fd == -1) {
+			//Without cycles there is no point in the rest
+			if (i == EVENT_CYCLES)
+				return false;
+			continue;
+		}
+
+		if (m_groupFd == -1)
+			m_groupFd = fd;
+
+		m_fds[i] = fd;
+		m_slot[i] = m_opened++;
+	}
+
+	ioctl(m_groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(m_groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void PerfCounters::close() {
+#ifdef __linux__
+	for (int i = 0; i < EVENT_COUNT; ++i) {
+		if (m_fds[i] != -1)
+			::close(m_fds[i]);
+	}
+#endif
+	for (int i = 0; i < EVENT_COUNT; ++i) {
+		m_fds[i] = -1;
+		m_slot[i] = -1;
+	}
+	m_groupFd = -1;
+	m_opened = 0;
+}
+
+bool PerfCounters::isOpen() const {
+	return m_groupFd != -1;
+}
+
+bool PerfCounters::isAvailable(Event event) const {
+	return m_slot[event] != -1;
+}
+
+void PerfCounters::read(unsigned long long (&values)[EVENT_COUNT]) const {
+	//Layout of a group read: number of events followed by one value per event
+	unsigned long long buffer[1 + EVENT_COUNT] = {};
+
+#ifdef __linux__
+	if (m_groupFd != -1 && ::read(m_groupFd, buffer, sizeof(buffer)) <= 0)
+		buffer[0] = 0;
+#endif
+
+	for (int i = 0; i < EVENT_COUNT; ++i) {
+		values[i] = (m_slot[i] != -1 && (unsigned long long)m_slot[i] < buffer[0]) ? buffer[1 + m_slot[i]] : 0;
+	}
+}
+
+const char* PerfCounters::eventName(Event event) {
+	static const char* names[EVENT_COUNT] = { "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses" };
+	return names[event];
+}
+
+PerfProfiler::PerfProfiler(unsigned int samplePeriod) : m_samplePeriod(std::max(2u, samplePeriod)), m_liveStream(nullptr), m_liveInterval(1.0) {
+	reset();
+}
+
+bool PerfProfiler::start() {
+	if (!m_counters.open())
+		return false;
+
+	calibrate();
+	m_lastLive = std::chrono::steady_clock::now();
+	return true;
+}
+
+bool PerfProfiler::isRunning() const {
+	return m_counters.isOpen();
+}
+
+void PerfProfiler::reset() {
+	std::memset(m_classes, 0, sizeof(m_classes));
+	std::memset(&m_total, 0, sizeof(m_total));
+	for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+		m_overhead[i] = 0.0;
+	}
+}
+
+void PerfProfiler::calibrate() {
+	//Median cost of two back to back reads, i.e. what every sample measures on top of the instruction
+	const int rounds = 255;
+	std::vector<unsigned long long> deltas[PerfCounters::EVENT_COUNT];
+
+	for (int round = 0; round < rounds; ++round) {
+		unsigned long long before[PerfCounters::EVENT_COUNT];
+		unsigned long long after[PerfCounters::EVENT_COUNT];
+		m_counters.read(before);
+		m_counters.read(after);
+
+		for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+			deltas[i].push_back(after[i] - before[i]);
+		}
+	}
+
+	for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+		std::nth_element(deltas[i].begin(), deltas[i].begin() + rounds / 2, deltas[i].end());
+		m_overhead[i] = (double)deltas[i][rounds / 2];
+	}
+}
+
+void PerfProfiler::setLiveSummary(std::ostream* stream, double intervalSeconds) {
+	m_liveStream = stream;
+	m_liveInterval = intervalSeconds;
+}
+
+void PerfProfiler::runCycles(Chip8& chip, unsigned int cycles) {
+	if (!m_counters.isOpen()) {
+		chip.runCycles(cycles);
+		return;
+	}
+
+	unsigned long long start[PerfCounters::EVENT_COUNT];
+	unsigned long long end[PerfCounters::EVENT_COUNT];
+	unsigned long long samples = 0;
+	unsigned int remaining = cycles;
+
+	m_counters.read(start);
+
+	while (remaining > 0) {
+		unsigned int batch = std::min(m_samplePeriod - 1, remaining);
+		chip.runCycles(batch);
+		remaining -= batch;
+
+		if (remaining == 0)
+			break;
+
+		//Measure the next instruction on its own
+		Totals& totals = m_classes[classifyOpcode(chip.GetNextOpcode())];
+		unsigned long long before[PerfCounters::EVENT_COUNT];
+		unsigned long long after[PerfCounters::EVENT_COUNT];
+
+		m_counters.read(before);
+		chip.emulateCycle();
+		m_counters.read(after);
+		--remaining;
+		++samples;
+
+		++totals.samples;
+		for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+			totals.values[i] += after[i] - before[i];
+		}
+
+		if (m_liveStream && std::chrono::duration<double>(std::chrono::steady_clock::now() - m_lastLive).count() >= m_liveInterval) {
+			printLive();
+			m_lastLive = std::chrono::steady_clock::now();
+		}
+	}
+
+	m_counters.read(end);
+
+	m_total.samples += cycles;
+	for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+		//Every sample added two reads to the run
+		double sampling = 2.0 * m_overhead[i] * samples;
+		double delta = (double)(end[i] - start[i]);
+		m_total.values[i] += (unsigned long long)std::max(0.0, delta - sampling);
+	}
+}
+
+void PerfProfiler::printLive() {
+	unsigned long long samples = 0;
+	double cycles = 0.0;
+	double branchMisses = 0.0;
+
+	for (const Totals& totals : m_classes) {
+		samples += totals.samples;
+		cycles += totals.values[PerfCounters::EVENT_CYCLES] - m_overhead[PerfCounters::EVENT_CYCLES] * totals.samples;
+		branchMisses += totals.values[PerfCounters::EVENT_BRANCH_MISSES] - m_overhead[PerfCounters::EVENT_BRANCH_MISSES] * totals.samples;
+	}
+
+	if (samples == 0)
+		return;
+
+	*m_liveStream << "[perf] " << samples << " samples, " << std::fixed << std::setprecision(1)
+		<< cycles / samples << " cycles/instr, " << std::setprecision(3) << branchMisses / samples << " branch-misses/instr\n";
+}
+
+void PerfProfiler::printSummary(std::ostream& stream) const {
+	if (!m_counters.isOpen()) {
+		stream << "Performance counters unavailable\n";
+		return;
+	}
+
+	stream << std::left << std::setw(10) << "class" << std::right << std::setw(10) << "samples";
+	for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+		stream << std::setw(15) << PerfCounters::eventName((PerfCounters::Event)i);
+	}
+	stream << "\n" << std::fixed << std::setprecision(3);
+
+	//Values are per emulated instruction
+	for (int c = 0; c < OPCLASS_COUNT; ++c) {
+		const Totals& totals = m_classes[c];
+		if (totals.samples == 0)
+			continue;
+
+		stream << std::left << std::setw(10) << opcodeClassName((OpcodeClass)c) << std::right << std::setw(10) << totals.samples;
+		for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+			if (!m_counters.isAvailable((PerfCounters::Event)i)) {
+				stream << std::setw(15) << "n/a";
+				continue;
+			}
+			stream << std::setw(15) << std::max(0.0, (double)totals.values[i] / totals.samples - m_overhead[i]);
+		}
+		stream << "\n";
+	}
+
+	if (m_total.samples > 0) {
+		stream << std::left << std::setw(10) << "total" << std::right << std::setw(10) << m_total.samples;
+		for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+			stream << std::setw(15) << (double)m_total.values[i] / m_total.samples;
+		}
+		stream << "\n";
+	}
+}
+
+bool PerfProfiler::writeFile(const char* path) const {
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	file << "class,samples";
+	for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+		file << "," << PerfCounters::eventName((PerfCounters::Event)i);
+	}
+	file << "\n";
+
+	for (int c = 0; c < OPCLASS_COUNT; ++c) {
+		const Totals& totals = m_classes[c];
+		if (totals.samples == 0)
+			continue;
+
+		file << opcodeClassName((OpcodeClass)c) << "," << totals.samples;
+		for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+			file << "," << std::max(0.0, (double)totals.values[i] / totals.samples - m_overhead[i]);
+		}
+		file << "\n";
+	}
+
+	if (m_total.samples > 0) {
+		file << "total," << m_total.samples;
+		for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+			file << "," << (double)m_total.values[i] / m_total.samples;
+		}
+		file << "\n";
+	}
+
+	return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <ostream>
+
+#include "chip8.h"
+#include "Opcode.h"
+
+/*
+Hardware performance counters around the emulation loop (Linux perf_event_open).
+On other platforms, or when the kernel refuses access (perf_event_paranoid), open() fails and nothing is recorded.
+*/
+class PerfCounters {
+public:
+
+	enum Event {
+		EVENT_CYCLES = 0,
+		EVENT_INSTRUCTIONS,
+		EVENT_BRANCH_MISSES,
+		EVENT_L1D_MISSES,
+		EVENT_LLC_MISSES,
+		EVENT_COUNT
+	};
+
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	//Opens all counters as one group for the calling thread. Returns false if not even the cycle counter is available
+	bool open();
+	void close();
+	bool isOpen() const;
+	//Not every CPU/VM exposes every event
+	bool isAvailable(Event event) const;
+
+	//Reads all counters at once; unavailable events read as 0
+	void read(unsigned long long (&values)[EVENT_COUNT]) const;
+
+	static const char* eventName(Event event);
+
+private:
+	int m_groupFd;
+	int m_fds[EVENT_COUNT];
+	//Position of each event in the group read buffer (-1 if not opened)
+	int m_slot[EVENT_COUNT];
+	int m_opened;
+};
+
+/*
+Runs the core under the counters and attributes the cost to opcode classes.
+Reading the counters costs a syscall, so only every samplePeriod-th instruction is measured on its own; all other
+instructions are executed in batches. The cost of an empty measurement is calibrated once and subtracted.
+*/
+class PerfProfiler {
+public:
+
+	PerfProfiler(unsigned int samplePeriod = 64);
+
+	bool start();
+	bool isRunning() const;
+
+	//Same as Chip8::runCycles, but measured
+	void runCycles(Chip8& chip, unsigned int cycles);
+
+	//Prints a one line summary to the stream at most every interval while runCycles is measuring
+	void setLiveSummary(std::ostream* stream, double intervalSeconds = 1.0);
+
+	void printSummary(std::ostream& stream) const;
+	bool writeFile(const char* path) const;
+	void reset();
+
+private:
+	struct Totals {
+		unsigned long long samples;
+		unsigned long long values[PerfCounters::EVENT_COUNT];
+	};
+
+	void calibrate();
+	void printLive();
+
+	PerfCounters m_counters;
+	unsigned int m_samplePeriod;
+
+	//Per class totals of the individually measured instructions
+	Totals m_classes[OPCLASS_COUNT];
+	//Totals of the whole run (batches and samples)
+	Totals m_total;
+	//Counter values of an empty measurement
+	double m_overhead[PerfCounters::EVENT_COUNT];
+
+	std::ostream* m_liveStream;
+	double m_liveInterval;
+	std::chrono::steady_clock::time_point m_lastLive;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+Behaviour Chip-8 interpreters disagree on. Every profile is a policy the core is compiled with (Chip8 keeps one
+specialization per profile and picks it in SetQuirks), so the checks below are constants and cost nothing at runtime.
+*/
+enum QuirkProfile {
+	QUIRKS_COSMAC_VIP = 0,	//the original interpreter
+	QUIRKS_SCHIP,			//SUPER-CHIP 1.1 on the HP 48
+	QUIRKS_XO_CHIP,			//Octo
+	QUIRKS_MODERN,			//what most ROMs written for emulators expect
+	QUIRKS_MEGA_CHIP,		//Mega8, SUPER-CHIP with the MEGA-CHIP extensions
+	QUIRKS_COUNT
+};
+
+struct QuirksCosmacVip {
+	//8XY6/8XYE shift VY into VX (otherwise VX is shifted in place)
+	static const bool shiftVY = true;
+	//FX55/FX65 leave I behind the last register
+	static const bool incrementI = true;
+	//BNNN jumps to XNN + VX instead of NNN + V0
+	static const bool jumpVX = false;
+	//8XY1/8XY2/8XY3 clear VF
+	static const bool resetVF = true;
+	//DXYN wraps the pixels leaving the screen around to the other side (otherwise they are clipped)
+	static const bool wrapSprites = false;
+	//SUPER-CHIP instructions: 128x64 high resolution, scrolling, 16x16 sprites (DXY0), big font, RPL flags
+	static const bool superChip = false;
+	//XO-CHIP instructions: 64 KB of memory for I (F000 NNNN), bitplanes (FN01), 5XY2/5XY3, 00DN, audio pattern
+	static const bool xoChip = false;
+	//MEGA-CHIP instructions: 256x192 color screen (0011), 24 bit I (01NN NNNN) and 16 MB of memory, palette, blending
+	static const bool megaChip = false;
+};
+
+struct QuirksSchip {
+	static const bool shiftVY = false;
+	static const bool incrementI = false;
+	static const bool jumpVX = true;
+	static const bool resetVF = false;
+	static const bool wrapSprites = false;
+	static const bool superChip = true;
+	static const bool xoChip = false;
+	static const bool megaChip = false;
+};
+
+struct QuirksXoChip {
+	static const bool shiftVY = true;
+	static const bool incrementI = true;
+	static const bool jumpVX = false;
+	static const bool resetVF = false;
+	static const bool wrapSprites = true;
+	static const bool superChip = true;
+	static const bool xoChip = true;
+	static const bool megaChip = false;
+};
+
+struct QuirksModern {
+	static const bool shiftVY = false;
+	static const bool incrementI = false;
+	static const bool jumpVX = false;
+	static const bool resetVF = false;
+	static const bool wrapSprites = false;
+	static const bool superChip = true;
+	static const bool xoChip = false;
+	static const bool megaChip = false;
+};
+
+//Mega8 runs SUPER-CHIP programs with the SUPER-CHIP quirks
+struct QuirksMegaChip {
+	static const bool shiftVY = false;
+	static const bool incrementI = false;
+	static const bool jumpVX = true;
+	static const bool resetVF = false;
+	static const bool wrapSprites = false;
+	static const bool superChip = true;
+	static const bool xoChip = false;
+	static const bool megaChip = true;
+};
+
+inline const char* quirkProfileName(QuirkProfile profile) {
+	static const char* names[QUIRKS_COUNT] = { "cosmac", "schip", "xochip", "modern", "megachip" };
+	return names[profile];
+}
@@ -0,0 +1,459 @@
+#include "RomAnalyzer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include "Disassembler.h"
+#include "Opcode.h"
+
+namespace {
+
+	bool isSkip(unsigned short opcode) {
+		switch (opcode & 0xF000) {
+		case 0x3000:
+		case 0x4000:
+			return true;
+		case 0x5000:
+		case 0x9000:
+			return (opcode & 0x000F) == 0;
+		case 0xE000:
+			return (opcode & 0x00FF) == 0x009E || (opcode & 0x00FF) == 0x00A1;
+		default:
+			return false;
+		}
+	}
+
+	//Opcodes the core executes (everything classifyOpcode knows, 5XY0/9XY0 and 8XYN need the low nibble checked too)
+	bool isValid(unsigned short opcode) {
+		if (classifyOpcode(opcode) == OPCLASS_UNKNOWN)
+			return false;
+
+		switch (opcode & 0xF000) {
+		case 0x5000:
+		case 0x9000:
+			return (opcode & 0x000F) == 0;
+		case 0x8000:
+			return (opcode & 0x000F) <= 0x7 || (opcode & 0x000F) == 0xE;
+		default:
+			return true;
+		}
+	}
+}
+
+RomAnalyzer::RomAnalyzer() : m_size(0) {
+	std::memset(m_memory, 0, sizeof(m_memory));
+	std::memset(m_quirks, 0, sizeof(m_quirks));
+	std::memset(m_firstQuirk, 0, sizeof(m_firstQuirk));
+}
+
+bool RomAnalyzer::analyzeFile(const char* path) {
+	m_name = path;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	unsigned char program[4096 - 0x200];
+	file.read(reinterpret_cast<char*>(program), sizeof(program));
+	analyze(program, (size_t)file.gcount());
+	return true;
+}
+
+void RomAnalyzer::analyze(const unsigned char* program, size_t size) {
+	size = std::min<size_t>(size, 4096 - 0x200);
+
+	std::memset(m_memory, 0, sizeof(m_memory));
+	std::memcpy(m_memory + 0x200, program, size);
+	m_size = size;
+
+	m_code.reset();
+	m_data.reset();
+	m_instructions.reset();
+	m_leaders.clear();
+	m_blocks.clear();
+	m_subroutines.clear();
+	m_indirect.clear();
+	m_invalid.clear();
+	m_stores.clear();
+	m_selfModifying.clear();
+	m_unresolved.clear();
+	std::memset(m_quirks, 0, sizeof(m_quirks));
+	std::memset(m_firstQuirk, 0, sizeof(m_firstQuirk));
+
+	recoverCode();
+	buildBlocks();
+
+	for (const auto& block : m_blocks) {
+		findData(block.second);
+	}
+
+	//Only now all code is known
+	for (const Store& store : m_stores) {
+		for (unsigned short i = 0; i < store.length; ++i) {
+			if (m_code[(store.start + i) & 0xFFF]) {
+				m_selfModifying.push_back(store);
+				break;
+			}
+		}
+	}
+}
+
+unsigned short RomAnalyzer::read(unsigned short address) const {
+	return m_memory[address & 0xFFF] << 8 | m_memory[(address + 1) & 0xFFF];
+}
+
+RomAnalyzer::ByteKind RomAnalyzer::GetKind(unsigned short address) const {
+	address &= 0xFFF;
+	if (m_code[address])
+		return m_data[address] ? BYTE_CODE_AND_DATA : BYTE_CODE;
+	return m_data[address] ? BYTE_DATA : BYTE_UNKNOWN;
+}
+
+void RomAnalyzer::recoverCode() {
+	std::vector<unsigned short> worklist;
+	worklist.push_back(0x200);
+	m_leaders.insert(0x200);
+
+	//Follows every path instruction by instruction, each address is decoded once
+	while (!worklist.empty()) {
+		unsigned short pc = worklist.back();
+		worklist.pop_back();
+
+		while (pc <= 0xFFE && !m_instructions[pc]) {
+			unsigned short opcode = read(pc);
+			unsigned short target = opcode & 0x0FFF;
+			unsigned short length = opcodeLength(opcode);
+
+			m_instructions[pc] = true;
+			for (unsigned short i = 0; i < length && pc + i <= 0xFFF; ++i) {
+				m_code[pc + i] = true;
+			}
+
+			if (!isValid(opcode)) {
+				m_invalid.push_back(pc);
+				break;
+			}
+
+			if ((opcode & 0xF000) == 0x1000) {
+				m_leaders.insert(target);
+				worklist.push_back(target);
+				break;
+			}
+			if ((opcode & 0xF000) == 0x2000) {
+				m_leaders.insert(target);
+				m_leaders.insert(pc + 2);
+				m_subroutines.insert(target);
+				worklist.push_back(target);
+			}
+			else if (opcode == 0x00EE) {
+				break;
+			}
+			else if ((opcode & 0xF000) == 0xB000) {
+				m_indirect.push_back(pc);
+				break;
+			}
+			else if (isSkip(opcode)) {
+				//The core skips an operand word along with its instruction
+				unsigned short skipped = pc + 2 + opcodeLength(read(pc + 2));
+				m_leaders.insert(pc + 2);
+				m_leaders.insert(skipped);
+				worklist.push_back(skipped);
+			}
+
+			pc += length;
+		}
+	}
+
+	std::sort(m_indirect.begin(), m_indirect.end());
+	std::sort(m_invalid.begin(), m_invalid.end());
+}
+
+void RomAnalyzer::buildBlocks() {
+	for (unsigned short leader : m_leaders) {
+		if (leader > 0xFFE || !m_instructions[leader])
+			continue;
+
+		BasicBlock block;
+		block.start = leader;
+		block.exit = BasicBlock::EXIT_FALLTHROUGH;
+
+		unsigned short pc = leader;
+		while (true) {
+			unsigned short opcode = read(pc);
+			unsigned short next = pc + opcodeLength(opcode);
+
+			if (!isValid(opcode)) {
+				block.exit = BasicBlock::EXIT_INVALID;
+			}
+			else if ((opcode & 0xF000) == 0x1000) {
+				block.exit = BasicBlock::EXIT_JUMP;
+				block.successors.push_back(opcode & 0x0FFF);
+			}
+			else if ((opcode & 0xF000) == 0x2000) {
+				block.exit = BasicBlock::EXIT_CALL;
+				block.successors.push_back(opcode & 0x0FFF);
+				block.successors.push_back(next);
+			}
+			else if (opcode == 0x00EE) {
+				block.exit = BasicBlock::EXIT_RETURN;
+			}
+			else if ((opcode & 0xF000) == 0xB000) {
+				block.exit = BasicBlock::EXIT_INDIRECT;
+			}
+			else if (isSkip(opcode)) {
+				block.exit = BasicBlock::EXIT_SKIP;
+				block.successors.push_back(next);
+				block.successors.push_back(next + opcodeLength(read(next)));
+			}
+			else if (next > 0xFFE || m_leaders.count(next) || !m_instructions[next]) {
+				if (next <= 0xFFE && m_instructions[next])
+					block.successors.push_back(next);
+			}
+			else {
+				pc = next;
+				continue;
+			}
+
+			block.end = next;
+			break;
+		}
+
+		m_blocks[block.start] = block;
+	}
+}
+
+void RomAnalyzer::findData(const BasicBlock& block) {
+	//Values known at each point of the block, nothing is known on entry
+	bool knownI = false;
+	unsigned short I = 0;
+	bool knownV[16] = {};
+	unsigned char V[16] = {};
+
+	auto quirk = [this](Quirk quirk, unsigned short pc) {
+		if (m_quirks[quirk]++ == 0)
+			m_firstQuirk[quirk] = pc;
+	};
+
+	auto access = [&](unsigned short pc, unsigned short length, bool write) {
+		if (!knownI) {
+			if (write) {
+				Store store = { pc, 0, length };
+				m_unresolved.push_back(store);
+			}
+			return;
+		}
+
+		for (unsigned short i = 0; i < length; ++i) {
+			m_data[(I + i) & 0xFFF] = true;
+		}
+		if (write) {
+			Store store = { pc, I, length };
+			m_stores.push_back(store);
+		}
+	};
+
+	for (unsigned short pc = block.start; pc < block.end; pc += opcodeLength(read(pc))) {
+		unsigned short opcode = read(pc);
+		int x = (opcode & 0x0F00) >> 8;
+		int y = (opcode & 0x00F0) >> 4;
+
+		switch (opcode & 0xF000) {
+		case 0x0000:
+			//MEGA-CHIP 01NN NNNN, the address is beyond the ROM
+			if ((opcode & 0xFF00) == 0x0100) {
+				knownI = false;
+				continue;
+			}
+			break;
+		case 0x6000:
+			knownV[x] = true;
+			V[x] = opcode & 0x00FF;
+			continue;
+		case 0x7000:
+			V[x] += opcode & 0x00FF;
+			continue;
+		case 0x8000:
+			if ((opcode & 0x000F) == 0x1 || (opcode & 0x000F) == 0x2 || (opcode & 0x000F) == 0x3)
+				quirk(QUIRK_LOGIC, pc);
+			if ((opcode & 0x000F) == 0x6 || (opcode & 0x000F) == 0xE)
+				quirk(QUIRK_SHIFT, pc);
+			if ((opcode & 0x000F) == 0x0) {
+				knownV[x] = knownV[y];
+				V[x] = V[y];
+				continue;
+			}
+			break;
+		case 0xA000:
+			knownI = true;
+			I = opcode & 0x0FFF;
+			continue;
+		case 0xB000:
+			quirk(QUIRK_JUMP, pc);
+			break;
+		case 0xD000:
+			quirk(QUIRK_DRAW, pc);
+			access(pc, (opcode & 0x000F) != 0 ? opcode & 0x000F : 32, false);
+			break;
+		case 0xF000:
+			switch (opcode & 0x00FF) {
+			case 0x0000:
+				//XO-CHIP F000 NNNN, only addresses within the ROM's 4 KB are followed
+				if (opcode == 0xF000) {
+					I = read(pc + 2);
+					knownI = I <= 0xFFF;
+					continue;
+				}
+				break;
+			case 0x001E:
+				knownI = knownI && knownV[x];
+				I = (I + V[x]) & 0xFFF;
+				continue;
+			case 0x0029:
+			case 0x0030:
+				//Font sprites live in the interpreter area
+				knownI = false;
+				continue;
+			case 0x0033:
+				access(pc, 3, true);
+				break;
+			case 0x0055:
+				quirk(QUIRK_LOAD_STORE, pc);
+				access(pc, x + 1, true);
+				//I is left alone or advanced past the registers depending on the quirk
+				knownI = false;
+				break;
+			case 0x0065:
+				quirk(QUIRK_LOAD_STORE, pc);
+				access(pc, x + 1, false);
+				knownI = false;
+				break;
+			}
+			break;
+		}
+
+		//Everything else the instruction writes becomes unknown
+		for (int reg = 0; reg < 16; ++reg) {
+			if (opcodeWritesRegister(opcode, reg))
+				knownV[reg] = false;
+		}
+	}
+}
+
+const char* RomAnalyzer::quirkName(Quirk quirk) {
+	static const char* names[QUIRK_COUNT] = { "shift (8XY6/8XYE)", "load/store I (FX55/FX65)", "jump (BNNN)", "logic VF reset (8XY1-3)", "draw (DXYN)" };
+	return names[quirk];
+}
+
+void RomAnalyzer::writeReport(std::ostream& out) const {
+	char line[160];
+
+	size_t code = 0, data = 0, unknown = 0;
+	for (size_t address = 0x200; address < 0x200 + m_size; ++address) {
+		switch (GetKind((unsigned short)address)) {
+		case BYTE_CODE: ++code; break;
+		case BYTE_DATA: ++data; break;
+		case BYTE_CODE_AND_DATA: ++code; ++data; break;
+		default: ++unknown; break;
+		}
+	}
+
+	std::snprintf(line, sizeof(line), "%s: %zu bytes, %zu code, %zu data, %zu unknown, %zu blocks, %zu subroutines\n",
+		m_name.c_str(), m_size, code, data, unknown, m_blocks.size(), m_subroutines.size());
+	out << line;
+
+	auto list = [&out, &line](const char* title, const std::vector<unsigned short>& addresses) {
+		if (addresses.empty())
+			return;
+		out << "  " << title << ":";
+		for (unsigned short address : addresses) {
+			std::snprintf(line, sizeof(line), " %03X", address);
+			out << line;
+		}
+		out << "\n";
+	};
+	list("indirect jumps", m_indirect);
+	list("invalid opcodes", m_invalid);
+
+	for (const Store& store : m_selfModifying) {
+		std::snprintf(line, sizeof(line), "  self-modifying store at %03X: %04X %s -> %03X-%03X\n",
+			store.pc, read(store.pc), disassemble(read(store.pc)).c_str(), store.start, (store.start + store.length - 1) & 0xFFF);
+		out << line;
+	}
+	for (const Store& store : m_unresolved) {
+		std::snprintf(line, sizeof(line), "  store with unknown target at %03X: %04X %s\n", store.pc, read(store.pc), disassemble(read(store.pc)).c_str());
+		out << line;
+	}
+
+	out << "  quirks:";
+	bool any = false;
+	for (int quirk = 0; quirk < QUIRK_COUNT; ++quirk) {
+		if (m_quirks[quirk] == 0)
+			continue;
+		std::snprintf(line, sizeof(line), "\n    %-26s %5u  first at %03X", quirkName((Quirk)quirk), m_quirks[quirk], m_firstQuirk[quirk]);
+		out << line;
+		any = true;
+	}
+	out << (any ? "\n" : " none\n");
+}
+
+bool RomAnalyzer::writeDot(const char* path) const {
+	FILE* file = std::fopen(path, "w");
+	if (!file)
+		return false;
+
+	std::fprintf(file, "digraph cfg {\n\tnode [shape=box fontname=monospace];\n");
+	for (const auto& entry : m_blocks) {
+		const BasicBlock& block = entry.second;
+
+		std::fprintf(file, "\tb%03X [label=\"", block.start);
+		for (unsigned short pc = block.start; pc < block.end; pc += opcodeLength(read(pc))) {
+			std::fprintf(file, "%03X  %s\\l", pc, disassemble(read(pc)).c_str());
+		}
+		std::fprintf(file, "\"%s];\n", m_subroutines.count(block.start) ? " peripheries=2" : "");
+
+		for (size_t i = 0; i < block.successors.size(); ++i) {
+			const char* style = "";
+			if (block.exit == BasicBlock::EXIT_CALL)
+				style = i == 0 ? " [style=dashed]" : " [style=dotted]";
+			std::fprintf(file, "\tb%03X -> b%03X%s;\n", block.start, block.successors[i], style);
+		}
+		if (block.exit == BasicBlock::EXIT_INDIRECT)
+			std::fprintf(file, "\tb%03X -> indirect_%03X;\n\tindirect_%03X [shape=plaintext label=\"V0 + %03X\"];\n",
+				block.start, block.start, block.start, read(block.end - 2) & 0x0FFF);
+	}
+	std::fprintf(file, "}\n");
+
+	return std::fclose(file) == 0;
+}
+
+std::vector<RomAnalyzer> analyzeCorpus(const std::vector<std::string>& paths, unsigned int threads) {
+	std::vector<RomAnalyzer> results(paths.size());
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::min<unsigned int>(threads, (unsigned int)std::max<size_t>(1, paths.size()));
+
+	//ROMs are tiny, handing them out one by one balances the work well enough
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < paths.size(); i = next++) {
+			results[i].analyzeFile(paths[i].c_str());
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < threads; ++i) {
+		workers.emplace_back(worker);
+	}
+	worker();
+
+	for (std::thread& thread : workers) {
+		thread.join();
+	}
+
+	return results;
+}
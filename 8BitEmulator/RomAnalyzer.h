@@ -0,0 +1,117 @@
+#pragma once
+#include <bitset>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+//Straight line code with a single entry at start
+struct BasicBlock {
+	enum Exit {
+		EXIT_FALLTHROUGH = 0,	//runs into the next block
+		EXIT_JUMP,				//1NNN
+		EXIT_CALL,				//2NNN, continues at end after the subroutine returned
+		EXIT_SKIP,				//3XNN, 4XNN, 5XY0, 9XY0, EX9E, EXA1
+		EXIT_RETURN,			//00EE
+		EXIT_INDIRECT,			//BNNN, the target depends on V0
+		EXIT_INVALID			//opcode the core doesn't know
+	};
+
+	unsigned short start;
+	//First address after the block
+	unsigned short end;
+	Exit exit;
+	//Jump/call target first, fallthrough/skip targets after it
+	std::vector<unsigned short> successors;
+};
+
+/*
+Static analysis of a ROM as it is loaded at 0x200.
+Recovers the control flow by following 1NNN/2NNN/skip edges from the entry point (BNNN is recorded as indirect and
+not followed), then runs a constant propagation of I and V0-VF over every block to find the memory that ANNN/F000 NNNN +
+DXYN/FX33/FX55/FX65 touch. Stores into bytes that were recovered as code are reported as self-modifying.
+The quirk report counts the instructions whose behaviour differs between Chip-8 interpreters.
+*/
+class RomAnalyzer {
+public:
+
+	enum ByteKind {
+		BYTE_UNKNOWN = 0,	//never reached and never referenced
+		BYTE_CODE,
+		BYTE_DATA,			//read or written through I
+		BYTE_CODE_AND_DATA	//executed and accessed through I
+	};
+
+	//Instructions whose meaning depends on the interpreter
+	enum Quirk {
+		QUIRK_SHIFT = 0,	//8XY6/8XYE shift VY (COSMAC) or VX (CHIP-48)
+		QUIRK_LOAD_STORE,	//FX55/FX65 increment I (COSMAC) or leave it
+		QUIRK_JUMP,			//BNNN adds V0 (COSMAC) or VX (CHIP-48)
+		QUIRK_LOGIC,		//8XY1/8XY2/8XY3 reset VF (COSMAC)
+		QUIRK_DRAW,			//DXYN waits for vblank and clips (COSMAC) or wraps
+		QUIRK_COUNT
+	};
+
+	//Store through I that hits recovered code (or whose target isn't known)
+	struct Store {
+		unsigned short pc;
+		unsigned short start;
+		unsigned short length;
+	};
+
+	RomAnalyzer();
+
+	bool analyzeFile(const char* path);
+	//The program is placed at 0x200 like Chip8::loadProgram does
+	void analyze(const unsigned char* program, size_t size);
+
+	const std::string& GetName() const { return m_name; }
+	size_t GetSize() const { return m_size; }
+	const std::map<unsigned short, BasicBlock>& GetBlocks() const { return m_blocks; }
+	const std::set<unsigned short>& GetSubroutines() const { return m_subroutines; }
+	ByteKind GetKind(unsigned short address) const;
+	bool IsCode(unsigned short address) const { return m_code[address & 0xFFF]; }
+	const std::vector<unsigned short>& GetIndirectJumps() const { return m_indirect; }
+	const std::vector<unsigned short>& GetInvalidOpcodes() const { return m_invalid; }
+	const std::vector<Store>& GetSelfModifyingStores() const { return m_selfModifying; }
+	const std::vector<Store>& GetUnresolvedStores() const { return m_unresolved; }
+	unsigned int GetQuirkCount(Quirk quirk) const { return m_quirks[quirk]; }
+
+	void writeReport(std::ostream& out) const;
+	//CFG in graphviz format
+	bool writeDot(const char* path) const;
+
+	static const char* quirkName(Quirk quirk);
+
+private:
+	unsigned short read(unsigned short address) const;
+	void recoverCode();
+	void buildBlocks();
+	void findData(const BasicBlock& block);
+
+	std::string m_name;
+	size_t m_size;
+	unsigned char m_memory[4096];
+
+	std::bitset<4096> m_code;
+	std::bitset<4096> m_data;
+	//Addresses where a recovered instruction starts
+	std::bitset<4096> m_instructions;
+	std::set<unsigned short> m_leaders;
+
+	std::map<unsigned short, BasicBlock> m_blocks;
+	std::set<unsigned short> m_subroutines;
+	std::vector<unsigned short> m_indirect;
+	std::vector<unsigned short> m_invalid;
+	std::vector<Store> m_stores;
+	std::vector<Store> m_selfModifying;
+	std::vector<Store> m_unresolved;
+
+	unsigned int m_quirks[QUIRK_COUNT];
+	unsigned short m_firstQuirk[QUIRK_COUNT];
+};
+
+//Analyzes every ROM on its own thread pool (one worker per hardware thread if threads is 0).
+//Files that can't be read are returned with GetSize() == 0
+std::vector<RomAnalyzer> analyzeCorpus(const std::vector<std::string>& paths, unsigned int threads = 0);
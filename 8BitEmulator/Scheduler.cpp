@@ -0,0 +1,84 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+
+Scheduler::Scheduler() : m_time(0), m_sequence(0), m_nextId(0), m_stopped(false) {
+}
+
+bool Scheduler::later(const Event& a, const Event& b) {
+	//std::push_heap keeps the largest element on top, so the comparison is reversed for a min-heap
+	return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+}
+
+unsigned long long Scheduler::GetNextEvent() {
+	discardCancelled();
+	return m_heap.empty() ? ~0ULL : m_heap.front().time;
+}
+
+Scheduler::EventId Scheduler::schedule(unsigned long long time, Callback callback, unsigned long long period) {
+	Event event = { std::max(time, m_time), period, m_sequence++, m_nextId++, callback };
+	m_heap.push_back(event);
+	std::push_heap(m_heap.begin(), m_heap.end(), later);
+	return event.id;
+}
+
+void Scheduler::cancel(EventId id) {
+	//Only pending events, ids of fired events would never be removed again
+	if (std::find(m_cancelled.begin(), m_cancelled.end(), id) != m_cancelled.end())
+		return;
+
+	for (const Event& event : m_heap) {
+		if (event.id == id) {
+			m_cancelled.push_back(id);
+			return;
+		}
+	}
+}
+
+void Scheduler::discardCancelled() {
+	while (!m_heap.empty() && !m_cancelled.empty()) {
+		auto cancelled = std::find(m_cancelled.begin(), m_cancelled.end(), m_heap.front().id);
+		if (cancelled == m_cancelled.end())
+			return;
+
+		m_cancelled.erase(cancelled);
+		std::pop_heap(m_heap.begin(), m_heap.end(), later);
+		m_heap.pop_back();
+	}
+}
+
+void Scheduler::runUntil(unsigned long long time, const Runner& cpu) {
+	m_stopped = false;
+
+	while (!m_stopped) {
+		discardCancelled();
+
+		//Nothing due before the end, the CPU gets the rest in one go
+		if (m_heap.empty() || m_heap.front().time > time) {
+			if (time > m_time)
+				cpu(time);
+			m_time = std::max(m_time, time);
+			return;
+		}
+
+		std::pop_heap(m_heap.begin(), m_heap.end(), later);
+		Event event = std::move(m_heap.back());
+		m_heap.pop_back();
+
+		if (event.time > m_time) {
+			cpu(event.time);
+			m_time = event.time;
+		}
+
+		//Rescheduled before it fires, so the callback can cancel it
+		if (event.period > 0) {
+			Event next = event;
+			next.time += event.period;
+			next.sequence = m_sequence++;
+			m_heap.push_back(next);
+			std::push_heap(m_heap.begin(), m_heap.end(), later);
+		}
+
+		event.callback();
+	}
+}
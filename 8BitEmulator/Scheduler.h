@@ -0,0 +1,60 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+/*
+Emulated time event scheduler shared by the devices of a machine (timers, vblank, input, audio...).
+Time is counted in ticks of a clock the machine picks (e.g. 3000 Hz for a 500 Hz Chip-8 with 60 Hz devices, so both
+divide it). Events sit in a min-heap ordered by time, events due at the same tick fire in the order they were
+scheduled. Between two events the CPU gets the whole stretch in one call, so it runs in batches as big as possible
+and never has to check for devices itself.
+Nothing in here knows about Chip-8, other cores can drive their devices with it the same way.
+*/
+class Scheduler {
+public:
+
+	using Callback = std::function<void()>;
+	//Brings the CPU up to the given tick (the CPU keeps its own time, it may stop a few ticks short)
+	using Runner = std::function<void(unsigned long long until)>;
+	using EventId = unsigned long long;
+
+	Scheduler();
+
+	unsigned long long GetTime() const { return m_time; }
+	//Tick of the next pending event, ~0ULL if there is none
+	unsigned long long GetNextEvent();
+
+	//Fires at the tick (right away if it already passed), then every period ticks if period isn't 0
+	EventId schedule(unsigned long long time, Callback callback, unsigned long long period = 0);
+	EventId scheduleIn(unsigned long long ticks, Callback callback, unsigned long long period = 0) { return schedule(m_time + ticks, callback, period); }
+	void cancel(EventId id);
+
+	//Advances to the tick: the CPU runs up to each event, then the event fires. Returns early after stop()
+	void runUntil(unsigned long long time, const Runner& cpu);
+	//Makes runUntil return once the event that's firing is done (called from a callback)
+	void stop() { m_stopped = true; }
+	bool IsStopped() const { return m_stopped; }
+
+private:
+	struct Event {
+		unsigned long long time;
+		unsigned long long period;
+		//Ties are broken by the order of scheduling
+		unsigned long long sequence;
+		EventId id;
+		Callback callback;
+	};
+
+	static bool later(const Event& a, const Event& b);
+	//Drops cancelled events from the top of the heap
+	void discardCancelled();
+
+	unsigned long long m_time;
+	unsigned long long m_sequence;
+	EventId m_nextId;
+	bool m_stopped;
+
+	std::vector<Event> m_heap;
+	//Still in the heap, dropped when they come up
+	std::vector<EventId> m_cancelled;
+};
@@ -0,0 +1,232 @@
+#include "SharedState.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include "chip8.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Other processes only see the atomics as plain words if they don't need a lock
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared memory needs lock-free atomics");
+
+//A reader gives up after this many frames that changed while it copied
+static const int READ_ATTEMPTS = 1000;
+
+SharedState::SharedState() : m_segment(nullptr), m_owner(false), m_inputApplied(0) {
+#ifdef _WIN32
+	m_section = nullptr;
+#endif
+}
+
+SharedState::~SharedState() {
+	close();
+}
+
+bool SharedState::create(const char* name) {
+	close();
+
+	const size_t size = sizeof(SharedMachine);
+	void* mapping = nullptr;
+
+#ifdef _WIN32
+	const std::string mappingName = std::string("Local\\") + (name[0] == '/' ? name + 1 : name);
+	m_section = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)size, mappingName.c_str());
+	mapping = m_section ? MapViewOfFile(m_section, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+	if (!mapping) {
+		std::cerr << "Couldn't create the shared memory " << mappingName << "\n";
+		close();
+		return false;
+	}
+#else
+	const int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+	if (fd < 0 || ftruncate(fd, size) != 0) {
+		std::cerr << "Couldn't create the shared memory " << name << "\n";
+		if (fd >= 0)
+			::close(fd);
+		return false;
+	}
+	mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		std::cerr << "Couldn't map the shared memory " << name << "\n";
+		shm_unlink(name);
+		return false;
+	}
+#endif
+
+	//A segment left behind by an emulator that crashed starts over, readers see the version change
+	std::memset(mapping, 0, size);
+	m_segment = new (mapping) SharedMachine;
+	std::memcpy(m_segment->magic, "C8SM", 4);
+	m_segment->size = (unsigned int)size;
+	m_segment->sequence.store(0, std::memory_order_relaxed);
+	m_segment->inputSequence.store(0, std::memory_order_relaxed);
+	m_segment->inputKeys.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_segment->version = SharedMachine::VERSION;
+
+	m_name = name;
+	m_owner = true;
+	m_inputApplied = 0;
+	return true;
+}
+
+bool SharedState::attach(const char* name) {
+	close();
+
+	const size_t size = sizeof(SharedMachine);
+	void* mapping = nullptr;
+
+#ifdef _WIN32
+	const std::string mappingName = std::string("Local\\") + (name[0] == '/' ? name + 1 : name);
+	m_section = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, mappingName.c_str());
+	mapping = m_section ? MapViewOfFile(m_section, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+	if (!mapping) {
+		close();
+		return false;
+	}
+#else
+	const int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size != size) {
+		::close(fd);
+		return false;
+	}
+	mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+		return false;
+#endif
+
+	m_segment = static_cast<SharedMachine*>(mapping);
+	m_name = name;
+	m_owner = false;
+
+	if (std::memcmp(m_segment->magic, "C8SM", 4) != 0 || m_segment->version != SharedMachine::VERSION || m_segment->size != size) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void SharedState::close() {
+	if (!m_segment)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_segment);
+	if (m_section)
+		CloseHandle(m_section);
+	m_section = nullptr;
+#else
+	munmap(m_segment, sizeof(SharedMachine));
+	//Readers that still have it mapped keep their mapping, new ones can't attach anymore
+	if (m_owner)
+		shm_unlink(m_name.c_str());
+#endif
+	m_segment = nullptr;
+	m_owner = false;
+}
+
+void SharedState::publish(const Chip8& chip) {
+	const unsigned int sequence = m_segment->sequence.load(std::memory_order_relaxed);
+	m_segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	SharedFrame& state = m_segment->state;
+	state.frame = chip.GetFrame();
+	state.cycle = chip.GetCycle();
+	state.inputApplied = m_inputApplied;
+	state.i = chip.GetI();
+	state.pc = chip.GetPC();
+	state.sp = chip.GetSP();
+	unsigned short keys = 0;
+	for (int n = 0; n < 16; ++n) {
+		state.stack[n] = chip.GetStack(n);
+		state.v[n] = chip.GetV(n);
+		keys |= (unsigned short)((chip.m_key[n] != 0) << n);
+	}
+	state.delayTimer = chip.GetDelayTimer();
+	state.soundTimer = chip.GetSoundTimer();
+	state.keys = keys;
+
+	const Display& display = chip.GetDisplay();
+	state.hires = display.IsHires() ? 1 : 0;
+	state.quirks = (unsigned char)chip.GetQuirks();
+	for (int plane = 0; plane < Display::PLANES; ++plane) {
+		std::copy(display.GetRows(plane), display.GetRows(plane) + Display::HEIGHT, state.rows[plane]);
+	}
+
+	m_segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool SharedState::pollKeys(unsigned int& keys) {
+	//Same retry as read(), so inputApplied never names an injection whose keys weren't the ones read
+	for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+		const unsigned int sequence = m_segment->inputSequence.load(std::memory_order_acquire);
+		if (sequence == 0)
+			return false;
+		if (sequence & 1) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		const unsigned int injected = m_segment->inputKeys.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_segment->inputSequence.load(std::memory_order_relaxed) == sequence) {
+			keys = injected & 0xFFFF;
+			m_inputApplied = sequence / 2;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SharedState::read(SharedFrame& frame) const {
+	for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+		const unsigned int sequence = m_segment->sequence.load(std::memory_order_acquire);
+		if (sequence & 1) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::memcpy(&frame, &m_segment->state, sizeof(SharedFrame));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_segment->sequence.load(std::memory_order_relaxed) == sequence)
+			return true;
+	}
+	return false;
+}
+
+unsigned int SharedState::GetPublished() const {
+	return m_segment->sequence.load(std::memory_order_acquire) / 2;
+}
+
+void SharedState::injectKeys(unsigned int keys) {
+	//Waits while another process is in the middle of its injection
+	unsigned int sequence = m_segment->inputSequence.load(std::memory_order_relaxed);
+	while ((sequence & 1) || !m_segment->inputSequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed)) {
+		if (sequence & 1) {
+			std::this_thread::yield();
+			sequence = m_segment->inputSequence.load(std::memory_order_relaxed);
+		}
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+
+	m_segment->inputKeys.store(keys & 0xFFFF, std::memory_order_relaxed);
+	m_segment->inputSequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <string>
+
+#include "Display.h"
+
+class Chip8;
+
+//Machine state of one frame as SharedState publishes it
+struct SharedFrame {
+	//Chip8::GetFrame() and GetCycle() when it was published
+	unsigned long long frame;
+	unsigned long long cycle;
+	//inputSequence / 2 of the injected keys the keypad held during this frame, 0 before any were injected
+	unsigned int inputApplied;
+	unsigned int i;
+	unsigned short pc;
+	unsigned short sp;
+	unsigned short stack[16];
+	unsigned char v[16];
+	unsigned char delayTimer;
+	unsigned char soundTimer;
+	//Keypad, bit n is key n
+	unsigned short keys;
+	unsigned char hires;
+	//QuirkProfile
+	unsigned char quirks;
+	Display::Row rows[Display::PLANES][Display::HEIGHT];
+};
+
+/*
+Layout of the shared memory segment. Host byte order and alignment, the segment is only shared on one machine.
+The emulator is the only writer of everything up to the input fields and never waits for a reader: it makes
+sequence odd, writes the frame in place and makes sequence even again (a seqlock). A reader reads sequence, reads
+what it needs straight from the segment, then checks that sequence is still the same even number and retries if it
+isn't. sequence / 2 counts the frames published.
+Keys go the other way through a second seqlock: a process makes inputSequence odd (compare and exchange from an even
+value, so injecting processes take turns), stores the bitmask of held keys in inputKeys and makes it even again.
+inputSequence / 2 counts the injections.
+*/
+struct SharedMachine {
+	static const unsigned int VERSION = 2;
+
+	char magic[4];					//"C8SM"
+	unsigned int version;
+	unsigned int size;				//sizeof(SharedMachine)
+
+	alignas(64) std::atomic<unsigned int> sequence;
+	SharedFrame state;
+
+	//Written by other processes, on their own cache line
+	alignas(64) std::atomic<unsigned int> inputSequence;
+	std::atomic<unsigned int> inputKeys;
+};
+
+/*
+Named shared memory segment holding a SharedMachine: POSIX shared memory (shm_open, the name starts with a slash,
+e.g. "/chip8") or a named file mapping on Windows ("Local\" + the name without the slash).
+The emulator create()s it, publishes every frame and picks up injected keys. Bots and dashboards attach() to it in
+their own process, read frames without ever blocking the emulator and inject keys. Processes that aren't written in
+C++ can map the segment themselves and follow the layout above.
+*/
+class SharedState {
+public:
+
+	SharedState();
+	~SharedState();
+	SharedState(const SharedState&) = delete;
+	SharedState& operator=(const SharedState&) = delete;
+
+	//Emulator side: creates the segment (an existing one of the same name is taken over) and removes it on close()
+	bool create(const char* name);
+	//Reader side: maps a segment created by an emulator
+	bool attach(const char* name);
+	void close();
+	bool IsOpen() const { return m_segment != nullptr; }
+
+	//Emulator thread, once per frame after it ran. Costs one copy of the screen rows
+	void publish(const Chip8& chip);
+	//Keys injected last, false if no process injected any yet or one kept injecting for all the retries. The next
+	//publish() reports them as applied
+	bool pollKeys(unsigned int& keys);
+
+	//Reader side: copies the last complete frame, false if the emulator kept writing for all the retries
+	bool read(SharedFrame& frame) const;
+	//Frames published so far, changes when read() has something new
+	unsigned int GetPublished() const;
+	void injectKeys(unsigned int keys);
+
+private:
+	SharedMachine* m_segment;
+	std::string m_name;
+	bool m_owner;
+	unsigned int m_inputApplied;
+#ifdef _WIN32
+	void* m_section;
+#endif
+};
@@ -0,0 +1,264 @@
+#include "SoftwareRenderer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "DisplaySimd.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/*
+Pixel kernels. Pixels are 32 bit RGBA values, every kernel handles whole vectors and finishes the rest one pixel at
+a time.
+*/
+
+//Writes every pixel factor times in a row (factor > 1). Each pixel is stored as whole vectors, the part of the last
+//vector that reaches into the next pixels' place is overwritten by them, only the pixels at the end of the row have
+//to stop exactly
+static void repeatPixels(const unsigned int* pixels, int count, int factor, unsigned int* out) {
+	const int end = count * factor;
+	int i = 0;
+#if defined(__AVX2__)
+	const int span = (factor + 7) & ~7;
+	for (; i * factor + span <= end; ++i) {
+		const __m256i value = _mm256_set1_epi32((int)pixels[i]);
+		unsigned int* target = out + i * factor;
+		for (int k = 0; k < factor; k += 8) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(target + k), value);
+		}
+	}
+#elif defined(DISPLAY_SSE2)
+	const int span = (factor + 3) & ~3;
+	for (; i * factor + span <= end; ++i) {
+		const __m128i value = _mm_set1_epi32((int)pixels[i]);
+		unsigned int* target = out + i * factor;
+		for (int k = 0; k < factor; k += 4) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(target + k), value);
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		std::fill(out + i * factor, out + (i + 1) * factor, pixels[i]);
+	}
+}
+
+//Nearest neighbour scaling of one row
+static void scalePixels(const unsigned int* pixels, int count, int factor, unsigned int* out) {
+	if (factor == 1)
+		std::memcpy(out, pixels, count * sizeof(unsigned int));
+	else
+		repeatPixels(pixels, count, factor, out);
+}
+
+//glow = max(pixel, glow * decay / 256) per channel, the pixel becomes the glow
+static void decayPixels(unsigned int* pixels, unsigned int* glow, int count, int decay) {
+	int i = 0;
+#ifdef DISPLAY_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i factor = _mm_set1_epi16((short)decay);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(glow + i));
+		//At most 255 * 255 per lane, the products fit unsigned 16 bit
+		const __m128i low = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(previous, zero), factor), 8);
+		const __m128i high = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(previous, zero), factor), 8);
+		const __m128i result = _mm_max_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i)),
+			_mm_packus_epi16(low, high));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(glow + i), result);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), result);
+	}
+#endif
+	for (; i < count; ++i) {
+		unsigned int result = 0;
+		for (int shift = 0; shift < 32; shift += 8) {
+			const unsigned int faded = (glow[i] >> shift & 0xFF) * decay >> 8;
+			result |= std::max(pixels[i] >> shift & 0xFF, faded) << shift;
+		}
+		glow[i] = result;
+		pixels[i] = result;
+	}
+}
+
+//Colors with their alpha applied over black, alpha becomes opaque. Divides by 255 like the MEGA-CHIP blend modes
+static void overBlack(unsigned int* pixels, int count) {
+	int i = 0;
+#ifdef DISPLAY_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(128);
+	const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+		__m128i low = _mm_unpacklo_epi8(value, zero);
+		__m128i high = _mm_unpackhi_epi8(value, zero);
+		//Alpha (lane 3 of each pixel) copied to all four lanes
+		const __m128i lowAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(low, 0xFF), 0xFF);
+		const __m128i highAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(high, 0xFF), 0xFF);
+		low = _mm_add_epi16(_mm_mullo_epi16(low, lowAlpha), round);
+		high = _mm_add_epi16(_mm_mullo_epi16(high, highAlpha), round);
+		low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+		high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), _mm_or_si128(_mm_packus_epi16(low, high), opaque));
+	}
+#endif
+	for (; i < count; ++i) {
+		const unsigned int alpha = pixels[i] >> 24;
+		unsigned int result = 0xFF000000;
+		for (int shift = 0; shift < 24; shift += 8) {
+			const unsigned int t = (pixels[i] >> shift & 0xFF) * alpha + 128;
+			result |= (t + (t >> 8)) >> 8 << shift;
+		}
+		pixels[i] = result;
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer() {
+	const int pixels = std::max(Display::WIDTH * Display::HEIGHT, MegaDisplay::WIDTH * MegaDisplay::HEIGHT);
+	m_indices.resize(Display::WIDTH * Display::HEIGHT);
+	m_source.resize(pixels);
+	m_glow.resize(pixels);
+	m_previous.resize(pixels);
+	m_dirty.resize(std::max((int)Display::HEIGHT, (int)MegaDisplay::HEIGHT));
+	m_smoothed.resize(std::max((int)Display::WIDTH, (int)MegaDisplay::WIDTH) * 4);
+
+	//Black background, white for index 1 like every other Chip-8
+	m_palette[0] = 0xFF000000;
+	for (int i = 1; i < 16; ++i) {
+		m_palette[i] = 0xFFFFFFFF;
+	}
+	m_scale = 1;
+	m_filter = FILTER_NONE;
+	m_phosphor = 0;
+
+	m_lastOutput = nullptr;
+	m_lastPitch = 0;
+	m_lastWidth = 0;
+	m_lastHeight = 0;
+}
+
+void SoftwareRenderer::setPalette(const unsigned int* rgba) {
+	//Changed colors show up as changed rows, no need to invalidate
+	std::memcpy(m_palette, rgba, sizeof(m_palette));
+}
+
+void SoftwareRenderer::setScale(int scale) {
+	m_scale = std::min(std::max(scale, 1), (int)MAX_SCALE);
+	invalidate();
+}
+
+void SoftwareRenderer::setFilter(Filter filter) {
+	m_filter = filter;
+	invalidate();
+}
+
+void SoftwareRenderer::setPhosphor(int decay) {
+	m_phosphor = std::min(std::max(decay, 0), 255);
+}
+
+void SoftwareRenderer::render(const Display& display, unsigned int* out, int pitch) {
+	const int width = display.GetWidth();
+	const int height = display.GetHeight();
+
+	display.compose(m_indices.data());
+	for (int i = 0; i < width * height; ++i) {
+		m_source[i] = m_palette[m_indices[i] & 0xF];
+	}
+	present(width, height, out, pitch);
+}
+
+void SoftwareRenderer::render(const MegaDisplay& display, unsigned int* out, int pitch) {
+	const int pixels = MegaDisplay::WIDTH * MegaDisplay::HEIGHT;
+	if (display.IsEnabled()) {
+		display.expand(m_source.data());
+		overBlack(m_source.data(), pixels);
+	}
+	else {
+		std::fill(m_source.begin(), m_source.begin() + pixels, 0xFF000000);
+	}
+	present(MegaDisplay::WIDTH, MegaDisplay::HEIGHT, out, pitch);
+}
+
+void SoftwareRenderer::present(int width, int height, unsigned int* out, int pitch) {
+	//A new resolution starts without afterglow and without a frame to compare with
+	const bool resized = width != m_lastWidth || height != m_lastHeight;
+	if (resized)
+		std::copy(m_source.begin(), m_source.begin() + width * height, m_glow.begin());
+	if (m_phosphor > 0)
+		decayPixels(m_source.data(), m_glow.data(), width * height, m_phosphor);
+	else
+		std::copy(m_source.begin(), m_source.begin() + width * height, m_glow.begin());
+
+	const bool full = resized || out != m_lastOutput || pitch != m_lastPitch;
+	for (int y = 0; y < height; ++y) {
+		const size_t row = (size_t)y * width;
+		m_dirty[y] = full || std::memcmp(&m_source[row], &m_previous[row], width * sizeof(unsigned int)) != 0;
+	}
+
+	//Scale2x looks at the rows above and below, a changed row changes its neighbours' output too
+	const bool smooth = m_filter == FILTER_SCALE2X && m_scale % 2 == 0;
+	for (int y = 0; y < height; ++y) {
+		bool dirty = m_dirty[y] != 0;
+		if (smooth)
+			dirty = dirty || (y > 0 && m_dirty[y - 1]) || (y + 1 < height && m_dirty[y + 1]);
+		if (!dirty)
+			continue;
+
+		const unsigned int* row = &m_source[(size_t)y * width];
+		const unsigned int* above = y > 0 ? row - width : row;
+		const unsigned int* below = y + 1 < height ? row + width : row;
+		scaleRow(above, row, below, width, out + (size_t)y * m_scale * pitch, pitch);
+	}
+
+	for (int y = 0; y < height; ++y) {
+		if (m_dirty[y]) {
+			const size_t row = (size_t)y * width;
+			std::memcpy(&m_previous[row], &m_source[row], width * sizeof(unsigned int));
+		}
+	}
+
+	m_lastOutput = out;
+	m_lastPitch = pitch;
+	m_lastWidth = width;
+	m_lastHeight = height;
+}
+
+void SoftwareRenderer::scaleRow(const unsigned int* above, const unsigned int* row, const unsigned int* below, int width,
+	unsigned int* out, int pitch) {
+	const size_t bytes = (size_t)width * m_scale * sizeof(unsigned int);
+
+	if (m_filter != FILTER_SCALE2X || m_scale % 2 != 0) {
+		scalePixels(row, width, m_scale, out);
+		for (int i = 1; i < m_scale; ++i) {
+			std::memcpy(out + (size_t)i * pitch, out, bytes);
+		}
+		return;
+	}
+
+	//Scale2x: a pixel's quarter takes the neighbour's color where two neighbours agree on an edge through it
+	unsigned int* top = m_smoothed.data();
+	unsigned int* bottom = top + width * 2;
+	for (int x = 0; x < width; ++x) {
+		const unsigned int b = above[x];
+		const unsigned int d = row[x > 0 ? x - 1 : x];
+		const unsigned int e = row[x];
+		const unsigned int f = row[x + 1 < width ? x + 1 : x];
+		const unsigned int h = below[x];
+		if (b != h && d != f) {
+			top[x * 2] = d == b ? d : e;
+			top[x * 2 + 1] = b == f ? f : e;
+			bottom[x * 2] = d == h ? d : e;
+			bottom[x * 2 + 1] = h == f ? f : e;
+		}
+		else {
+			top[x * 2] = top[x * 2 + 1] = bottom[x * 2] = bottom[x * 2 + 1] = e;
+		}
+	}
+
+	const int half = m_scale / 2;
+	unsigned int* lower = out + (size_t)half * pitch;
+	scalePixels(top, width * 2, half, out);
+	scalePixels(bottom, width * 2, half, lower);
+	for (int i = 1; i < half; ++i) {
+		std::memcpy(out + (size_t)i * pitch, out, bytes);
+		std::memcpy(lower + (size_t)i * pitch, lower, bytes);
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+
+#include "Display.h"
+#include "MegaDisplay.h"
+
+/*
+Draws the emulator screen on the CPU into RGBA pixels (bytes R, G, B, A in memory order, like MegaDisplay), for
+headless runs that want images without an OpenGL context.
+Every frame goes through the same steps at the screen's own resolution first: palette lookup (Chip-8 screens) or the
+finished MEGA-CHIP frame, then the optional phosphor decay, which keeps a fading copy of lit pixels so sprites that
+are erased and redrawn every frame don't flicker. Only then is the frame scaled up by a whole factor (1-16),
+optionally with scale2x smoothing the edges first, so the per pixel work never depends on the output size.
+
+Output rows are written with whole vector stores (SSE2, AVX2 when the target has it) and repeated rows are copied.
+Rows of the screen that look the same as in the last frame are skipped when the same buffer is passed again, so a
+static screen costs a compare per row instead of a full 1080p write. Nothing is allocated per frame.
+*/
+class SoftwareRenderer {
+public:
+
+	static const int MAX_SCALE = 16;
+
+	enum Filter {
+		FILTER_NONE = 0,
+		//Scale2x (AdvMAME2x) before the nearest neighbour scaling, used at even scales only
+		FILTER_SCALE2X
+	};
+
+	SoftwareRenderer();
+
+	//Colors of the 16 bitplane palette indices
+	void setPalette(const unsigned int* rgba);
+	//Clamped to 1-MAX_SCALE
+	void setScale(int scale);
+	int GetScale() const { return m_scale; }
+	void setFilter(Filter filter);
+	Filter GetFilter() const { return m_filter; }
+	//Share of the last frame's brightness kept per frame (0-255), 0 turns the decay off
+	void setPhosphor(int decay);
+	int GetPhosphor() const { return m_phosphor; }
+
+	//Size of the image render() writes
+	int GetOutputWidth(const Display& display) const { return display.GetWidth() * m_scale; }
+	int GetOutputHeight(const Display& display) const { return display.GetHeight() * m_scale; }
+	int GetOutputWidth(const MegaDisplay&) const { return MegaDisplay::WIDTH * m_scale; }
+	int GetOutputHeight(const MegaDisplay&) const { return MegaDisplay::HEIGHT * m_scale; }
+
+	//Writes the frame into out, pitch is the distance between rows in pixels. Rows are only skipped if out is the
+	//buffer of the last call and still holds what was written there
+	void render(const Display& display, unsigned int* out, int pitch);
+	//The last finished frame with the screen alpha applied over black
+	void render(const MegaDisplay& display, unsigned int* out, int pitch);
+
+	//The next frame is written in full
+	void invalidate() { m_lastOutput = nullptr; }
+
+private:
+	//Phosphor, change detection and scaling of m_source
+	void present(int width, int height, unsigned int* out, int pitch);
+	void scaleRow(const unsigned int* above, const unsigned int* row, const unsigned int* below, int width,
+		unsigned int* out, int pitch);
+
+	unsigned int m_palette[16];
+	int m_scale;
+	Filter m_filter;
+	int m_phosphor;
+
+	//Screen sized buffers, allocated once for the largest screen
+	std::vector<unsigned char> m_indices;
+	std::vector<unsigned int> m_source;
+	std::vector<unsigned int> m_glow;
+	std::vector<unsigned int> m_previous;
+	std::vector<unsigned char> m_dirty;
+	//Two scale2x output rows
+	std::vector<unsigned int> m_smoothed;
+
+	//What the last frame was written to, anything different is written in full
+	const unsigned int* m_lastOutput;
+	int m_lastPitch;
+	int m_lastWidth;
+	int m_lastHeight;
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/*
+Bounded lock-free queue for exactly one producer thread and one consumer thread.
+Capacity is rounded up to a power of two. Head and tail live on their own cache lines so the
+two sides don't invalidate each other on every operation.
+*/
+template <typename T>
+class SpscRing {
+public:
+
+	explicit SpscRing(size_t capacity) : m_head(0), m_tail(0) {
+		size_t size = 2;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		m_buffer.resize(size);
+		m_mask = size - 1;
+	}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	//Producer side. Returns false if the ring is full
+	bool tryPush(const T& value) {
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_cachedTail > m_mask) {
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head - m_cachedTail > m_mask)
+				return false;
+		}
+
+		m_buffer[head & m_mask] = value;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Producer side, for values too big to build and then copy: the slot the next value goes into, nullptr if the
+	//ring is full. The value is filled in place and handed to the consumer by publish()
+	T* tryClaim() {
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_cachedTail > m_mask) {
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head - m_cachedTail > m_mask)
+				return nullptr;
+		}
+		return &m_buffer[head & m_mask];
+	}
+
+	void publish() {
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	//Consumer side. Returns false if the ring is empty
+	bool tryPop(T& value) {
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_cachedHead) {
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+			if (tail == m_cachedHead)
+				return false;
+		}
+
+		value = m_buffer[tail & m_mask];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Consumer side. Pops up to count values at once, returns how many were popped
+	size_t tryPop(T* values, size_t count) {
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (m_cachedHead - tail < count)
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+
+		size_t available = m_cachedHead - tail;
+		if (available < count)
+			count = available;
+
+		for (size_t i = 0; i < count; ++i) {
+			values[i] = m_buffer[(tail + i) & m_mask];
+		}
+		m_tail.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	//Approximate, only exact when called from one of the two sides while the other is idle
+	size_t size() const {
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const {
+		return m_mask + 1;
+	}
+
+private:
+	std::vector<T> m_buffer;
+	size_t m_mask;
+
+	//Written by the producer
+	alignas(64) std::atomic<size_t> m_head;
+	size_t m_cachedTail = 0;
+
+	//Written by the consumer
+	alignas(64) std::atomic<size_t> m_tail;
+	size_t m_cachedHead = 0;
+};
@@ -0,0 +1,115 @@
+#include "Terminal.h"
+
+#ifdef _WIN32
+#include <conio.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+Terminal::Terminal() : m_open(false) {
+#ifdef _WIN32
+	m_inputMode = 0;
+	m_outputMode = 0;
+#endif
+}
+
+Terminal::~Terminal() {
+	close();
+}
+
+#ifdef _WIN32
+
+bool Terminal::open() {
+	HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+	HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+	DWORD inputMode = 0;
+	DWORD outputMode = 0;
+	if (!GetConsoleMode(input, &inputMode) || !GetConsoleMode(output, &outputMode))
+		return false;
+
+	m_inputMode = inputMode;
+	m_outputMode = outputMode;
+	SetConsoleMode(input, inputMode & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT | ENABLE_PROCESSED_INPUT));
+	SetConsoleMode(output, outputMode | ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+	SetConsoleOutputCP(CP_UTF8);
+	m_open = true;
+	return true;
+}
+
+void Terminal::close() {
+	if (!m_open)
+		return;
+	SetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), m_inputMode);
+	SetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), m_outputMode);
+	m_open = false;
+}
+
+bool Terminal::write(const char* data, size_t size) {
+	HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+	while (size > 0) {
+		DWORD written = 0;
+		if (!WriteFile(output, data, (DWORD)size, &written, nullptr))
+			return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+size_t Terminal::read(char* buffer, size_t size) {
+	size_t count = 0;
+	while (count < size && _kbhit()) {
+		buffer[count++] = (char)_getch();
+	}
+	return count;
+}
+
+#else
+
+bool Terminal::open() {
+	if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &m_saved) != 0)
+		return false;
+
+	//No line buffering, no echo, no signals, and reads return at once with whatever is there
+	struct termios raw = m_saved;
+	raw.c_iflag &= ~(IXON | ICRNL | BRKINT | INPCK | ISTRIP);
+	raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+	raw.c_cc[VMIN] = 0;
+	raw.c_cc[VTIME] = 0;
+	if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) != 0)
+		return false;
+	m_open = true;
+	return true;
+}
+
+void Terminal::close() {
+	if (!m_open)
+		return;
+	tcsetattr(STDIN_FILENO, TCSANOW, &m_saved);
+	m_open = false;
+}
+
+bool Terminal::write(const char* data, size_t size) {
+	while (size > 0) {
+		const ssize_t written = ::write(STDOUT_FILENO, data, size);
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= (size_t)written;
+	}
+	return true;
+}
+
+size_t Terminal::read(char* buffer, size_t size) {
+	if (!m_open)
+		return 0;
+	const ssize_t count = ::read(STDIN_FILENO, buffer, size);
+	return count > 0 ? (size_t)count : 0;
+}
+
+#endif
+
+bool Terminal::write(const std::string& data) {
+	return write(data.data(), data.size());
+}
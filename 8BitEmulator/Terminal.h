@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#ifndef _WIN32
+#include <termios.h>
+#endif
+
+/*
+The terminal a text frontend runs in: raw keyboard input (keys arrive one by one as they are typed, without echo and
+without Ctrl-C stopping the process) and output that goes out in as few system calls as possible.
+The previous modes are restored by close() or the destructor.
+*/
+class Terminal {
+public:
+	Terminal();
+	~Terminal();
+	Terminal(const Terminal&) = delete;
+	Terminal& operator=(const Terminal&) = delete;
+
+	//Switches to raw input and, on Windows, turns on escape sequence processing. Returns false if stdin isn't a
+	//terminal, output still works then
+	bool open();
+	void close();
+	bool IsOpen() const { return m_open; }
+
+	//Writes all of data to stdout, one call unless the system takes it in parts
+	bool write(const std::string& data);
+	bool write(const char* data, size_t size);
+	//Copies the bytes typed since the last call into buffer without waiting, returns how many
+	size_t read(char* buffer, size_t size);
+
+private:
+	bool m_open;
+#ifdef _WIN32
+	unsigned long m_inputMode;
+	unsigned long m_outputMode;
+#else
+	struct termios m_saved;
+#endif
+};
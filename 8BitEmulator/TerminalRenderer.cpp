@@ -0,0 +1,150 @@
+#include "TerminalRenderer.h"
+
+//UTF-8 of the block glyphs
+static const char UPPER_HALF[] = "\xE2\x96\x80";
+static const char LOWER_HALF[] = "\xE2\x96\x84";
+static const char FULL_BLOCK[] = "\xE2\x96\x88";
+
+TerminalRenderer::TerminalRenderer() {
+	//Black background, white for index 1, the other indices like the window's default palette
+	const unsigned char colors[16] = { 16, 231, 208, 94, 33, 153, 134, 54, 35, 157, 184, 100, 197, 218, 244, 238 };
+	setColors(colors);
+
+	m_indices.resize(Display::WIDTH * Display::HEIGHT);
+	m_cells.resize(Display::WIDTH * Display::HEIGHT / 2);
+	m_width = 0;
+	m_rows = 0;
+	m_valid = false;
+	m_cursorX = -1;
+	m_cursorY = -1;
+	m_foreground = -1;
+	m_background = -1;
+	//A full 128x64 frame with a color change in every cell
+	m_output.reserve(Display::WIDTH * Display::HEIGHT / 2 * 32);
+}
+
+void TerminalRenderer::setColors(const unsigned char* colors) {
+	for (int i = 0; i < 16; ++i) {
+		m_colors[i] = colors[i];
+	}
+	m_valid = false;
+}
+
+void TerminalRenderer::appendNumber(int value) {
+	char digits[12];
+	int count = 0;
+	do {
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+	while (count > 0) {
+		m_output += digits[--count];
+	}
+}
+
+void TerminalRenderer::moveTo(int x, int y) {
+	if (x == m_cursorX && y == m_cursorY)
+		return;
+
+	//Moving right on the same row is shorter than a full position
+	if (y == m_cursorY && x > m_cursorX && m_cursorX >= 0) {
+		m_output += "\x1b[";
+		if (x - m_cursorX > 1)
+			appendNumber(x - m_cursorX);
+		m_output += 'C';
+	}
+	else {
+		m_output += "\x1b[";
+		appendNumber(y + 1);
+		m_output += ';';
+		appendNumber(x + 1);
+		m_output += 'H';
+	}
+	m_cursorX = x;
+	m_cursorY = y;
+}
+
+void TerminalRenderer::useColors(int foreground, int background) {
+	const bool setForeground = foreground >= 0 && foreground != m_foreground;
+	const bool setBackground = background >= 0 && background != m_background;
+	if (!setForeground && !setBackground)
+		return;
+
+	m_output += "\x1b[";
+	if (setForeground) {
+		m_output += "38;5;";
+		appendNumber(m_colors[foreground]);
+		m_foreground = foreground;
+	}
+	if (setForeground && setBackground)
+		m_output += ';';
+	if (setBackground) {
+		m_output += "48;5;";
+		appendNumber(m_colors[background]);
+		m_background = background;
+	}
+	m_output += 'm';
+}
+
+const std::string& TerminalRenderer::encode(const Display& display) {
+	m_output.clear();
+
+	const int width = display.GetWidth();
+	const int rows = display.GetHeight() / 2;
+	if (width != m_width || rows != m_rows)
+		m_valid = false;
+
+	//Start over from a known state: default colors, empty screen, cursor nowhere in particular
+	const bool full = !m_valid;
+	if (full) {
+		m_output += "\x1b[0m\x1b[2J";
+		m_width = width;
+		m_rows = rows;
+		m_foreground = -1;
+		m_background = -1;
+		m_cursorX = -1;
+		m_cursorY = -1;
+		m_valid = true;
+	}
+
+	display.compose(m_indices.data());
+
+	for (int y = 0; y < rows; ++y) {
+		const unsigned char* top = &m_indices[y * 2 * width];
+		const unsigned char* bottom = top + width;
+		unsigned char* cells = &m_cells[y * width];
+
+		for (int x = 0; x < width; ++x) {
+			const unsigned char cell = (unsigned char)((top[x] & 0xF) | (bottom[x] & 0xF) << 4);
+			if (!full && cell == cells[x])
+				continue;
+			cells[x] = cell;
+
+			const int upper = cell & 0xF;
+			const int lower = cell >> 4;
+			moveTo(x, y);
+
+			//Every cell has two glyphs that show it, the one that fits the current colors wins
+			if (upper == lower) {
+				if (upper == m_background || upper != m_foreground) {
+					useColors(-1, upper);
+					m_output += ' ';
+				}
+				else {
+					m_output += FULL_BLOCK;
+				}
+			}
+			else if ((upper != m_background) + (lower != m_foreground) < (upper != m_foreground) + (lower != m_background)) {
+				useColors(lower, upper);
+				m_output += LOWER_HALF;
+			}
+			else {
+				useColors(upper, lower);
+				m_output += UPPER_HALF;
+			}
+			++m_cursorX;
+		}
+	}
+
+	return m_output;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Display.h"
+
+/*
+Draws the Chip-8 screen in a terminal with ANSI escape sequences. Every character cell shows two pixels, one above
+the other, as a Unicode half block ("▀" with the top pixel as foreground and the bottom one as background), so
+64x32 takes 64x16 cells and 128x64 takes 128x32.
+
+The encoder remembers the cells it sent and what it left the terminal in (cursor position, colors), and a frame only
+carries the cells that changed: the cursor jumps over unchanged runs, colors are only set when the glyph can't be
+picked to fit the current ones. Two color screens never send a color after the first frame. A static screen costs
+nothing, a moving sprite costs a few dozen bytes.
+*/
+class TerminalRenderer {
+public:
+
+	TerminalRenderer();
+
+	//xterm 256 color numbers of the 16 bitplane palette indices
+	void setColors(const unsigned char* colors);
+
+	//Bytes that bring the terminal from the last frame to this one, empty if nothing changed. The first frame (and
+	//the first after invalidate() or a resolution change) clears the terminal and draws everything. The string is
+	//reused by the next call
+	const std::string& encode(const Display& display);
+	//The next frame is drawn in full, e.g. after something else wrote to the terminal
+	void invalidate() { m_valid = false; }
+
+	//Switch to the alternate screen with the cursor hidden and back, around a session of frames
+	static const char* enterSequence() { return "\x1b[?1049h\x1b[?25l"; }
+	static const char* leaveSequence() { return "\x1b[0m\x1b[?25h\x1b[?1049l"; }
+
+private:
+	void moveTo(int x, int y);
+	//Palette indices, -1 keeps the current color
+	void useColors(int foreground, int background);
+	void appendNumber(int value);
+
+	unsigned char m_colors[16];
+	std::vector<unsigned char> m_indices;
+	//Top pixel's index in the low nibble, the bottom one's in the high nibble
+	std::vector<unsigned char> m_cells;
+	int m_width;
+	int m_rows;
+	bool m_valid;
+
+	//Terminal state the sent bytes leave behind, -1 if unknown
+	int m_cursorX;
+	int m_cursorY;
+	int m_foreground;
+	int m_background;
+
+	std::string m_output;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include "Opcode.h"
+
+//How executed instructions map to emulated time (Chip8::SetTiming)
+enum TimingModel {
+	TIMING_INSTRUCTION = 0,	//every instruction is one cycle and ticks the timers (the emulator's original model)
+	TIMING_COSMAC_VIP,		//instructions cost what they cost the VIP interpreter, the timers tick once per frame
+	TIMING_SCHEDULED		//every instruction is one cycle, the timers only tick on Chip8::tickTimers() (host scheduler)
+};
+
+/*
+COSMAC VIP: the 1802 runs at 1.7609 MHz with 8 clocks per machine cycle, 3668 machine cycles per 60 Hz frame. The
+display DMA takes one machine cycle per byte (8 bytes on each of the 128 lines), the interpreter gets the rest.
+*/
+const int VIP_FRAME_CYCLES = 3668;
+const int VIP_DMA_CYCLES = 128 * 8;
+
+/*
+Machine cycles of an instruction, fetch and decode included: base + perX * X + perN * N + perDigit * (sum of the
+decimal digits of VX). The variable parts are the interpreter's loops (FX55/FX65 per register, DXYN per sprite row,
+FX33 counting down every digit), 00E0 clears the 256 display bytes one by one.
+The numbers are approximations read off the interpreter's listing, close enough that games run at their speed.
+*/
+struct InstructionCost {
+	unsigned short base;
+	unsigned char perX;
+	unsigned char perN;
+	unsigned char perDigit;
+	//DXYN waits for the display interrupt before it draws
+	unsigned char waitsForVblank;
+};
+
+//Indexed by opcodeShape()
+const InstructionCost VIP_COSTS[OPCODE_SHAPE_COUNT] = {
+	{ 3078, 0, 0, 0, 0 },	//00E0
+	{ 20, 0, 0, 0, 0 },		//00EE
+	{ 20, 0, 0, 0, 0 },		//0NNN
+	{ 12, 0, 0, 0, 0 },		//1NNN
+	{ 26, 0, 0, 0, 0 },		//2NNN
+	{ 14, 0, 0, 0, 0 },		//3XNN
+	{ 14, 0, 0, 0, 0 },		//4XNN
+	{ 18, 0, 0, 0, 0 },		//5XY0
+	{ 6, 0, 0, 0, 0 },		//6XNN
+	{ 10, 0, 0, 0, 0 },		//7XNN
+	{ 12, 0, 0, 0, 0 },		//8XY0
+	{ 44, 0, 0, 0, 0 },		//8XY1
+	{ 44, 0, 0, 0, 0 },		//8XY2
+	{ 44, 0, 0, 0, 0 },		//8XY3
+	{ 44, 0, 0, 0, 0 },		//8XY4
+	{ 44, 0, 0, 0, 0 },		//8XY5
+	{ 44, 0, 0, 0, 0 },		//8XY6
+	{ 44, 0, 0, 0, 0 },		//8XY7
+	{ 44, 0, 0, 0, 0 },		//8XY8
+	{ 44, 0, 0, 0, 0 },		//8XY9
+	{ 44, 0, 0, 0, 0 },		//8XYA
+	{ 44, 0, 0, 0, 0 },		//8XYB
+	{ 44, 0, 0, 0, 0 },		//8XYC
+	{ 44, 0, 0, 0, 0 },		//8XYD
+	{ 44, 0, 0, 0, 0 },		//8XYE
+	{ 44, 0, 0, 0, 0 },		//8XYF
+	{ 18, 0, 0, 0, 0 },		//9XY0
+	{ 12, 0, 0, 0, 0 },		//ANNN
+	{ 22, 0, 0, 0, 0 },		//BNNN
+	{ 36, 0, 0, 0, 0 },		//CXNN
+	{ 26, 0, 68, 0, 1 },	//DXYN
+	{ 18, 0, 0, 0, 0 },		//EX9E
+	{ 18, 0, 0, 0, 0 },		//EXA1
+	{ 20, 0, 0, 0, 0 },		//EXNN
+	{ 10, 0, 0, 0, 0 },		//FX07
+	{ 18, 0, 0, 0, 0 },		//FX0A (per poll while no key is down)
+	{ 10, 0, 0, 0, 0 },		//FX15
+	{ 10, 0, 0, 0, 0 },		//FX18
+	{ 16, 0, 0, 0, 0 },		//FX1E
+	{ 16, 0, 0, 0, 0 },		//FX29
+	{ 24, 0, 0, 16, 0 },	//FX33
+	{ 14, 14, 0, 0, 0 },	//FX55
+	{ 14, 14, 0, 0, 0 },	//FX65
+	{ 20, 0, 0, 0, 0 }		//FXNN
+};
+
+/*
+opcodeShape() as a 4 KB table indexed by opcodeTimingKey(), so the cost lookup doesn't branch on the shape.
+The key keeps the high nibble and the low byte, which is all opcodeShape() looks at except for telling 00E0/00EE from
+other 0NNN. The 0NNN opcodes with a second nibble (MEGA-CHIP 01NN-06NN) would alias 00NN and 01E0 would cost as much
+as 00E0, so they take the key of 00FF instead. Like the SUPER-CHIP/XO-CHIP 00CN, 00DN and 00FB-00FF they have no VIP
+cost of their own and count as a plain 0NNN.
+*/
+inline unsigned short opcodeTimingKey(unsigned short opcode) {
+	const bool extended = opcode >= 0x0100 && opcode < 0x1000;
+	return extended ? (unsigned short)0x00FF : (unsigned short)((opcode >> 4 & 0x0F00) | (opcode & 0x00FF));
+}
+
+struct OpcodeShapeTable {
+	unsigned char shapes[4096];
+	//Sum of the decimal digits of every byte (FX33 loops once per unit of every digit)
+	unsigned char digits[256];
+
+	OpcodeShapeTable() {
+		for (unsigned int key = 0; key < 4096; ++key) {
+			shapes[key] = (unsigned char)opcodeShape((unsigned short)((key & 0x0F00) << 4 | (key & 0x00FF)));
+		}
+		for (unsigned int value = 0; value < 256; ++value) {
+			digits[value] = (unsigned char)(value / 100 + value / 10 % 10 + value % 10);
+		}
+	}
+};
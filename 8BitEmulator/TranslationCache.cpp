@@ -0,0 +1,263 @@
+#include "TranslationCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "chip8.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Bump when Header or the table layout changes
+#define CACHE_FORMAT 1
+
+TranslationCache::TranslationCache() : m_memoryHash(0), m_fusion(0), m_mapping(nullptr), m_mappingSize(0), m_table(nullptr) {
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_section = nullptr;
+#endif
+	for (unsigned int i = 0; i < PAGE_COUNT; ++i) {
+		m_pages[i] = PAGE_UNCHECKED;
+	}
+}
+
+TranslationCache::~TranslationCache() {
+	close();
+}
+
+bool TranslationCache::open(const char* directory, const Chip8& chip) {
+	close();
+
+	//The program and the font both decide what gets decoded
+	m_memoryHash = chip.GetMemoryHash();
+	m_fusion = chip.GetFusion();
+
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.c8x", m_memoryHash);
+	m_path = directory;
+	if (!m_path.empty() && m_path.back() != '/' && m_path.back() != '\\')
+		m_path += '/';
+	m_path += name;
+
+	const size_t size = sizeof(Header) + 4096;
+
+#ifdef _WIN32
+	m_file = CreateFileA(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart != (LONGLONG)size) {
+		close();
+		return false;
+	}
+
+	m_section = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	m_mapping = m_section ? MapViewOfFile(m_section, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!m_mapping) {
+		close();
+		return false;
+	}
+#else
+	int fd = ::open(m_path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size != size) {
+		::close(fd);
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	//The mapping stays valid after closing the descriptor
+	::close(fd);
+	if (mapping == MAP_FAILED)
+		return false;
+	m_mapping = mapping;
+#endif
+	m_mappingSize = size;
+
+	//Only the header is checked now, the table page by page on first use
+	const Header* header = static_cast<const Header*>(m_mapping);
+	if (std::memcmp(header->magic, "C8XC", 4) != 0 || header->format != CACHE_FORMAT || header->version != FUSION_VERSION
+		|| header->fusion != m_fusion || header->memoryHash != m_memoryHash) {
+		close();
+		return false;
+	}
+
+	m_table = static_cast<const unsigned char*>(m_mapping) + sizeof(Header);
+	return true;
+}
+
+void TranslationCache::close() {
+#ifdef _WIN32
+	if (m_mapping)
+		UnmapViewOfFile(m_mapping);
+	if (m_section)
+		CloseHandle(m_section);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_section = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_mapping)
+		munmap(m_mapping, m_mappingSize);
+#endif
+	m_mapping = nullptr;
+	m_mappingSize = 0;
+	m_table = nullptr;
+
+	for (unsigned int i = 0; i < PAGE_COUNT; ++i) {
+		m_pages[i] = PAGE_UNCHECKED;
+	}
+}
+
+unsigned int TranslationCache::pageChecksum(const unsigned char* entries) {
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < PAGE_SIZE; ++i) {
+		hash = (hash ^ entries[i]) * 16777619u;
+	}
+	return hash;
+}
+
+bool TranslationCache::checkPage(unsigned int page) const {
+	unsigned char state = m_pages[page].load(std::memory_order_acquire);
+	if (state == PAGE_UNCHECKED) {
+		const Header* header = static_cast<const Header*>(m_mapping);
+		const unsigned char* entries = m_table + page * PAGE_SIZE;
+		bool valid = pageChecksum(entries) == header->pages[page];
+		for (unsigned int i = 0; i < PAGE_SIZE && valid; ++i) {
+			valid = entries[i] < SUPER_COUNT || entries[i] == FUSED_UNKNOWN;
+		}
+
+		//Threads checking the same page at once come to the same result
+		state = valid ? PAGE_VALID : PAGE_CORRUPT;
+		m_pages[page].store(state, std::memory_order_release);
+	}
+	return state == PAGE_VALID;
+}
+
+unsigned char TranslationCache::lookup(unsigned short pc) const {
+	pc &= 0xFFF;
+	if (!m_table || !checkPage(pc / PAGE_SIZE))
+		return FUSED_UNKNOWN;
+	return m_table[pc];
+}
+
+bool TranslationCache::save(const Chip8& chip) {
+	return write(chip.GetFusion(), [&chip](unsigned short pc) { return chip.GetTranslation(pc); });
+}
+
+bool TranslationCache::save(const SharedTranslations& shared) {
+	if (shared.GetMemoryHash() != m_memoryHash)
+		return false;
+	return write(shared.GetFusion(), [&shared](unsigned short pc) { return shared.lookup(pc); });
+}
+
+bool TranslationCache::write(unsigned int fusion, const std::function<unsigned char(unsigned short pc)>& decoded) {
+	if (m_path.empty() || fusion != m_fusion)
+		return false;
+
+	Header header;
+	std::memcpy(header.magic, "C8XC", 4);
+	header.format = CACHE_FORMAT;
+	header.version = FUSION_VERSION;
+	header.fusion = m_fusion;
+	header.memoryHash = m_memoryHash;
+
+	std::vector<unsigned char> table(4096);
+	bool changed = !m_table;
+	for (unsigned int pc = 0; pc < 4096; ++pc) {
+		table[pc] = lookup((unsigned short)pc);
+		unsigned char entry = decoded((unsigned short)pc);
+		if (entry != FUSED_UNKNOWN && entry != table[pc]) {
+			table[pc] = entry;
+			changed = true;
+		}
+	}
+	for (unsigned int page = 0; page < PAGE_COUNT; ++page) {
+		header.pages[page] = pageChecksum(table.data() + page * PAGE_SIZE);
+	}
+
+	//Nothing new, keep the file (and its page cache) as it is
+	close();
+	if (!changed)
+		return true;
+
+	//Written next to the cache and renamed over it, sessions starting meanwhile never map a half written file
+	std::string temporary = m_path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(table.data()), table.size());
+		if (!file)
+			return false;
+	}
+
+#ifdef _WIN32
+	if (!MoveFileExA(temporary.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+	if (std::rename(temporary.c_str(), m_path.c_str()) != 0) {
+#endif
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+SharedTranslations::SharedTranslations(unsigned long long memoryHash, unsigned int fusion) : m_memoryHash(memoryHash), m_fusion(fusion), m_decoded(0) {
+	for (unsigned int pc = 0; pc < 4096; ++pc) {
+		m_entries[pc].store(FUSED_UNKNOWN, std::memory_order_relaxed);
+	}
+}
+
+std::shared_ptr<SharedTranslations> SharedTranslations::acquire(const Chip8& chip, const TranslationCache* cache) {
+	//Tables of the programs some machine still runs. Only taken when a session starts, never on a lookup
+	static std::mutex mutex;
+	static std::map<std::pair<unsigned long long, unsigned int>, std::weak_ptr<SharedTranslations>> tables;
+
+	const std::pair<unsigned long long, unsigned int> key(chip.GetMemoryHash(), chip.GetFusion());
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::shared_ptr<SharedTranslations> table = tables[key].lock();
+	if (table)
+		return table;
+
+	table = std::make_shared<SharedTranslations>(key.first, key.second);
+	if (cache && cache->IsOpen() && cache->GetFusion() == key.second) {
+		for (unsigned int pc = 0; pc < 4096; ++pc) {
+			table->m_entries[pc].store(cache->lookup((unsigned short)pc), std::memory_order_relaxed);
+		}
+	}
+
+	//Drop the programs nobody runs anymore while we're at it
+	for (auto it = tables.begin(); it != tables.end();) {
+		if (it->second.expired())
+			it = tables.erase(it);
+		else
+			++it;
+	}
+	tables[key] = table;
+	return table;
+}
+
+void SharedTranslations::publish(unsigned short pc, unsigned char super) {
+	unsigned char expected = FUSED_UNKNOWN;
+	//Another machine may have been faster, it published the same value
+	if (m_entries[pc & 0xFFF].compare_exchange_strong(expected, super, std::memory_order_release, std::memory_order_relaxed))
+		m_decoded.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+class Chip8;
+class SharedTranslations;
+
+/*
+Superinstruction table of a program saved to disk, so a new session doesn't have to decode it again.
+The file is named after the hash of the memory as it was loaded (program and font) and is only used if its format,
+FUSION_VERSION and fusion mask match. It is memory-mapped when opened and validated lazily: the header is checked
+right away, the table is checked one page at a time when a lookup first touches the page, pages whose checksum
+doesn't match are ignored.
+Layout (host byte order, the cache isn't meant to move between machines): Header, then one entry per address.
+*/
+class TranslationCache {
+public:
+
+	static const unsigned int PAGE_SIZE = 256;
+	static const unsigned int PAGE_COUNT = 4096 / PAGE_SIZE;
+
+	TranslationCache();
+	~TranslationCache();
+	TranslationCache(const TranslationCache&) = delete;
+	TranslationCache& operator=(const TranslationCache&) = delete;
+
+	//Opens the cache of the chip's program in the directory. Call it right after loading, before the program
+	//changes its memory. Returns false if there is no usable cache yet (save() creates it)
+	bool open(const char* directory, const Chip8& chip);
+	void close();
+	bool IsOpen() const { return m_table != nullptr; }
+
+	//Saved superinstruction at pc, FUSED_UNKNOWN if there is none or its page is corrupt
+	unsigned char lookup(unsigned short pc) const;
+	unsigned int GetFusion() const { return m_fusion; }
+	const std::string& GetPath() const { return m_path; }
+
+	//Writes the saved entries merged with everything the chip (or every machine sharing the table) decoded since.
+	//Closes the mapping
+	bool save(const Chip8& chip);
+	bool save(const SharedTranslations& shared);
+
+private:
+	struct Header {
+		char magic[4];			//"C8XC"
+		unsigned int format;
+		unsigned int version;	//FUSION_VERSION
+		unsigned int fusion;
+		unsigned long long memoryHash;
+		unsigned int pages[PAGE_COUNT];	//checksum of every page of the table
+	};
+
+	enum PageState {
+		PAGE_UNCHECKED = 0,
+		PAGE_VALID,
+		PAGE_CORRUPT
+	};
+
+	bool write(unsigned int fusion, const std::function<unsigned char(unsigned short pc)>& decoded);
+	bool checkPage(unsigned int page) const;
+	static unsigned int pageChecksum(const unsigned char* entries);
+
+	std::string m_path;
+	unsigned long long m_memoryHash;
+	unsigned int m_fusion;
+
+	//Mapped file, m_table points behind the header
+	void* m_mapping;
+	size_t m_mappingSize;
+	const unsigned char* m_table;
+#ifdef _WIN32
+	void* m_file;
+	void* m_section;
+#endif
+
+	//Sessions may share a cache and look up from their own threads
+	mutable std::atomic<unsigned char> m_pages[PAGE_COUNT];
+};
+
+/*
+Superinstruction table shared by every machine of the process that runs the same program with the same fusion mask,
+so a batch of sessions decodes each address once instead of once per session.
+Lookups and publishes are lock-free: an entry only ever changes from FUSED_UNKNOWN to its superinstruction, and every
+machine decoding it comes to the same value, so there is nothing to retire while readers are still around. The
+table itself lives as long as one of the shared_ptr handed out by acquire().
+Machines keep their own m_fused table in front of it and never publish or read entries of addresses they wrote to,
+so self-modifying sessions diverge privately.
+*/
+class SharedTranslations {
+public:
+
+	//Table for the program the chip has loaded (call it before the program changes its memory). Seeded from the cache
+	//if one is given and open
+	static std::shared_ptr<SharedTranslations> acquire(const Chip8& chip, const TranslationCache* cache = nullptr);
+
+	SharedTranslations(unsigned long long memoryHash, unsigned int fusion);
+	SharedTranslations(const SharedTranslations&) = delete;
+	SharedTranslations& operator=(const SharedTranslations&) = delete;
+
+	unsigned char lookup(unsigned short pc) const { return m_entries[pc & 0xFFF].load(std::memory_order_acquire); }
+	void publish(unsigned short pc, unsigned char super);
+
+	unsigned long long GetMemoryHash() const { return m_memoryHash; }
+	unsigned int GetFusion() const { return m_fusion; }
+	//Entries decoded by the machines (the ones taken from the cache don't count)
+	unsigned int GetDecoded() const { return m_decoded.load(std::memory_order_relaxed); }
+
+private:
+	unsigned long long m_memoryHash;
+	unsigned int m_fusion;
+	std::atomic<unsigned char> m_entries[4096];
+	std::atomic<unsigned int> m_decoded;
+};
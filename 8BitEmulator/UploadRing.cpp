@@ -0,0 +1,77 @@
+#include "UploadRing.h"
+
+#include <iostream>
+
+UploadRing::UploadRing() {
+	m_gl = nullptr;
+	m_buffer = 0;
+	m_mapped = nullptr;
+	m_slotSize = 0;
+	for (int i = 0; i < SLOTS; ++i) {
+		m_fences[i] = nullptr;
+	}
+	m_slot = 0;
+}
+
+bool UploadRing::init(const GLFunctions& gl, size_t slotSize) {
+	m_gl = &gl;
+	m_slotSize = slotSize;
+	m_slot = 0;
+
+	//Coherent, so writes through the pointer need no flush before the texture update reads them
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	gl.GenBuffers(1, &m_buffer);
+	gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+	gl.BufferStorage(GL_PIXEL_UNPACK_BUFFER, slotSize * SLOTS, nullptr, flags);
+	m_mapped = static_cast<unsigned char*>(gl.MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize * SLOTS, flags));
+	gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!m_mapped) {
+		std::cerr << "Couldn't map the pixel buffer\n";
+		release();
+		return false;
+	}
+	return true;
+}
+
+void UploadRing::release() {
+	if (!m_gl)
+		return;
+
+	for (int i = 0; i < SLOTS; ++i) {
+		if (m_fences[i])
+			m_gl->DeleteSync(m_fences[i]);
+		m_fences[i] = nullptr;
+	}
+	if (m_buffer) {
+		m_gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+		if (m_mapped)
+			m_gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		m_gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		m_gl->DeleteBuffers(1, &m_buffer);
+	}
+	m_buffer = 0;
+	m_mapped = nullptr;
+}
+
+unsigned char* UploadRing::begin() {
+	//Frames in flight are short, the wait only blocks if the GPU is SLOTS frames behind
+	GLsync& fence = m_fences[m_slot];
+	if (fence) {
+		while (m_gl->ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+		}
+		m_gl->DeleteSync(fence);
+		fence = nullptr;
+	}
+	return m_mapped + m_slot * m_slotSize;
+}
+
+const void* UploadRing::bind() const {
+	m_gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+	return reinterpret_cast<const void*>(m_slot * m_slotSize);
+}
+
+void UploadRing::end() {
+	m_gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_fences[m_slot] = m_gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_slot = (m_slot + 1) % SLOTS;
+}
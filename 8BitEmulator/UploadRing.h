@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+
+#include "GLFunctions.h"
+
+/*
+Pixel buffer the renderers upload their textures through. It stays mapped (GL_MAP_PERSISTENT_BIT) and has one slot per
+frame in flight: the frame is written straight into the slot, the texture update copies from it on the GPU side, and a
+fence tells when the slot can be written again. Nothing is allocated or mapped per frame.
+A frame goes begin() (write the slot), bind() (texture updates with the returned offset), end().
+*/
+class UploadRing {
+public:
+
+	//Frames the GPU may still be reading while the next one is written
+	static const int SLOTS = 3;
+
+	UploadRing();
+
+	//Creates and maps the buffer with SLOTS slots of slotSize bytes. The functions have to outlive the ring. Prints the
+	//reason to std::cerr and returns false if the buffer can't be mapped
+	bool init(const GLFunctions& gl, size_t slotSize);
+	//Deletes the buffer and the fences, the context must still be current
+	void release();
+
+	//Waits until the GPU is done with the next slot and returns it
+	unsigned char* begin();
+	//Binds the buffer for unpacking and returns the slot as the offset texture updates take with it bound
+	const void* bind() const;
+	//Unbinds the buffer and fences the slot, it is written again once the texture updates since bind() have read it
+	void end();
+
+private:
+	const GLFunctions* m_gl;
+	unsigned int m_buffer;
+	unsigned char* m_mapped;
+	size_t m_slotSize;
+	GLsync m_fences[SLOTS];
+	int m_slot;
+};
@@ -1,35 +1,344 @@
 #include "chip8.h"
 
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <iostream>
 #include <random>
 
-unsigned int randomNumber();
+#include "Debugger.h"
+#include "EventLog.h"
+#include "TranslationCache.h"
 
-Chip8::Chip8(Renderer::Grid& grid) : m_grid(grid) {
+#ifdef CHIP8_PROFILER
+#define PROFILE(hook) do { if (m_profiler) m_profiler->hook; } while (0)
+#else
+#define PROFILE(hook)
+#endif
+
+//Instruction costs of TIMING_COSMAC_VIP
+static const OpcodeShapeTable s_timing;
+
+//Watchpoints, only looked at while a debugger is attached
+#define DEBUG_ARMED (Debugger::armed.load(std::memory_order_relaxed) != 0 && m_debugger)
+#define DEBUG_READ(address) do { if (DEBUG_ARMED) m_debugger->onRead(address); } while (0)
+#define DEBUG_WRITE(address) do { if (DEBUG_ARMED) m_debugger->onWrite(address); } while (0)
+
+Chip8::Chip8() {
 	drawFlag = false;
+	m_halted = false;
+	m_exited = false;
+	m_illegalPolicy = ILLEGAL_HALT;
+	m_debugger = nullptr;
+	m_translations = nullptr;
+	m_shared = nullptr;
+	//Unseeded runs stay random, SetSeed() makes them reproducible
+	m_seed = std::random_device{}();
+	m_fusion = FUSION_DEFAULT;
+	resetSuperinstructions();
+	m_timing = TIMING_INSTRUCTION;
+	m_instructionsPerFrame = 8;
+	m_frame = 0;
+	m_frameCycles = VIP_FRAME_CYCLES - VIP_DMA_CYCLES;
+	m_I = 0;
+	SetQuirks(QUIRKS_MODERN);
+#ifdef CHIP8_PROFILER
+	m_profiler = nullptr;
+#endif
+#ifdef CHIP8_TRACE
+	m_trace = nullptr;
+#endif
 
-	//init key
-	for (int i = 0; i < 15; ++i) {
+	//init key and flags
+	for (int i = 0; i < 16; ++i) {
 		m_key[i] = 0;
+		m_flags[i] = 0;
 	}
 }
 
-const unsigned char(&Chip8::GetGFX() const)[64][32]{
-	return m_gfx;
+const Display& Chip8::GetDisplay() const {
+	return m_display;
+}
+
+const MegaDisplay& Chip8::GetMegaDisplay() const {
+	return m_megaDisplay;
+}
+
+unsigned short Chip8::GetNextOpcode() const {
+	return m_memory[m_pc] << 8 | m_memory[(m_pc + 1) & 0xFFFF];
+}
+
+unsigned long long Chip8::GetCycle() const {
+	return m_cycle;
+}
+
+bool Chip8::IsHalted() const {
+	return m_halted;
+}
+
+bool Chip8::HasExited() const {
+	return m_exited;
+}
+
+unsigned short Chip8::GetPC() const {
+	return m_pc;
+}
+
+unsigned int Chip8::GetI() const {
+	return m_I;
+}
+
+unsigned short Chip8::GetSP() const {
+	return m_sp;
+}
+
+unsigned char Chip8::GetV(int index) const {
+	return m_V[index & 0xF];
+}
+
+unsigned short Chip8::GetStack(int level) const {
+	return m_stack[level & 0xF];
+}
+
+unsigned char Chip8::GetMemory(unsigned int address) const {
+	return m_memory[address & m_addressMask];
+}
+
+size_t Chip8::GetMemorySize() const {
+	return m_memory.size();
+}
+
+unsigned char Chip8::GetDelayTimer() const {
+	return m_delay_timer;
+}
+
+unsigned char Chip8::GetSoundTimer() const {
+	return m_sound_timer;
+}
+
+unsigned int Chip8::GetRandomState() const {
+	return m_random;
+}
+
+unsigned char Chip8::GetFlag(int index) const {
+	return m_flags[index & 0xF];
+}
+
+unsigned char Chip8::GetAudioPattern(int index) const {
+	return m_audioPattern[index & 0xF];
+}
+
+unsigned char Chip8::GetPitch() const {
+	return m_pitch;
+}
+
+double Chip8::GetAudioRate() const {
+	return 4000.0 * std::pow(2.0, (m_pitch - 64) / 48.0);
+}
+
+const Chip8::Sample& Chip8::GetSample() const {
+	return m_sample;
+}
+
+unsigned long long Chip8::GetStateHash() const {
+	//FNV-1a over everything that influences the following cycles
+	unsigned long long hash = 14695981039346656037ULL;
+	auto add = [&hash](const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+	};
+
+	add(m_memory.data(), m_memory.size());
+	const bool hires = m_display.IsHires();
+	const unsigned int planes = m_display.GetPlanes();
+	for (int plane = 0; plane < Display::PLANES; ++plane) {
+		add(m_display.GetRows(plane), sizeof(Display::Row) * Display::HEIGHT);
+	}
+	add(&hires, sizeof(hires));
+	add(&planes, sizeof(planes));
+	add(m_flags, sizeof(m_flags));
+	add(m_audioPattern, sizeof(m_audioPattern));
+	add(&m_pitch, sizeof(m_pitch));
+	if (m_megaDisplay.IsEnabled()) {
+		add(m_megaDisplay.GetIndices(), MegaDisplay::WIDTH * MegaDisplay::HEIGHT);
+		add(m_megaDisplay.GetColors(), MegaDisplay::WIDTH * MegaDisplay::HEIGHT * sizeof(unsigned int));
+	}
+	for (int i = 0; i < 256; ++i) {
+		const unsigned int color = m_megaDisplay.GetColor(i);
+		add(&color, sizeof(color));
+	}
+	const int megaSettings[] = { m_megaDisplay.IsEnabled(), m_megaDisplay.GetSpriteWidth(), m_megaDisplay.GetSpriteHeight(),
+		m_megaDisplay.GetBlendMode(), m_megaDisplay.GetCollisionIndex(), m_megaDisplay.GetScreenAlpha() };
+	add(megaSettings, sizeof(megaSettings));
+	const unsigned int sample[] = { m_sample.address, m_sample.length, m_sample.rate, m_sample.loop, m_sample.playing };
+	add(sample, sizeof(sample));
+	add(m_V, sizeof(m_V));
+	add(m_stack, sizeof(m_stack));
+	add(m_key, sizeof(m_key));
+	add(&m_I, sizeof(m_I));
+	add(&m_pc, sizeof(m_pc));
+	add(&m_sp, sizeof(m_sp));
+	add(&m_delay_timer, sizeof(m_delay_timer));
+	add(&m_sound_timer, sizeof(m_sound_timer));
+	add(&m_random, sizeof(m_random));
+	add(&m_cycle, sizeof(m_cycle));
+	add(&m_halted, sizeof(m_halted));
+	add(&m_exited, sizeof(m_exited));
+	add(&m_frame, sizeof(m_frame));
+	add(&m_frameCycles, sizeof(m_frameCycles));
+
+	return hash;
+}
+
+unsigned long long Chip8::GetMemoryHash() const {
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < m_memory.size(); ++i) {
+		hash = (hash ^ m_memory[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+void Chip8::SetSeed(unsigned int seed) {
+	m_seed = seed;
+	m_random = m_seed != 0 ? m_seed : 0x2545F491;
+}
+
+void Chip8::SetFusion(unsigned int superinstructions) {
+	m_fusion = superinstructions;
+	//What was decoded for the old set is stale, the stores since loading stay known. Stores made while fusion was off
+	//weren't tracked, no address counts as loaded anymore then
+	std::memset(m_fused, FUSED_UNKNOWN, sizeof(m_fused));
+	if (m_untrackedStores)
+		m_modified.set();
+}
+
+unsigned int Chip8::GetFusion() const {
+	return m_fusion;
+}
+
+void Chip8::SetTranslationCache(const TranslationCache* cache) {
+	m_translations = cache;
+}
+
+void Chip8::SetSharedTranslations(SharedTranslations* shared) {
+	m_shared = shared;
+}
+
+unsigned char Chip8::GetTranslation(unsigned short pc) const {
+	if (pc >= sizeof(m_fused))
+		return FUSED_UNKNOWN;
+	return m_modified[pc] ? FUSED_UNKNOWN : m_fused[pc];
+}
+
+void Chip8::SetQuirks(QuirkProfile profile) {
+	m_quirks = profile;
+
+	//One specialization of the interpreter per profile, picked here instead of checked on every instruction
+	switch (profile) {
+	case QUIRKS_COSMAC_VIP:
+		useQuirks<QuirksCosmacVip>();
+		break;
+	case QUIRKS_SCHIP:
+		useQuirks<QuirksSchip>();
+		break;
+	case QUIRKS_XO_CHIP:
+		useQuirks<QuirksXoChip>();
+		break;
+	case QUIRKS_MEGA_CHIP:
+		useQuirks<QuirksMegaChip>();
+		break;
+	default:
+		m_quirks = QUIRKS_MODERN;
+		useQuirks<QuirksModern>();
+	}
+}
+
+QuirkProfile Chip8::GetQuirks() const {
+	return m_quirks;
+}
+
+template<class Quirks>
+void Chip8::useQuirks() {
+	//MEGA-CHIP addresses are 24 bits, everything else gets the 64 KB XO-CHIP programs can reach. The contents stay
+	const size_t memory = Quirks::megaChip ? 0x1000000 : 0x10000;
+	if (m_memory.size() != memory) {
+		m_memory.resize(memory, 0);
+		m_addressMask = (unsigned int)memory - 1;
+		m_I &= m_addressMask;
+	}
+
+	if (m_timing == TIMING_COSMAC_VIP) {
+		m_step = &Chip8::stepCycleVip<Quirks>;
+		m_run = &Chip8::runBatchVip<Quirks>;
+	}
+	else if (m_timing == TIMING_SCHEDULED) {
+		m_step = &Chip8::stepCycle<Quirks, false>;
+		m_run = &Chip8::runBatch<Quirks, false>;
+	}
+	else {
+		m_step = &Chip8::stepCycle<Quirks, true>;
+		m_run = &Chip8::runBatch<Quirks, true>;
+	}
+}
+
+void Chip8::SetTiming(TimingModel timing) {
+	m_timing = timing;
+	m_frameCycles = VIP_FRAME_CYCLES - VIP_DMA_CYCLES;
+	SetQuirks(m_quirks);
+}
+
+TimingModel Chip8::GetTiming() const {
+	return m_timing;
+}
+
+void Chip8::SetInstructionsPerFrame(unsigned int instructions) {
+	m_instructionsPerFrame = instructions;
+}
+
+unsigned long long Chip8::GetFrame() const {
+	return m_frame;
+}
+
+void Chip8::SetDebugger(Debugger* debugger) {
+	m_debugger = debugger;
+}
+
+void Chip8::SetIllegalOpcodePolicy(IllegalOpcodePolicy policy, IllegalOpcodeHandler handler) {
+	m_illegalPolicy = policy;
+	m_illegalHandler = handler;
+}
+
+#ifdef CHIP8_PROFILER
+void Chip8::SetProfiler(GuestProfiler* profiler) {
+	m_profiler = profiler;
 }
+#endif
+
+#ifdef CHIP8_TRACE
+void Chip8::SetTrace(TraceWriter* trace) {
+	m_trace = trace;
+}
+#endif
 
 void Chip8::initialize() {
 	m_pc = 0x200;	//application is loaded at this location
+	m_cycle = 0;	//Reset cycle counter
+	m_frame = 0;
+	m_frameCycles = VIP_FRAME_CYCLES - VIP_DMA_CYCLES;
+	m_halted = false;
+	m_exited = false;
 	m_opcode = 0;	//Reset current opcode
 	m_I = 0;		//Reset index register
 	m_sp = 0;		//Reset stack pointer
 
-	//Clear display
-	for (int i = 0; i < 64; ++i) {
-		for (int j = 0; j < 32; ++j) {
-			m_gfx[i][j] = 0;
-		}
-	}
+	//Clear display, back to low resolution and the first plane
+	m_display.setPlanes(1);
+	m_display.setHires(false);
+	//Out of MEGA-CHIP mode with the default palette
+	m_megaDisplay = MegaDisplay();
+	m_sample = Sample();
 
 	//Clear stack
 	for (int i = 0; i < 16; ++i) {
@@ -42,18 +351,28 @@ void Chip8::initialize() {
 	}
 
 	//Clear memory
-	for (int i = 0; i < 4096; ++i) {
-		m_memory[i] = 0;
-	}
+	std::fill(m_memory.begin(), m_memory.end(), 0);
 
 	//Clear timers
 	m_sound_timer = 0;
 	m_delay_timer = 0;
 
+	//Silent pattern at the default pitch
+	std::memset(m_audioPattern, 0, sizeof(m_audioPattern));
+	m_pitch = 64;
+
+	//Restart the random sequence (xorshift must not start at zero)
+	m_random = m_seed != 0 ? m_seed : 0x2545F491;
+
 	//Load fontset
 	for (int i = 0x050; i < 0x0A0; ++i) {
 		m_memory[i] = m_fontset[i-0x050];
 	}
+	for (int i = 0x0A0; i < 0x140; ++i) {
+		m_memory[i] = m_bigFontset[i-0x0A0];
+	}
+
+	resetSuperinstructions();
 
 }
 
@@ -66,55 +385,457 @@ void Chip8::loadGame(const char* game) {
 	}
 
 	//Read the file and cast unsigned char* to char, then specify max size for loading data
-	file.read(reinterpret_cast<char*>(m_memory + 0x200), sizeof(m_memory) - 0x200);
+	file.read(reinterpret_cast<char*>(&m_memory[0x200]), m_memory.size() - 0x200);
 	file.close();
+	resetSuperinstructions();
 
 	std::cout << "Read " << file.gcount() << " bytes!\n";
 
 }
 
+void Chip8::loadProgram(const unsigned char* program, size_t size) {
+	//Programs are placed at the same location as ROMs, anything that doesn't fit is cut off
+	if (size > m_memory.size() - 0x200)
+		size = m_memory.size() - 0x200;
+
+	std::memcpy(&m_memory[0x200], program, size);
+	resetSuperinstructions();
+}
+
+void Chip8::runCycles(unsigned int cycles) {
+	//Let the debugger run the batch so breakpoints are honoured
+	if (DEBUG_ARMED) {
+		m_debugger->runCycles(cycles);
+		return;
+	}
+
+	(this->*m_run)(cycles);
+}
+
+template<class Quirks, bool InstructionTimers>
+void Chip8::runBatch(unsigned int cycles) {
+	//The hooks want to see every single instruction
+	bool fuse = m_fusion != FUSION_NONE;
+#ifdef CHIP8_PROFILER
+	fuse = fuse && !m_profiler;
+#endif
+#ifdef CHIP8_TRACE
+	fuse = fuse && !m_trace;
+#endif
+
+	if (!fuse) {
+		for (unsigned int i = 0; i < cycles; ++i) {
+			stepCycle<Quirks, InstructionTimers>();
+		}
+		return;
+	}
+
+	unsigned int i = 0;
+	while (i < cycles) {
+		if (m_halted)
+			return;
+
+		//Only the first 4 KB are fused, code that runs on into XO-CHIP memory above it is interpreted
+		unsigned char super = SUPER_NONE;
+		if (m_pc < sizeof(m_fused)) {
+			super = m_fused[m_pc];
+			if (super == FUSED_UNKNOWN)
+				super = decodeSuperinstruction(m_pc);
+		}
+
+		if (super != SUPER_NONE) {
+			//0 if the rest of the batch is too short for it
+			unsigned int executed = executeSuperinstruction<Quirks, InstructionTimers>((Superinstruction)super, cycles - i);
+			if (executed > 0) {
+				i += executed;
+				continue;
+			}
+		}
+
+		stepCycle<Quirks, InstructionTimers>();
+		++i;
+	}
+}
+
+void Chip8::resetSuperinstructions() {
+	std::memset(m_fused, FUSED_UNKNOWN, sizeof(m_fused));
+	m_modified.reset();
+	m_untrackedStores = false;
+}
+
+unsigned char Chip8::decodeSuperinstruction(unsigned short pc) {
+	//Saved and shared translations only describe the bytes as the program was loaded, addresses this machine
+	//wrote to are decoded privately (copy-on-write)
+	const bool pristine = !m_modified[pc];
+	SharedTranslations* shared = pristine && m_shared && m_shared->GetFusion() == m_fusion ? m_shared : nullptr;
+
+	if (shared) {
+		unsigned char known = shared->lookup(pc);
+		if (known != FUSED_UNKNOWN) {
+			m_fused[pc] = known;
+			return known;
+		}
+	}
+
+	unsigned char super = FUSED_UNKNOWN;
+	if (pristine && m_translations && m_translations->GetFusion() == m_fusion)
+		super = m_translations->lookup(pc);
+
+	if (super == FUSED_UNKNOWN) {
+		//Memory is at least 64 KB, the bytes after the last entry are there to read
+		unsigned short opcodes[3];
+		for (int i = 0; i < 3; ++i) {
+			const unsigned int address = pc + i * 2;
+			opcodes[i] = m_memory[address] << 8 | m_memory[address + 1];
+		}
+
+		Superinstruction match = matchSuperinstruction(pc, opcodes[0], opcodes[1], opcodes[2]);
+		//A sequence lies entirely in the table, so executeSuperinstruction reads no further than 0xFFF and a store
+		//above it can't change a fused sequence
+		if ((m_fusion & (1u << match)) == 0 || pc + superinstructionLength(match) * 2 > sizeof(m_fused))
+			match = SUPER_NONE;
+		super = (unsigned char)match;
+	}
+
+	if (shared)
+		shared->publish(pc, super);
+	m_fused[pc] = super;
+	return super;
+}
+
+void Chip8::invalidateSuperinstructions(unsigned int address, unsigned short length) {
+	//Nothing is cached while fusion is off, SetFusion catches up if it is turned on later
+	if (m_fusion == FUSION_NONE) {
+		m_untrackedStores = true;
+		return;
+	}
+	//Stores that lie above the table and don't wrap around
+	if (address >= sizeof(m_fused) + 5 && address + length <= m_addressMask + 1)
+		return;
+
+	//Any sequence starting up to 5 bytes before the store may contain the written bytes. Sequences never reach past
+	//the first 4 KB (decodeSuperinstruction), stores above them can be ignored
+	for (int i = -5; i < length; ++i) {
+		const unsigned int written = (address + i) & m_addressMask;
+		if (written < sizeof(m_fused)) {
+			m_fused[written] = FUSED_UNKNOWN;
+			m_modified[written] = true;
+		}
+	}
+}
+
+template<class Quirks, bool InstructionTimers>
+unsigned int Chip8::executeSuperinstruction(Superinstruction super, unsigned int budget) {
+	//Below 0x1000 with the whole sequence (runBatch, decodeSuperinstruction)
+	const unsigned short start = m_pc;
+	const unsigned short first = m_memory[start] << 8 | m_memory[start + 1];
+	const unsigned short second = m_memory[start + 2] << 8 | m_memory[start + 3];
+	const int x = (first & 0x0F00) >> 8;
+
+	//Every instruction still counts as a cycle and ticks the timers
+	switch (super) {
+	case SUPER_SPRITE:
+		if (budget < 2)
+			return 0;
+
+		++m_cycle;
+		m_opcode = first;
+		m_I = first & 0x0FFF;
+		m_pc += 2;
+		afterInstruction<InstructionTimers>();
+
+		++m_cycle;
+		m_opcode = second;
+		drawSprite<Quirks>();
+		m_pc += 2;
+		afterInstruction<InstructionTimers>();
+		return 2;
+	case SUPER_LOAD_PAIR:
+		if (budget < 2)
+			return 0;
+
+		++m_cycle;
+		m_opcode = first;
+		m_V[x] = first & 0x00FF;
+		m_pc += 2;
+		afterInstruction<InstructionTimers>();
+
+		++m_cycle;
+		m_opcode = second;
+		m_V[(second & 0x0F00) >> 8] = second & 0x00FF;
+		m_pc += 2;
+		afterInstruction<InstructionTimers>();
+		return 2;
+	case SUPER_COUNTER:
+		if (budget < 2)
+			return 0;
+
+		++m_cycle;
+		m_opcode = first;
+		m_V[x] += first & 0x00FF;
+		m_pc += 2;
+		afterInstruction<InstructionTimers>();
+
+		++m_cycle;
+		m_opcode = second;
+		m_pc += m_V[x] == (second & 0x00FF) ? skipLength<Quirks>() : 2;
+		afterInstruction<InstructionTimers>();
+		return 2;
+	case SUPER_BRANCH:
+		if (budget < 2)
+			return 0;
+
+		++m_cycle;
+		m_opcode = first;
+		if ((m_V[x] == (first & 0x00FF)) == ((first & 0xF000) == 0x3000)) {
+			//Skipped the jump (1NNN, always one word)
+			m_pc += 4;
+			afterInstruction<InstructionTimers>();
+			return 1;
+		}
+		m_pc += 2;
+		afterInstruction<InstructionTimers>();
+
+		++m_cycle;
+		m_opcode = second;
+		m_pc = second & 0x0FFF;
+		afterInstruction<InstructionTimers>();
+		return 2;
+	case SUPER_INDEX:
+		if (budget < 2)
+			return 0;
+
+		++m_cycle;
+		m_opcode = first;
+		m_I = first & 0x0FFF;
+		m_pc += 2;
+		afterInstruction<InstructionTimers>();
+
+		++m_cycle;
+		m_opcode = second;
+		m_I = (m_I + m_V[(second & 0x0F00) >> 8]) & m_addressMask;
+		m_pc += 2;
+		afterInstruction<InstructionTimers>();
+		return 2;
+	case SUPER_TIMER_WAIT:
+		{
+			//Spins until the delay timer reached zero, whole iterations only
+			const unsigned short jump = m_memory[start + 4] << 8 | m_memory[start + 5];
+			unsigned int executed = 0;
+
+			while (budget - executed >= 3) {
+				++m_cycle;
+				m_opcode = first;
+				m_V[x] = m_delay_timer;
+				m_pc += 2;
+				afterInstruction<InstructionTimers>();
+
+				++m_cycle;
+				m_opcode = second;
+				if (m_V[x] == 0) {
+					//Over the 1NNN
+					m_pc += 4;
+					afterInstruction<InstructionTimers>();
+					return executed + 2;
+				}
+				m_pc += 2;
+				afterInstruction<InstructionTimers>();
+
+				++m_cycle;
+				m_opcode = jump;
+				m_pc = start;
+				afterInstruction<InstructionTimers>();
+				executed += 3;
+			}
+			return executed;
+		}
+	default:
+		return 0;
+	}
+}
+
+template<bool InstructionTimers>
+void Chip8::afterInstruction() {
+	if (InstructionTimers)
+		updateTimers();
+}
+
+void Chip8::tickTimers() {
+	updateTimers();
+}
+
+void Chip8::updateTimers() {
+	if (m_delay_timer > 0)
+		--m_delay_timer;
+
+	if (m_sound_timer > 0)
+	{
+		if (m_sound_timer == 1)
+			EventLog::post(EventLog::EVENT_BEEP, m_pc, m_opcode, m_cycle);
+		--m_sound_timer;
+	}
+}
+
 void Chip8::emulateCycle() {
+	(this->*m_step)();
+}
+
+unsigned int Chip8::runFrame() {
+	const unsigned long long start = m_cycle;
+
+	if (m_timing != TIMING_COSMAC_VIP) {
+		runCycles(m_instructionsPerFrame);
+		if (m_timing == TIMING_SCHEDULED)
+			updateTimers();
+		++m_frame;
+		return (unsigned int)(m_cycle - start);
+	}
+
+	//Runs until the instruction that used up the frame's budget (it ticks the timers and counts the frame)
+	const unsigned long long frame = m_frame;
+	if (DEBUG_ARMED) {
+		//One at a time so the debugger sees every instruction, a breakpoint ends the frame early
+		while (m_frame == frame && !m_halted && !m_debugger->isPaused()) {
+			m_debugger->runCycles(1);
+		}
+	}
+	else {
+		while (m_frame == frame && !m_halted) {
+			(this->*m_step)();
+		}
+	}
+	return (unsigned int)(m_cycle - start);
+}
+
+template<class Quirks, bool InstructionTimers>
+void Chip8::stepCycle() {
+	if (m_halted)
+		return;
+
+	executeCycle<Quirks>();
+	afterInstruction<InstructionTimers>();
+}
+
+template<class Quirks>
+void Chip8::stepCycleVip() {
+	if (m_halted)
+		return;
+
+	executeCycle<Quirks>();
+
+	//Table lookups only, accuracy mode shouldn't cost more than the instruction itself
+	const InstructionCost& cost = VIP_COSTS[s_timing.shapes[opcodeTimingKey(m_opcode)]];
+	const int x = (m_opcode & 0x0F00) >> 8;
+	//DXYN waits for the display interrupt and draws in the next frame
+	m_frameCycles = cost.waitsForVblank && m_frameCycles > 0 ? 0 : m_frameCycles;
+	m_frameCycles -= cost.base + cost.perX * x + cost.perN * (m_opcode & 0x000F) + cost.perDigit * s_timing.digits[m_V[x]];
+
+	//00E0 alone takes longer than a frame
+	while (m_frameCycles <= 0) {
+		m_frameCycles += VIP_FRAME_CYCLES - VIP_DMA_CYCLES;
+		++m_frame;
+		updateTimers();
+	}
+}
+
+template<class Quirks>
+void Chip8::runBatchVip(unsigned int cycles) {
+	//Superinstructions tick the timers per instruction, the VIP model runs unfused
+	for (unsigned int i = 0; i < cycles; ++i) {
+		stepCycleVip<Quirks>();
+	}
+}
+
+template<class Quirks>
+void Chip8::executeCycle() {
+	++m_cycle;
+
 	//Fetch opcode
-	m_opcode = m_memory[m_pc] << 8 | m_memory[m_pc + 1];
+	m_opcode = m_memory[m_pc] << 8 | m_memory[(m_pc + 1) & 0xFFFF];
+	PROFILE(onInstruction(m_pc, m_opcode));
+
+#ifdef CHIP8_TRACE
+	const unsigned short pc = m_pc;
+	unsigned char registers[16];
+	if (m_trace)
+		std::memcpy(registers, m_V, sizeof(m_V));
+#endif
+
+	executeOpcode<Quirks>();
+
+#ifdef CHIP8_TRACE
+	if (m_trace)
+		traceOpcode(pc, registers);
+#endif
+}
+
+#ifdef CHIP8_TRACE
+void Chip8::traceOpcode(unsigned short pc, const unsigned char (&registers)[16]) {
+	TraceRecord record = { m_cycle, pc, m_opcode, TraceRecord::NO_REGISTER, 0 };
 
+	//Compare 8 registers at a time, most instructions change at most one
+	unsigned long long before[2];
+	unsigned long long after[2];
+	std::memcpy(before, registers, sizeof(before));
+	std::memcpy(after, m_V, sizeof(after));
+
+	for (unsigned char word = 0; word < 2; ++word) {
+		if (before[word] == after[word])
+			continue;
+
+		for (unsigned char i = word * 8; i < word * 8 + 8; ++i) {
+			if (registers[i] != m_V[i]) {
+				record.reg = i;
+				record.value = m_V[i];
+				break;
+			}
+		}
+		break;
+	}
+
+	m_trace->record(record);
+}
+#endif
+
+template<class Quirks>
+void Chip8::executeOpcode() {
 	//std::cout << "Instruction: " << std::hex << m_opcode << "\n";
 
 	//Decode opcode (1x Opcode = 4x 4 bit; durch bit-AND alle bits 0 auer ersten 4 (hchster Nibble um Opcode-Kategorie zu filtern))
 	switch (m_opcode & 0xF000) {
 	case 0x0000:
-		switch (m_opcode & 0x000F) {
-		case 0x0000: //Clears the screen TODO: Rework for chip-8 logic
-			m_grid.Clear();
-
-			for (int i = 0; i < 64; ++i) {
-				for (int j = 0; j < 32; ++j) {
-					m_gfx[i][j] = 0;
-				}
-			}
+		switch (m_opcode) {
+		case 0x00E0: //Clears the screen (MEGA-CHIP: presents the frame drawn so far, then clears)
+			if (Quirks::megaChip && m_megaDisplay.IsEnabled())
+				m_megaDisplay.flip();
+			else
+				m_display.clear();
+			drawFlag = true;
 
 			m_pc += 2;
 			break;
-		case 0x000E: //Return from subroutine
+		case 0x00EE: //Return from subroutine
+			PROFILE(onReturn());
 			--m_sp;
 			m_pc = m_stack[m_sp];
 			m_pc += 2;
 			break;
+		default:
+			executeExtendedOpcode<Quirks>();
 		}
 		break;
 	case 0x1000: //Jumps to address NNN
-		if (m_opcode == 0x13DC) {
-			int a;
-		}
 		m_pc = m_opcode & 0x0FFF;
 		break;
 	case 0x2000: //Calls subroutine at NNN
+		PROFILE(onCall(m_opcode & 0x0FFF));
 		m_stack[m_sp] = m_pc;
 		++m_sp;
 		m_pc = m_opcode & 0x0FFF;
 		break;
 	case 0x3000: //Skips the next instruction if VX equals NN(usually the next instruction is a jump to skip a code block)
 		if (m_V[(m_opcode & 0x0F00) >> 8] == (m_opcode & 0x00FF)) {
-			m_pc += 4;
+			m_pc += skipLength<Quirks>();
 		}
 		else {
 			m_pc += 2;
@@ -122,15 +843,18 @@ void Chip8::emulateCycle() {
 		break;
 	case 0x4000: //Skips the next instruction if VX does not equal NN (usually the next instruction is a jump to skip a code block)
 		if (m_V[(m_opcode & 0x0F00) >> 8] != (m_opcode & 0x00FF)) {
-			m_pc += 4;
+			m_pc += skipLength<Quirks>();
 		}
 		else {
 			m_pc += 2;
 		}
 		break;
 	case 0x5000: //Skips the next instruction if VX equals VY (usually the next instruction is a jump to skip a code block)
-		if (m_V[(m_opcode & 0x0F00) >> 8] == m_V[(m_opcode & 0x00F0) >> 4]) {
-			m_pc += 4;
+		if ((m_opcode & 0x000F) != 0) {
+			executeExtendedOpcode<Quirks>();
+		}
+		else if (m_V[(m_opcode & 0x0F00) >> 8] == m_V[(m_opcode & 0x00F0) >> 4]) {
+			m_pc += skipLength<Quirks>();
 		}
 		else {
 			m_pc += 2;
@@ -153,14 +877,20 @@ void Chip8::emulateCycle() {
 			break;
 		case 0x0001: //Sets VX to VX or VY. (bitwise OR operation)
 			m_V[(m_opcode & 0x0F00) >> 8] = m_V[(m_opcode & 0x0F00) >> 8] | m_V[(m_opcode & 0x00F0) >> 4];
+			if (Quirks::resetVF)
+				m_V[15] = 0;
 			m_pc += 2;
 			break;
 		case 0x0002: //Sets VX to VX and VY. (bitwise AND operation)
 			m_V[(m_opcode & 0x0F00) >> 8] = m_V[(m_opcode & 0x0F00) >> 8] & m_V[(m_opcode & 0x00F0) >> 4];
+			if (Quirks::resetVF)
+				m_V[15] = 0;
 			m_pc += 2;
 			break;
 		case 0x0003: //Sets VX to VX xor VY
 			m_V[(m_opcode & 0x0F00) >> 8] = m_V[(m_opcode & 0x0F00) >> 8] ^ m_V[(m_opcode & 0x00F0) >> 4];
+			if (Quirks::resetVF)
+				m_V[15] = 0;
 			m_pc += 2;
 			break;
 		case 0x0004: //Adds VY to VX. VF is set to 1 when there's an overflow, and to 0 when there is not
@@ -174,43 +904,47 @@ void Chip8::emulateCycle() {
 			m_pc += 2;
 			break;
 		case 0x0005: //VY is subtracted from VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VX >= VY and 0 if not)
-			if (m_V[(m_opcode & 0x0F00) >> 8] < m_V[(m_opcode & 0x00F0) >> 4]) {
-				m_V[15] = 0;
-			}
-			else {
-				m_V[15] = 1;
+			{
+				const unsigned char noBorrow = m_V[(m_opcode & 0x0F00) >> 8] >= m_V[(m_opcode & 0x00F0) >> 4] ? 1 : 0;
+				m_V[(m_opcode & 0x0F00) >> 8] -= m_V[(m_opcode & 0x00F0) >> 4];
+				//Written last, the flag wins over the result for 8FY5
+				m_V[15] = noBorrow;
 			}
-			m_V[(m_opcode & 0x0F00) >> 8] -= m_V[(m_opcode & 0x00F0) >> 4];
-
 			m_pc += 2;
 			break;
-		case 0x0006: //Shifts VX to the right by 1, then stores the least significant bit of VX prior to the shift into VF
-			m_V[15] = m_V[(m_opcode & 0x0F00) >> 8] & 0x1;
-			m_V[(m_opcode & 0x0F00) >> 8] >>= 1;
-
+		case 0x0006: //Shifts VX (or VY) to the right by 1 into VX, then stores the least significant bit prior to the shift into VF
+			{
+				unsigned char value = m_V[(m_opcode & (Quirks::shiftVY ? 0x00F0 : 0x0F00)) >> (Quirks::shiftVY ? 4 : 8)];
+				m_V[(m_opcode & 0x0F00) >> 8] = value >> 1;
+				//Written last, the flag wins over the result for 8FY6
+				m_V[15] = value & 0x1;
+			}
 			m_pc += 2;
 			break;
 		case 0x0007: //Sets VX to VY minus VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VY >= VX)
-			if (m_V[(m_opcode & 0x00F0) >> 4] < m_V[(m_opcode & 0x0F00) >> 8]) {
-				m_V[15] = 0;
-			}
-			else {
-				m_V[15] = 1;
+			{
+				const unsigned char noBorrow = m_V[(m_opcode & 0x00F0) >> 4] >= m_V[(m_opcode & 0x0F00) >> 8] ? 1 : 0;
+				m_V[(m_opcode & 0x0F00) >> 8] = m_V[(m_opcode & 0x00F0) >> 4] - m_V[(m_opcode & 0x0F00) >> 8];
+				//Written last, the flag wins over the result for 8FY7
+				m_V[15] = noBorrow;
 			}
-			m_V[(m_opcode & 0x0F00) >> 8] = m_V[(m_opcode & 0x00F0) >> 4] - m_V[(m_opcode & 0x0F00) >> 8];
-
 			m_pc += 2;
 			break;
-		case 0x000E: //Shifts VX to the left by 1, then sets VF to 1 if the most significant bit of VX prior to that shift was set, or to 0 if it was unset
-			m_V[15] = m_V[(m_opcode & 0x0F00) >> 8] & 0x1;
-			m_V[(m_opcode & 0x0F00) >> 8] <<= 1;
+		case 0x000E: //Shifts VX (or VY) to the left by 1 into VX, then sets VF to 1 if the most significant bit prior to that shift was set, or to 0 if it was unset
+			{
+				unsigned char value = m_V[(m_opcode & (Quirks::shiftVY ? 0x00F0 : 0x0F00)) >> (Quirks::shiftVY ? 4 : 8)];
+				m_V[(m_opcode & 0x0F00) >> 8] = value << 1;
+				m_V[15] = value >> 7;
+			}
 			m_pc += 2;
 			break;
+		default:
+			illegalOpcode();
 		}
 		break;
 	case 0x9000: //Skips the next instruction if VX does not equal VY. (Usually the next instruction is a jump to skip a code block)
 		if (m_V[(m_opcode & 0x0F00) >> 8] != m_V[(m_opcode & 0x00F0) >> 4]) {
-			m_pc += 4;
+			m_pc += skipLength<Quirks>();
 		}
 		else {
 			m_pc += 2;
@@ -222,51 +956,22 @@ void Chip8::emulateCycle() {
 		m_pc += 2;
 		break;
 
-	case 0xB000: //Jumps to the address NNN plus V0
-		m_pc = (m_opcode & 0x0FFF) + m_V[0];
+	case 0xB000: //Jumps to the address NNN plus V0 (BXNN: XNN plus VX)
+		m_pc = ((m_opcode & 0x0FFF) + m_V[Quirks::jumpVX ? (m_opcode & 0x0F00) >> 8 : 0]) & 0x0FFF;
 		break;
 	case 0xC000: //Sets VX to the result of a bitwise AND operation on a random number (Typically: 0 to 255) and NN
 		m_V[(m_opcode & 0x0F00) >> 8] = (m_opcode & 0x00FF) & randomNumber();
 		m_pc += 2;
 		break;
-	case 0xD000: //Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. Each row of 8 pixels is read as bit-coded starting from memory location I; I value does not change after the execution of this instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen
-		{
-
-		//std::cout << std::hex << m_opcode << "\n";
-
-		unsigned short x = m_V[(m_opcode & 0x0F00) >> 8];
-		unsigned short y = m_V[(m_opcode & 0x00F0) >> 4];
-		unsigned short height = (m_opcode & 0x000F);
-		unsigned short pixel;
-
-		m_V[15] = 0;
-
-		//Use the height to know how many values to read from I
-		for (int yline = 0; yline < height; ++yline) {
-			pixel = m_memory[m_I + yline];
-			for (int xline = 0; xline < 8; ++xline) {
-				// 0xFF for example in pixel
-				//1111 1111
-				//Check if current pixel is set (1) and if instruction is 1
-				if((pixel & (0x80 >> xline)) != 0) {
-					if (m_gfx[x + xline][y + yline] == 1) {
-						m_V[15] = 1;
-					}
-					m_gfx[x + xline][y + yline] ^= 1;
-					drawFlag = true;
-				}
-			}
-		}
-		
-		
-	}
+	case 0xD000: //Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels (DXY0: 16x16 pixels on SUPER-CHIP). Each row of 8 pixels is read as bit-coded starting from memory location I; I value does not change after the execution of this instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen
+		drawSprite<Quirks>();
 		m_pc += 2;
 		break;
 	case 0xE000:
 		switch (m_opcode & 0x00FF) {
 		case 0x009E: //Skips the next instruction if the key stored in VX is pressed (usually the next instruction is a jump to skip a code block)
 			if (m_key[m_V[(m_opcode & 0x0F00) >> 8]] != 0) {
-				m_pc += 4;
+				m_pc += skipLength<Quirks>();
 			}
 			else {
 				m_pc += 2;
@@ -276,12 +981,14 @@ void Chip8::emulateCycle() {
 		case 0x00A1: //Skips the next instruction if the key stored in VX is not pressed (usually the next instruction is a jump to skip a code block)
 			//std::cout << "Key: " << m_V[(m_opcode & 0x0F00) >> 8] << "\n";
 			if (m_key[m_V[(m_opcode & 0x0F00) >> 8]] == 0) {
-				m_pc += 4;
+				m_pc += skipLength<Quirks>();
 			}
 			else {
 				m_pc += 2;
 			}
 			break;
+		default:
+			illegalOpcode();
 		}
 		break;
 	case 0xF000:
@@ -315,7 +1022,7 @@ void Chip8::emulateCycle() {
 			m_pc += 2;
 			break;
 		case 0x001E: //Adds VX to I. VF is not affected
-			m_I += m_V[(m_opcode & 0x0F00) >> 8];
+			m_I = (m_I + m_V[(m_opcode & 0x0F00) >> 8]) & m_addressMask;
 			m_pc += 2;
 			break;
 		case 0x0029: //Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font
@@ -324,44 +1031,388 @@ void Chip8::emulateCycle() {
 			break;
 		case 0x0033: //Stores the binary-coded decimal representation of VX, with the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2
 			m_memory[m_I] = m_V[(m_opcode & 0x0F00) >> 8] / 100;
-			m_memory[m_I + 1] = (m_V[(m_opcode & 0x0F00) >> 8] / 10) % 10;
-			m_memory[m_I + 2] = (m_V[(m_opcode & 0x0F00) >> 8] % 100) % 10;
+			m_memory[(m_I + 1) & m_addressMask] = (m_V[(m_opcode & 0x0F00) >> 8] / 10) % 10;
+			m_memory[(m_I + 2) & m_addressMask] = (m_V[(m_opcode & 0x0F00) >> 8] % 100) % 10;
+			PROFILE(onWrite(m_I));
+			DEBUG_WRITE(m_I);
+			PROFILE(onWrite((m_I + 1) & m_addressMask));
+			DEBUG_WRITE((m_I + 1) & m_addressMask);
+			PROFILE(onWrite((m_I + 2) & m_addressMask));
+			DEBUG_WRITE((m_I + 2) & m_addressMask);
+			invalidateSuperinstructions(m_I, 3);
 			m_pc += 2;
 			break;
 		case 0x0055: //Stores from V0 to VX (including VX) in memory, starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified
 			for (int i = 0; i <= (m_opcode & 0x0F00) >> 8; ++i) {
-				m_memory[m_I + i] = m_V[i];
+				m_memory[(m_I + i) & m_addressMask] = m_V[i];
+				PROFILE(onWrite((m_I + i) & m_addressMask));
+				DEBUG_WRITE((m_I + i) & m_addressMask);
 			}
+			invalidateSuperinstructions(m_I, ((m_opcode & 0x0F00) >> 8) + 1);
+			if (Quirks::incrementI)
+				m_I = (m_I + ((m_opcode & 0x0F00) >> 8) + 1) & m_addressMask;
 			m_pc += 2;
 			break;
 		case 0x0065: //Fills from V0 to VX (including VX) with values from memory, starting at address I. The offset from I is increased by 1 for each value read, but I itself is left unmodified
 			for (int i = 0; i <= (m_opcode & 0x0F00) >> 8; ++i) {
-				m_V[i] = m_memory[m_I + i];
+				m_V[i] = m_memory[(m_I + i) & m_addressMask];
+				PROFILE(onRead((m_I + i) & m_addressMask));
+				DEBUG_READ((m_I + i) & m_addressMask);
 			}
+			if (Quirks::incrementI)
+				m_I = (m_I + ((m_opcode & 0x0F00) >> 8) + 1) & m_addressMask;
 			m_pc += 2;
 			break;
+		default:
+			executeExtendedOpcode<Quirks>();
 		}
 		break;
 
 	default:
-		std::cout << "Couldn't find opcode: "<< m_opcode <<"!\n";
+		illegalOpcode();
 	}
-	if (m_delay_timer > 0)
-		--m_delay_timer;
+}
 
-	if (m_sound_timer > 0)
-	{
-		if (m_sound_timer == 1)
-			printf("BEEP!\n");
-		--m_sound_timer;
+//DXYN
+template<class Quirks>
+void Chip8::drawSprite() {
+	if (Quirks::megaChip && m_megaDisplay.IsEnabled()) {
+		drawMegaSprite();
+		return;
+	}
+
+	const int width = m_display.GetWidth();
+	const int height = m_display.GetHeight();
+	//The sprite always starts on screen, only the pixels that leave it are wrapped or clipped (both sizes are powers
+	//of two, masks instead of divisions)
+	const int x = m_V[(m_opcode & 0x0F00) >> 8] & (width - 1);
+	const int y = m_V[(m_opcode & 0x00F0) >> 4] & (height - 1);
+	//DXY0 draws 16 rows of two bytes
+	const bool large = Quirks::superChip && (m_opcode & 0x000F) == 0;
+	const int rows = large ? 16 : m_opcode & 0x000F;
+	const int bytes = large ? 2 : 1;
+	bool collision = false;
+
+	//Every selected plane gets its own sprite, stored one after the other starting at I
+	unsigned int address = m_I;
+	for (int plane = 0; plane < Display::PLANES; ++plane) {
+		if ((m_display.GetPlanes() & (1u << plane)) == 0)
+			continue;
+
+		//Use the height to know how many values to read from I
+		for (int row = 0; row < rows; ++row) {
+			unsigned int pixels = 0;
+			for (int byte = 0; byte < bytes; ++byte) {
+				pixels = pixels << 8 | m_memory[address];
+				PROFILE(onRead(address));
+				DEBUG_READ(address);
+				address = (address + 1) & m_addressMask;
+			}
+
+			if (!Quirks::wrapSprites && y + row >= height)
+				continue;
+
+			//The whole row in one go, VF is set if any set pixel got cleared
+			collision |= m_display.drawRow(plane, x, (y + row) & (height - 1), pixels, bytes * 8, Quirks::wrapSprites);
+		}
+	}
+
+	m_V[15] = collision ? 1 : 0;
+	drawFlag = drawFlag || rows > 0;
+}
+
+void Chip8::drawMegaSprite() {
+	const int x = m_V[(m_opcode & 0x0F00) >> 8];
+	const int y = m_V[(m_opcode & 0x00F0) >> 4];
+	const int width = m_megaDisplay.GetSpriteWidth();
+	bool collision = false;
+
+	//Rows of one byte per pixel (palette index) starting at I, the ones below the screen are clipped. A sprite can be
+	//64 KB, the bytes aren't reported to the profiler and the watchpoints (they only cover the code in the first 4 KB)
+	for (int row = 0; row < m_megaDisplay.GetSpriteHeight() && y + row < MegaDisplay::HEIGHT; ++row) {
+		const unsigned int address = (m_I + row * width) & m_addressMask;
+		const unsigned char* pixels = &m_memory[address];
+
+		//Rows running past the end of memory continue at 0 like everything else addressed through I
+		unsigned char wrapped[256];
+		if (address + width > m_memory.size()) {
+			for (int i = 0; i < width; ++i) {
+				wrapped[i] = m_memory[(address + i) & m_addressMask];
+			}
+			pixels = wrapped;
+		}
+
+		collision |= m_megaDisplay.drawRow(x, y + row, pixels, width);
+	}
+
+	//Shown on the next 00E0
+	m_V[15] = collision ? 1 : 0;
+}
+
+template<class Quirks>
+unsigned short Chip8::skipLength() const {
+	const unsigned char next = m_memory[(m_pc + 2) & 0xFFFF];
+	if (Quirks::xoChip && next == 0xF0 && m_memory[(m_pc + 3) & 0xFFFF] == 0x00)
+		return 6;
+	if (Quirks::megaChip && next == 0x01)
+		return 6;
+	return 4;
+}
+
+template<class Quirks>
+void Chip8::executeExtendedOpcode() {
+	if (Quirks::megaChip && executeMegaChipOpcode())
+		return;
+	if (Quirks::xoChip && executeXoChipOpcode())
+		return;
+	if (Quirks::superChip && executeSuperChipOpcode())
+		return;
+	illegalOpcode();
+}
+
+bool Chip8::executeSuperChipOpcode() {
+	const int x = (m_opcode & 0x0F00) >> 8;
+
+	if ((m_opcode & 0xFFF0) == 0x00C0) { //00CN: Scrolls the display down by N pixels
+		m_display.scrollDown(m_opcode & 0x000F);
+		drawFlag = true;
+		m_pc += 2;
+		return true;
+	}
+
+	switch ((m_opcode & 0xF000) == 0xF000 ? m_opcode & 0xF0FF : m_opcode) {
+	case 0x00FB: //Scrolls the display right by 4 pixels
+		m_display.scrollRight(4);
+		drawFlag = true;
+		break;
+	case 0x00FC: //Scrolls the display left by 4 pixels
+		m_display.scrollLeft(4);
+		drawFlag = true;
+		break;
+	case 0x00FD: //Exits the interpreter
+		m_halted = true;
+		m_exited = true;
+		EventLog::post(EventLog::EVENT_HALTED, m_pc, m_opcode, m_cycle);
+		return true;
+	case 0x00FE: //Switches to the 64x32 low resolution (clears the display)
+		m_display.setHires(false);
+		drawFlag = true;
+		break;
+	case 0x00FF: //Switches to the 128x64 high resolution (clears the display)
+		m_display.setHires(true);
+		drawFlag = true;
+		break;
+	case 0xF030: //Sets I to the location of the 8x10 sprite for the character in VX
+		m_I = 0x0A0 + (m_V[x] & 0xF) * 10;
+		break;
+	case 0xF075: //Stores V0 to VX (including VX) in the RPL user flags
+		for (int i = 0; i <= x; ++i) {
+			m_flags[i] = m_V[i];
+		}
+		break;
+	case 0xF085: //Fills V0 to VX (including VX) from the RPL user flags
+		for (int i = 0; i <= x; ++i) {
+			m_V[i] = m_flags[i];
+		}
+		break;
+	default:
+		return false;
 	}
+
+	m_pc += 2;
+	return true;
 }
 
-unsigned int randomNumber() {
-	std::random_device seed;
-	std::mt19937 gen{ seed() };
+bool Chip8::executeXoChipOpcode() {
+	const int x = (m_opcode & 0x0F00) >> 8;
+	const int y = (m_opcode & 0x00F0) >> 4;
+
+	if ((m_opcode & 0xFFF0) == 0x00D0) { //00DN: Scrolls the display up by N pixels
+		m_display.scrollUp(m_opcode & 0x000F);
+		drawFlag = true;
+		m_pc += 2;
+		return true;
+	}
+
+	switch (m_opcode & 0xF00F) {
+	case 0x5002: //Stores VX to VY in memory starting at I (backwards if X > Y), I is left unmodified
+		{
+			const int step = x <= y ? 1 : -1;
+			for (int i = 0; i <= (x <= y ? y - x : x - y); ++i) {
+				const unsigned int address = (m_I + i) & m_addressMask;
+				m_memory[address] = m_V[x + i * step];
+				PROFILE(onWrite(address));
+				DEBUG_WRITE(address);
+			}
+			invalidateSuperinstructions(m_I, (x <= y ? y - x : x - y) + 1);
+		}
+		m_pc += 2;
+		return true;
+	case 0x5003: //Fills VX to VY from memory starting at I (backwards if X > Y), I is left unmodified
+		{
+			const int step = x <= y ? 1 : -1;
+			for (int i = 0; i <= (x <= y ? y - x : x - y); ++i) {
+				const unsigned int address = (m_I + i) & m_addressMask;
+				m_V[x + i * step] = m_memory[address];
+				PROFILE(onRead(address));
+				DEBUG_READ(address);
+			}
+		}
+		m_pc += 2;
+		return true;
+	}
+
+	switch (m_opcode & 0xF0FF) {
+	case 0xF000: //F000 NNNN: Sets I to the 16 bit address in the following word
+		if (x != 0)
+			return false;
+		m_I = m_memory[(m_pc + 2) & 0xFFFF] << 8 | m_memory[(m_pc + 3) & 0xFFFF];
+		m_pc += 4;
+		return true;
+	case 0xF001: //FN01: Selects the planes DXYN, 00E0 and the scrolls draw on (bit per plane)
+		m_display.setPlanes(x);
+		break;
+	case 0xF002: //Loads the 16 byte audio pattern from memory at I
+		if (x != 0)
+			return false;
+		for (int i = 0; i < 16; ++i) {
+			const unsigned int address = (m_I + i) & m_addressMask;
+			m_audioPattern[i] = m_memory[address];
+			PROFILE(onRead(address));
+			DEBUG_READ(address);
+		}
+		break;
+	case 0xF03A: //Sets the audio pitch to VX
+		m_pitch = m_V[x];
+		break;
+	default:
+		return false;
+	}
+
+	m_pc += 2;
+	return true;
+}
+
+bool Chip8::executeMegaChipOpcode() {
+	const bool mega = m_megaDisplay.IsEnabled();
+	const unsigned char n = m_opcode & 0x00FF;
+
+	//The scrolls move the MEGA-CHIP screen while it's shown, the SUPER-CHIP ones stay with the other screen
+	if (mega && (m_opcode & 0xFFF0) == 0x00C0) { //00CN: Scrolls the display down by N pixels
+		m_megaDisplay.scrollDown(m_opcode & 0x000F);
+		m_pc += 2;
+		return true;
+	}
+
+	switch (m_opcode & 0xFF00) {
+	case 0x0000:
+		if ((m_opcode & 0xFFF0) == 0x00B0) { //00BN: Scrolls the display up by N pixels
+			if (!mega)
+				return false;
+			m_megaDisplay.scrollUp(m_opcode & 0x000F);
+			break;
+		}
+
+		switch (m_opcode) {
+		case 0x0010: //Leaves MEGA-CHIP mode
+			m_megaDisplay.disable();
+			drawFlag = true;
+			break;
+		case 0x0011: //Enters MEGA-CHIP mode (256x192 color screen)
+			m_megaDisplay.enable();
+			drawFlag = true;
+			break;
+		case 0x00FB: //Scrolls the display right by 4 pixels
+			if (!mega)
+				return false;
+			m_megaDisplay.scrollRight(4);
+			break;
+		case 0x00FC: //Scrolls the display left by 4 pixels
+			if (!mega)
+				return false;
+			m_megaDisplay.scrollLeft(4);
+			break;
+		default:
+			return false;
+		}
+		break;
+	case 0x0100: //01NN NNNN: Sets I to the 24 bit address made of NN and the following word
+		m_I = (n << 16 | m_memory[(m_pc + 2) & 0xFFFF] << 8 | m_memory[(m_pc + 3) & 0xFFFF]) & m_addressMask;
+		m_pc += 4;
+		return true;
+	case 0x0200: //02NN: Loads NN colors (4 bytes ARGB each) from I into the palette, starting at index 1
+		{
+			unsigned char colors[255 * 4];
+			for (int i = 0; i < n * 4; ++i) {
+				colors[i] = m_memory[(m_I + i) & m_addressMask];
+			}
+			m_megaDisplay.loadPalette(colors, n);
+		}
+		break;
+	case 0x0300: //03NN: Sets the sprite width to NN (0: 256)
+		m_megaDisplay.setSpriteSize(n, m_megaDisplay.GetSpriteHeight());
+		break;
+	case 0x0400: //04NN: Sets the sprite height to NN (0: 256)
+		m_megaDisplay.setSpriteSize(m_megaDisplay.GetSpriteWidth(), n);
+		break;
+	case 0x0500: //05NN: Sets the screen alpha to NN
+		m_megaDisplay.setScreenAlpha(n);
+		break;
+	case 0x0600: //060N: Plays the digitized sound at I, once if N is 1 and looped if it is 0
+		{
+			//16 bit sample rate, 24 bit length and a reserved byte in front of the samples
+			unsigned char header[6];
+			for (int i = 0; i < 6; ++i) {
+				header[i] = m_memory[(m_I + i) & m_addressMask];
+			}
+			m_sample.rate = (unsigned short)(header[0] << 8 | header[1]);
+			m_sample.length = (unsigned int)(header[2] << 16 | header[3] << 8 | header[4]);
+			m_sample.address = (m_I + 6) & m_addressMask;
+			m_sample.loop = (n & 0x0F) == 0;
+			m_sample.playing = true;
+		}
+		break;
+	case 0x0700: //0700: Stops the digitized sound
+		if (n != 0)
+			return false;
+		m_sample.playing = false;
+		break;
+	case 0x0800: //080N: Sets the sprite blend mode (MegaDisplay::BlendMode)
+		m_megaDisplay.setBlendMode(n & 0x0F);
+		break;
+	case 0x0900: //09NN: Sets the collision color to palette index NN
+		m_megaDisplay.setCollisionIndex(n);
+		break;
+	default:
+		return false;
+	}
+
+	m_pc += 2;
+	return true;
+}
+
+void Chip8::illegalOpcode() {
+	EventLog::post(EventLog::EVENT_ILLEGAL_OPCODE, m_pc, m_opcode, m_cycle);
+
+	IllegalOpcodePolicy policy = m_illegalPolicy;
+	if (policy == ILLEGAL_CALLBACK)
+		policy = m_illegalHandler ? m_illegalHandler(*this, m_pc, m_opcode) : ILLEGAL_HALT;
+
+	if (policy == ILLEGAL_SKIP) {
+		m_pc += 2;
+		return;
+	}
+
+	//Without advancing m_pc the same opcode would be decoded again on every cycle
+	m_halted = true;
+	EventLog::post(EventLog::EVENT_HALTED, m_pc, m_opcode, m_cycle);
+}
 
-	std::uniform_int_distribution<> num{ 0, 255 };
+unsigned int Chip8::randomNumber() {
+	//xorshift32, the state is part of the machine so checkpoints and replays see the same numbers
+	m_random ^= m_random << 13;
+	m_random ^= m_random >> 17;
+	m_random ^= m_random << 5;
 
-	return num(gen);
+	return m_random >> 24;
 }
\ No newline at end of file
@@ -1,59 +1,254 @@
 #pragma once
-#include "Grid.h"
+#include <bitset>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "Display.h"
+#include "Fusion.h"
+#include "MegaDisplay.h"
+#include "Quirks.h"
+#include "Timing.h"
+
+#ifdef CHIP8_PROFILER
+#include "GuestProfiler.h"
+#endif
+#ifdef CHIP8_TRACE
+#include "ExecutionTrace.h"
+#endif
+
+class Debugger;
+class SharedTranslations;
+class TranslationCache;
 
 class Chip8 {
 public:
 
-	Chip8(Renderer::Grid& grid);
+	//What happens when the core decodes an opcode it doesn't know
+	enum IllegalOpcodePolicy {
+		ILLEGAL_HALT,		//stop executing until initialize() (IsHalted() returns true)
+		ILLEGAL_SKIP,		//treat it as a 2 byte no-op
+		ILLEGAL_CALLBACK	//ask the handler, which returns ILLEGAL_HALT or ILLEGAL_SKIP
+	};
+	using IllegalOpcodeHandler = std::function<IllegalOpcodePolicy(Chip8& chip, unsigned short pc, unsigned short opcode)>;
+
+	Chip8();
 
 	void initialize();
 	void loadGame(const char* game);
+	//Copies a program from memory to 0x200 (used by tools that build their own programs)
+	void loadProgram(const unsigned char* program, size_t size);
 	void emulateCycle();
+	//Runs a batch of cycles without any host interaction in between
+	void runCycles(unsigned int cycles);
+	//Runs one 60 Hz frame (SetInstructionsPerFrame instructions and a timer tick, or the frame's machine cycles under
+	//TIMING_COSMAC_VIP). Returns the number of instructions executed
+	unsigned int runFrame();
 	bool drawFlag;
 
-	const unsigned char(&GetGFX() const)[64][32];
+	const Display& GetDisplay() const;
+	//MEGA-CHIP screen, IsEnabled() while the program runs in MEGA-CHIP mode (0011) and GetDisplay() isn't shown
+	const MegaDisplay& GetMegaDisplay() const;
+	//Opcode at the current program counter (the one the next cycle will execute)
+	unsigned short GetNextOpcode() const;
+	//Number of cycles executed since initialize()
+	unsigned long long GetCycle() const;
+	bool IsHalted() const;
+	//Halted by 00FD rather than by an illegal opcode
+	bool HasExited() const;
+
+	//Machine state (used by the debugger)
+	unsigned short GetPC() const;
+	unsigned int GetI() const;
+	unsigned short GetSP() const;
+	unsigned char GetV(int index) const;
+	unsigned short GetStack(int level) const;
+	unsigned char GetMemory(unsigned int address) const;
+	//64 KB, 16 MB under QUIRKS_MEGA_CHIP
+	size_t GetMemorySize() const;
+	unsigned char GetDelayTimer() const;
+	unsigned char GetSoundTimer() const;
+	unsigned int GetRandomState() const;
+	//SUPER-CHIP RPL user flags (FX75/FX85)
+	unsigned char GetFlag(int index) const;
+	//XO-CHIP audio: 128 one bit samples (F002) played while the sound timer runs, at a rate set by the pitch (FX3A)
+	unsigned char GetAudioPattern(int index) const;
+	unsigned char GetPitch() const;
+	//Samples per second of the pattern, 4000 at the default pitch of 64
+	double GetAudioRate() const;
+	//MEGA-CHIP digitized sound (060N/0700): 8 bit unsigned samples in memory, played by the host
+	struct Sample {
+		unsigned int address;
+		unsigned int length;
+		unsigned short rate;
+		bool loop;
+		bool playing;
+	};
+	const Sample& GetSample() const;
+	//Hash of the complete machine state, equal hashes mean both machines behave the same from here on
+	unsigned long long GetStateHash() const;
+	//Hash of the memory alone (identifies the loaded program)
+	unsigned long long GetMemoryHash() const;
+
+	//Superinstructions runCycles may use (FUSION_* / bit per Superinstruction). Single steps never fuse
+	void SetFusion(unsigned int superinstructions);
+	unsigned int GetFusion() const;
+	//Translations saved by an earlier run of the same program, used instead of decoding (nullptr to disable)
+	void SetTranslationCache(const TranslationCache* cache);
+	//Table shared by every machine running the same program (nullptr to disable). Must be made for this program
+	void SetSharedTranslations(SharedTranslations* shared);
+	//Superinstruction decoded at pc from the bytes as they were loaded, FUSED_UNKNOWN if there is none yet
+	unsigned char GetTranslation(unsigned short pc) const;
+
+	//Called by Debugger::attach/detach
+	void SetDebugger(Debugger* debugger);
+
+	//Behaviour of the instructions interpreters disagree on, usually picked once after loading the ROM.
+	//QUIRKS_MEGA_CHIP grows the memory to 16 MB, pick it before loading so big ROMs aren't cut off
+	void SetQuirks(QuirkProfile profile);
+	QuirkProfile GetQuirks() const;
+
+	//Emulated time of the instructions, TIMING_INSTRUCTION unless set
+	void SetTiming(TimingModel timing);
+	TimingModel GetTiming() const;
+	//Instructions runFrame() executes under TIMING_INSTRUCTION
+	void SetInstructionsPerFrame(unsigned int instructions);
+	//Frames completed since initialize()
+	unsigned long long GetFrame() const;
+	//Counts the delay and sound timer down once, the 60 Hz tick under TIMING_SCHEDULED
+	void tickTimers();
+
+	//Seed of the CXNN random numbers, applied immediately and on every initialize()
+	void SetSeed(unsigned int seed);
+
+	void SetIllegalOpcodePolicy(IllegalOpcodePolicy policy, IllegalOpcodeHandler handler = nullptr);
 
 	//HEX-based keypad (0x0-0xF)
 	unsigned char m_key[16];
 
+#ifdef CHIP8_PROFILER
+	//Profiler that receives the guest events (nullptr to disable)
+	void SetProfiler(GuestProfiler* profiler);
+#endif
+#ifdef CHIP8_TRACE
+	//Trace that receives one record per executed instruction (nullptr to disable)
+	void SetTrace(TraceWriter* trace);
+#endif
+
 private:
-	//Variables
+	//Specializations for a quirk profile (Quirks.h), the public functions call them through m_step/m_run
+	template<class Quirks> void useQuirks();
+	template<class Quirks, bool InstructionTimers> void stepCycle();
+	template<class Quirks, bool InstructionTimers> void runBatch(unsigned int cycles);
+	template<class Quirks> void stepCycleVip();
+	template<class Quirks> void runBatchVip(unsigned int cycles);
+	//Fetches and executes one instruction with the profiler/trace hooks, the timing is up to the caller
+	template<class Quirks> void executeCycle();
+	//Decodes and executes m_opcode
+	template<class Quirks> void executeOpcode();
+	void illegalOpcode();
+	unsigned int randomNumber();
+	template<class Quirks> void drawSprite();
+	//SUPER-CHIP and XO-CHIP instructions the profile decodes (Quirks::superChip, Quirks::xoChip), illegal otherwise
+	template<class Quirks> void executeExtendedOpcode();
+	//00CN, 00FB-00FF, FX30, FX75 and FX85. Returns false for any other opcode
+	bool executeSuperChipOpcode();
+	//00DN, 5XY2, 5XY3, F000 NNNN, FN01, F002 and FX3A. Returns false for any other opcode
+	bool executeXoChipOpcode();
+	//0010, 0011, 01NN NNNN, 02NN-09NN and the scrolls of the MEGA-CHIP screen. Returns false for any other opcode
+	bool executeMegaChipOpcode();
+	//DXYN in MEGA-CHIP mode
+	void drawMegaSprite();
+	//Bytes a skip instruction at m_pc jumps, F000 NNNN (XO-CHIP) and 01NN NNNN (MEGA-CHIP) are skipped as a whole
+	template<class Quirks> unsigned short skipLength() const;
+	void updateTimers();
+	//Ticks the timers after every instruction under TIMING_INSTRUCTION, compiled out otherwise
+	template<bool InstructionTimers> void afterInstruction();
+	void resetSuperinstructions();
+	//Looks up the superinstruction at pc and caches it in m_fused
+	unsigned char decodeSuperinstruction(unsigned short pc);
+	//Runs a superinstruction at m_pc within the cycle budget, returns the cycles it used
+	template<class Quirks, bool InstructionTimers> unsigned int executeSuperinstruction(Superinstruction super, unsigned int budget);
+	//Drops the cached superinstructions that contain the written bytes
+	void invalidateSuperinstructions(unsigned int address, unsigned short length);
+#ifdef CHIP8_TRACE
+	void traceOpcode(unsigned short pc, const unsigned char (&registers)[16]);
+#endif
 
-	//Graphics
-	Renderer::Grid& m_grid;
+	//Variables
 
 	//stores the current opcode (2 bytes)
 	unsigned short m_opcode;
 
+	//Executed cycles
+	unsigned long long m_cycle;
+
+	//CXNN random number generator
+	unsigned int m_seed;
+	unsigned int m_random;
+
+	//Set by an illegal opcode under ILLEGAL_HALT and by 00FD, m_exited only by 00FD
+	bool m_halted;
+	bool m_exited;
+	IllegalOpcodePolicy m_illegalPolicy;
+	IllegalOpcodeHandler m_illegalHandler;
+
+	QuirkProfile m_quirks;
+	TimingModel m_timing;
+	unsigned int m_instructionsPerFrame;
+	unsigned long long m_frame;
+	//Machine cycles left in the current frame under TIMING_COSMAC_VIP (negative: the last instruction ran over)
+	int m_frameCycles;
+	void (Chip8::*m_step)();
+	void (Chip8::*m_run)(unsigned int cycles);
+
 	/*
 	0x000-0x1FF - Chip 8 interpreter (contains font set in emu)
 	0x050-0x0A0 - Used for the built in 4x5 pixel font set (0-F)
+	0x0A0-0x140 - SUPER-CHIP 8x10 pixel font set (0-F)
 	0x200-0xFFF - Program ROM and work RAM
+	0x1000-0xFFFF - XO-CHIP data, addressed through I. Jumps and calls only reach the first 4 KB, but code can run on
+	                into it
+	0x10000-0xFFFFFF - MEGA-CHIP data (sprites, palettes and sounds), I only
 	*/
 
-	//Memory of the chip
-	unsigned char m_memory[4096];
+	//Memory of the chip, sized by the quirk profile (on the heap, 16 MB don't fit a copy on the stack)
+	std::vector<unsigned char> m_memory;
+	//Size - 1, I and everything addressed through it wraps around with it
+	unsigned int m_addressMask;
 
 	//Registers
 	//Chip 8 has 15 general purpose registers (from V0 to VE)
 	//16th register is used for a carry flag
 	unsigned char m_V[16];
 
-	//Both registers go from 0x000 to 0xFFF
+	//Both registers go from 0x000 to 0xFFF, I up to 0xFFFF under XO-CHIP (F000 NNNN) and 0xFFFFFF under MEGA-CHIP
+	//(01NN NNNN)
 	//Index register
-	unsigned short m_I;
+	unsigned int m_I;
 
 	//Program counter
 	unsigned short m_pc;
 
 	//Graphics
-	unsigned char m_gfx[64][32];
+	Display m_display;
+	MegaDisplay m_megaDisplay;
+
+	//RPL user flags of the HP 48 (FX75/FX85), they survive initialize() like they survived quitting the interpreter
+	unsigned char m_flags[16];
 
 	//Timers
 	//Registers that count at 60 hz. When set above zero they count down to zero
 	unsigned char m_delay_timer;
 	unsigned char m_sound_timer;
 
+	//XO-CHIP audio pattern buffer and pitch register
+	unsigned char m_audioPattern[16];
+	unsigned char m_pitch;
+
+	//MEGA-CHIP sound playing since 060N
+	Sample m_sample;
+
 
 	/*There are opcodes for jumping to a certain address or subroutine.
 	The stack is used to remember the current location before the jump
@@ -65,6 +260,26 @@ private:
 	//Stack ptr
 	unsigned short m_sp;
 
+	Debugger* m_debugger;
+
+	//Enabled superinstructions and the one starting at each address of the first 4 KB (FUSED_UNKNOWN until it is
+	//decoded). Code above it is never fused
+	unsigned int m_fusion;
+	unsigned char m_fused[4096];
+	//Addresses whose sequence contains bytes written since loading, their entries aren't taken from/saved to the cache
+	std::bitset<4096> m_modified;
+	//Stores ran while fusion was off since loading, m_modified doesn't know which addresses they hit
+	bool m_untrackedStores;
+	const TranslationCache* m_translations;
+	SharedTranslations* m_shared;
+
+#ifdef CHIP8_PROFILER
+	GuestProfiler* m_profiler;
+#endif
+#ifdef CHIP8_TRACE
+	TraceWriter* m_trace;
+#endif
+
 	//Fontset (Each number/character is 4 pixels wide and 5 pixels high)
 
 	/*
@@ -92,4 +307,24 @@ private:
 	  0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
 	  0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 	};
+
+	//SUPER-CHIP big font (FX30), 8 pixels wide and 10 pixels high. SUPER-CHIP only had the digits, A-F are Octo's
+	unsigned char m_bigFontset[160] = {
+	  0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+	  0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+	  0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+	  0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+	  0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+	  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+	  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+	  0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+	  0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+	  0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+	  0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+	  0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+	  0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+	  0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+	};
 };
\ No newline at end of file
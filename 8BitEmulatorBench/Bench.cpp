@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../8BitEmulator/chip8.h"
+#include "../8BitEmulator/PerfCounters.h"
+
+/*
+Microbenchmarks for the Chip-8 core.
+
+Every opcode family is measured with a small synthetic program: a setup part that puts the registers
+into a sane state, followed by a loop of the same instruction repeated and a jump back to the start of the loop.
+The opcode loops run without superinstructions, which would fuse the repeated instructions (6XNN pairs, ANNN+FX1E)
+and measure those instead. ROMs are measured end to end with the default fusion and reported in MIPS, a ROM that
+halts is reported as such instead of timing a machine that does nothing.
+
+Usage: 8BitEmulatorBench [options] [rom ...]
+	--samples N       timed samples per benchmark (default 30)
+	--warmup N        samples that are run but discarded before measuring (default 5)
+	--cycles N        emulated instructions per sample (default 200000)
+	--filter TEXT     only run benchmarks whose name contains TEXT
+	--csv FILE        write the results as CSV
+	--baseline FILE   compare against a CSV written by an earlier run
+	--threshold PCT   relative change that counts as a regression (default 3)
+	--perf FILE       run the ROMs again under the hardware performance counters (Linux only),
+	                  print the cost per opcode class and write it as CSV
+*/
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Options {
+		int samples = 30;
+		int warmup = 5;
+		unsigned int cycles = 200000;
+		std::string filter;
+		std::string csvPath;
+		std::string baselinePath;
+		double threshold = 3.0;
+		std::string perfPath;
+		std::vector<std::string> roms;
+	};
+
+	struct Result {
+		std::string name;
+		double median;	//ns per instruction
+		double ciLow;
+		double ciHigh;
+		int samples;
+		//The ROM halted, median etc. are meaningless
+		bool halted;
+	};
+
+	//Program start (0x200) is used for the setup, the timed loop starts at 0x240
+	const unsigned short loopStart = 0x240;
+	//Number of copies of the measured instruction inside the loop
+	const int loopLength = 64;
+
+	void push(std::vector<unsigned char>& program, unsigned short opcode) {
+		program.push_back(opcode >> 8);
+		program.push_back(opcode & 0xFF);
+	}
+
+	//Builds setup + loop for a single instruction. The subroutine (if used) lives at 0x400, sprite/BCD data at 0x600
+	std::vector<unsigned char> buildProgram(const std::vector<unsigned short>& body) {
+		std::vector<unsigned char> program;
+
+		//V0-VE get distinct non zero values so no ALU operation degenerates, VF is the flag register anyway
+		for (unsigned short i = 0; i < 15; ++i) {
+			push(program, 0x6000 | (i << 8) | (0x11 * (i + 1) & 0xFF));
+		}
+		//Sprites are drawn at (8, 8) so even 15 rows stay inside the display
+		push(program, 0x6808);
+		push(program, 0x6908);
+		push(program, 0xA600);
+
+		push(program, 0x1000 | loopStart);
+		program.resize(loopStart - 0x200);
+
+		for (int i = 0; i < loopLength; ++i) {
+			for (unsigned short opcode : body) {
+				push(program, opcode);
+			}
+		}
+		push(program, 0x1000 | loopStart);
+
+		//Subroutine used by the call/return benchmark
+		program.resize(0x400 - 0x200);
+		push(program, 0x00EE);
+
+		//Sprite data
+		program.resize(0x600 - 0x200);
+		for (int i = 0; i < 16; ++i) {
+			program.push_back(0xA5 ^ (i * 0x33));
+		}
+
+		return program;
+	}
+
+	struct Family {
+		std::string name;
+		std::vector<unsigned short> body;
+	};
+
+	std::vector<Family> opcodeFamilies() {
+		std::vector<Family> families = {
+			{ "6XNN ld",         { 0x6A42 } },
+			{ "7XNN add",        { 0x7A01 } },
+			{ "8XY0 ld",         { 0x8AB0 } },
+			{ "8XY1 or",         { 0x8AB1 } },
+			{ "8XY2 and",        { 0x8AB2 } },
+			{ "8XY3 xor",        { 0x8AB3 } },
+			{ "8XY4 add",        { 0x8AB4 } },
+			{ "8XY5 sub",        { 0x8AB5 } },
+			{ "8XY6 shr",        { 0x8AB6 } },
+			{ "8XY7 subn",       { 0x8AB7 } },
+			{ "8XYE shl",        { 0x8ABE } },
+			{ "3XNN skip",       { 0x3A42 } },	//not taken
+			{ "3XNN skip taken", { 0x3AFF, 0x6AFF } },	//the skipped load keeps VA at FF
+			{ "4XNN skip",       { 0x4AAA } },
+			{ "5XY0 skip",       { 0x5AB0 } },
+			{ "9XY0 skip",       { 0x9AA0 } },
+			{ "ANNN ld I",       { 0xA600 } },
+			{ "2NNN/00EE",       { 0x2400 } },
+			{ "CXNN rnd",        { 0xCAFF } },
+			{ "FX1E add I",      { 0xF01E, 0xA600 } },
+			{ "FX33 bcd",        { 0xFA33 } },
+			{ "FX55 store",      { 0xFE55 } },
+			{ "FX65 load",       { 0xFE65 } },
+		};
+
+		//DXYN for every sprite height
+		for (int height = 1; height <= 15; ++height) {
+			char name[16];
+			std::snprintf(name, sizeof(name), "DXY%X sprite", height);
+			families.push_back({ name, { (unsigned short)(0xD890 | height) } });
+		}
+
+		return families;
+	}
+
+	bool readFile(const std::string& path, std::vector<unsigned char>& data) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	//Cost of reading the clock twice, subtracted from every sample
+	double clockOverhead() {
+		std::vector<double> samples;
+		for (int i = 0; i < 1000; ++i) {
+			auto start = Clock::now();
+			auto end = Clock::now();
+			samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+		}
+		std::sort(samples.begin(), samples.end());
+		return samples[samples.size() / 2];
+	}
+
+	/*
+	Median with a distribution free 95% confidence interval.
+	The ranks of the bounds come from the normal approximation of the binomial distribution: n/2 +- 1.96 * sqrt(n)/2
+	*/
+	Result summarize(const std::string& name, std::vector<double> samples) {
+		std::sort(samples.begin(), samples.end());
+
+		const size_t n = samples.size();
+		const double median = (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+
+		const double spread = 1.96 * std::sqrt((double)n) / 2.0;
+		long low = (long)std::floor(n / 2.0 - spread);
+		long high = (long)std::ceil(n / 2.0 + spread);
+		low = std::max(0L, low);
+		high = std::min((long)n - 1, high);
+
+		return { name, median, samples[low], samples[high], (int)n, false };
+	}
+
+	Result measure(const std::string& name, const std::vector<unsigned char>& program, unsigned int fusion, const Options& options,
+		double overhead) {
+		Chip8 chip;
+		chip.initialize();
+		chip.SetFusion(fusion);
+		chip.loadProgram(program.data(), program.size());
+
+		std::vector<double> samples;
+		for (int i = 0; i < options.warmup + options.samples; ++i) {
+			const unsigned long long cycle = chip.GetCycle();
+			auto start = Clock::now();
+			chip.runCycles(options.cycles);
+			auto end = Clock::now();
+
+			//A sample that stopped short of its instructions doesn't count
+			if (chip.IsHalted() || chip.GetCycle() - cycle < options.cycles) {
+				Result halted = { name, 0.0, 0.0, 0.0, 0, true };
+				return halted;
+			}
+			if (i < options.warmup)
+				continue;
+
+			double ns = std::chrono::duration<double, std::nano>(end - start).count() - overhead;
+			samples.push_back(std::max(0.0, ns) / options.cycles);
+		}
+
+		return summarize(name, samples);
+	}
+
+	std::map<std::string, Result> readBaseline(const std::string& path) {
+		std::map<std::string, Result> baseline;
+		std::ifstream file(path);
+		std::string line;
+
+		//Skip header
+		std::getline(file, line);
+		while (std::getline(file, line)) {
+			std::stringstream stream(line);
+			Result result;
+			std::string field;
+
+			std::getline(stream, result.name, ',');
+			std::getline(stream, field, ','); result.median = std::atof(field.c_str());
+			std::getline(stream, field, ','); result.ciLow = std::atof(field.c_str());
+			std::getline(stream, field, ','); result.ciHigh = std::atof(field.c_str());
+			std::getline(stream, field, ','); result.samples = std::atoi(field.c_str());
+
+			baseline[result.name] = result;
+		}
+
+		return baseline;
+	}
+
+	void writeCsv(const std::string& path, const std::vector<Result>& results) {
+		std::ofstream file(path);
+		file << "name,median_ns,ci_low_ns,ci_high_ns,samples,mips\n";
+		for (const Result& result : results) {
+			if (result.halted)
+				continue;
+			file << result.name << "," << result.median << "," << result.ciLow << "," << result.ciHigh << ","
+				<< result.samples << "," << (result.median > 0 ? 1000.0 / result.median : 0.0) << "\n";
+		}
+	}
+
+	//Whole ROM corpus under the hardware counters, attributed to opcode classes
+	void runPerf(const Options& options) {
+		PerfProfiler profiler;
+		if (!profiler.start()) {
+			std::cerr << "Performance counters unavailable on this system\n";
+			return;
+		}
+		profiler.setLiveSummary(&std::cerr);
+
+		for (const std::string& rom : options.roms) {
+			std::vector<unsigned char> program;
+			if (!readFile(rom, program))
+				continue;
+
+			Chip8 chip;
+			chip.initialize();
+			chip.loadProgram(program.data(), program.size());
+			for (int i = 0; i < options.samples && !chip.IsHalted(); ++i) {
+				profiler.runCycles(chip, options.cycles);
+			}
+			if (chip.IsHalted())
+				std::cerr << rom << " halted after " << chip.GetCycle() << " instructions\n";
+		}
+
+		std::printf("\nPer instruction cost by opcode class:\n");
+		profiler.printSummary(std::cout);
+		if (!profiler.writeFile(options.perfPath.c_str()))
+			std::cerr << "Couldn't write " << options.perfPath << "\n";
+	}
+
+	bool parseOptions(int argc, char** argv, Options& options) {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+
+			if (arg == "--samples" && hasValue) options.samples = std::max(1, std::atoi(argv[++i]));
+			else if (arg == "--warmup" && hasValue) options.warmup = std::max(0, std::atoi(argv[++i]));
+			else if (arg == "--cycles" && hasValue) options.cycles = std::max(1, std::atoi(argv[++i]));
+			else if (arg == "--filter" && hasValue) options.filter = argv[++i];
+			else if (arg == "--csv" && hasValue) options.csvPath = argv[++i];
+			else if (arg == "--baseline" && hasValue) options.baselinePath = argv[++i];
+			else if (arg == "--threshold" && hasValue) options.threshold = std::atof(argv[++i]);
+			else if (arg == "--perf" && hasValue) options.perfPath = argv[++i];
+			else if (arg.rfind("--", 0) == 0) {
+				std::cerr << "Unknown option: " << arg << "\n";
+				return false;
+			}
+			else options.roms.push_back(arg);
+		}
+
+		//Bundled ROMs
+		if (options.roms.empty()) {
+			options.roms = { "test_opcode.ch8", "test_opcode_space.ch8" };
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parseOptions(argc, argv, options))
+		return 2;
+
+	const double overhead = clockOverhead();
+	std::vector<Result> results;
+
+	for (const Family& family : opcodeFamilies()) {
+		if (family.name.find(options.filter) == std::string::npos)
+			continue;
+
+		results.push_back(measure(family.name, buildProgram(family.body), FUSION_NONE, options, overhead));
+	}
+
+	for (const std::string& rom : options.roms) {
+		std::string name = "rom " + rom.substr(rom.find_last_of("/\\") + 1);
+		if (name.find(options.filter) == std::string::npos)
+			continue;
+
+		std::vector<unsigned char> program;
+		if (!readFile(rom, program)) {
+			std::cerr << "Couldn't load " << rom << ", skipping\n";
+			continue;
+		}
+
+		results.push_back(measure(name, program, FUSION_DEFAULT, options, overhead));
+	}
+
+	std::map<std::string, Result> baseline;
+	if (!options.baselinePath.empty())
+		baseline = readBaseline(options.baselinePath);
+
+	int regressions = 0;
+
+	std::printf("%-22s %10s %21s %9s", "benchmark", "ns/instr", "95% CI", "MIPS");
+	if (!baseline.empty())
+		std::printf(" %9s", "change");
+	std::printf("\n");
+
+	for (const Result& result : results) {
+		if (result.halted) {
+			std::printf("%-22s %10s\n", result.name.c_str(), "halted");
+			continue;
+		}
+		std::printf("%-22s %10.2f   [%7.2f, %7.2f] %9.1f", result.name.c_str(), result.median, result.ciLow, result.ciHigh,
+			result.median > 0 ? 1000.0 / result.median : 0.0);
+
+		auto it = baseline.find(result.name);
+		if (it != baseline.end() && it->second.median > 0) {
+			const Result& base = it->second;
+			double change = (result.median - base.median) / base.median * 100.0;
+
+			//Only flag a change if it is larger than the threshold and the intervals don't overlap
+			const char* verdict = "";
+			if (std::fabs(change) >= options.threshold && (result.ciLow > base.ciHigh || result.ciHigh < base.ciLow)) {
+				verdict = change > 0 ? " slower" : " faster";
+				if (change > 0)
+					++regressions;
+			}
+			std::printf(" %+8.1f%%%s", change, verdict);
+		}
+		std::printf("\n");
+	}
+
+	if (!options.csvPath.empty())
+		writeCsv(options.csvPath, results);
+
+	if (!options.perfPath.empty())
+		runPerf(options);
+
+	if (regressions > 0) {
+		std::printf("%d benchmark(s) regressed against %s\n", regressions, options.baselinePath.c_str());
+		return 1;
+	}
+
+	return 0;
+}
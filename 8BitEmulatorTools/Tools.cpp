@@ -0,0 +1,1293 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../8BitEmulator/Bisector.h"
+#include "../8BitEmulator/CaptureExport.h"
+#include "../8BitEmulator/chip8.h"
+#include "../8BitEmulator/Debugger.h"
+#include "../8BitEmulator/EventLog.h"
+#include "../8BitEmulator/ExecutionTrace.h"
+#include "../8BitEmulator/FrameCapture.h"
+#include "../8BitEmulator/FrameRenderer.h"
+#include "../8BitEmulator/FrameStream.h"
+#include "../8BitEmulator/GridRenderer.h"
+#include "../8BitEmulator/GuestProfiler.h"
+#include "../8BitEmulator/HeadlessContext.h"
+#include "../8BitEmulator/RomAnalyzer.h"
+#include "../8BitEmulator/SharedState.h"
+#include "../8BitEmulator/SoftwareRenderer.h"
+#include "../8BitEmulator/Terminal.h"
+#include "../8BitEmulator/TerminalRenderer.h"
+#include "../8BitEmulator/TranslationCache.h"
+
+/*
+Headless command line tools around the Chip-8 core.
+
+Usage: 8BitEmulatorTools <command> [arguments]
+	profile <rom> [cycles] [output prefix]
+		Runs the ROM without a window and writes <prefix>.folded (flamegraph input), <prefix>.report.txt
+		(hottest addresses and opcodes) and <prefix>.heatmap.csv (executions/reads/writes per address)
+	trace record <rom> <cycles> <file>
+		Runs the ROM without a window and writes a binary execution trace
+	trace dump <file> [first cycle] [count]
+		Prints records of a trace, starting at the first record at or after the cycle
+	debug <rom>
+		Interactive debugger on stdin/stdout (breakpoints, watchpoints, stepping, "h" lists the commands)
+	bisect <rom> <config A> <config B> [cycles] [seed] [input log]
+		Runs the ROM in two configurations and prints the first instruction after which their states differ.
+		A configuration is a comma separated list of options: halt, skip (illegal opcode policy),
+		fuse, nofuse (superinstructions), cosmac, schip, xochip, modern, megachip (quirk profile), vip (COSMAC VIP timing)
+		The input log holds one "cycle key 0|1" per line
+	fusion [--cycles <n>] <rom or directory>...
+		Profiles every ROM and reports how much of the corpus each superinstruction covers, the instruction pairs that
+		occur most often and the FUSION_* mask the profile suggests
+	analyze [--dot <directory>] [--threads <n>] <rom or directory>...
+		Static analysis of every ROM (directories are searched for *.ch8): control flow, code/data bytes,
+		indirect jumps, self-modifying stores and quirk usage. --dot writes the CFG of every ROM for graphviz
+	batch [--sessions <n>] [--cycles <n> | --frames <n>] [--vip] [--threads <n>] [--shared] [--cache <directory>] <rom>
+		Starts the ROM in many fresh sessions without a window, spread over the threads (0: one per hardware
+		thread). --shared lets the sessions decode the superinstructions into one table, --cache saves them
+		to/maps them from the directory so later batches don't decode them at all. --frames runs 60 Hz frames
+		instead of cycles and reports the speed relative to real time, --vip uses the COSMAC VIP timing
+	render [--frames <n>] [--config <config>] [--size <width>x<height>] [--shaders <directory>] <rom> <output.ppm>
+	render --cpu [--frames <n>] [--config <config>] [--scale <1-16>] [--scale2x] [--phosphor <0-255>] <rom> <output.ppm>
+		Runs the ROM for some 60 Hz frames (bisect configuration), draws every frame with the OpenGL renderer into
+		a headless context (or with the software renderer, --cpu) and writes the last one as a PPM image. Reports
+		the time per frame drawn
+	grid [--sessions <n>] [--frames <n>] [--config <config>] [--size <width>x<height>] [--shaders <directory>] <rom> <output.ppm>
+		Runs the ROM in some sessions for some 60 Hz frames and draws all their screens as a grid with one draw call
+		per frame into a headless context, writes the last frame as a PPM image. Reports the time per frame drawn
+	watch [--config <config>] [--frames <n>] [--capture <file>] <rom>
+		Runs the ROM at 60 Hz in the terminal (Unicode half blocks, only changed cells are sent, one write per
+		frame). Keys 1-4, Q-R, A-F and Z/Y-V are the keypad, Ctrl-C quits. Reports the bytes sent per frame.
+		--capture records the session like capture record does
+	capture record [--config <config>] <rom> <frames> <file>
+		Runs the ROM for some 60 Hz frames without a window and captures every frame that drew something.
+		Reports the time the emulation thread spent per captured frame and the size of the capture
+	capture export [--scale <1-16>] <file> <output.png|output.gif|output.y4m>
+		Converts a capture into an animated PNG, a GIF or a YUV4MPEG2 video
+	share [--config <config>] [--frames <n>] [--name <name>] <rom>
+		Runs the ROM at 60 Hz without a window and publishes every frame (screen, registers, keypad) in a shared
+		memory segment (default /chip8). The keypad holds the keys other processes inject
+	peek [--name <name>] [--keys <hex mask>] [--frames <n>]
+		Attaches to the segment of a running share, injects the keys if given, waits for some frames and prints
+		the last one
+	stream [--config <config>] [--sessions <n>] [--frames <n>] [--port <port>] [--unix <path>] <rom>
+		Runs the ROM in some sessions at 60 Hz without a window and streams their screens to viewers as tile deltas
+		over TCP on the loopback interface (default port 8642) and/or a Unix domain socket. Reports what was sent,
+		the frames slow viewers missed and the time the emulation thread spent handing frames over
+	view [--port <port> | --unix <path>] [--host <host>] [--session <n>] [--frames <n>] [--slow <ms>]
+		Connects to a stream, receives some frames and prints the last one. --slow waits after every frame like a
+		viewer that can't keep up
+*/
+
+namespace {
+
+	void usage() {
+		std::cerr << "Usage: 8BitEmulatorTools <command> [arguments]\n"
+			<< "  profile <rom> [cycles] [output prefix]\n"
+			<< "  trace record <rom> <cycles> <file>\n"
+			<< "  trace dump <file> [first cycle] [count]\n"
+			<< "  debug <rom>\n"
+			<< "  bisect <rom> <config A> <config B> [cycles] [seed] [input log]\n"
+			<< "  fusion [--cycles <n>] <rom or directory>...\n"
+			<< "  analyze [--dot <directory>] [--threads <n>] <rom or directory>...\n"
+			<< "  batch [--sessions <n>] [--cycles <n> | --frames <n>] [--vip] [--threads <n>] [--shared] [--cache <directory>] <rom>\n"
+			<< "  render [--frames <n>] [--config <config>] [--size <width>x<height>] [--shaders <directory>] <rom> <output.ppm>\n"
+			<< "  render --cpu [--frames <n>] [--config <config>] [--scale <1-16>] [--scale2x] [--phosphor <0-255>] <rom> <output.ppm>\n"
+			<< "  grid [--sessions <n>] [--frames <n>] [--config <config>] [--size <width>x<height>] [--shaders <directory>] <rom> <output.ppm>\n"
+			<< "  watch [--config <config>] [--frames <n>] [--capture <file>] <rom>\n"
+			<< "  capture record [--config <config>] <rom> <frames> <file>\n"
+			<< "  capture export [--scale <1-16>] <file> <output.png|output.gif|output.y4m>\n"
+			<< "  share [--config <config>] [--frames <n>] [--name <name>] <rom>\n"
+			<< "  peek [--name <name>] [--keys <hex mask>] [--frames <n>]\n"
+			<< "  stream [--config <config>] [--sessions <n>] [--frames <n>] [--port <port>] [--unix <path>] <rom>\n"
+			<< "  view [--port <port> | --unix <path>] [--host <host>] [--session <n>] [--frames <n>] [--slow <ms>]\n";
+	}
+
+	//Runs a potentially huge number of cycles in batches runCycles can take
+	void runFor(Chip8& chip, unsigned long long cycles) {
+		while (cycles > 0) {
+			unsigned int batch = cycles > 1000000 ? 1000000 : (unsigned int)cycles;
+			chip.runCycles(batch);
+			cycles -= batch;
+		}
+	}
+
+	int profileCommand(int argc, char** argv) {
+		if (argc < 1) {
+			usage();
+			return 2;
+		}
+
+		const char* rom = argv[0];
+		unsigned long long cycles = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000ULL;
+		std::string prefix = argc > 2 ? argv[2] : "profile";
+
+		GuestProfiler profiler;
+		Chip8 chip;
+		chip.initialize();
+		chip.loadGame(rom);
+		chip.SetProfiler(&profiler);
+
+		runFor(chip, cycles);
+
+		bool written = profiler.writeFoldedStacks((prefix + ".folded").c_str())
+			&& profiler.writeReport((prefix + ".report.txt").c_str())
+			&& profiler.writeHeatmap((prefix + ".heatmap.csv").c_str());
+
+		if (!written) {
+			std::cerr << "Couldn't write profile to " << prefix << ".*\n";
+			return 1;
+		}
+
+		std::cout << "Profiled " << profiler.GetInstructions() << " instructions into " << prefix << ".*\n";
+		return 0;
+	}
+
+	int traceCommand(int argc, char** argv) {
+		if (argc >= 4 && std::strcmp(argv[0], "record") == 0) {
+			unsigned long long cycles = std::strtoull(argv[2], nullptr, 10);
+
+			TraceWriter trace;
+			if (!trace.open(argv[3])) {
+				std::cerr << "Couldn't create " << argv[3] << "\n";
+				return 1;
+			}
+
+			Chip8 chip;
+			chip.initialize();
+			chip.loadGame(argv[1]);
+			chip.SetTrace(&trace);
+
+			//Nothing runs in real time here, waiting for the disk between batches that fit the ring keeps the trace
+			//complete
+			const unsigned int batch = (unsigned int)(TraceWriter::RING_SIZE / 2);
+			auto start = std::chrono::steady_clock::now();
+			for (unsigned long long remaining = cycles; remaining > 0;) {
+				while (trace.GetFree() < batch) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				const unsigned int run = remaining > batch ? batch : (unsigned int)remaining;
+				chip.runCycles(run);
+				remaining -= run;
+			}
+			chip.SetTrace(nullptr);
+			trace.close();
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			std::cout << "Traced " << cycles << " cycles in " << seconds << "s (" << trace.GetDropped() << " records dropped)\n";
+			return 0;
+		}
+
+		if (argc >= 2 && std::strcmp(argv[0], "dump") == 0) {
+			TraceReader reader;
+			if (!reader.open(argv[1])) {
+				std::cerr << "Couldn't read trace " << argv[1] << "\n";
+				return 1;
+			}
+
+			unsigned long long first = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+			unsigned long long count = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100;
+
+			if (!reader.seek(first))
+				return 0;
+
+			TraceRecord record;
+			for (unsigned long long i = 0; i < count && reader.next(record); ++i) {
+				if (record.reg != TraceRecord::NO_REGISTER)
+					std::printf("%12llu  %03X  %04X  V%X=%02X\n", record.cycle, record.pc, record.opcode, record.reg, record.value);
+				else
+					std::printf("%12llu  %03X  %04X\n", record.cycle, record.pc, record.opcode);
+			}
+			return 0;
+		}
+
+		usage();
+		return 2;
+	}
+
+	//Applies a bisect configuration, returns false for unknown options
+	bool configure(Chip8& chip, const std::string& config) {
+		size_t start = 0;
+		while (start <= config.size()) {
+			size_t end = config.find(',', start);
+			if (end == std::string::npos)
+				end = config.size();
+			std::string option = config.substr(start, end - start);
+
+			if (option == "halt")
+				chip.SetIllegalOpcodePolicy(Chip8::ILLEGAL_HALT);
+			else if (option == "skip")
+				chip.SetIllegalOpcodePolicy(Chip8::ILLEGAL_SKIP);
+			else if (option == "fuse")
+				chip.SetFusion(FUSION_ALL);
+			else if (option == "nofuse")
+				chip.SetFusion(FUSION_NONE);
+			else if (option == "vip")
+				chip.SetTiming(TIMING_COSMAC_VIP);
+			else if (!option.empty() && option != "default") {
+				int profile = 0;
+				while (profile < QUIRKS_COUNT && option != quirkProfileName((QuirkProfile)profile)) {
+					++profile;
+				}
+				if (profile == QUIRKS_COUNT)
+					return false;
+				chip.SetQuirks((QuirkProfile)profile);
+			}
+
+			start = end + 1;
+		}
+		return true;
+	}
+
+	int bisectCommand(int argc, char** argv) {
+		if (argc < 3) {
+			usage();
+			return 2;
+		}
+
+		std::string rom = argv[0];
+		std::string configs[2] = { argv[1], argv[2] };
+		unsigned long long cycles = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100000000ULL;
+		unsigned int seed = argc > 4 ? (unsigned int)std::strtoul(argv[4], nullptr, 10) : 1;
+
+		for (const std::string& config : configs) {
+			Chip8 chip;
+			if (!configure(chip, config)) {
+				std::cerr << "Unknown configuration " << config << "\n";
+				return 2;
+			}
+		}
+
+		auto setup = [&rom](const std::string& config) {
+			return [rom, config](Chip8& chip) {
+				configure(chip, config);
+				chip.loadGame(rom.c_str());
+			};
+		};
+
+		Bisector bisector(setup(configs[0]), setup(configs[1]), seed);
+		if (argc > 5 && !bisector.loadInput(argv[5])) {
+			std::cerr << "Couldn't read input log " << argv[5] << "\n";
+			return 1;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		bool diverged = bisector.run(cycles);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (!diverged) {
+			std::cout << "No divergence within " << cycles << " cycles (" << seconds << "s)\n";
+			return 0;
+		}
+
+		bisector.printDiff(std::cout);
+		std::cout << "Found in " << seconds << "s\n";
+		return 1;
+	}
+
+	//Adds the ROM, or every *.ch8 below the directory
+	void addRoms(const char* path, std::vector<std::string>& paths) {
+		if (!std::filesystem::is_directory(path)) {
+			paths.push_back(path);
+			return;
+		}
+
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".ch8")
+				paths.push_back(entry.path().string());
+		}
+	}
+
+	int fusionCommand(int argc, char** argv) {
+		unsigned long long cycles = 10000000ULL;
+		std::vector<std::string> paths;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+				cycles = std::strtoull(argv[++i], nullptr, 10);
+			else
+				addRoms(argv[i], paths);
+		}
+
+		if (paths.empty()) {
+			usage();
+			return 2;
+		}
+
+		//Corpus totals
+		unsigned long long instructions = 0;
+		unsigned long long supers[SUPER_COUNT] = {};
+		std::vector<unsigned long long> pairs(OPCODE_SHAPE_COUNT * OPCODE_SHAPE_COUNT, 0);
+
+		for (const std::string& path : paths) {
+			std::unique_ptr<GuestProfiler> profiler(new GuestProfiler());
+			Chip8 chip;
+			chip.initialize();
+			chip.loadGame(path.c_str());
+			chip.SetProfiler(profiler.get());
+			runFor(chip, cycles);
+
+			std::printf("%s:", path.c_str());
+			for (int super = SUPER_NONE + 1; super < SUPER_COUNT; ++super) {
+				unsigned long long count = profiler->GetSuperinstructionCount((Superinstruction)super);
+				supers[super] += count;
+				std::printf(" %s %.2f%%", superinstructionName((Superinstruction)super), 100.0 * count / std::max(1ULL, profiler->GetInstructions()));
+			}
+			std::printf("\n");
+
+			instructions += profiler->GetInstructions();
+			for (int first = 0; first < OPCODE_SHAPE_COUNT; ++first) {
+				for (int second = 0; second < OPCODE_SHAPE_COUNT; ++second) {
+					pairs[first * OPCODE_SHAPE_COUNT + second] += profiler->GetPairCount(first, second);
+				}
+			}
+		}
+
+		//Worth a dispatch table entry if it covers at least 0.5% of what the corpus executes
+		unsigned int mask = FUSION_NONE;
+		std::printf("\nCorpus (%llu instructions):\n", instructions);
+		for (int super = SUPER_NONE + 1; super < SUPER_COUNT; ++super) {
+			double share = 100.0 * supers[super] / std::max(1ULL, instructions);
+			if (share >= 0.5)
+				mask |= 1u << super;
+			std::printf("  %-30s %6.2f%%\n", superinstructionName((Superinstruction)super), share);
+		}
+
+		std::vector<int> order(pairs.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = (int)i;
+		}
+		std::sort(order.begin(), order.end(), [&pairs](int a, int b) { return pairs[a] > pairs[b]; });
+
+		std::printf("\nMost frequent pairs:\n");
+		for (int i = 0; i < 16 && pairs[order[i]] > 0; ++i) {
+			std::printf("  %s %s %6.2f%%\n", opcodeShapeName(order[i] / OPCODE_SHAPE_COUNT), opcodeShapeName(order[i] % OPCODE_SHAPE_COUNT),
+				100.0 * pairs[order[i]] / std::max(1ULL, instructions));
+		}
+
+		std::printf("\nSuggested fusion mask: 0x%X\n", mask);
+		return 0;
+	}
+
+	int analyzeCommand(int argc, char** argv) {
+		std::string dotDirectory;
+		unsigned int threads = 0;
+		std::vector<std::string> paths;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--dot") == 0 && i + 1 < argc)
+				dotDirectory = argv[++i];
+			else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threads = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+			else
+				addRoms(argv[i], paths);
+		}
+
+		if (paths.empty()) {
+			usage();
+			return 2;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<RomAnalyzer> results = analyzeCorpus(paths, threads);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		int failed = 0;
+		for (const RomAnalyzer& result : results) {
+			if (result.GetSize() == 0) {
+				std::cerr << "Couldn't read " << result.GetName() << "\n";
+				++failed;
+				continue;
+			}
+
+			result.writeReport(std::cout);
+
+			if (!dotDirectory.empty()) {
+				std::filesystem::path dot = std::filesystem::path(dotDirectory) / std::filesystem::path(result.GetName()).filename();
+				dot.replace_extension(".dot");
+				if (!result.writeDot(dot.string().c_str()))
+					std::cerr << "Couldn't write " << dot.string() << "\n";
+			}
+		}
+
+		std::cout << "Analyzed " << results.size() - failed << " ROMs in " << seconds << "s\n";
+		return failed > 0 ? 1 : 0;
+	}
+
+	int batchCommand(int argc, char** argv) {
+		unsigned int sessions = 100;
+		unsigned long long cycles = 100000ULL;
+		unsigned long long frames = 0;
+		bool vip = false;
+		unsigned int threads = 1;
+		bool shared = false;
+		std::string cacheDirectory;
+		const char* rom = nullptr;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--sessions") == 0 && i + 1 < argc)
+				sessions = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+				cycles = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--vip") == 0)
+				vip = true;
+			else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threads = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--shared") == 0)
+				shared = true;
+			else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+				cacheDirectory = argv[++i];
+			else
+				rom = argv[i];
+		}
+
+		if (!rom) {
+			usage();
+			return 2;
+		}
+
+		std::ifstream file(rom, std::ios::binary);
+		std::vector<unsigned char> program((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (!file || program.empty()) {
+			std::cerr << "Couldn't read " << rom << "\n";
+			return 1;
+		}
+
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = std::min(threads, std::max(1u, sessions));
+
+		//Every session starts as a copy of this machine, it also identifies the program for the caches
+		Chip8 loaded;
+		loaded.initialize();
+		loaded.loadProgram(program.data(), program.size());
+		if (vip)
+			loaded.SetTiming(TIMING_COSMAC_VIP);
+
+		auto session = [cycles, frames](Chip8& chip) {
+			if (frames == 0) {
+				runFor(chip, cycles);
+				return;
+			}
+			for (unsigned long long frame = 0; frame < frames && !chip.IsHalted(); ++frame) {
+				chip.runFrame();
+			}
+		};
+
+		auto start = std::chrono::steady_clock::now();
+		unsigned int next = 0;
+
+		TranslationCache cache;
+		bool mapped = false;
+		if (!cacheDirectory.empty()) {
+			mapped = cache.open(cacheDirectory.c_str(), loaded);
+
+			//No usable cache yet, the first session runs on its own and writes it for the others
+			if (!mapped && sessions > 0) {
+				Chip8 chip = loaded;
+				session(chip);
+				++next;
+
+				if (!cache.save(chip))
+					std::cerr << "Couldn't write " << cache.GetPath() << "\n";
+				mapped = cache.open(cacheDirectory.c_str(), loaded);
+			}
+		}
+
+		std::shared_ptr<SharedTranslations> table;
+		if (shared)
+			table = SharedTranslations::acquire(loaded, mapped ? &cache : nullptr);
+
+		//Sessions are handed out one by one, they all take about as long
+		std::atomic<unsigned int> started(next);
+		auto worker = [&]() {
+			while (started++ < sessions) {
+				Chip8 chip = loaded;
+				if (mapped)
+					chip.SetTranslationCache(&cache);
+				chip.SetSharedTranslations(table.get());
+				session(chip);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (unsigned int i = 1; i < threads; ++i) {
+			workers.emplace_back(worker);
+		}
+		worker();
+
+		for (std::thread& thread : workers) {
+			thread.join();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (frames == 0) {
+			std::printf("%u sessions of %llu cycles on %u threads in %.3fs (%.1f us per session)\n", sessions, cycles, threads, seconds,
+				seconds * 1e6 / std::max(1u, sessions));
+		}
+		else {
+			//Every session emulates frames / 60 seconds
+			std::printf("%u sessions of %llu frames on %u threads in %.3fs (%.0fx real time per session)\n", sessions, frames, threads, seconds,
+				frames / 60.0 * sessions / threads / std::max(seconds, 1e-9));
+		}
+		if (!cacheDirectory.empty())
+			std::printf("Cache %s %s\n", cache.GetPath().c_str(), mapped ? "mapped" : "not usable");
+		if (table)
+			std::printf("Shared table: %u entries decoded for all sessions\n", table->GetDecoded());
+
+		//Whatever the sessions decoded beyond the cache is kept for the next batch
+		if (table && mapped && table->GetDecoded() > 0 && !cache.save(*table))
+			std::cerr << "Couldn't write " << cache.GetPath() << "\n";
+		return 0;
+	}
+
+	//Binary PPM of RGBA pixels (bytes R, G, B, A), alpha is dropped
+	bool writePpm(const char* path, const unsigned char* rgba, int width, int height) {
+		std::ofstream image(path, std::ios::binary);
+		image << "P6\n" << width << " " << height << "\n255\n";
+		for (size_t i = 0; i < (size_t)width * height * 4; i += 4) {
+			image.write(reinterpret_cast<const char*>(&rgba[i]), 3);
+		}
+		return (bool)image;
+	}
+
+	int renderCommand(int argc, char** argv) {
+		unsigned long long frames = 60;
+		std::string config;
+		int width = 640;
+		int height = 320;
+		std::string shaders = "shader";
+		bool cpu = false;
+		int scale = 10;
+		SoftwareRenderer::Filter filter = SoftwareRenderer::FILTER_NONE;
+		int phosphor = 0;
+		const char* rom = nullptr;
+		const char* output = nullptr;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+				config = argv[++i];
+			else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc && std::sscanf(argv[i + 1], "%dx%d", &width, &height) == 2)
+				++i;
+			else if (std::strcmp(argv[i], "--shaders") == 0 && i + 1 < argc)
+				shaders = argv[++i];
+			else if (std::strcmp(argv[i], "--cpu") == 0)
+				cpu = true;
+			else if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+				scale = std::atoi(argv[++i]);
+			else if (std::strcmp(argv[i], "--scale2x") == 0)
+				filter = SoftwareRenderer::FILTER_SCALE2X;
+			else if (std::strcmp(argv[i], "--phosphor") == 0 && i + 1 < argc)
+				phosphor = std::atoi(argv[++i]);
+			else if (!rom)
+				rom = argv[i];
+			else
+				output = argv[i];
+		}
+
+		if (!rom || !output || width <= 0 || height <= 0) {
+			usage();
+			return 2;
+		}
+
+		//Fixed seed, the same ROM renders the same image every time
+		Chip8 chip;
+		chip.SetSeed(1);
+		chip.initialize();
+		if (!configure(chip, config)) {
+			std::cerr << "Unknown configuration " << config << "\n";
+			return 2;
+		}
+		chip.loadGame(rom);
+
+		//Every frame is drawn, like a window presenting at 60 Hz would
+		std::chrono::steady_clock::duration drawing(0);
+		unsigned long long drawn = 0;
+		std::vector<unsigned char> rgba;
+
+		if (cpu) {
+			SoftwareRenderer renderer;
+			renderer.setScale(scale);
+			renderer.setFilter(filter);
+			renderer.setPhosphor(phosphor);
+
+			//One buffer for the whole run, it only grows when the resolution does
+			std::vector<unsigned int> pixels;
+			for (; drawn < frames && !chip.IsHalted(); ++drawn) {
+				chip.runFrame();
+				const bool mega = chip.GetMegaDisplay().IsEnabled();
+				width = mega ? renderer.GetOutputWidth(chip.GetMegaDisplay()) : renderer.GetOutputWidth(chip.GetDisplay());
+				height = mega ? renderer.GetOutputHeight(chip.GetMegaDisplay()) : renderer.GetOutputHeight(chip.GetDisplay());
+				if (pixels.size() < (size_t)width * height)
+					pixels.resize((size_t)width * height);
+
+				auto start = std::chrono::steady_clock::now();
+				if (mega)
+					renderer.render(chip.GetMegaDisplay(), pixels.data(), width);
+				else
+					renderer.render(chip.GetDisplay(), pixels.data(), width);
+				drawing += std::chrono::steady_clock::now() - start;
+			}
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(pixels.data());
+			rgba.assign(bytes, bytes + (size_t)width * height * 4);
+		}
+		else {
+			HeadlessContext context;
+			if (!context.create(width, height))
+				return 1;
+			FrameRenderer renderer;
+			if (!renderer.init(HeadlessContext::getProcAddress, (shaders + "/vertex.txt").c_str(), (shaders + "/fragment.txt").c_str()))
+				return 1;
+
+			for (; drawn < frames && !chip.IsHalted(); ++drawn) {
+				chip.runFrame();
+				auto start = std::chrono::steady_clock::now();
+				if (chip.GetMegaDisplay().IsEnabled())
+					renderer.draw(chip.GetMegaDisplay(), width, height);
+				else
+					renderer.draw(chip.GetDisplay(), width, height);
+				drawing += std::chrono::steady_clock::now() - start;
+			}
+
+			//Reading back waits for the GPU, the time above is what the emulator thread pays
+			context.readPixels(rgba);
+			renderer.release();
+		}
+
+		if (!writePpm(output, rgba.data(), width, height)) {
+			std::cerr << "Couldn't write " << output << "\n";
+			return 1;
+		}
+
+		std::printf("%llu frames, %.2f us per %s, %dx%d %s written\n", drawn,
+			std::chrono::duration<double, std::micro>(drawing).count() / std::max(1ULL, drawn),
+			cpu ? "frame" : "upload and draw", width, height, output);
+		return 0;
+	}
+
+	int gridCommand(int argc, char** argv) {
+		int sessions = 16;
+		unsigned long long frames = 60;
+		std::string config;
+		int width = 1920;
+		int height = 1080;
+		std::string shaders = "shader";
+		const char* rom = nullptr;
+		const char* output = nullptr;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--sessions") == 0 && i + 1 < argc)
+				sessions = std::atoi(argv[++i]);
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+				config = argv[++i];
+			else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc && std::sscanf(argv[i + 1], "%dx%d", &width, &height) == 2)
+				++i;
+			else if (std::strcmp(argv[i], "--shaders") == 0 && i + 1 < argc)
+				shaders = argv[++i];
+			else if (!rom)
+				rom = argv[i];
+			else
+				output = argv[i];
+		}
+
+		if (!rom || !output || sessions < 1 || width <= 0 || height <= 0) {
+			usage();
+			return 2;
+		}
+
+		//Every session its own seed so the screens of games using random numbers differ
+		std::vector<std::unique_ptr<Chip8>> chips;
+		std::vector<const Display*> displays;
+		for (int session = 0; session < sessions; ++session) {
+			chips.emplace_back(new Chip8);
+			Chip8& chip = *chips.back();
+			chip.SetSeed(session + 1);
+			chip.initialize();
+			if (!configure(chip, config)) {
+				std::cerr << "Unknown configuration " << config << "\n";
+				return 2;
+			}
+			chip.loadGame(rom);
+			displays.push_back(&chip.GetDisplay());
+		}
+		if (chips[0]->GetQuirks() == QUIRKS_MEGA_CHIP)
+			std::cerr << "MEGA-CHIP screens aren't shown, only the Chip-8 display\n";
+
+		HeadlessContext context;
+		if (!context.create(width, height))
+			return 1;
+		GridRenderer renderer;
+		if (!renderer.init(HeadlessContext::getProcAddress, sessions, (shaders + "/grid_vertex.txt").c_str(), (shaders + "/grid_fragment.txt").c_str()))
+			return 1;
+
+		//All sessions advance a frame, then one draw shows them all
+		std::chrono::steady_clock::duration drawing(0);
+		unsigned long long drawn = 0;
+		for (; drawn < frames; ++drawn) {
+			for (auto& chip : chips) {
+				if (!chip->IsHalted())
+					chip->runFrame();
+			}
+			auto start = std::chrono::steady_clock::now();
+			renderer.draw(displays.data(), sessions, width, height);
+			drawing += std::chrono::steady_clock::now() - start;
+		}
+
+		//Reading back waits for the GPU, the time above is what the emulator thread pays
+		std::vector<unsigned char> rgba;
+		context.readPixels(rgba);
+		renderer.release();
+
+		if (!writePpm(output, rgba.data(), width, height)) {
+			std::cerr << "Couldn't write " << output << "\n";
+			return 1;
+		}
+
+		const double perDraw = std::chrono::duration<double, std::micro>(drawing).count() / std::max(1ULL, drawn);
+		std::printf("%llu frames of %d sessions, %.2f us per upload and draw (%.3f per session), %dx%d %s written\n", drawn,
+			sessions, perDraw, perDraw / sessions, width, height, output);
+		return 0;
+	}
+
+	//Keypad key of a typed character, -1 for anything else. Z and Y both work so QWERTZ keyboards get the same layout
+	int keypadKey(char typed) {
+		static const char keys[] = "1234qwerasdfzxcv";
+		static const int values[] = { 0x1, 0x2, 0x3, 0xC, 0x4, 0x5, 0x6, 0xD, 0x7, 0x8, 0x9, 0xE, 0xA, 0x0, 0xB, 0xF };
+		if (typed >= 'A' && typed <= 'Z')
+			typed = (char)(typed - 'A' + 'a');
+		if (typed == 'y')
+			typed = 'z';
+		for (int i = 0; keys[i] != '\0'; ++i) {
+			if (keys[i] == typed)
+				return values[i];
+		}
+		return -1;
+	}
+
+	int watchCommand(int argc, char** argv) {
+		std::string config;
+		unsigned long long frames = ~0ULL;
+		const char* capturePath = nullptr;
+		const char* rom = nullptr;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+				config = argv[++i];
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+				capturePath = argv[++i];
+			else
+				rom = argv[i];
+		}
+
+		if (!rom) {
+			usage();
+			return 2;
+		}
+
+		Chip8 chip;
+		chip.initialize();
+		if (!configure(chip, config)) {
+			std::cerr << "Unknown configuration " << config << "\n";
+			return 2;
+		}
+		chip.loadGame(rom);
+		if (chip.GetQuirks() == QUIRKS_MEGA_CHIP)
+			std::cerr << "MEGA-CHIP screens aren't shown, only the Chip-8 display\n";
+
+		CaptureWriter capture;
+		if (capturePath && !capture.open(capturePath)) {
+			std::cerr << "Couldn't create " << capturePath << "\n";
+			return 1;
+		}
+
+		//Without a terminal on stdin (output piped or sent over a link) the session just runs
+		Terminal terminal;
+		const bool keyboard = terminal.open();
+		TerminalRenderer renderer;
+		terminal.write(TerminalRenderer::enterSequence());
+
+		//Terminals don't report releases, a key counts as held until its auto-repeat stops arriving
+		const int holdFrames = 6;
+		int held[16] = {};
+
+		unsigned long long bytes = 0;
+		unsigned long long frame = 0;
+		auto start = std::chrono::steady_clock::now();
+		bool quit = false;
+		for (; frame < frames && !quit && !chip.IsHalted(); ++frame) {
+			char typed[64];
+			const size_t count = terminal.read(typed, sizeof(typed));
+			for (size_t i = 0; i < count; ++i) {
+				//Ctrl-C, raw mode delivers it as a character
+				if (typed[i] == 0x03)
+					quit = true;
+				const int key = keypadKey(typed[i]);
+				if (key >= 0)
+					held[key] = holdFrames;
+			}
+			for (int key = 0; key < 16; ++key) {
+				chip.m_key[key] = held[key] > 0 ? 1 : 0;
+				if (held[key] > 0)
+					--held[key];
+			}
+
+			chip.runFrame();
+			if (capture.IsOpen() && chip.drawFlag)
+				capture.capture(chip.GetDisplay(), frame);
+			chip.drawFlag = false;
+
+			const std::string& output = renderer.encode(chip.GetDisplay());
+			if (!output.empty() && !terminal.write(output))
+				break;
+			bytes += output.size();
+
+			std::this_thread::sleep_until(start + std::chrono::microseconds((frame + 1) * 1000000 / 60));
+		}
+
+		terminal.write(TerminalRenderer::leaveSequence());
+		terminal.close();
+		capture.close();
+		if (!keyboard)
+			std::cerr << "stdin is not a terminal, the keypad wasn't read\n";
+		std::printf("%llu frames, %llu bytes sent (%.1f per frame)\n", frame, bytes, (double)bytes / std::max(1ULL, frame));
+		return 0;
+	}
+
+	int captureCommand(int argc, char** argv) {
+		if (argc >= 4 && std::strcmp(argv[0], "record") == 0) {
+			std::string config;
+			std::vector<const char*> arguments;
+			for (int i = 1; i < argc; ++i) {
+				if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+					config = argv[++i];
+				else
+					arguments.push_back(argv[i]);
+			}
+			if (arguments.size() != 3) {
+				usage();
+				return 2;
+			}
+			const unsigned long long frames = std::strtoull(arguments[1], nullptr, 10);
+
+			CaptureWriter capture;
+			if (!capture.open(arguments[2])) {
+				std::cerr << "Couldn't create " << arguments[2] << "\n";
+				return 1;
+			}
+
+			//Fixed seed like render, the same ROM captures the same frames every time
+			Chip8 chip;
+			chip.SetSeed(1);
+			chip.initialize();
+			if (!configure(chip, config)) {
+				std::cerr << "Unknown configuration " << config << "\n";
+				return 2;
+			}
+			chip.loadGame(arguments[0]);
+			if (chip.GetQuirks() == QUIRKS_MEGA_CHIP)
+				std::cerr << "MEGA-CHIP screens aren't captured, only the Chip-8 display\n";
+
+			//Only the capture calls are timed, that's what a frontend's emulation thread pays. Without a window the
+			//frames come much faster than 60 Hz and would outrun the writer, so the loop waits for room in the ring
+			//(untimed) instead of letting frames drop
+			std::vector<double> times;
+			unsigned long long frame = 0;
+			for (; frame < frames && !chip.IsHalted(); ++frame) {
+				chip.runFrame();
+				if (!chip.drawFlag)
+					continue;
+				chip.drawFlag = false;
+
+				while (capture.GetFree() == 0) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				auto start = std::chrono::steady_clock::now();
+				capture.capture(chip.GetDisplay(), frame);
+				times.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+			}
+			capture.close();
+
+			std::sort(times.begin(), times.end());
+			std::printf("%llu frames, %zu captured, %.3f us median per capture, %llu bytes (%.1f per frame), %llu dropped\n",
+				frame, times.size(), times.empty() ? 0.0 : times[times.size() / 2], capture.GetSize(),
+				(double)capture.GetSize() / std::max(1ULL, frame), capture.GetDropped());
+			return 0;
+		}
+
+		if (argc >= 3 && std::strcmp(argv[0], "export") == 0) {
+			int scale = 1;
+			std::vector<const char*> arguments;
+			for (int i = 1; i < argc; ++i) {
+				if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+					scale = std::atoi(argv[++i]);
+				else
+					arguments.push_back(argv[i]);
+			}
+
+			CaptureExport::Format format;
+			if (arguments.size() != 2 || !CaptureExport::formatOf(arguments[1], format)) {
+				usage();
+				return 2;
+			}
+
+			CaptureExport exporter;
+			exporter.setScale(scale);
+			if (!exporter.write(arguments[0], arguments[1], format))
+				return 1;
+
+			std::printf("%llu frames, %llu images written to %s\n", exporter.GetFrames(), exporter.GetImages(), arguments[1]);
+			return 0;
+		}
+
+		usage();
+		return 2;
+	}
+
+	//Plane 0 of a screen, one character per pixel
+	void printPlane(const Display::Row* rows, bool hires) {
+		const int width = hires ? Display::WIDTH : Display::WIDTH / 2;
+		const int height = hires ? Display::HEIGHT : Display::HEIGHT / 2;
+		std::string line;
+		for (int y = 0; y < height; ++y) {
+			line.clear();
+			for (int x = 0; x < width; ++x) {
+				line += (rows[y].words[x >> 6] >> (63 - (x & 63)) & 1) ? '#' : '.';
+			}
+			std::printf("%s\n", line.c_str());
+		}
+	}
+
+	int shareCommand(int argc, char** argv) {
+		std::string config;
+		unsigned long long frames = ~0ULL;
+		const char* name = "/chip8";
+		const char* rom = nullptr;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+				config = argv[++i];
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+				name = argv[++i];
+			else
+				rom = argv[i];
+		}
+
+		if (!rom) {
+			usage();
+			return 2;
+		}
+
+		Chip8 chip;
+		chip.initialize();
+		if (!configure(chip, config)) {
+			std::cerr << "Unknown configuration " << config << "\n";
+			return 2;
+		}
+		chip.loadGame(rom);
+
+		SharedState shared;
+		if (!shared.create(name))
+			return 1;
+
+		std::chrono::steady_clock::duration publishing(0);
+		unsigned long long frame = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (; frame < frames && !chip.IsHalted(); ++frame) {
+			unsigned int keys = 0;
+			if (shared.pollKeys(keys)) {
+				for (int key = 0; key < 16; ++key) {
+					chip.m_key[key] = (unsigned char)(keys >> key & 1);
+				}
+			}
+
+			chip.runFrame();
+
+			auto published = std::chrono::steady_clock::now();
+			shared.publish(chip);
+			publishing += std::chrono::steady_clock::now() - published;
+
+			std::this_thread::sleep_until(start + std::chrono::microseconds((frame + 1) * 1000000 / 60));
+		}
+		shared.close();
+
+		std::printf("%llu frames published to %s, %.3f us per frame\n", frame, name,
+			std::chrono::duration<double, std::micro>(publishing).count() / std::max(1ULL, frame));
+		return 0;
+	}
+
+	int peekCommand(int argc, char** argv) {
+		const char* name = "/chip8";
+		const char* keys = nullptr;
+		unsigned int frames = 1;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+				name = argv[++i];
+			else if (std::strcmp(argv[i], "--keys") == 0 && i + 1 < argc)
+				keys = argv[++i];
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+			else {
+				usage();
+				return 2;
+			}
+		}
+
+		SharedState shared;
+		if (!shared.attach(name)) {
+			std::cerr << "No emulator shares " << name << "\n";
+			return 1;
+		}
+
+		if (keys)
+			shared.injectKeys((unsigned int)std::strtoul(keys, nullptr, 16));
+
+		//Polls like a bot would, the emulator doesn't know anyone is reading
+		const unsigned int first = shared.GetPublished();
+		auto start = std::chrono::steady_clock::now();
+		while (shared.GetPublished() - first < frames) {
+			if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5)) {
+				std::cerr << "The emulator stopped publishing\n";
+				return 1;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		SharedFrame frame;
+		if (!shared.read(frame)) {
+			std::cerr << "Couldn't read a complete frame\n";
+			return 1;
+		}
+
+		std::printf("frame %llu  cycle %llu  PC %03X  I %03X  SP %X  DT %02X  ST %02X  keys %04X  input %u\n", frame.frame,
+			frame.cycle, frame.pc, frame.i, frame.sp, frame.delayTimer, frame.soundTimer, frame.keys, frame.inputApplied);
+		for (int n = 0; n < 16; ++n) {
+			std::printf("V%X %02X%s", n, frame.v[n], n % 8 == 7 ? "\n" : "  ");
+		}
+
+		printPlane(frame.rows[0], frame.hires != 0);
+		return 0;
+	}
+
+	int streamCommand(int argc, char** argv) {
+		std::string config;
+		unsigned int sessions = 1;
+		unsigned long long frames = ~0ULL;
+		int port = -1;
+		const char* unixPath = nullptr;
+		const char* rom = nullptr;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+				config = argv[++i];
+			else if (std::strcmp(argv[i], "--sessions") == 0 && i + 1 < argc)
+				sessions = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+				port = std::atoi(argv[++i]);
+			else if (std::strcmp(argv[i], "--unix") == 0 && i + 1 < argc)
+				unixPath = argv[++i];
+			else
+				rom = argv[i];
+		}
+
+		if (!rom || sessions == 0) {
+			usage();
+			return 2;
+		}
+		if (port < 0 && !unixPath)
+			port = 8642;
+
+		//Every session gets its own seed, they drift apart like separate players would
+		std::vector<std::unique_ptr<Chip8>> chips;
+		StreamServer server;
+		for (unsigned int session = 0; session < sessions; ++session) {
+			std::unique_ptr<Chip8> chip(new Chip8());
+			chip->SetSeed(session + 1);
+			chip->initialize();
+			if (!configure(*chip, config)) {
+				std::cerr << "Unknown configuration " << config << "\n";
+				return 2;
+			}
+			chip->loadGame(rom);
+			chips.push_back(std::move(chip));
+			server.addSession();
+		}
+
+		if ((port >= 0 && !server.listenTcp((unsigned short)port)) || (unixPath && !server.listenUnix(unixPath)) || !server.start())
+			return 1;
+
+		std::chrono::steady_clock::duration publishing(0);
+		unsigned long long late = 0;
+		unsigned long long frame = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (; frame < frames; ++frame) {
+			for (unsigned int session = 0; session < sessions; ++session) {
+				chips[session]->runFrame();
+				auto published = std::chrono::steady_clock::now();
+				server.publish(session, chips[session]->GetDisplay(), frame);
+				publishing += std::chrono::steady_clock::now() - published;
+			}
+
+			//Frames that missed their 60 Hz deadline, viewers must never cause any
+			auto deadline = start + std::chrono::microseconds((frame + 1) * 1000000 / 60);
+			if (std::chrono::steady_clock::now() > deadline)
+				++late;
+			std::this_thread::sleep_until(deadline);
+		}
+		server.stop();
+
+		unsigned long long skipped = 0;
+		for (unsigned int session = 0; session < sessions; ++session) {
+			skipped += server.GetSkipped(session);
+		}
+		std::printf("%llu frames of %u sessions, %llu bytes sent, %llu frames dropped for slow viewers, %llu skipped, "
+			"%.3f us per frame handed over, %llu frames late\n", frame, sessions, server.GetBytesSent(), server.GetDropped(),
+			skipped, std::chrono::duration<double, std::micro>(publishing).count() / std::max(1ULL, frame * sessions), late);
+		return 0;
+	}
+
+	int viewCommand(int argc, char** argv) {
+		int port = 8642;
+		const char* host = "127.0.0.1";
+		const char* unixPath = nullptr;
+		int session = 0;
+		unsigned long long frames = 60;
+		int slow = 0;
+
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+				port = std::atoi(argv[++i]);
+			else if (std::strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+				host = argv[++i];
+			else if (std::strcmp(argv[i], "--unix") == 0 && i + 1 < argc)
+				unixPath = argv[++i];
+			else if (std::strcmp(argv[i], "--session") == 0 && i + 1 < argc)
+				session = std::atoi(argv[++i]);
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--slow") == 0 && i + 1 < argc)
+				slow = std::atoi(argv[++i]);
+			else {
+				usage();
+				return 2;
+			}
+		}
+
+		StreamClient client;
+		if (unixPath ? !client.connectUnix(unixPath, session) : !client.connectTcp(host, (unsigned short)port, session))
+			return 1;
+
+		CaptureFrame frame;
+		unsigned long long received = 0;
+		unsigned long long first = 0;
+		for (; received < frames; ++received) {
+			if (!client.next(frame, 5000))
+				break;
+			if (received == 0)
+				first = frame.frame;
+			if (slow > 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(slow));
+		}
+
+		if (received == 0) {
+			std::cerr << "No frames received\n";
+			return 1;
+		}
+		std::printf("%llu frames received (stream frames %llu-%llu), %llu bytes (%.1f per frame)\n", received, first,
+			frame.frame, client.GetBytesReceived(), (double)client.GetBytesReceived() / received);
+		printPlane(frame.rows[0], frame.hires);
+		return 0;
+	}
+
+	int debugCommand(int argc, char** argv) {
+		if (argc < 1) {
+			usage();
+			return 2;
+		}
+
+		Chip8 chip;
+		chip.initialize();
+		chip.loadGame(argv[0]);
+
+		Debugger debugger;
+		debugger.attach(chip);
+		debugger.printDisassembly(std::cout, chip.GetPC(), 1);
+		debugger.commandLoop(std::cin, std::cout);
+		debugger.detach();
+		return 0;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		usage();
+		return 2;
+	}
+
+	std::string command = argv[1];
+	int result = 2;
+
+	EventLog::start();
+
+	if (command == "profile")
+		result = profileCommand(argc - 2, argv + 2);
+	else if (command == "trace")
+		result = traceCommand(argc - 2, argv + 2);
+	else if (command == "debug")
+		result = debugCommand(argc - 2, argv + 2);
+	else if (command == "bisect")
+		result = bisectCommand(argc - 2, argv + 2);
+	else if (command == "fusion")
+		result = fusionCommand(argc - 2, argv + 2);
+	else if (command == "analyze")
+		result = analyzeCommand(argc - 2, argv + 2);
+	else if (command == "batch")
+		result = batchCommand(argc - 2, argv + 2);
+	else if (command == "render")
+		result = renderCommand(argc - 2, argv + 2);
+	else if (command == "grid")
+		result = gridCommand(argc - 2, argv + 2);
+	else if (command == "watch")
+		result = watchCommand(argc - 2, argv + 2);
+	else if (command == "capture")
+		result = captureCommand(argc - 2, argv + 2);
+	else if (command == "share")
+		result = shareCommand(argc - 2, argv + 2);
+	else if (command == "peek")
+		result = peekCommand(argc - 2, argv + 2);
+	else if (command == "stream")
+		result = streamCommand(argc - 2, argv + 2);
+	else if (command == "view")
+		result = viewCommand(argc - 2, argv + 2);
+	else
+		usage();
+
+	EventLog::stop();
+	return result;
+}